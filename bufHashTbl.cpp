@@ -111,4 +111,14 @@ void BufHashTbl::remove(const File* file, const PageId pageNo) {
   throw HashNotFoundException(file->filename(), pageNo);
 }
 
+std::uint32_t BufHashTbl::size() const
+{
+  std::uint32_t entries = 0;
+  for (int i = 0; i < HTSIZE; i++) {
+    for (hashBucket* tmpBuc = ht[i]; tmpBuc; tmpBuc = tmpBuc->next)
+      entries++;
+  }
+  return entries;
+}
+
 }
@@ -104,6 +104,13 @@ class BufHashTbl
    * @throws HashNotFoundException if the page entry is not found in the hash table 
 	 */
   void remove(const File* file, const PageId pageNo);  
+
+	/**
+   * Count the entries in the hash table.
+	 *
+	 * @return  			Number of (file, pageNo) entries.
+	 */
+  std::uint32_t size() const;
 };
 
 }
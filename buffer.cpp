@@ -5,6 +5,7 @@
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
 
+#include <algorithm>
 #include <memory>
 #include <iostream>
 #include "buffer.h"
@@ -13,6 +14,7 @@
 #include "exceptions/page_pinned_exception.h"
 #include "exceptions/bad_buffer_exception.h"
 #include "exceptions/hash_not_found_exception.h"
+#include "exceptions/invalid_page_exception.h"
 #include <cstring>
 namespace badgerdb { 
 
@@ -35,6 +37,10 @@ BufMgr::BufMgr(std::uint32_t bufs)
   hashTable = new BufHashTbl (HTsize);  // allocate the buffer hash table
 
   clockHand = bufs - 1;
+  defragHand = 0;
+  flashCache = NULL;
+  ioScheduler = NULL;
+  recordCache = NULL;
   NumBufs = bufs;
 }
 
@@ -156,7 +162,20 @@ int bufs = NumBufs;
 	// flush page changes to disk
 	if (tmpbuf->dirty)
 	{
-		tmpbuf->file->writePage(bufPool[clockHand]);
+		// with a scheduler the write happens in the background, so the miss
+		// that needs this frame doesn't wait for it
+		if (ioScheduler)
+			ioScheduler->write(tmpbuf->file, bufPool[clockHand], IoScheduler::WRITEBACK);
+		else
+			tmpbuf->file->writePage(bufPool[clockHand]);
+		bufStats.diskwrites++;
+		if (flashCache)
+			flashCache->invalidate(tmpbuf->file, tmpbuf->pageNo);
+	}
+	else if (found && flashCache)
+	{
+		// clean victim, keep a copy in the second-level cache
+		flashCache->insert(tmpbuf->file, tmpbuf->pageNo, bufPool[clockHand]);
 	}
 
 	// return frame number
@@ -171,6 +190,8 @@ Caller won't know if it had to be io'd
 void BufMgr::readPage(File* file, const PageId pageNo, Page*& page)
 {
 	FrameId frameNo=0;
+	bufStats.accesses++;
+	file->recordAccess(pageNo);
 
 	try
 	{
@@ -190,7 +211,11 @@ void BufMgr::readPage(File* file, const PageId pageNo, Page*& page)
 		//io pg first which tests file and pg for validity
 		//we'll let the InvalidPageException to percolate up.
 		Page p;
-		p = file->readPage(pageNo);//io pg
+		if (!flashCache || !flashCache->lookup(file, pageNo, p))
+		{
+			p = ioScheduler ? ioScheduler->read(file, pageNo) : file->readPage(pageNo);//io pg
+			bufStats.diskreads++;
+		}
 
 		//Valid page:
 		BufMgr::allocBuf(frameNo);//get frameno
@@ -203,6 +228,177 @@ void BufMgr::readPage(File* file, const PageId pageNo, Page*& page)
 	}
 }
 
+/**
+Pages prefetched ahead of a batched record fetch at most
+*/
+static const std::size_t MAX_PREFETCH_PAGES = 64;
+
+/**
+Fetches a batch of records: sorts them by page, then walks the pages
+in order, prefetching a window of pages and pinning each page once
+to copy out all of its records.
+*/
+std::string BufMgr::readRecord(File* file, const RecordId& recordId)
+{
+	std::string record;
+	std::uint64_t fillToken = 0;
+	if (recordCache && recordCache->lookup(file, recordId, record, &fillToken))
+		return record;
+
+	Page* page;
+	readPage(file, recordId.page_number, page);
+	try
+	{
+		record = page->getRecord(recordId);
+	}
+	catch (...)
+	{
+		unPinPage(file, recordId.page_number, false);
+		throw;
+	}
+	unPinPage(file, recordId.page_number, false);
+	if (recordCache)
+		recordCache->insert(file, recordId, record, fillToken);
+	return record;
+}
+
+void BufMgr::readRecords(File* file, const std::vector<RecordId>& recordIds,
+                         std::vector<std::string>& records)
+{
+	records.assign(recordIds.size(), std::string());
+	// records the cache has need no page; the others fill it once read
+	std::vector<std::uint64_t> fillTokens(recordIds.size(), 0);
+	std::vector<std::size_t> order;
+	for (std::size_t i = 0; i < recordIds.size(); i++)
+	{
+		if (!recordCache ||
+		    !recordCache->lookup(file, recordIds[i], records[i], &fillTokens[i]))
+			order.push_back(i);
+	}
+
+	// visit the records in page order, remembering where each one goes
+	std::stable_sort(order.begin(), order.end(),
+	                 [&recordIds](const std::size_t a, const std::size_t b) {
+		return recordIds[a].page_number < recordIds[b].page_number;
+	});
+	std::vector<PageId> pageNos;
+	for (std::size_t i = 0; i < order.size(); i++)
+	{
+		const PageId pageNo = recordIds[order[i]].page_number;
+		if (pageNos.empty() || pageNos.back() != pageNo)
+			pageNos.push_back(pageNo);
+	}
+
+	// prefetched pages must survive until they are used
+	const std::size_t window = std::max<std::size_t>(1,
+		std::min<std::size_t>(MAX_PREFETCH_PAGES, numBufs / 2));
+	std::size_t next = 0;
+	for (std::size_t first = 0; first < pageNos.size(); first += window)
+	{
+		const std::size_t last = std::min(pageNos.size(), first + window);
+		prefetchPages(file, std::vector<PageId>(pageNos.begin() + first,
+		                                        pageNos.begin() + last));
+		for (std::size_t i = first; i < last; i++)
+		{
+			Page* page;
+			readPage(file, pageNos[i], page);
+			try
+			{
+				for (; next < order.size() &&
+				       recordIds[order[next]].page_number == pageNos[i]; next++)
+				{
+					const std::size_t index = order[next];
+					records[index] = page->getRecord(recordIds[index]);
+					if (recordCache)
+						recordCache->insert(file, recordIds[index], records[index],
+						                    fillTokens[index]);
+				}
+			}
+			catch (...)
+			{
+				unPinPage(file, pageNos[i], false);
+				throw;
+			}
+			unPinPage(file, pageNos[i], false);
+		}
+	}
+}
+
+void BufMgr::prefetchPages(File* file, const std::vector<PageId>& pageNos)
+{
+	std::vector<PageId> missing;
+	for (std::size_t i = 0; i < pageNos.size(); i++)
+	{
+		FrameId frameNo = 0;
+		try
+		{
+			hashTable->lookup(file, pageNos[i], frameNo);
+		}
+		catch (HashNotFoundException)
+		{
+			missing.push_back(pageNos[i]);
+		}
+	}
+	if (missing.empty())
+		return;
+
+	try
+	{
+		if (ioScheduler)
+		{
+			// the scheduler knows about queued writes the file doesn't have yet,
+			// so go through it page by page
+			for (std::size_t i = 0; i < missing.size(); i++)
+			{
+				try
+				{
+					installPage(file, ioScheduler->read(file, missing[i],
+					                                    IoScheduler::PREFETCH));
+				}
+				catch (InvalidPageException)
+				{
+				}
+			}
+			return;
+		}
+
+		const PageId numPages = file->readHeader().num_pages;
+		std::size_t runStart = 0;
+		while (runStart < missing.size() && missing[runStart] < numPages)
+		{
+			std::size_t runLength = 1;
+			while (runStart + runLength < missing.size() &&
+			       missing[runStart + runLength] == missing[runStart] + runLength &&
+			       missing[runStart + runLength] < numPages)
+				runLength++;
+			std::vector<Page> pages;
+			file->readPages(missing[runStart], runLength, pages);
+			for (std::size_t i = 0; i < pages.size(); i++)
+			{
+				// free pages stay out; reading them reports the error
+				if (pages[i].page_number() == missing[runStart + i])
+					installPage(file, pages[i]);
+			}
+			runStart += runLength;
+		}
+	}
+	catch (BufferExceededException)
+	{
+		// every frame is pinned; the pages are read when they are used
+	}
+}
+
+void BufMgr::installPage(File* file, const Page& page)
+{
+	FrameId frameNo = 0;
+	allocBuf(frameNo);
+	bufPool[frameNo] = page;
+	hashTable->insert(file, page.page_number(), frameNo);
+	bufDescTable[frameNo].Set(file, page.page_number());
+	bufDescTable[frameNo].pinCnt = 0;
+	bufStats.diskreads++;
+}
+
 /*
 Given the file and pageNo, will unpin the page and set dirty
 If the file and page isn't in the buffer pool, throw HashNotFoundException
@@ -233,21 +429,90 @@ void BufMgr::unPinPage(File* file, const PageId pageNo, const bool dirty)
 	if (dirty)
 	{
 		bufDescTable[frameNo].dirty = true;
+		if (recordCache)
+			recordCache->invalidatePage(file, pageNo);
+		// the page may not be written back for a while; inserts should see its
+		// space now
+		updateFreeSpace(file, pageNo, bufPool[frameNo].getFreeSpace());
 	}
 
 
 }
 
+/**
+Inserts a record on a page the free-space map says has room,
+checking each candidate in the pool, or on a new page if none does.
+*/
+RecordId BufMgr::insertRecord(File* file, const std::string& record)
+{
+	PageId pageNo = nextPageWithSpace(file, record.length(), Page::INVALID_NUMBER);
+	while (pageNo != Page::INVALID_NUMBER)
+	{
+		Page* page;
+		try
+		{
+			readPage(file, pageNo, page);
+		}
+		catch (InvalidPageException)
+		{
+			// freed since its entry was written
+			updateFreeSpace(file, pageNo, 0);
+			pageNo = nextPageWithSpace(file, record.length(), pageNo);
+			continue;
+		}
+		if (page->hasSpaceForRecord(record))
+		{
+			RecordId rid;
+			try
+			{
+				rid = page->insertRecord(record);
+			}
+			catch (...)
+			{
+				unPinPage(file, pageNo, false);
+				throw;
+			}
+			unPinPage(file, pageNo, true);
+			return rid;
+		}
+		// stale entry, or no free slot for the record; correct it and go on
+		updateFreeSpace(file, pageNo, page->getFreeSpace());
+		unPinPage(file, pageNo, false);
+		pageNo = nextPageWithSpace(file, record.length(), pageNo);
+	}
+
+	Page* page;
+	allocPage(file, pageNo, page);
+	RecordId rid;
+	try
+	{
+		rid = page->insertRecord(record);
+	}
+	catch (...)
+	{
+		// the page is still empty; don't leave it behind
+		unPinPage(file, pageNo, false);
+		disposePage(file, pageNo);
+		throw;
+	}
+	unPinPage(file, pageNo, true);
+	return rid;
+}
+
 void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page) 
 {
-	Page oPg = file->allocatePage();
-	
+	Page oPg;
+	runFileOperation([&oPg, file]() { oPg = file->allocatePage(); });
+	bufStats.accesses++;
+	// the file writes the new page out; nothing is read
+	bufStats.diskwrites++;
 
 	FrameId frameNo = 0;
 	allocBuf(frameNo);
 
 
 	pageNo = oPg.page_number();
+	file->recordAccess(pageNo);
 	hashTable->insert(file, pageNo, frameNo); //record that we have this
 	bufDescTable[frameNo].Set(file, pageNo); //record this usage in our buffer pool.
 
@@ -265,20 +530,131 @@ clears the frame and hashtable first
 void BufMgr::disposePage(File* file, const PageId pageNo)
 {
 	FrameId frameNo=0;
-	hashTable->lookup(file, pageNo, frameNo);//don't handle exception
+	try
+	{
+		hashTable->lookup(file, pageNo, frameNo);
+
+		// if execution reaches this point, the page is in the buffer pool
+		bufDescTable[frameNo].Clear();//clear frame
+		hashTable->remove(file, pageNo);//forget this page
+	}
+	catch (HashNotFoundException)
+	{
+		//not resident, so only the file needs updating
+	}
+	if (flashCache)
+		flashCache->invalidate(file, pageNo);
+	if (recordCache)
+		recordCache->invalidatePage(file, pageNo);
+	// a queued write would bring the page back
+	if (ioScheduler)
+		ioScheduler->cancel(file, pageNo);
+	runFileOperation([file, pageNo]() { file->deletePage(pageNo); });//delete
+	// the file reads the page and writes it back onto its free list
+	bufStats.diskreads++;
+	bufStats.diskwrites++;
+}
+
+void BufMgr::discardPage(File* file, const PageId pageNo)
+{
+	FrameId frameNo=0;
+	try
+	{
+		hashTable->lookup(file, pageNo, frameNo);
 
-	// if execution reaches this point, the page is in the buffer pool
-	bufDescTable[frameNo].Clear();//clear frame
-	hashTable->remove(file, pageNo);//forget this page
-	file->deletePage(pageNo);//delete
+		// someone still reads the old copy, so it can't go away
+		if (bufDescTable[frameNo].pinCnt > 0)
+			throw PagePinnedException(file->filename(), pageNo, frameNo);
+		bufDescTable[frameNo].Clear();
+		hashTable->remove(file, pageNo);
+	}
+	catch (HashNotFoundException)
+	{
+		//not resident, nothing to drop
+	}
+	if (ioScheduler)
+		ioScheduler->cancel(file, pageNo);
+	if (flashCache)
+		flashCache->invalidate(file, pageNo);
+	if (recordCache)
+		recordCache->invalidatePage(file, pageNo);
 }
 
 /**
-Writes the file to the disk.
-Iterates over all page frames, flushing the (dirty)
-ones that belong to the file to disk.
+Compacts fragmented pages that nobody has pinned.
+Examines at most maxFrames frames per call so callers
+can spread the work over idle periods.
+*/
+std::uint32_t BufMgr::defragment(std::uint32_t maxFrames,
+                                 std::uint16_t minFragmentedBytes)
+{
+	std::uint32_t compacted = 0;
+	for (std::uint32_t i = 0; i < maxFrames && i < numBufs; i++)
+	{
+		BufDesc* tmpbuf = &bufDescTable[defragHand];
+		Page* page = &bufPool[defragHand];
+		defragHand = (defragHand + 1) % numBufs;
+
+		// only unpinned pages, so no one holds a pointer into the data
+		if (!tmpbuf->valid || tmpbuf->pinCnt > 0)
+			continue;
+		if (page->getFragmentedBytes() < minFragmentedBytes)
+			continue;
+
+		page->compact();
+		tmpbuf->dirty = true;
+		// record IDs and contents are unchanged, so cached records stay
+		updateFreeSpace(tmpbuf->file, tmpbuf->pageNo, page->getFreeSpace());
+		compacted++;
+	}
+	return compacted;
+}
+
+void BufMgr::runFileOperation(const std::function<void()>& operation)
+{
+	if (ioScheduler)
+		ioScheduler->execute(operation);
+	else
+		operation();
+}
+
+void BufMgr::updateFreeSpace(File* file, const PageId pageNo, std::size_t freeBytes)
+{
+	if (!file->hasFreeSpaceMap())
+		return;
+	runFileOperation([file, pageNo, freeBytes]() {
+		file->updateFreeSpace(pageNo, freeBytes);
+	});
+}
+
+PageId BufMgr::nextPageWithSpace(File* file, std::size_t bytes, const PageId after)
+{
+	if (!file->hasFreeSpaceMap())
+		return Page::INVALID_NUMBER;
+	PageId pageNo = Page::INVALID_NUMBER;
+	runFileOperation([&pageNo, file, bytes, after]() {
+		pageNo = file->nextPageWithSpace(bytes, after);
+	});
+	return pageNo;
+}
+
+/**
+Writes the file to the disk, waiting for
+the scheduler if the writes were queued.
 */
 void BufMgr::flushFile(const File* file) 
+{
+	startFlushFile(file);
+	if (ioScheduler)
+		ioScheduler->drain(file);
+}
+
+/**
+Iterates over all page frames, flushing the (dirty)
+ones that belong to the file to disk, or queueing
+them on the scheduler if there is one.
+*/
+void BufMgr::startFlushFile(const File* file)
 {
 
 	BufDesc* tmpbuf;
@@ -319,8 +695,14 @@ void BufMgr::flushFile(const File* file)
 		{
 			FrameId frameNo = tmpbuf->frameNo;
 			File* f = bufDescTable[frameNo].file;
-			f->writePage(bufPool[frameNo]);
+			if (ioScheduler)
+				ioScheduler->write(f, bufPool[frameNo], IoScheduler::CHECKPOINT);
+			else
+				f->writePage(bufPool[frameNo]);
+			bufStats.diskwrites++;
 			tmpbuf->dirty = false;
+			if (flashCache)
+				flashCache->invalidate(f, tmpbuf->pageNo);
 		}
 		hashTable->remove(file, tmpbuf->pageNo);//no longer keep page
 		bufDescTable[i].Clear();//clear buffer frame
@@ -331,6 +713,45 @@ void BufMgr::flushFile(const File* file)
 
 
 
+/**
+Walks the descriptor table and cross-checks
+it against the hash table
+*/
+void BufMgr::checkConsistency(const bool expectUnpinned)
+{
+	std::uint32_t validFrames = 0;
+	for (FrameId i = 0; i < numBufs; i++)
+	{
+		BufDesc& desc = bufDescTable[i];
+		bool ok = desc.frameNo == i;
+		if (desc.valid)
+		{
+			validFrames++;
+			FrameId frameNo = numBufs;
+			try
+			{
+				hashTable->lookup(desc.file, desc.pageNo, frameNo);
+			}
+			catch (HashNotFoundException)
+			{
+			}
+			ok = ok && frameNo == i && desc.file != NULL
+				&& bufPool[i].page_number() == desc.pageNo;
+			if (ok && expectUnpinned && desc.pinCnt != 0)
+				throw PagePinnedException(desc.file->filename(), desc.pageNo, i);
+		}
+		else
+		{
+			ok = ok && desc.pinCnt == 0 && !desc.dirty && desc.file == NULL;
+		}
+		if (!ok || desc.pinCnt < 0)
+			throw BadBufferException(i, desc.dirty, desc.valid, desc.refbit);
+	}
+	// a leftover entry would hand out a frame that now holds another page
+	if (hashTable->size() != validFrames)
+		throw BadBufferException(numBufs, false, false, false);
+}
+
 void BufMgr::printSelf(void) 
 {
   BufDesc* tmpbuf;
@@ -7,8 +7,16 @@
 
 #pragma once
 
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
 #include "file.h"
 #include "bufHashTbl.h"
+#include "flash_cache.h"
+#include "io_scheduler.h"
+#include "record_cache.h"
 
 namespace badgerdb {
 
@@ -127,12 +135,12 @@ struct BufStats
   int accesses;
 
 	/**
-   * Number of pages read from disk (including allocs)
+   * Number of pages read from disk (including deletes)
 	 */
   int diskreads;
 
 	/**
-   * Number of pages written back to disk
+   * Number of pages written to disk (including allocs and deletes)
 	 */
   int diskwrites;
 
@@ -165,6 +173,11 @@ class BufMgr
 	 */
   FrameId clockHand;
 
+	/**
+   * Next frame to be examined by defragment()
+	 */
+  FrameId defragHand;
+
 	/**
    * Number of frames in the buffer pool
 	 */
@@ -185,6 +198,21 @@ class BufMgr
 	 */
   BufStats bufStats;
 
+	/**
+   * Second-level cache for evicted pages, or NULL
+	 */
+  FlashCache* flashCache;
+
+	/**
+   * Scheduler all file I/O goes through, or NULL to do it directly
+	 */
+  IoScheduler* ioScheduler;
+
+	/**
+   * Cache of records above this pool whose stale records it drops, or NULL
+	 */
+  RecordCache* recordCache;
+
 	/**
    * Advance clock to next frame in the buffer pool
 	 */
@@ -198,6 +226,47 @@ class BufMgr
 	 */
   void allocBuf(FrameId & frame);
 
+	/**
+	 * Reads the listed pages that aren't in the pool into free frames, unpinned,
+	 * with one read per run of adjacent page numbers (or at prefetch priority
+	 * through the I/O scheduler, if there is one).  Pages that can't be read are
+	 * skipped, so that reading them later reports the error.
+	 *
+	 * @param file   	File object
+	 * @param pageNos	Page numbers in ascending order
+	 */
+  void prefetchPages(File* file, const std::vector<PageId>& pageNos);
+
+	/**
+	 * Puts a page just read from its file into a free frame, unpinned.
+	 *
+	 * @param file   	File object
+	 * @param page  	Page read
+	 */
+  void installPage(File* file, const Page& page);
+
+	/**
+	 * Records a page's free space in its file's free-space map, if the file has
+	 * one.  Runs on the I/O scheduler's worker if there is one, since writes
+	 * done there update the map as well.
+	 *
+	 * @param file   	File object
+	 * @param pageNo	Page number
+	 * @param freeBytes	Free space on the page
+	 */
+  void updateFreeSpace(File* file, const PageId pageNo, std::size_t freeBytes);
+
+	/**
+	 * Looks up the next page the file's free-space map says has room for a
+	 * record, on the I/O scheduler's worker if there is one.
+	 *
+	 * @param file   	File object
+	 * @param bytes  	Length of the record
+	 * @param after  	Page to search after, or Page::INVALID_NUMBER
+	 * @return  Page number, or Page::INVALID_NUMBER if there is none
+	 */
+  PageId nextPageWithSpace(File* file, std::size_t bytes, const PageId after);
+
  public:
 	/**
    * Actual buffer pool from which frames are allocated
@@ -235,6 +304,51 @@ class BufMgr
 	 */
   void unPinPage(File* file, const PageId PageNo, const bool dirty);
 
+	/**
+	 * Fetches one record.  With a record cache attached, the cache is looked up
+	 * first and a miss fills it from the page; otherwise the page is read and
+	 * unpinned again.
+	 *
+	 * @param file   	File object
+	 * @param recordId	ID of the record
+	 * @return  The record
+	 * @throws  InvalidPageException If the page is not a used page of the file
+	 * @throws  InvalidRecordException If the record doesn't exist
+	 */
+  std::string readRecord(File* file, const RecordId& recordId);
+
+	/**
+	 * Fetches many records at once, e.g. the matches of an index lookup.  The
+	 * records are grouped by page and the pages visited in page number order,
+	 * each pinned once, with the next pages prefetched in runs ahead of them;
+	 * so fetching records in index order costs about what a sequential read of
+	 * their pages would.  With a record cache attached, only pages holding
+	 * records the cache misses are read, and those records fill the cache.
+	 *
+	 * @param file   	File object
+	 * @param recordIds	IDs of the records, in any order; may repeat
+	 * @param records	Receives the records in the order of recordIds
+	 * @throws  InvalidPageException If a page is not a used page of the file
+	 * @throws  InvalidRecordException If a record doesn't exist
+	 */
+  void readRecords(File* file, const std::vector<RecordId>& recordIds,
+                   std::vector<std::string>& records);
+
+	/**
+	 * Inserts a record into the file through the pool.  Pages the file's
+	 * free-space map says have room are tried in page number order, each
+	 * checked in the pool, where it may be newer than on disk; entries found to
+	 * be wrong are corrected on the way.  If no page has room, or the file has
+	 * no free-space map, the record goes on a newly allocated page.
+	 *
+	 * @param file   	File object
+	 * @param record	Bytes of the record
+	 * @return  ID of the new record
+	 * @throws  InsufficientSpaceException If the record doesn't fit on an empty page
+	 * @throws  BufferExceededException If every frame is pinned
+	 */
+  RecordId insertRecord(File* file, const std::string& record);
+
 	/**
 	 * Allocates a new, empty page in the file and returns the Page object.
 	 * The newly allocated page is also assigned a frame in the buffer pool.
@@ -256,6 +370,19 @@ class BufMgr
 	 */
   void flushFile(const File* file);
 
+	/**
+	 * Like flushFile(), but with an I/O scheduler attached it returns as soon as
+	 * the writes are queued, at checkpoint priority.  IoScheduler::drain() waits
+	 * for them, so a caller serializing access to the buffer manager can wait
+	 * without blocking other users of it.  Without a scheduler it is the same
+	 * as flushFile().
+	 *
+	 * @param file   	File object
+   * @throws  PagePinnedException If any page of the file is pinned in the buffer pool 
+   * @throws BadBufferException If any frame allocated to the file is found to be invalid
+	 */
+  void startFlushFile(const File* file);
+
 	/**
 	 * Delete page from file and also from buffer pool if present.
 	 * Since the page is entirely deleted from file, its unnecessary to see if the page is dirty.
@@ -266,6 +393,98 @@ class BufMgr
   void disposePage(File* file, const PageId PageNo);
 
 	/**
+	 * Drops a page from the buffer pool without writing it back, so the next read
+	 * sees the copy on disk.  Used when the file has been changed underneath the
+	 * pool, e.g. by a replica applying the primary's changes.  Does nothing if the
+	 * page is not resident.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number
+   * @throws  PagePinnedException If the page is pinned in the buffer pool
+	 */
+  void discardPage(File* file, const PageId PageNo);
+
+	/**
+	 * Background page defragmentation.  Examines up to maxFrames frames, resuming
+	 * where the previous call stopped, and compacts every unpinned resident page
+	 * with at least minFragmentedBytes bytes in holes left by deletes.  Compacted
+	 * pages are marked dirty and written back as usual, and their new free space
+	 * is reported to the file's free-space map at once.  Meant to be called when
+	 * the system is otherwise idle, like FileVacuum::step(); pinned pages are
+	 * skipped, so no caller sees a page move under it.
+	 *
+	 * @param maxFrames           Number of frames to examine
+	 * @param minFragmentedBytes  Fragmentation at which a page is compacted
+	 * @return  Number of pages compacted
+	 */
+  std::uint32_t defragment(std::uint32_t maxFrames,
+                           std::uint16_t minFragmentedBytes = Page::DATA_SIZE / 8);
+
+	/**
+	 * Runs an operation on a file the way this buffer manager runs its own file
+	 * operations: on the I/O scheduler's worker if there is one, so that it
+	 * doesn't race with I/O queued there, or else right away.  Exceptions it
+	 * throws are rethrown here.
+	 *
+	 * @param operation   Operation to run, e.g. File::truncate()
+	 */
+  void runFileOperation(const std::function<void()>& operation);
+
+	/**
+	 * Attaches a second-level cache for evicted pages.  Clean pages evicted from
+	 * the pool are offered to it, and pages missing from the pool are looked up
+	 * in it before being read from their file.  Pages this buffer manager writes
+	 * back or disposes of are invalidated in it.  The cache is not owned.
+	 *
+	 * @param cache   Cache to use, or NULL to stop using one
+	 */
+  void setFlashCache(FlashCache* cache)
+  {
+		flashCache = cache;
+  }
+
+	/**
+	 * Checks the buffer manager's internal invariants: every valid frame is
+	 * found under its (file, pageNo) in the hash table, the hash table holds no
+	 * other entries, invalid frames are clear and unpinned, and resident pages
+	 * carry the page number of their frame.  Meant for tests and stress runs
+	 * while no other operation is in progress.
+	 *
+	 * @param expectUnpinned  Also require that no frame is pinned
+   * @throws  BadBufferException If a frame breaks an invariant
+   * @throws  PagePinnedException If expectUnpinned is set and a page is pinned
+	 */
+  void checkConsistency(const bool expectUnpinned = false);
+
+	/**
+	 * Sends all file I/O of this buffer manager through an I/O scheduler:
+	 * misses are read at foreground priority, dirty pages evicted to make room
+	 * are written back asynchronously at writeback priority, and flushes write
+	 * at checkpoint priority.  The scheduler is not owned; it must be drained
+	 * before it is detached.
+	 *
+	 * @param scheduler   Scheduler to use, or NULL to do I/O directly
+	 */
+  void setIoScheduler(IoScheduler* scheduler)
+  {
+		ioScheduler = scheduler;
+  }
+
+	/**
+	 * Attaches a record cache kept in front of this pool.  Whenever a page is
+	 * unpinned dirty, disposed of or discarded, its records are dropped from the
+	 * cache.  readRecord() and readRecords() consult and fill the cache; callers
+	 * reading records from pages directly need to fill it themselves.  The
+	 * cache is not owned.
+	 *
+	 * @param cache   Cache to keep current, or NULL to stop
+	 */
+  void setRecordCache(RecordCache* cache)
+  {
+		recordCache = cache;
+  }
+
+	/**
    * Print member variable values. 
 	 */
   void  printSelf();
@@ -0,0 +1,90 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "change_tracker.h"
+
+#include <iterator>
+
+#include "exceptions/file_exists_exception.h"
+#include "exceptions/file_not_found_exception.h"
+#include "file.h"
+
+namespace badgerdb {
+
+ChangeTracker::ChangeTracker(const std::string& data_filename,
+                             const bool create_new)
+    : filename_(mapFilename(data_filename)) {
+  std::ios_base::openmode mode =
+      std::fstream::in | std::fstream::out | std::fstream::binary;
+  if (create_new) {
+    if (File::exists(filename_)) {
+      throw FileExistsException(filename_);
+    }
+    mode = mode | std::fstream::trunc;
+  } else if (!File::exists(filename_)) {
+    throw FileNotFoundException(filename_);
+  }
+  stream_.open(filename_, mode);
+  if (!create_new) {
+    bits_.assign(std::istreambuf_iterator<char>(stream_),
+                 std::istreambuf_iterator<char>());
+    stream_.clear();
+  }
+}
+
+void ChangeTracker::markChanged(const PageId page_number) {
+  const std::size_t index = page_number / 8;
+  const std::uint8_t bit = 1 << (page_number % 8);
+  if (index >= bits_.size()) {
+    bits_.resize(index + 1, 0);
+  } else if (bits_[index] & bit) {
+    return;
+  }
+  bits_[index] |= bit;
+  writeByte(index);
+}
+
+void ChangeTracker::clearChanged(const PageId page_number) {
+  const std::size_t index = page_number / 8;
+  const std::uint8_t bit = 1 << (page_number % 8);
+  if (index >= bits_.size() || !(bits_[index] & bit)) {
+    return;
+  }
+  bits_[index] &= ~bit;
+  writeByte(index);
+}
+
+std::vector<PageId> ChangeTracker::changedPages(const PageId num_pages) const {
+  std::vector<PageId> pages;
+  for (std::size_t index = 0; index < bits_.size(); ++index) {
+    if (bits_[index] == 0) {
+      continue;
+    }
+    for (PageId bit = 0; bit < 8; ++bit) {
+      const PageId page_number = index * 8 + bit;
+      if (page_number < num_pages && (bits_[index] >> bit) & 1) {
+        pages.push_back(page_number);
+      }
+    }
+  }
+  return pages;
+}
+
+void ChangeTracker::beforePageChange(const PageId page_number) {
+  // The file header is small and always part of a backup.
+  if (page_number != 0) {
+    markChanged(page_number);
+  }
+}
+
+void ChangeTracker::writeByte(const std::size_t index) {
+  stream_.seekp(index, std::ios::beg);
+  stream_.put(static_cast<char>(bits_[index]));
+  stream_.flush();
+}
+
+}
@@ -0,0 +1,124 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "file_listener.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Persistent record of which pages of a file changed since the last
+ *        backup.
+ *
+ * One bit per data page is kept in a companion file (named after the data
+ * file with a ".chg" suffix) and in memory.  A bit is set just before its page
+ * is first written after a backup, so a crash part way through the write
+ * can't leave a changed page unmarked.  Setting it costs one byte written to
+ * the companion file; later writes of the page cost nothing.  Backups clear the
+ * bits of the pages they copied (see OnlineBackup), so an incremental backup
+ * finds the pages it needs without reading the data file.
+ *
+ * File owns the tracker of a file and attaches it as a listener; see
+ * File::enableChangeTracking().
+ *
+ * @warning This class is not threadsafe.
+ */
+class ChangeTracker : public FileListener {
+ public:
+  /**
+   * Returns the name of the companion file holding the bitmap for a data file.
+   *
+   * @param data_filename   Name of the data file.
+   * @return  Name of the change bitmap file.
+   */
+  static std::string mapFilename(const std::string& data_filename) {
+    return data_filename + ".chg";
+  }
+
+  /**
+   * Opens the change bitmap of a data file, creating an empty one if
+   * requested.
+   *
+   * @param data_filename   Name of the data file the bitmap describes.
+   * @param create_new      Whether to create a new, empty bitmap.
+   * @throws  FileExistsException     If create_new is set and the bitmap
+   *                                  exists.
+   * @throws  FileNotFoundException   If create_new is not set and the bitmap
+   *                                  doesn't exist.
+   */
+  ChangeTracker(const std::string& data_filename, const bool create_new);
+
+  /**
+   * Records that a page has changed.
+   *
+   * @param page_number   Number of the data page.
+   */
+  void markChanged(const PageId page_number);
+
+  /**
+   * Records that a page is unchanged since the last backup.
+   *
+   * @param page_number   Number of the data page.
+   */
+  void clearChanged(const PageId page_number);
+
+  /**
+   * Returns true if a page has changed since the last backup.
+   *
+   * @param page_number   Number of the data page.
+   * @return  Whether the page has changed.
+   */
+  bool isChanged(const PageId page_number) const {
+    const std::size_t index = page_number / 8;
+    return index < bits_.size() && (bits_[index] >> (page_number % 8)) & 1;
+  }
+
+  /**
+   * Returns the changed pages below <num_pages> in page number order.
+   *
+   * @param num_pages   Number of pages in the data file.
+   * @return  Numbers of the changed pages.
+   */
+  std::vector<PageId> changedPages(const PageId num_pages) const;
+
+  virtual void beforePageChange(const PageId page_number);
+
+  virtual void afterPageWrite(const PageId /* page_number */,
+                              const Page* /* page */) {}
+
+ private:
+  /**
+   * Writes one byte of the bitmap to the companion file.
+   *
+   * @param index   Index of the byte.
+   */
+  void writeByte(const std::size_t index);
+
+  /**
+   * Name of the companion file.
+   */
+  std::string filename_;
+
+  /**
+   * Stream of the companion file.
+   */
+  std::fstream stream_;
+
+  /**
+   * Bitmap, one bit per page; bytes past the end are all zero.
+   */
+  std::vector<std::uint8_t> bits_;
+};
+
+}
@@ -0,0 +1,24 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "bad_tablespace_exception.h"
+
+#include <sstream>
+#include <string>
+
+namespace badgerdb {
+
+BadTablespaceException::BadTablespaceException(const std::string& path,
+                                               const std::string& reason)
+    : BadgerDbException(""),
+      path_(path) {
+  std::stringstream ss;
+  ss << "Tablespace '" << path_ << "': " << reason;
+  message_.assign(ss.str());
+}
+
+}
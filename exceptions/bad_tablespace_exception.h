@@ -0,0 +1,48 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "badgerdb_exception.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when an OS file opened as a tablespace
+ *        doesn't hold a valid tablespace.
+ */
+class BadTablespaceException : public BadgerDbException {
+ public:
+  /**
+   * Constructs a bad tablespace exception for the given OS file.
+   *
+   * @param path    Name of the OS file.
+   * @param reason  What is wrong with it.
+   */
+  BadTablespaceException(const std::string& path, const std::string& reason);
+
+  /**
+   * Destroys the exception.  Does nothing special; just included to make the
+   * compiler happy.
+   */
+  virtual ~BadTablespaceException() throw() {}
+
+  /**
+   * Returns name of the OS file that caused this exception.
+   */
+  virtual const std::string& path() const { return path_; }
+
+ protected:
+  /**
+   * Name of OS file which caused this exception.
+   */
+  const std::string path_;
+};
+
+}
@@ -0,0 +1,24 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "deadlock_exception.h"
+
+#include <sstream>
+#include <string>
+
+namespace badgerdb {
+
+DeadlockException::DeadlockException(const std::uint64_t txn_id)
+    : BadgerDbException(""),
+      txn_id_(txn_id) {
+  std::stringstream ss;
+  ss << "Transaction " << txn_id_
+     << " was chosen as the victim of a deadlock and must abort.";
+  message_.assign(ss.str());
+}
+
+}
@@ -0,0 +1,48 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "badgerdb_exception.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when a transaction waiting for a lock is
+ *        chosen as the victim of a deadlock.
+ */
+class DeadlockException : public BadgerDbException {
+ public:
+  /**
+   * Constructs a deadlock exception for the given transaction.
+   *
+   * @param txn_id  ID of transaction chosen as the victim.
+   */
+  explicit DeadlockException(const std::uint64_t txn_id);
+
+  /**
+   * Destroys the exception.  Does nothing special; just included to make the
+   * compiler happy.
+   */
+  virtual ~DeadlockException() throw() {}
+
+  /**
+   * Returns the ID of the transaction chosen as the victim.
+   */
+  virtual std::uint64_t txnId() const { return txn_id_; }
+
+ protected:
+  /**
+   * ID of transaction chosen as the victim.
+   */
+  const std::uint64_t txn_id_;
+};
+
+}
@@ -0,0 +1,47 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "badgerdb_exception.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when a file given as a backup isn't one.
+ */
+class InvalidBackupException : public BadgerDbException {
+ public:
+  /**
+   * Constructs an invalid backup exception for the given backup file.
+   *
+   * @param path    Name of the backup file.
+   * @param reason  What is wrong with it.
+   */
+  InvalidBackupException(const std::string& path, const std::string& reason);
+
+  /**
+   * Destroys the exception.  Does nothing special; just included to make the
+   * compiler happy.
+   */
+  virtual ~InvalidBackupException() throw() {}
+
+  /**
+   * Returns name of the backup file that caused this exception.
+   */
+  virtual const std::string& path() const { return path_; }
+
+ protected:
+  /**
+   * Name of backup file which caused this exception.
+   */
+  const std::string path_;
+};
+
+}
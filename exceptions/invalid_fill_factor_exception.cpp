@@ -0,0 +1,27 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "invalid_fill_factor_exception.h"
+
+#include <sstream>
+#include <string>
+
+namespace badgerdb {
+
+InvalidFillFactorException::InvalidFillFactorException(
+    const std::uint32_t percent, const std::string& file)
+    : BadgerDbException(""),
+      percent_(percent),
+      filename_(file) {
+  std::stringstream ss;
+  ss << "Fill factor must be between 1 and 100 percent."
+     << " Requested " << percent_
+     << "% for file '" << filename_ << "'";
+  message_.assign(ss.str());
+}
+
+}
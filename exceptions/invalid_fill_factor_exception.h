@@ -0,0 +1,61 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "badgerdb_exception.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when a file is given a fill factor
+ *        outside the range 1 to 100 percent.
+ */
+class InvalidFillFactorException : public BadgerDbException {
+ public:
+  /**
+   * Constructs an invalid fill factor exception for the given percentage and
+   * filename.
+   *
+   * @param percent   Requested fill factor.
+   * @param file      Name of file the fill factor was given for.
+   */
+  InvalidFillFactorException(const std::uint32_t percent,
+                             const std::string& file);
+
+  /**
+   * Destroys the exception.  Does nothing special; just included to make the
+   * compiler happy.
+   */
+  virtual ~InvalidFillFactorException() throw() {}
+
+  /**
+   * Returns the requested fill factor that caused this exception.
+   */
+  virtual std::uint32_t percent() const { return percent_; }
+
+  /**
+   * Returns name of the file that caused this exception.
+   */
+  virtual const std::string& filename() const { return filename_; }
+
+ protected:
+  /**
+   * Requested fill factor which caused this exception.
+   */
+  const std::uint32_t percent_;
+
+  /**
+   * Name of file which caused this exception.
+   */
+  const std::string filename_;
+};
+
+}
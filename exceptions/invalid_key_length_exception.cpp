@@ -0,0 +1,27 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "invalid_key_length_exception.h"
+
+#include <sstream>
+#include <string>
+
+namespace badgerdb {
+
+InvalidKeyLengthException::InvalidKeyLengthException(
+    const std::uint32_t key_length, const std::string& file)
+    : BadgerDbException(""),
+      key_length_(key_length),
+      filename_(file) {
+  std::stringstream ss;
+  ss << "Zone map key length must be between 1 and 64 bytes."
+     << " Requested " << key_length_
+     << " for file '" << filename_ << "'";
+  message_.assign(ss.str());
+}
+
+}
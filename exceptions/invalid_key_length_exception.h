@@ -0,0 +1,61 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "badgerdb_exception.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when a zone map is asked to summarize
+ *        keys that are empty or longer than ZoneMap::MAX_KEY_LENGTH.
+ */
+class InvalidKeyLengthException : public BadgerDbException {
+ public:
+  /**
+   * Constructs an invalid key length exception for the given length and
+   * filename.
+   *
+   * @param key_length  Requested key length.
+   * @param file        Name of file the key length was given for.
+   */
+  InvalidKeyLengthException(const std::uint32_t key_length,
+                            const std::string& file);
+
+  /**
+   * Destroys the exception.  Does nothing special; just included to make the
+   * compiler happy.
+   */
+  virtual ~InvalidKeyLengthException() throw() {}
+
+  /**
+   * Returns the requested key length that caused this exception.
+   */
+  virtual std::uint32_t keyLength() const { return key_length_; }
+
+  /**
+   * Returns name of the file that caused this exception.
+   */
+  virtual const std::string& filename() const { return filename_; }
+
+ protected:
+  /**
+   * Requested key length which caused this exception.
+   */
+  const std::uint32_t key_length_;
+
+  /**
+   * Name of file which caused this exception.
+   */
+  const std::string filename_;
+};
+
+}
@@ -0,0 +1,27 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "io_error_exception.h"
+
+#include <sstream>
+#include <string>
+
+namespace badgerdb {
+
+IoErrorException::IoErrorException(const std::string& name,
+                                   const PageId page_num,
+                                   const std::string& what)
+    : BadgerDbException(""),
+      filename_(name),
+      page_number_(page_num) {
+  std::stringstream ss;
+  ss << "I/O error (" << what << ") on page " << page_number_ << " of file '"
+     << filename_ << "'";
+  message_.assign(ss.str());
+}
+
+}
@@ -0,0 +1,61 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "badgerdb_exception.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when the storage under a file fails a
+ * read or write.
+ */
+class IoErrorException : public BadgerDbException {
+ public:
+  /**
+   * Constructs an I/O error exception for the given page.
+   *
+   * @param name      Name of the file.
+   * @param page_num  Number of the page being read or written.
+   * @param what      What failed, e.g. "read" or "short write".
+   */
+  IoErrorException(const std::string& name, const PageId page_num,
+                   const std::string& what);
+
+  /**
+   * Destroys the exception.  Does nothing special; just included to make the
+   * compiler happy.
+   */
+  virtual ~IoErrorException() throw() {}
+
+  /**
+   * Returns name of the file that caused this exception.
+   */
+  virtual const std::string& filename() const { return filename_; }
+
+  /**
+   * Returns the page number that caused this exception.
+   */
+  virtual PageId page_number() const { return page_number_; }
+
+ protected:
+  /**
+   * Name of file which caused this exception.
+   */
+  const std::string filename_;
+
+  /**
+   * Page number which caused this exception.
+   */
+  const PageId page_number_;
+};
+
+}
@@ -0,0 +1,24 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "shared_memory_exception.h"
+
+#include <sstream>
+#include <string>
+
+namespace badgerdb {
+
+SharedMemoryException::SharedMemoryException(const std::string& segment,
+                                             const std::string& reason)
+    : BadgerDbException(""),
+      segment_(segment) {
+  std::stringstream ss;
+  ss << "Shared buffer pool '" << segment_ << "': " << reason;
+  message_.assign(ss.str());
+}
+
+}
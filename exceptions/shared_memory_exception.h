@@ -0,0 +1,49 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "badgerdb_exception.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when a shared-memory buffer pool can't be
+ *        set up or has run out of a fixed-size resource.
+ */
+class SharedMemoryException : public BadgerDbException {
+ public:
+  /**
+   * Constructs a shared memory exception for the given segment.
+   *
+   * @param segment   Name of the shared-memory segment.
+   * @param reason    What went wrong.
+   */
+  SharedMemoryException(const std::string& segment,
+                        const std::string& reason);
+
+  /**
+   * Destroys the exception.  Does nothing special; just included to make the
+   * compiler happy.
+   */
+  virtual ~SharedMemoryException() throw() {}
+
+  /**
+   * Returns name of the segment that caused this exception.
+   */
+  virtual const std::string& segment() const { return segment_; }
+
+ protected:
+  /**
+   * Name of segment which caused this exception.
+   */
+  const std::string segment_;
+};
+
+}
@@ -7,24 +7,50 @@
 
 #include "file.h"
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <memory>
 #include <string>
 #include <cstdio>
+#include <cstring>
 #include <cassert>
+#include <unistd.h>
+#include <vector>
 
+#include "change_tracker.h"
 #include "exceptions/file_exists_exception.h"
 #include "exceptions/file_not_found_exception.h"
 #include "exceptions/file_open_exception.h"
+#include "exceptions/invalid_fill_factor_exception.h"
+#include "exceptions/invalid_key_length_exception.h"
 #include "exceptions/invalid_page_exception.h"
+#include "exceptions/io_error_exception.h"
 #include "file_iterator.h"
+#include "file_listener.h"
+#include "free_space_map.h"
 #include "page.h"
+#include "physical_file_iterator.h"
+#include "simulated_device.h"
+#include "tablespace.h"
+#include "tiered_store.h"
+#include "zone_map.h"
 
 namespace badgerdb {
 
 File::StreamMap File::open_streams_;
 File::CountMap File::open_counts_;
+File::FreeSpaceMapMap File::free_space_maps_;
+File::ReservationMap File::space_reservations_;
+File::IncarnationMap File::incarnations_;
+std::uint64_t File::last_incarnation_ = 0;
+File::PageIncarnationMap File::page_incarnations_;
+File::TieredStoreMap File::tiered_stores_;
+File::TablespaceMap File::tablespaces_;
+File::ChangeTrackerMap File::change_trackers_;
+File::ZoneMapMap File::zone_maps_;
+File::ListenerMap File::listeners_;
+File::DeviceMap File::devices_;
 
 File File::create(const std::string& filename) {
   return File(filename, true /* create_new */);
@@ -42,6 +68,25 @@ void File::remove(const std::string& filename) {
     throw FileOpenException(filename);
   }
   std::remove(filename.c_str());
+  const std::string& map_filename = FreeSpaceMap::mapFilename(filename);
+  if (exists(map_filename)) {
+    std::remove(map_filename.c_str());
+  }
+  const std::string& change_filename = ChangeTracker::mapFilename(filename);
+  if (exists(change_filename)) {
+    std::remove(change_filename.c_str());
+  }
+  const std::string& zone_filename = ZoneMap::mapFilename(filename);
+  if (exists(zone_filename)) {
+    std::remove(zone_filename.c_str());
+  }
+  const std::string& fill_filename = fillFactorFilename(filename);
+  if (exists(fill_filename)) {
+    std::remove(fill_filename.c_str());
+  }
+  TieredStore::removeFiles(filename);
+  incarnations_.erase(filename);
+  page_incarnations_.erase(filename);
 }
 
 bool File::isOpen(const std::string& filename) {
@@ -84,7 +129,8 @@ File::~File() {
 Page File::allocatePage() {
   FileHeader header = readHeader();
   Page new_page;
-  Page existing_page;
+  // Used page whose next page link has to point at the new page, if any.
+  PageId previous_page_number = Page::INVALID_NUMBER;
   if (header.num_free_pages > 0) {
     new_page = readPage(header.first_free_page, true /* allow_free */);
     new_page.set_page_number(header.first_free_page);
@@ -94,24 +140,22 @@ Page File::allocatePage() {
     if (header.first_used_page == Page::INVALID_NUMBER ||
         header.first_used_page > new_page.page_number()) {
       // Either have no pages used or the head of the used list is a page later
-      // than the one we just allocated, so add the new page to the head.
-      if (header.first_used_page > new_page.page_number()) {
-        new_page.set_next_page_number(header.first_used_page);
-      }
+      // than the one we just allocated, so add the new page to the head.  This
+      // also replaces the free list link the page was carrying.
+      new_page.set_next_page_number(header.first_used_page);
       header.first_used_page = new_page.page_number();
     } else {
       // New page is reused from somewhere after the beginning, so we need to
-      // find where in the used list to insert it.
-      PageId next_page_number = Page::INVALID_NUMBER;
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        next_page_number = (*iter).next_page_number();
-        if (next_page_number > new_page.page_number() ||
-            next_page_number == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
+      // find where in the used list to insert it.  Only headers are read until
+      // the insertion point is found.
+      previous_page_number = header.first_used_page;
+      PageId next_page_number =
+          readPageHeader(previous_page_number).next_page_number;
+      while (next_page_number != Page::INVALID_NUMBER &&
+             next_page_number < new_page.page_number()) {
+        previous_page_number = next_page_number;
+        next_page_number = readPageHeader(previous_page_number).next_page_number;
       }
-      existing_page.set_next_page_number(new_page.page_number());
       new_page.set_next_page_number(next_page_number);
     }
 
@@ -124,25 +168,25 @@ Page File::allocatePage() {
     } else {
       // If we have pages allocated, we need to add the new page to the tail
       // of the linked list.
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        if ((*iter).next_page_number() == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
+      PageId last_page_number = header.first_used_page;
+      PageId next_page_number = readPageHeader(last_page_number).next_page_number;
+      while (next_page_number != Page::INVALID_NUMBER) {
+        last_page_number = next_page_number;
+        next_page_number = readPageHeader(last_page_number).next_page_number;
       }
-      assert(existing_page.isUsed());
-      existing_page.set_next_page_number(new_page.page_number());
+      previous_page_number = last_page_number;
     }
     ++header.num_pages;
   }
   writePage(new_page.page_number(), new_page);
-  if (existing_page.page_number() != Page::INVALID_NUMBER) {
-    // If we updated an existing page by inserting the new page into the
-    // used list, we need to write it out.
-    writePage(existing_page.page_number(), existing_page);
+  if (previous_page_number != Page::INVALID_NUMBER) {
+    // Only the link changes, so only the header is rewritten; the rest of the
+    // page on disk may be older than a copy being changed in a buffer pool.
+    setNextPageNumber(previous_page_number, new_page.page_number());
   }
   writeHeader(header);
 
+  new_page.reservation_ = spaceReservation();
   return new_page;
 }
 
@@ -156,12 +200,18 @@ Page File::readPage(const PageId page_number) const {
 
 Page File::readPage(const PageId page_number, const bool allow_free) const {
   Page page;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&page.header_), sizeof(page.header_));
-  stream_->read(reinterpret_cast<char*>(&page.data_[0]), Page::DATA_SIZE);
+  std::streampos position;
+  std::fstream& stream =
+      pageStream(page_number, position, false /* for_write */);
+  deviceRead(page_number, position, Page::SIZE);
+  stream.seekg(position, std::ios::beg);
+  stream.read(reinterpret_cast<char*>(&page.header_), sizeof(page.header_));
+  stream.read(reinterpret_cast<char*>(&page.data_[0]), Page::DATA_SIZE);
+  page.upgradeFormat();
   if (!allow_free && !page.isUsed()) {
     throw InvalidPageException(page_number, filename_);
   }
+  page.reservation_ = spaceReservation();
 
   return page;
 }
@@ -184,31 +234,392 @@ void File::writePage(const Page& new_page) {
 void File::deletePage(const PageId page_number) {
   FileHeader header = readHeader();
   Page existing_page = readPage(page_number);
-  Page previous_page;
+  PageId linked_page_number = Page::INVALID_NUMBER;
   // If this page is the head of the used list, update the header to point to
   // the next page in line.
   if (page_number == header.first_used_page) {
     header.first_used_page = existing_page.next_page_number();
   } else {
     // Walk the used list so we can update the page that points to this one.
-    for (FileIterator iter = begin(); iter != end(); ++iter) {
-      previous_page = *iter;
-      if (previous_page.next_page_number() == existing_page.page_number()) {
-        previous_page.set_next_page_number(existing_page.next_page_number());
+    // Only headers are read until the page is found.
+    for (PageId previous_page_number = header.first_used_page;
+         previous_page_number != Page::INVALID_NUMBER;
+         previous_page_number =
+             readPageHeader(previous_page_number).next_page_number) {
+      if (readPageHeader(previous_page_number).next_page_number ==
+          page_number) {
+        linked_page_number = previous_page_number;
         break;
       }
     }
   }
+  // Free pages go back to the fast tier at the next migration.
+  TieredStore* tiered_store = tieredStore();
+  if (tiered_store != NULL) {
+    tiered_store->release(page_number);
+  }
+  const PageId next_used_page_number = existing_page.next_page_number();
   // Clear the page and add it to the head of the free list.
   existing_page.initialize();
   existing_page.set_next_page_number(header.first_free_page);
   header.first_free_page = page_number;
   ++header.num_free_pages;
-  if (previous_page.isUsed()) {
-    writePage(previous_page.page_number(), previous_page);
+  if (linked_page_number != Page::INVALID_NUMBER) {
+    setNextPageNumber(linked_page_number, next_used_page_number);
   }
   writePage(page_number, existing_page);
   writeHeader(header);
+  // The deleted page may be cached elsewhere by callers that don't know
+  // about the deletion.
+  page_incarnations_[filename_][page_number] = ++last_incarnation_;
+}
+
+std::vector<bool> File::allocationMap() const {
+  const FileHeader& header = readHeader();
+  std::vector<bool> used_pages(header.num_pages, true);
+  used_pages[0] = false;  // The file header.
+  for (PageId page_number = header.first_free_page;
+       page_number != Page::INVALID_NUMBER;
+       page_number = readPageHeader(page_number).next_page_number) {
+    used_pages[page_number] = false;
+  }
+  return used_pages;
+}
+
+void File::reorderPageLists() {
+  FileHeader header = readHeader();
+  const std::vector<bool>& used_pages = allocationMap();
+  PageId last_used_page = Page::INVALID_NUMBER;
+  PageId last_free_page = Page::INVALID_NUMBER;
+  header.first_used_page = Page::INVALID_NUMBER;
+  header.first_free_page = Page::INVALID_NUMBER;
+  for (PageId page_number = 1; page_number < header.num_pages; ++page_number) {
+    PageId& last_page = used_pages[page_number] ? last_used_page
+                                                : last_free_page;
+    if (last_page == Page::INVALID_NUMBER) {
+      if (used_pages[page_number]) {
+        header.first_used_page = page_number;
+      } else {
+        header.first_free_page = page_number;
+      }
+    } else {
+      setNextPageNumber(last_page, page_number);
+    }
+    last_page = page_number;
+  }
+  if (last_used_page != Page::INVALID_NUMBER) {
+    setNextPageNumber(last_used_page, Page::INVALID_NUMBER);
+  }
+  if (last_free_page != Page::INVALID_NUMBER) {
+    setNextPageNumber(last_free_page, Page::INVALID_NUMBER);
+  }
+  writeHeader(header);
+}
+
+std::uint32_t File::truncate() {
+  FileHeader header = readHeader();
+  std::uint32_t page_io = 1;
+  PageId new_num_pages = header.num_pages;
+  while (new_num_pages > 1 &&
+         readPageHeader(new_num_pages - 1).current_page_number ==
+             Page::INVALID_NUMBER) {
+    --new_num_pages;
+    ++page_io;
+  }
+  if (new_num_pages == header.num_pages) {
+    return page_io;
+  }
+  ++page_io;
+  for (PageId page_number = new_num_pages; page_number < header.num_pages;
+       ++page_number) {
+    notifyBeforeChange(page_number);
+  }
+
+  // Unlink the dropped pages from the free list, keeping the rest in order.
+  std::vector<PageId> kept_pages;
+  for (PageId page_number = header.first_free_page;
+       page_number != Page::INVALID_NUMBER;
+       page_number = readPageHeader(page_number).next_page_number) {
+    ++page_io;
+    if (page_number < new_num_pages) {
+      kept_pages.push_back(page_number);
+    }
+  }
+  for (std::size_t i = 0; i < kept_pages.size(); ++i) {
+    const PageId next_page_number = i + 1 < kept_pages.size()
+        ? kept_pages[i + 1] : Page::INVALID_NUMBER;
+    Page free_page = readPage(kept_pages[i], true /* allow_free */);
+    ++page_io;
+    if (free_page.next_page_number() != next_page_number) {
+      free_page.set_next_page_number(next_page_number);
+      writePage(kept_pages[i], free_page);
+      ++page_io;
+    }
+  }
+  header.num_pages = new_num_pages;
+  header.num_free_pages = kept_pages.size();
+  header.first_free_page = kept_pages.empty() ? Page::INVALID_NUMBER
+                                              : kept_pages.front();
+  writeHeader(header);
+  ++page_io;
+
+  std::string name;
+  Tablespace* tablespace = this->tablespace(&name);
+  if (tablespace != NULL) {
+    tablespace->truncateFile(name, new_num_pages);
+  } else if (::truncate(filename_.c_str(), pagePosition(new_num_pages)) != 0) {
+    // The header is already consistent; only the space isn't given back.
+    throw IoErrorException(filename_, new_num_pages, "truncate");
+  }
+  if (new_num_pages == 1) {
+    newIncarnation();
+  }
+  return page_io;
+}
+
+void File::enableFreeSpaceMap() {
+  if (freeSpaceMap() != NULL) {
+    return;
+  }
+  FreeSpaceMap::build(*this);
+  free_space_maps_[filename_].reset(
+      new FreeSpaceMap(filename_, false /* create_new */));
+}
+
+PageId File::findPageWithSpace(std::size_t bytes) {
+  FreeSpaceMap* free_space_map = freeSpaceMap();
+  if (free_space_map == NULL) {
+    return Page::INVALID_NUMBER;
+  }
+  bytes += spaceReservation()->reserved_bytes;
+  const FileHeader& header = readHeader();
+  PageId candidate = free_space_map->findPage(bytes, Page::INVALID_NUMBER);
+  while (candidate != Page::INVALID_NUMBER) {
+    std::size_t free_bytes = 0;
+    if (candidate < header.num_pages) {
+      const Page& page = readPage(candidate, true /* allow_free */);
+      if (page.isUsed()) {
+        free_bytes = page.getFreeSpace();
+      }
+    }
+    if (free_bytes >= bytes) {
+      return candidate;
+    }
+    // The map was stale (or the request was beyond the top category); fix the
+    // entry and keep looking.
+    free_space_map->update(candidate, free_bytes);
+    candidate = free_space_map->findPage(bytes, candidate);
+  }
+  return Page::INVALID_NUMBER;
+}
+
+PageId File::nextPageWithSpace(std::size_t bytes, const PageId after) const {
+  FreeSpaceMap* free_space_map = freeSpaceMap();
+  if (free_space_map == NULL) {
+    return Page::INVALID_NUMBER;
+  }
+  bytes += spaceReservation()->reserved_bytes;
+  return free_space_map->findPage(bytes, after);
+}
+
+void File::updateFreeSpace(const PageId page_number,
+                           const std::size_t free_bytes) {
+  FreeSpaceMap* free_space_map = freeSpaceMap();
+  if (free_space_map != NULL) {
+    free_space_map->update(page_number, free_bytes);
+  }
+}
+
+void File::enableTiering(const std::string& cold_directory) {
+  if (tieredStore() != NULL || tablespace(NULL) != NULL) {
+    return;
+  }
+  tiered_stores_[filename_].reset(new TieredStore(filename_, cold_directory));
+}
+
+void File::recordAccess(const PageId page_number) {
+  TieredStore* tiered_store = tieredStore();
+  if (tiered_store != NULL) {
+    tiered_store->recordAccess(page_number);
+  }
+}
+
+std::uint32_t File::migratePages(const std::uint32_t max_pages) {
+  TieredStore* tiered_store = tieredStore();
+  return tiered_store == NULL ? 0 : tiered_store->migrate(this, max_pages);
+}
+
+PageId File::coldPages() const {
+  const TieredStore* tiered_store = tieredStore();
+  return tiered_store == NULL ? 0 : tiered_store->coldPages();
+}
+
+void File::enableChangeTracking() {
+  if (changeTracker() != NULL) {
+    return;
+  }
+  std::shared_ptr<ChangeTracker> change_tracker(
+      new ChangeTracker(filename_, true /* create_new */));
+  const FileHeader& header = readHeader();
+  for (PageId page_number = 1; page_number < header.num_pages; ++page_number) {
+    change_tracker->markChanged(page_number);
+  }
+  change_trackers_[filename_] = change_tracker;
+  addListener(change_tracker.get());
+}
+
+void File::enableZoneMap(const std::uint16_t key_offset,
+                         const std::uint16_t key_length) {
+  if (key_length == 0 || key_length > ZoneMap::MAX_KEY_LENGTH) {
+    throw InvalidKeyLengthException(key_length, filename_);
+  }
+  ZoneMap* old_zone_map = zoneMap();
+  if (old_zone_map != NULL) {
+    if (old_zone_map->keyOffset() == key_offset &&
+        old_zone_map->keyLength() == key_length) {
+      return;
+    }
+    removeListener(old_zone_map);
+    zone_maps_.erase(filename_);
+    std::remove(ZoneMap::mapFilename(filename_).c_str());
+  }
+  std::shared_ptr<ZoneMap> zone_map(
+      new ZoneMap(filename_, key_offset, key_length));
+  for (PhysicalFileIterator iter = physicalBegin(); iter != physicalEnd();
+       ++iter) {
+    const Page& page = *iter;
+    zone_map->summarize(page.page_number(), page);
+  }
+  zone_maps_[filename_] = zone_map;
+  addListener(zone_map.get());
+}
+
+void File::addListener(FileListener* listener) {
+  listeners_[filename_].push_back(listener);
+}
+
+void File::removeListener(FileListener* listener) {
+  ListenerMap::iterator iter = listeners_.find(filename_);
+  if (iter == listeners_.end()) {
+    return;
+  }
+  std::vector<FileListener*>& listeners = iter->second;
+  listeners.erase(std::remove(listeners.begin(), listeners.end(), listener),
+                  listeners.end());
+  if (listeners.empty()) {
+    listeners_.erase(iter);
+  }
+}
+
+void File::attachDevice(const std::shared_ptr<SimulatedDevice>& device) {
+  if (device) {
+    devices_[filename_] = device;
+  } else {
+    devices_.erase(filename_);
+  }
+}
+
+void File::setFillFactor(const std::uint32_t percent) {
+  if (percent == 0 || percent > 100) {
+    throw InvalidFillFactorException(percent, filename_);
+  }
+  const std::string& fill_filename = fillFactorFilename(filename_);
+  if (percent == 100) {
+    if (exists(fill_filename)) {
+      std::remove(fill_filename.c_str());
+    }
+  } else {
+    // Written aside and renamed so a crash leaves the old setting or the new
+    // one, never a torn file.
+    const std::string& temp_filename = fill_filename + ".tmp";
+    {
+      std::ofstream out(temp_filename, std::ios::binary | std::ios::trunc);
+      out.write(reinterpret_cast<const char*>(&percent), sizeof(percent));
+      out.flush();
+      if (!out) {
+        throw IoErrorException(temp_filename, 0 /* page_number */, "write");
+      }
+    }
+    if (std::rename(temp_filename.c_str(), fill_filename.c_str()) != 0) {
+      throw IoErrorException(fill_filename, 0 /* page_number */, "rename");
+    }
+  }
+  spaceReservation()->reserved_bytes = Page::DATA_SIZE * (100 - percent) / 100;
+}
+
+std::uint32_t File::fillFactor() const {
+  // Round the reserved percentage up to undo the rounding down in
+  // setFillFactor().
+  return 100 - (spaceReservation()->reserved_bytes * 100 + Page::DATA_SIZE -
+                1) / Page::DATA_SIZE;
+}
+
+SpaceReservation File::reservationStats() const {
+  return *spaceReservation();
+}
+
+std::vector<RecordId> File::bulkLoad(const std::vector<std::string>& records) {
+  std::vector<RecordId> record_ids;
+  record_ids.reserve(records.size());
+  if (records.empty()) {
+    return record_ids;
+  }
+  FileHeader header = readHeader();
+  if (header.num_free_pages > 0) {
+    // Free pages are reused in place, and each needs its own spot in the
+    // used list.
+    Page page = allocatePage();
+    bool page_empty = true;
+    for (std::size_t i = 0; i < records.size(); ++i) {
+      // A record that doesn't fit on an empty page is left to insertRecord to
+      // reject, rather than allocating pages forever.
+      if (!page_empty && !page.hasSpaceForRecord(records[i])) {
+        writePage(page);
+        page = allocatePage();
+      }
+      record_ids.push_back(page.insertRecord(records[i]));
+      page_empty = false;
+    }
+    writePage(page);
+    return record_ids;
+  }
+
+  // Otherwise the new pages all go at the end of the file, so they are
+  // chained to each other as they fill and the used list is walked only once,
+  // to attach the chain after its last page.
+  PageId last_used_page = Page::INVALID_NUMBER;
+  for (PageId page_number = header.first_used_page;
+       page_number != Page::INVALID_NUMBER;
+       page_number = readPageHeader(page_number).next_page_number) {
+    last_used_page = page_number;
+  }
+  const PageId first_new_page = header.num_pages;
+  Page page;
+  page.set_page_number(first_new_page);
+  page.reservation_ = spaceReservation();
+  bool page_empty = true;
+  for (std::size_t i = 0; i < records.size(); ++i) {
+    if (!page_empty && !page.hasSpaceForRecord(records[i])) {
+      const PageId next_page_number = page.page_number() + 1;
+      page.set_next_page_number(next_page_number);
+      writePage(page.page_number(), page);
+      page.initialize();
+      page.set_page_number(next_page_number);
+    }
+    record_ids.push_back(page.insertRecord(records[i]));
+    page_empty = false;
+  }
+  writePage(page.page_number(), page);
+
+  // The new pages only become part of the file here.
+  if (last_used_page == Page::INVALID_NUMBER) {
+    header.first_used_page = first_new_page;
+  } else {
+    setNextPageNumber(last_used_page, first_new_page);
+  }
+  header.num_pages = page.page_number() + 1;
+  writeHeader(header);
+  return record_ids;
 }
 
 FileIterator File::begin() {
@@ -220,6 +631,28 @@ FileIterator File::end() {
   return FileIterator(this, Page::INVALID_NUMBER);
 }
 
+PhysicalFileIterator File::physicalBegin() {
+  return PhysicalFileIterator(this);
+}
+
+PhysicalFileIterator File::physicalBegin(const std::string& low_key,
+                                         const std::string& high_key) {
+  std::vector<bool> pages = allocationMap();
+  ZoneMap* zone_map = zoneMap();
+  if (zone_map != NULL) {
+    const std::vector<bool>& candidates =
+        zone_map->candidatePages(low_key, high_key);
+    for (std::size_t i = 0; i < pages.size(); ++i) {
+      pages[i] = pages[i] && i < candidates.size() && candidates[i];
+    }
+  }
+  return PhysicalFileIterator(this, pages);
+}
+
+PhysicalFileIterator File::physicalEnd() {
+  return PhysicalFileIterator(this, Page::INVALID_NUMBER);
+}
+
 File::File(const std::string& name, const bool create_new) : filename_(name) {
   openIfNeeded(create_new);
 
@@ -231,6 +664,33 @@ File::File(const std::string& name, const bool create_new) : filename_(name) {
   }
 }
 
+File::File(Tablespace* tablespace, const std::string& name,
+           const bool create_new)
+    : filename_(tablespace->logicalFilename(name)) {
+  if (open_counts_.find(filename_) != open_counts_.end()) {
+    ++open_counts_[filename_];
+    stream_ = open_streams_[filename_];
+  } else {
+    stream_ = tablespace->stream_;
+    open_streams_[filename_] = stream_;
+    open_counts_[filename_] = 1;
+    tablespaces_[filename_] = std::make_pair(tablespace, name);
+    openReservation();
+    if (create_new || incarnations_.count(filename_) == 0) {
+      newIncarnation();
+    }
+    if (!create_new) {
+      openCompanions();
+    }
+  }
+
+  if (create_new) {
+    FileHeader header = {1 /* num_pages */, 0 /* first_used_page */,
+                         0 /* num_free_pages */, 0 /* first_free_page */};
+    writeHeader(header);
+  }
+}
+
 void File::openIfNeeded(const bool create_new) {
   if (open_counts_.find(filename_) != open_counts_.end()) {	//exists an entry already
     ++open_counts_[filename_];
@@ -244,6 +704,25 @@ void File::openIfNeeded(const bool create_new) {
       if (already_exists) {
         throw FileExistsException(filename_);
       }
+      // Drop any free-space map left behind by an earlier file of this name.
+      const std::string& map_filename = FreeSpaceMap::mapFilename(filename_);
+      if (exists(map_filename)) {
+        std::remove(map_filename.c_str());
+      }
+      const std::string& change_filename =
+          ChangeTracker::mapFilename(filename_);
+      if (exists(change_filename)) {
+        std::remove(change_filename.c_str());
+      }
+      const std::string& zone_filename = ZoneMap::mapFilename(filename_);
+      if (exists(zone_filename)) {
+        std::remove(zone_filename.c_str());
+      }
+      const std::string& fill_filename = fillFactorFilename(filename_);
+      if (exists(fill_filename)) {
+        std::remove(fill_filename.c_str());
+      }
+      TieredStore::removeFiles(filename_);
       // New files have to be truncated on open.
       mode = mode | std::fstream::trunc;
     } else {
@@ -255,6 +734,16 @@ void File::openIfNeeded(const bool create_new) {
     stream_.reset(new std::fstream(filename_, mode));
     open_streams_[filename_] = stream_;
     open_counts_[filename_] = 1;
+    openReservation();
+    if (create_new || incarnations_.count(filename_) == 0) {
+      newIncarnation();
+    }
+    if (!create_new) {
+      openCompanions();
+    }
+    if (!create_new && exists(TieredStore::mapFilename(filename_))) {
+      tiered_stores_[filename_].reset(new TieredStore(filename_));
+    }
   }
 }
 
@@ -262,6 +751,13 @@ void File::close() {
   --open_counts_[filename_];
   stream_.reset();
   if (open_counts_[filename_] == 0) {
+    free_space_maps_.erase(filename_);
+    tiered_stores_.erase(filename_);
+    tablespaces_.erase(filename_);
+    change_trackers_.erase(filename_);
+    zone_maps_.erase(filename_);
+    listeners_.erase(filename_);
+    devices_.erase(filename_);
     open_streams_.erase(filename_);
     open_counts_.erase(filename_);
   }
@@ -273,31 +769,275 @@ void File::writePage(const PageId page_number, const Page& new_page) {
 
 void File::writePage(const PageId page_number, const PageHeader& header,
                      const Page& new_page) {
-  stream_->seekp(pagePosition(page_number), std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(header));
-  stream_->write(reinterpret_cast<const char*>(&new_page.data_[0]),
-                 Page::DATA_SIZE);
-  stream_->flush();
+  notifyBeforeChange(page_number);
+  std::streampos position;
+  std::fstream& stream =
+      pageStream(page_number, position, true /* for_write */);
+  const std::size_t length = deviceWrite(page_number, position, Page::SIZE);
+  stream.seekp(position, std::ios::beg);
+  if (length < Page::SIZE) {
+    // A torn page: only the first sectors reach the file.
+    char bytes[Page::SIZE];
+    std::memcpy(bytes, &header, sizeof(header));
+    std::memcpy(bytes + sizeof(header), &new_page.data_[0], Page::DATA_SIZE);
+    stream.write(bytes, length);
+    stream.flush();
+    throw IoErrorException(filename_, page_number, "short write");
+  }
+  stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  stream.write(reinterpret_cast<const char*>(&new_page.data_[0]),
+               Page::DATA_SIZE);
+  stream.flush();
+  notifyAfterWrite(page_number, &new_page);
+
+  FreeSpaceMap* free_space_map = freeSpaceMap();
+  if (free_space_map != NULL) {
+    // Free pages can't take records until they are allocated again.
+    free_space_map->update(page_number,
+                           header.current_page_number == Page::INVALID_NUMBER
+                               ? 0 : new_page.getFreeSpace());
+  }
 }
 
 FileHeader File::readHeader() const {
   FileHeader header;
-  stream_->seekg(0 /* pos */, std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(header));
+  std::streampos position;
+  std::fstream& stream = pageStream(0 /* page_number */, position,
+                                    false /* for_write */);
+  stream.seekg(position, std::ios::beg);
+  stream.read(reinterpret_cast<char*>(&header), sizeof(header));
 
   return header;
 }
 
 void File::writeHeader(const FileHeader& header) {
-  stream_->seekp(0 /* pos */, std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(header));
-  stream_->flush();
+  notifyBeforeChange(0 /* page_number */);
+  std::streampos position;
+  std::fstream& stream = pageStream(0 /* page_number */, position,
+                                    true /* for_write */);
+  if (deviceWrite(0 /* page_number */, position, sizeof(header)) <
+      sizeof(header)) {
+    throw IoErrorException(filename_, 0 /* page_number */, "short write");
+  }
+  stream.seekp(position, std::ios::beg);
+  stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  stream.flush();
+  notifyAfterWrite(0 /* page_number */, NULL);
+}
+
+void File::readPages(const PageId first_page_number, const PageId num_pages,
+                     std::vector<Page>& pages) const {
+  // Cold pages and extent boundaries in a tablespace break the pages up into
+  // runs that are each contiguous in one stream.
+  pages.resize(num_pages);
+  std::vector<char> buffer;
+  PageId run_start = 0;
+  while (run_start < num_pages) {
+    std::streampos position;
+    std::fstream& stream = pageStream(first_page_number + run_start, position,
+                                      false /* for_write */);
+    PageId run_length = 1;
+    while (run_start + run_length < num_pages) {
+      std::streampos next_position;
+      const std::fstream& next_stream =
+          pageStream(first_page_number + run_start + run_length,
+                     next_position, false /* for_write */);
+      if (&next_stream != &stream ||
+          next_position - position !=
+              static_cast<std::streamoff>(run_length * Page::SIZE)) {
+        break;
+      }
+      ++run_length;
+    }
+    buffer.resize(run_length * Page::SIZE);
+    deviceRead(first_page_number + run_start, position, buffer.size());
+    stream.seekg(position, std::ios::beg);
+    stream.read(&buffer[0], buffer.size());
+    for (PageId i = 0; i < run_length; ++i) {
+      Page& page = pages[run_start + i];
+      decodePage(&buffer[i * Page::SIZE], page);
+      page.reservation_ = spaceReservation();
+    }
+    run_start += run_length;
+  }
+}
+
+void File::decodePage(const char* page_bytes, Page& page) {
+  std::memcpy(&page.header_, page_bytes, sizeof(page.header_));
+  std::memcpy(&page.data_[0], page_bytes + sizeof(page.header_),
+              Page::DATA_SIZE);
+  page.upgradeFormat();
+}
+
+void File::encodePage(const Page& page, char* page_bytes) {
+  std::memcpy(page_bytes, &page.header_, sizeof(page.header_));
+  std::memcpy(page_bytes + sizeof(page.header_), &page.data_[0],
+              Page::DATA_SIZE);
+}
+
+void File::setNextPageNumber(const PageId page_number,
+                             const PageId next_page_number) {
+  PageHeader header = readPageHeader(page_number);
+  if (header.next_page_number != next_page_number) {
+    header.next_page_number = next_page_number;
+    notifyBeforeChange(page_number);
+    std::streampos position;
+    std::fstream& stream =
+        pageStream(page_number, position, true /* for_write */);
+    if (deviceWrite(page_number, position, sizeof(header)) < sizeof(header)) {
+      throw IoErrorException(filename_, page_number, "short write");
+    }
+    stream.seekp(position, std::ios::beg);
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    stream.flush();
+    notifyAfterWrite(page_number, NULL);
+  }
+}
+
+SpaceReservation* File::spaceReservation() const {
+  return &space_reservations_[filename_];
+}
+
+void File::openReservation() {
+  SpaceReservation& reservation = space_reservations_[filename_];
+  reservation = SpaceReservation();
+  std::ifstream in(fillFactorFilename(filename_), std::ios::binary);
+  std::uint32_t percent = 100;
+  if (in.read(reinterpret_cast<char*>(&percent), sizeof(percent)) &&
+      percent > 0 && percent < 100) {
+    reservation.reserved_bytes = Page::DATA_SIZE * (100 - percent) / 100;
+  }
+}
+
+std::uint64_t File::pageIncarnation(const PageId page_number) const {
+  const PageIncarnationMap::const_iterator file_iter =
+      page_incarnations_.find(filename_);
+  if (file_iter == page_incarnations_.end()) {
+    return 0;
+  }
+  const std::map<PageId, std::uint64_t>::const_iterator iter =
+      file_iter->second.find(page_number);
+  return iter == file_iter->second.end() ? 0 : iter->second;
+}
+
+void File::newIncarnation() {
+  incarnations_[filename_] = ++last_incarnation_;
+  page_incarnations_.erase(filename_);
+}
+
+TieredStore* File::tieredStore() const {
+  TieredStoreMap::const_iterator iter = tiered_stores_.find(filename_);
+  return iter == tiered_stores_.end() ? NULL : iter->second.get();
+}
+
+Tablespace* File::tablespace(std::string* name) const {
+  TablespaceMap::const_iterator iter = tablespaces_.find(filename_);
+  if (iter == tablespaces_.end()) {
+    return NULL;
+  }
+  if (name != NULL) {
+    *name = iter->second.second;
+  }
+  return iter->second.first;
+}
+
+void File::deviceRead(const PageId page_number, const std::streampos position,
+                      const std::size_t bytes) const {
+  DeviceMap::const_iterator iter = devices_.find(filename_);
+  if (iter != devices_.end()) {
+    iter->second->read(filename_, page_number, position, bytes);
+  }
+}
+
+std::size_t File::deviceWrite(const PageId page_number,
+                              const std::streampos position,
+                              const std::size_t bytes) const {
+  DeviceMap::const_iterator iter = devices_.find(filename_);
+  return iter == devices_.end()
+      ? bytes : iter->second->write(filename_, page_number, position, bytes);
+}
+
+std::fstream& File::pageStream(const PageId page_number,
+                               std::streampos& position,
+                               const bool for_write) const {
+  TablespaceMap::const_iterator iter = tablespaces_.find(filename_);
+  if (iter != tablespaces_.end()) {
+    position = iter->second.first->pagePosition(iter->second.second,
+                                                page_number, for_write);
+    return *stream_;
+  }
+  const TieredStore* tiered_store = tieredStore();
+  if (tiered_store != NULL && tiered_store->isCold(page_number)) {
+    position = tiered_store->coldPosition(page_number);
+    return tiered_store->coldStream();
+  }
+  position = page_number == 0 ? std::streampos(0) : pagePosition(page_number);
+  return *stream_;
+}
+
+FreeSpaceMap* File::freeSpaceMap() const {
+  FreeSpaceMapMap::const_iterator iter = free_space_maps_.find(filename_);
+  return iter == free_space_maps_.end() ? NULL : iter->second.get();
+}
+
+ChangeTracker* File::changeTracker() const {
+  ChangeTrackerMap::const_iterator iter = change_trackers_.find(filename_);
+  return iter == change_trackers_.end() ? NULL : iter->second.get();
+}
+
+ZoneMap* File::zoneMap() const {
+  ZoneMapMap::const_iterator iter = zone_maps_.find(filename_);
+  return iter == zone_maps_.end() ? NULL : iter->second.get();
+}
+
+void File::openCompanions() {
+  if (exists(FreeSpaceMap::mapFilename(filename_))) {
+    free_space_maps_[filename_].reset(
+        new FreeSpaceMap(filename_, false /* create_new */));
+  }
+  if (exists(ChangeTracker::mapFilename(filename_))) {
+    std::shared_ptr<ChangeTracker>& change_tracker =
+        change_trackers_[filename_];
+    change_tracker.reset(new ChangeTracker(filename_, false /* create_new */));
+    addListener(change_tracker.get());
+  }
+  if (exists(ZoneMap::mapFilename(filename_))) {
+    std::shared_ptr<ZoneMap>& zone_map = zone_maps_[filename_];
+    zone_map.reset(new ZoneMap(filename_));
+    addListener(zone_map.get());
+  }
+}
+
+void File::notifyBeforeChange(const PageId page_number) const {
+  ListenerMap::const_iterator iter = listeners_.find(filename_);
+  if (iter == listeners_.end()) {
+    return;
+  }
+  const std::vector<FileListener*>& listeners = iter->second;
+  for (std::size_t i = 0; i < listeners.size(); ++i) {
+    listeners[i]->beforePageChange(page_number);
+  }
+}
+
+void File::notifyAfterWrite(const PageId page_number, const Page* page) const {
+  ListenerMap::const_iterator iter = listeners_.find(filename_);
+  if (iter == listeners_.end()) {
+    return;
+  }
+  const std::vector<FileListener*>& listeners = iter->second;
+  for (std::size_t i = 0; i < listeners.size(); ++i) {
+    listeners[i]->afterPageWrite(page_number, page);
+  }
 }
 
 PageHeader File::readPageHeader(PageId page_number) const {
   PageHeader header;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(header));
+  std::streampos position;
+  std::fstream& stream =
+      pageStream(page_number, position, false /* for_write */);
+  deviceRead(page_number, position, sizeof(header));
+  stream.seekg(position, std::ios::beg);
+  stream.read(reinterpret_cast<char*>(&header), sizeof(header));
 
   return header;
 }
@@ -11,12 +11,21 @@
 #include <string>
 #include <map>
 #include <memory>
+#include <vector>
 
 #include "page.h"
 
 namespace badgerdb {
 
+class ChangeTracker;
 class FileIterator;
+class FileListener;
+class FreeSpaceMap;
+class PhysicalFileIterator;
+class SimulatedDevice;
+class Tablespace;
+class TieredStore;
+class ZoneMap;
 
 /**
  * @brief Header metadata for files on disk which contain pages.
@@ -171,6 +180,238 @@ class File {
    */
   void deletePage(const PageId page_number);
 
+  /**
+   * Returns which pages of the file are in use, indexed by page number.  The
+   * map is built from the free list, so only free pages are read.
+   *
+   * @return  For each page number, true if the page is in use.
+   */
+  std::vector<bool> allocationMap() const;
+
+  /**
+   * Relinks the used list and the free list so that both follow page number
+   * order, which is also the order of the pages on disk.  Pages allocated by
+   * allocatePage() are kept in order already; this repairs files whose lists
+   * were written in another order.  Only page headers are rewritten.
+   */
+  void reorderPageLists();
+
+  /**
+   * Shrinks the file by dropping the free pages at its end, both from the free
+   * list and from disk.  Free pages before the last used page stay on the free
+   * list.  Files in a tablespace give their unneeded extents back to it.
+   *
+   * @return  Number of page reads and writes done, headers included.
+   * @throws  IoErrorException  If the file can't be shrunk on disk.
+   */
+  std::uint32_t truncate();
+
+  /**
+   * Creates a free-space map for this file from its current contents, if it
+   * doesn't have one loaded already.  The map is stored in a companion file
+   * (see FreeSpaceMap), kept up to date on every page write, and loaded
+   * automatically whenever the file is opened.  A map file that exists but
+   * isn't loaded, e.g. one left behind by a crash, is rebuilt rather than
+   * trusted.
+   */
+  void enableFreeSpaceMap();
+
+  /**
+   * Returns true if this file has a free-space map.
+   *
+   * @return  Whether the file has a free-space map.
+   */
+  bool hasFreeSpaceMap() const { return freeSpaceMap() != NULL; }
+
+  /**
+   * Returns the number of a used page with at least <bytes> bytes of free
+   * space, using the free-space map to avoid reading pages that can't hold the
+   * data.  The candidate is checked against its on-disk copy; callers working
+   * through a buffer pool should still check hasSpaceForRecord on the pooled
+   * copy before inserting.
+   *
+   * @param bytes   Free space required in bytes.
+   * @return  Number of a page with enough space, or Page::INVALID_NUMBER if
+   *          there is none or the file has no free-space map.
+   */
+  PageId findPageWithSpace(std::size_t bytes);
+
+  /**
+   * Returns the next page after <after> that the free-space map says has at
+   * least <bytes> bytes free on top of the space reserved by the fill factor.
+   * Unlike findPageWithSpace(), the page itself is not read, for callers that
+   * check it in a buffer pool where it may be newer than on disk.
+   *
+   * @param bytes   Free space required in bytes.
+   * @param after   Page number to start searching after.
+   * @return  Candidate page number, or Page::INVALID_NUMBER if there is none
+   *          or the file has no free-space map.
+   */
+  PageId nextPageWithSpace(std::size_t bytes, const PageId after) const;
+
+  /**
+   * Records how much free space a page has in the free-space map.  Page
+   * writes do this themselves; this is for copies changed in a buffer pool
+   * and not yet written back.  Does nothing if the file has no free-space map.
+   *
+   * @param page_number   Number of the page.
+   * @param free_bytes    Free space on the page in bytes; zero for free pages.
+   */
+  void updateFreeSpace(const PageId page_number, const std::size_t free_bytes);
+
+  /**
+   * Gives this file a slow storage tier in another directory, if it doesn't
+   * have one already.  Cold pages are moved there by migratePages() and read
+   * and written there transparently (see TieredStore).  The tier is loaded
+   * automatically whenever the file is opened.  Files in a tablespace are
+   * never tiered; for them this does nothing.
+   *
+   * @param cold_directory  Directory to hold the slow-tier file.
+   */
+  void enableTiering(const std::string& cold_directory);
+
+  /**
+   * Returns true if this file has a slow storage tier.
+   *
+   * @return  Whether the file is tiered.
+   */
+  bool isTiered() const { return tieredStore() != NULL; }
+
+  /**
+   * Counts an access to a page for deciding which tier it belongs in.  Does
+   * nothing unless the file is tiered.  Called by BufMgr on every page access.
+   *
+   * @param page_number   Number of the page accessed.
+   */
+  void recordAccess(const PageId page_number);
+
+  /**
+   * Moves up to <max_pages> pages between the storage tiers based on the
+   * accesses recorded since the last call, after moving pages deleted since
+   * then back to the fast tier.  Does nothing unless the file is tiered.
+   * Meant to be called in the background when the system is idle.
+   *
+   * @param max_pages   Maximum number of pages to move.
+   * @return  Number of pages moved.
+   */
+  std::uint32_t migratePages(const std::uint32_t max_pages);
+
+  /**
+   * Returns the number of pages in the slow tier.
+   *
+   * @return  Number of cold pages; zero if the file is not tiered.
+   */
+  PageId coldPages() const;
+
+  /**
+   * Starts recording which pages change, if this file doesn't do so already.
+   * The record is kept in a companion file (see ChangeTracker) and loaded
+   * automatically whenever the file is opened; incremental backups use it to
+   * copy only changed pages.  All pages count as changed to begin with.
+   */
+  void enableChangeTracking();
+
+  /**
+   * Returns true if this file records which pages change.
+   *
+   * @return  Whether the file has change tracking.
+   */
+  bool hasChangeTracking() const { return changeTracker() != NULL; }
+
+  /**
+   * Starts keeping the smallest and largest record key of every page, so that
+   * physicalBegin(low_key, high_key) can skip pages holding no key in range.
+   * The key of a record is the <key_length> bytes at <key_offset>.  The
+   * summaries are built from the current contents of the file, stored in a
+   * companion file (see ZoneMap), kept up to date on every page write, and
+   * loaded automatically whenever the file is opened.  If the file already
+   * keeps summaries of a different key they are rebuilt.
+   *
+   * @param key_offset  Offset of the key within each record.
+   * @param key_length  Length of the key in bytes.
+   * @throws  InvalidKeyLengthException  If key_length is 0 or more than
+   *                                     ZoneMap::MAX_KEY_LENGTH.
+   */
+  void enableZoneMap(const std::uint16_t key_offset,
+                     const std::uint16_t key_length);
+
+  /**
+   * Returns true if this file keeps per-page key summaries.
+   *
+   * @return  Whether the file has a zone map.
+   */
+  bool hasZoneMap() const { return zoneMap() != NULL; }
+
+  /**
+   * Attaches a listener that is told about every change to this file's pages
+   * made through any File object for the file.  Listeners are dropped when the
+   * last File object for the file is closed.
+   *
+   * @param listener  Listener to attach; not owned.
+   */
+  void addListener(FileListener* listener);
+
+  /**
+   * Detaches a listener attached with addListener().
+   *
+   * @param listener  Listener to detach.
+   */
+  void removeListener(FileListener* listener);
+
+  /**
+   * Sends every page read and write of this file, through any File object for
+   * it, through a simulated storage device that delays it and may fail it
+   * (see SimulatedDevice).  The data itself still lives in the real file.
+   * Reads of the file header aren't charged, since it is read on almost every
+   * call and any real system would keep it in memory.  The device is dropped
+   * when the last File object for the file is closed.
+   *
+   * @param device  Device to use, possibly shared with other files, or NULL
+   *                to stop simulating.
+   */
+  void attachDevice(const std::shared_ptr<SimulatedDevice>& device);
+
+  /**
+   * Sets how full inserts may make the pages of this file.  Inserts (including
+   * bulkLoad()) leave (100 - percent)% of Page::DATA_SIZE free on each page so
+   * that records can grow in place; updates may use the reserved space.  The
+   * setting applies to every File object and in-memory page of the file, and
+   * is kept in a companion file (named after the file with a ".fill" suffix)
+   * so it lasts until changed.  Files start at 100 percent.
+   *
+   * @param percent   Fill factor between 1 and 100.
+   * @throws  InvalidFillFactorException  If percent is out of range.
+   */
+  void setFillFactor(const std::uint32_t percent);
+
+  /**
+   * Returns the fill factor of this file in percent.
+   *
+   * @return  Fill factor.
+   */
+  std::uint32_t fillFactor() const;
+
+  /**
+   * Returns counts of how updates have used the space reserved by the fill
+   * factor since it was first set.
+   *
+   * @return  Snapshot of the reservation and its counters.
+   */
+  SpaceReservation reservationStats() const;
+
+  /**
+   * Appends the given records to new pages, filling each page up to the fill
+   * factor and writing it once when full.  Existing pages are not touched
+   * apart from the link to the new pages.  If the file has no free pages, the
+   * new pages are added at its end without walking the used list for each.
+   *
+   * @param records   Records to load, in order.
+   * @return  IDs of the loaded records, in the same order.
+   * @throws  InsufficientSpaceException  If a record doesn't fit on an empty
+   *                                      page.
+   */
+  std::vector<RecordId> bulkLoad(const std::vector<std::string>& records);
+
   /**
    * Returns the name of the file this object represents.
    *
@@ -178,6 +419,26 @@ class File {
    */
   const std::string& filename() const { return filename_; }
 
+  /**
+   * Returns a number identifying the current contents of this file within the
+   * process.  It changes whenever the file is created anew or truncated to
+   * its header, so copies of pages cached under an older number are known to
+   * be stale.
+   *
+   * @return Incarnation of the file.
+   */
+  std::uint64_t incarnation() const { return incarnations_[filename_]; }
+
+  /**
+   * Returns a number identifying the current contents of a page within the
+   * file's incarnation.  It changes whenever the page is deleted, so copies
+   * of the page cached under an older number are known to be stale.
+   *
+   * @param page_number   Number of the page.
+   * @return Incarnation of the page; 0 if it was never deleted.
+   */
+  std::uint64_t pageIncarnation(const PageId page_number) const;
+
   /**
    * Returns an iterator at the first page in the file.
    *
@@ -193,6 +454,40 @@ class File {
    */
   FileIterator end();
 
+  /**
+   * Returns an iterator at the first used page in the file that visits pages
+   * in the order they are stored on disk, reading runs of adjacent used pages
+   * with a single I/O.
+   *
+   * @return  Iterator at first used page of file in physical order.
+   */
+  PhysicalFileIterator physicalBegin();
+
+  /**
+   * Returns an iterator like physicalBegin() that visits only the pages that
+   * may hold a record whose key (see enableZoneMap()) is in [low_key,
+   * high_key], skipping the rest without reading them.  Visited pages may
+   * still hold records outside the range, so callers filter records as
+   * usual.  Files without a zone map visit every used page.
+   *
+   * The summaries describe pages as written to the file; flush a buffer pool
+   * holding dirty pages of the file before relying on them.
+   *
+   * @param low_key   Smallest key wanted.
+   * @param high_key  Largest key wanted.
+   * @return  Iterator at the first page that may hold a key in range.
+   */
+  PhysicalFileIterator physicalBegin(const std::string& low_key,
+                                     const std::string& high_key);
+
+  /**
+   * Returns an iterator representing the position after the last page visited
+   * by a physical-order scan.  This iterator should not be dereferenced.
+   *
+   * @return  Iterator representing the end of a physical-order scan.
+   */
+  PhysicalFileIterator physicalEnd();
+
  private:
   /**
    * Returns the position of the page with the given number in the file (as an
@@ -221,6 +516,19 @@ class File {
    */
   File(const std::string& name, const bool create_new);
 
+  /**
+   * Constructs a file object representing a logical file in a tablespace.
+   * This method should not be called directly; instead use the methods on
+   * Tablespace, which check that the file exists (or not).
+   *
+   * @see Tablespace::createFile()
+   * @see Tablespace::openFile()
+   * @param tablespace  Tablespace holding the file.
+   * @param name        Name of the file within the tablespace.
+   * @param create_new  Whether to create a new file.
+   */
+  File(Tablespace* tablespace, const std::string& name, const bool create_new);
+
   /**
    * Opens the underlying file named in filename_.
    * This method only opens the file if no other File objects exist that access
@@ -301,9 +609,196 @@ class File {
    */
   PageHeader readPageHeader(const PageId page_number) const;
 
+  /**
+   * Reads <num_pages> adjacent pages starting at <first_page_number>, with a
+   * single read for each run of pages that is contiguous on disk.  Free pages are returned as they are on disk.  No bounds
+   * checking is performed.
+   *
+   * @param first_page_number   Number of first page to read.
+   * @param num_pages           Number of pages to read.
+   * @param pages               Receives the pages in page number order.
+   */
+  void readPages(const PageId first_page_number, const PageId num_pages,
+                 std::vector<Page>& pages) const;
+
+  /**
+   * Builds a page from its on-disk bytes, converting it to the current layout
+   * if needed.
+   *
+   * @param page_bytes  Page::SIZE bytes as stored in the file.
+   * @param page        Receives the page.
+   */
+  static void decodePage(const char* page_bytes, Page& page);
+
+  /**
+   * Stores a page as its on-disk bytes.
+   *
+   * @param page        Page to store.
+   * @param page_bytes  Receives Page::SIZE bytes.
+   */
+  static void encodePage(const Page& page, char* page_bytes);
+
+  /**
+   * Changes the next page pointer in the header of the given page on disk,
+   * leaving the rest of the page alone.
+   *
+   * @param page_number       Number of page to change.
+   * @param next_page_number  New next page number.
+   */
+  void setNextPageNumber(const PageId page_number,
+                         const PageId next_page_number);
+
+  /**
+   * Returns the free-space map of this file, or NULL if it has none.
+   *
+   * @return  Free-space map or NULL.
+   */
+  FreeSpaceMap* freeSpaceMap() const;
+
+  /**
+   * Returns the change record of this file, or NULL if it has none.
+   *
+   * @return  Change tracker or NULL.
+   */
+  ChangeTracker* changeTracker() const;
+
+  /**
+   * Returns the zone map of this file, or NULL if it has none.
+   *
+   * @return  Zone map or NULL.
+   */
+  ZoneMap* zoneMap() const;
+
+  /**
+   * Loads the free-space map, change record and zone map of this file from
+   * their companion files, if they exist.  Called when the file is first
+   * opened.
+   */
+  void openCompanions();
+
+  /**
+   * Tells the attached listeners that a page is about to change.
+   *
+   * @param page_number   Number of the page; 0 for the file header.
+   */
+  void notifyBeforeChange(const PageId page_number) const;
+
+  /**
+   * Tells the attached listeners that a page has been written.
+   *
+   * @param page_number   Number of the page; 0 for the file header.
+   * @param page          Contents written, or NULL for header-only writes.
+   */
+  void notifyAfterWrite(const PageId page_number, const Page* page) const;
+
+  /**
+   * Returns the slow storage tier of this file, or NULL if it has none.
+   *
+   * @return  Tiered store or NULL.
+   */
+  TieredStore* tieredStore() const;
+
+  /**
+   * Returns the tablespace holding this file, or NULL if the file is an OS
+   * file of its own.
+   *
+   * @param name  Receives the name of the file within the tablespace.
+   * @return  Tablespace or NULL.
+   */
+  Tablespace* tablespace(std::string* name) const;
+
+  /**
+   * Charges a read to this file's simulated device, if it has one.
+   *
+   * @param page_number   Page being read.
+   * @param position      Position of the read in its stream.
+   * @param bytes         Length of the read.
+   * @throws  IoErrorException  If the device fails the read.
+   */
+  void deviceRead(const PageId page_number, const std::streampos position,
+                  const std::size_t bytes) const;
+
+  /**
+   * Charges a write to this file's simulated device, if it has one.
+   *
+   * @param page_number   Page being written.
+   * @param position      Position of the write in its stream.
+   * @param bytes         Length of the write.
+   * @return  Number of bytes to really write; fewer than <bytes> for a short
+   *          write.
+   * @throws  IoErrorException  If the device fails the write.
+   */
+  std::size_t deviceWrite(const PageId page_number,
+                          const std::streampos position,
+                          const std::size_t bytes) const;
+
+  /**
+   * Returns the stream holding the given page and the page's position in it,
+   * which is in the slow tier for cold pages, at the page's block for files in
+   * a tablespace and in this file otherwise.  Page 0 is the file header.
+   *
+   * @param page_number   Number of the page.
+   * @param position      Receives the position of the page in the stream.
+   * @param for_write     Whether the page is about to be written.  Only then
+   *                      are blocks allocated for pages past the end of a file
+   *                      in a tablespace.
+   * @return  Stream holding the page.
+   * @throws  InvalidPageException  If the file is in a tablespace, the page is
+   *                                past its end and <for_write> isn't set.
+   */
+  std::fstream& pageStream(const PageId page_number, std::streampos& position,
+                           const bool for_write) const;
+
+  /**
+   * Returns the space reservation of this file.  Every open file has one,
+   * created with its fill factor when the file is first opened.
+   *
+   * @return  Reservation of the file.
+   */
+  SpaceReservation* spaceReservation() const;
+
+  /**
+   * Creates the space reservation of this file when it is first opened, with
+   * the fill factor stored in its companion file, if any.
+   */
+  void openReservation();
+
+  /**
+   * Gives this file a new incarnation number, which retires the incarnations
+   * of its pages as well.
+   */
+  void newIncarnation();
+
+  /**
+   * Returns the name of the companion file holding the fill factor of a file.
+   *
+   * @param filename  Name of the data file.
+   * @return  Name of the fill factor file.
+   */
+  static std::string fillFactorFilename(const std::string& filename) {
+    return filename + ".fill";
+  }
+
   typedef std::map<std::string,
                    std::shared_ptr<std::fstream> > StreamMap;
   typedef std::map<std::string, int> CountMap;
+  typedef std::map<std::string,
+                   std::shared_ptr<FreeSpaceMap> > FreeSpaceMapMap;
+  typedef std::map<std::string, SpaceReservation> ReservationMap;
+  typedef std::map<std::string, std::uint64_t> IncarnationMap;
+  typedef std::map<std::string,
+                   std::map<PageId, std::uint64_t> > PageIncarnationMap;
+  typedef std::map<std::string,
+                   std::shared_ptr<TieredStore> > TieredStoreMap;
+  typedef std::map<std::string,
+                   std::pair<Tablespace*, std::string> > TablespaceMap;
+  typedef std::map<std::string,
+                   std::shared_ptr<ChangeTracker> > ChangeTrackerMap;
+  typedef std::map<std::string,
+                   std::shared_ptr<ZoneMap> > ZoneMapMap;
+  typedef std::map<std::string, std::vector<FileListener*> > ListenerMap;
+  typedef std::map<std::string,
+                   std::shared_ptr<SimulatedDevice> > DeviceMap;
 
   /**
    * Streams for opened files.
@@ -315,6 +810,62 @@ class File {
    */
   static CountMap open_counts_;
 
+  /**
+   * Free-space maps for opened files that have one.
+   */
+  static FreeSpaceMapMap free_space_maps_;
+
+  /**
+   * Space reservations of every file opened so far.  Entries are reset, not
+   * erased, when a file is opened again, so pages that outlive their File
+   * objects never point at a freed reservation.
+   */
+  static ReservationMap space_reservations_;
+
+  /**
+   * Incarnation numbers of files opened so far, kept across closes so that
+   * cached pages of a reopened file stay usable, and the last number handed
+   * out.
+   */
+  static IncarnationMap incarnations_;
+  static std::uint64_t last_incarnation_;
+
+  /**
+   * Incarnation numbers of the pages deleted in the current incarnation of
+   * each file.
+   */
+  static PageIncarnationMap page_incarnations_;
+
+  /**
+   * Slow storage tiers for opened files that have one.
+   */
+  static TieredStoreMap tiered_stores_;
+
+  /**
+   * Tablespace and name within it for opened files that are in a tablespace.
+   */
+  static TablespaceMap tablespaces_;
+
+  /**
+   * Change records for opened files that have one.
+   */
+  static ChangeTrackerMap change_trackers_;
+
+  /**
+   * Zone maps for opened files that have one.
+   */
+  static ZoneMapMap zone_maps_;
+
+  /**
+   * Listeners attached to opened files.
+   */
+  static ListenerMap listeners_;
+
+  /**
+   * Simulated devices of opened files that have one.
+   */
+  static DeviceMap devices_;
+
   /**
    * Name of the file this object represents.
    */
@@ -325,8 +876,20 @@ class File {
    */
   std::shared_ptr<std::fstream> stream_;
 
+  friend class BufMgr;
+  friend class FileAnalyzer;
   friend class FileIterator;
   friend class FileTest;
+  friend class FileVacuum;
+  friend class FreeSpaceMap;
+  friend class OnlineBackup;
+  friend class PhysicalFileIterator;
+  friend class ReplicaApplier;
+  friend class ReplicationLog;
+  friend class SharedBufMgr;
+  friend class Tablespace;
+  friend class TieredStore;
+  friend class ZoneMap;
 };
 
 }
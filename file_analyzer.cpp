@@ -0,0 +1,224 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "file_analyzer.h"
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <thread>
+
+#include "exceptions/file_not_found_exception.h"
+
+namespace badgerdb {
+
+namespace {
+
+/**
+ * Returns <part> as a percentage of <whole>, or zero if <whole> is zero.
+ */
+double percentOf(const std::uint64_t part, const std::uint64_t whole) {
+  return whole == 0 ? 0.0 : 100.0 * part / whole;
+}
+
+}
+
+const std::size_t FileReport::FILL_BUCKETS;
+const PageId FileAnalyzer::CHUNK_PAGES;
+
+void FileReport::print(std::ostream& out) const {
+  const std::uint64_t used_bytes =
+      static_cast<std::uint64_t>(used_pages) * Page::DATA_SIZE;
+  out << "pages:              " << num_pages << " (" << used_pages
+      << " used, " << free_pages << " free)\n";
+  out << "free list length:   " << free_list_length << "\n";
+  out << "used list length:   " << used_list_length << "\n";
+  out << "out-of-order links: " << backward_links << " backward, "
+      << skipping_links << " skipping\n";
+  out << "records:            " << records << "\n";
+  out << "record data:        " << record_bytes << " bytes ("
+      << percentOf(record_bytes, used_bytes) << "% of used pages)\n";
+  out << "slot arrays:        " << slot_bytes << " bytes ("
+      << unused_slot_bytes << " in unused slots)\n";
+  out << "free space:         " << free_bytes << " bytes ("
+      << percentOf(free_bytes, used_bytes) << "%)\n";
+  out << "fragmented space:   " << fragmented_bytes << " bytes ("
+      << percentOf(fragmented_bytes, used_bytes) << "%)\n";
+  out << "page fill:\n";
+  for (std::size_t i = 0; i < FILL_BUCKETS; ++i) {
+    out << "  " << (i * 100 / FILL_BUCKETS) << "-"
+        << ((i + 1) * 100 / FILL_BUCKETS) << "%: " << fill_histogram[i]
+        << "\n";
+  }
+}
+
+FileAnalyzer::FileAnalyzer(const std::string& filename,
+                           const std::uint32_t num_threads)
+    : filename_(filename),
+      num_threads_(num_threads) {
+  if (num_threads_ == 0) {
+    num_threads_ = std::max(1u, std::thread::hardware_concurrency());
+  }
+}
+
+FileReport FileAnalyzer::analyze() const {
+  std::ifstream stream(filename_, std::ios::binary);
+  if (!stream) {
+    throw FileNotFoundException(filename_);
+  }
+  FileHeader header;
+  stream.read(reinterpret_cast<char*>(&header), sizeof(header));
+  stream.close();
+
+  FileReport report;
+  report.num_pages = header.num_pages;
+  if (header.num_pages <= 1) {
+    return report;
+  }
+  // Cold pages read as holes in the data file; their real copies are needed.
+  std::unique_ptr<TieredStore> tiered_store;
+  if (File::exists(TieredStore::mapFilename(filename_))) {
+    tiered_store.reset(new TieredStore(filename_));
+  }
+
+  // Page 0 is the file header, so data pages are [1, num_pages).
+  std::vector<char> used_pages(header.num_pages, 0);
+  std::vector<PageId> next_pages(header.num_pages, Page::INVALID_NUMBER);
+  const PageId data_pages = header.num_pages - 1;
+  const PageId num_threads =
+      std::min<PageId>(num_threads_, (data_pages + CHUNK_PAGES - 1) /
+                                         CHUNK_PAGES);
+  std::vector<FileReport> partials(num_threads);
+  std::vector<std::thread> threads;
+  for (PageId i = 0; i < num_threads; ++i) {
+    const PageId first_page = 1 + data_pages * i / num_threads;
+    const PageId end_page = 1 + data_pages * (i + 1) / num_threads;
+    threads.push_back(std::thread(&FileAnalyzer::scanRange, this, first_page,
+                                  end_page, tiered_store.get(), &partials[i],
+                                  &used_pages, &next_pages));
+  }
+  for (std::size_t i = 0; i < threads.size(); ++i) {
+    threads[i].join();
+  }
+
+  for (std::size_t i = 0; i < partials.size(); ++i) {
+    const FileReport& partial = partials[i];
+    report.used_pages += partial.used_pages;
+    report.free_pages += partial.free_pages;
+    report.records += partial.records;
+    report.record_bytes += partial.record_bytes;
+    report.slot_bytes += partial.slot_bytes;
+    report.unused_slot_bytes += partial.unused_slot_bytes;
+    report.free_bytes += partial.free_bytes;
+    report.fragmented_bytes += partial.fragmented_bytes;
+    for (std::size_t j = 0; j < FileReport::FILL_BUCKETS; ++j) {
+      report.fill_histogram[j] += partial.fill_histogram[j];
+    }
+  }
+
+  // The next used page after each page, for spotting links that skip ahead.
+  std::vector<PageId> next_used(header.num_pages, Page::INVALID_NUMBER);
+  for (PageId page_number = header.num_pages - 1; page_number > 0;
+       --page_number) {
+    if (page_number + 1 < header.num_pages) {
+      next_used[page_number] = used_pages[page_number + 1]
+          ? page_number + 1 : next_used[page_number + 1];
+    }
+  }
+
+  // Follow both lists, stopping after num_pages steps in case of a cycle.
+  for (PageId page_number = header.first_used_page;
+       page_number != Page::INVALID_NUMBER &&
+           page_number < header.num_pages &&
+           report.used_list_length < header.num_pages;
+       page_number = next_pages[page_number]) {
+    ++report.used_list_length;
+    const PageId next_page_number = next_pages[page_number];
+    if (next_page_number == Page::INVALID_NUMBER) {
+      continue;
+    }
+    if (next_page_number < page_number) {
+      ++report.backward_links;
+    } else if (next_page_number != next_used[page_number]) {
+      ++report.skipping_links;
+    }
+  }
+  for (PageId page_number = header.first_free_page;
+       page_number != Page::INVALID_NUMBER &&
+           page_number < header.num_pages &&
+           report.free_list_length < header.num_pages;
+       page_number = next_pages[page_number]) {
+    ++report.free_list_length;
+  }
+  return report;
+}
+
+void FileAnalyzer::scanRange(const PageId first_page, const PageId end_page,
+                             const TieredStore* tiered_store,
+                             FileReport* report, std::vector<char>* used_pages,
+                             std::vector<PageId>* next_pages) const {
+  std::ifstream stream(filename_, std::ios::binary);
+  std::ifstream cold_stream;
+  if (tiered_store != NULL) {
+    cold_stream.open(TieredStore::coldFilename(filename_,
+                                               tiered_store->coldDirectory()),
+                     std::ios::binary);
+  }
+  std::vector<char> buffer;
+  Page page;
+  for (PageId chunk_start = first_page; chunk_start < end_page;
+       chunk_start += CHUNK_PAGES) {
+    const PageId chunk_pages = std::min(CHUNK_PAGES, end_page - chunk_start);
+    buffer.resize(chunk_pages * Page::SIZE);
+    stream.seekg(File::pagePosition(chunk_start), std::ios::beg);
+    stream.read(&buffer[0], buffer.size());
+    if (stream.gcount() != static_cast<std::streamsize>(buffer.size())) {
+      // Short file; whatever wasn't read is reported as free pages.
+      std::fill(buffer.begin() + stream.gcount(), buffer.end(), 0);
+      stream.clear();
+    }
+    if (tiered_store != NULL) {
+      for (PageId i = 0; i < chunk_pages; ++i) {
+        if (tiered_store->isCold(chunk_start + i)) {
+          cold_stream.seekg(tiered_store->coldPosition(chunk_start + i),
+                            std::ios::beg);
+          cold_stream.read(&buffer[i * Page::SIZE], Page::SIZE);
+        }
+      }
+    }
+
+    for (PageId i = 0; i < chunk_pages; ++i) {
+      const PageId page_number = chunk_start + i;
+      File::decodePage(&buffer[i * Page::SIZE], page);
+      (*next_pages)[page_number] = page.next_page_number();
+      if (!page.isUsed()) {
+        ++report->free_pages;
+        continue;
+      }
+      (*used_pages)[page_number] = 1;
+      ++report->used_pages;
+
+      const std::size_t slot_bytes = page.freeSpaceLowerBound();
+      const std::size_t fragmented_bytes = page.getFragmentedBytes();
+      const std::size_t record_bytes = Page::DATA_SIZE - slot_bytes -
+          page.getFreeSpace() - fragmented_bytes;
+      report->records += page.header_.num_slots - page.header_.num_free_slots;
+      report->record_bytes += record_bytes;
+      report->slot_bytes += slot_bytes;
+      report->unused_slot_bytes +=
+          page.header_.num_free_slots * sizeof(PageSlot);
+      report->free_bytes += page.getFreeSpace();
+      report->fragmented_bytes += fragmented_bytes;
+      const std::size_t bucket = std::min(
+          FileReport::FILL_BUCKETS - 1,
+          record_bytes * FileReport::FILL_BUCKETS / Page::DATA_SIZE);
+      ++report->fill_histogram[bucket];
+    }
+  }
+}
+
+}
@@ -0,0 +1,197 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "file.h"
+#include "page.h"
+#include "tiered_store.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Space usage of a data file, as measured by FileAnalyzer.
+ */
+struct FileReport {
+  /**
+   * Number of buckets in <fill_histogram>.
+   */
+  static const std::size_t FILL_BUCKETS = 10;
+
+  /**
+   * Number of pages in the file, including the header page.
+   */
+  PageId num_pages;
+
+  /**
+   * Number of pages holding data.
+   */
+  PageId used_pages;
+
+  /**
+   * Number of free pages found on disk.
+   */
+  PageId free_pages;
+
+  /**
+   * Number of pages on the free list, found by following it.  Differs from
+   * <free_pages> only if the file is damaged.
+   */
+  PageId free_list_length;
+
+  /**
+   * Number of pages on the used list, found by following it.  Differs from
+   * <used_pages> only if the file is damaged.
+   */
+  PageId used_list_length;
+
+  /**
+   * Links in the used list that go to a lower page number, i.e. backwards on
+   * disk.
+   */
+  PageId backward_links;
+
+  /**
+   * Links in the used list that skip over other used pages.  Together with
+   * <backward_links> this is the number of seeks a scan in list order makes
+   * that a scan in physical order doesn't.
+   */
+  PageId skipping_links;
+
+  /**
+   * Number of records in the file.
+   */
+  std::uint64_t records;
+
+  /**
+   * Bytes of record data.
+   */
+  std::uint64_t record_bytes;
+
+  /**
+   * Bytes taken by slot arrays, counting both used and unused slots.
+   */
+  std::uint64_t slot_bytes;
+
+  /**
+   * Bytes taken by unused slots in the middle of slot arrays.
+   */
+  std::uint64_t unused_slot_bytes;
+
+  /**
+   * Free bytes between slot arrays and record data.
+   */
+  std::uint64_t free_bytes;
+
+  /**
+   * Free bytes in holes between records, which only become usable once their
+   * pages are compacted (see BufMgr::defragment()).
+   */
+  std::uint64_t fragmented_bytes;
+
+  /**
+   * Number of used pages whose record data fills [10 * i, 10 * (i + 1))
+   * percent of Page::DATA_SIZE, with full pages in the last bucket.
+   */
+  std::vector<PageId> fill_histogram;
+
+  FileReport()
+      : num_pages(0),
+        used_pages(0),
+        free_pages(0),
+        free_list_length(0),
+        used_list_length(0),
+        backward_links(0),
+        skipping_links(0),
+        records(0),
+        record_bytes(0),
+        slot_bytes(0),
+        unused_slot_bytes(0),
+        free_bytes(0),
+        fragmented_bytes(0),
+        fill_histogram(FILL_BUCKETS, 0) {
+  }
+
+  /**
+   * Writes the report in human-readable form.
+   *
+   * @param out   Stream to write to.
+   */
+  void print(std::ostream& out) const;
+};
+
+/**
+ * @brief Measures how full and how fragmented a data file is.
+ *
+ * The analyzer reads the file directly, not through a File or a buffer
+ * manager, splitting the pages between several threads that each read their
+ * share in large sequential chunks.  Changes that are still only in a buffer
+ * pool are not seen, so flush the file first for exact numbers.  Pages of a
+ * tiered file that are in the slow tier are read from there.  The file is
+ * never written.
+ */
+class FileAnalyzer {
+ public:
+  /**
+   * Prepares an analysis of the given file.
+   *
+   * @param filename      Name of the file to analyze.
+   * @param num_threads   Number of reader threads; zero picks one per
+   *                      hardware thread.
+   */
+  FileAnalyzer(const std::string& filename,
+               const std::uint32_t num_threads = 0);
+
+  /**
+   * Scans the file and returns its report.
+   *
+   * @return  Space usage of the file.
+   * @throws  FileNotFoundException   If the file doesn't exist.
+   */
+  FileReport analyze() const;
+
+ private:
+  /**
+   * Scans pages [first_page, end_page) of the file into <report>, recording
+   * for each page whether it is used and what its next page number is.
+   * Threads scanning disjoint ranges may share the output vectors.
+   *
+   * @param first_page  First page to scan.
+   * @param end_page    Page after the last page to scan.
+   * @param tiered_store  Slow tier of the file, or NULL if it isn't tiered.
+   * @param report      Receives the counts for the pages scanned.
+   * @param used_pages  Set to 1 for used pages, indexed by page number.
+   * @param next_pages  Next page numbers, indexed by page number.
+   */
+  void scanRange(const PageId first_page, const PageId end_page,
+                 const TieredStore* tiered_store, FileReport* report,
+                 std::vector<char>* used_pages,
+                 std::vector<PageId>* next_pages) const;
+
+  /**
+   * Number of pages read with one I/O.
+   */
+  static const PageId CHUNK_PAGES = 64;
+
+  /**
+   * Name of the file to analyze.
+   */
+  std::string filename_;
+
+  /**
+   * Number of reader threads.
+   */
+  std::uint32_t num_threads_;
+};
+
+}
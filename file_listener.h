@@ -0,0 +1,47 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include "page.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Interface for objects that watch the pages of a file change on disk.
+ *
+ * Listeners are attached with File::addListener() and are called by every
+ * File object for the same underlying file, for every change made through
+ * File, including page writes made by a buffer manager.  Page 0 stands for the
+ * file header.  Listeners must not modify the file from inside a call.
+ */
+class FileListener {
+ public:
+  virtual ~FileListener() {}
+
+  /**
+   * Called before a page is overwritten or dropped from the end of the file.
+   * The page on disk still has its old contents.
+   *
+   * @param page_number   Number of the page about to change.
+   */
+  virtual void beforePageChange(const PageId page_number) = 0;
+
+  /**
+   * Called after a page has been written.
+   *
+   * @param page_number   Number of the page written.
+   * @param page          Contents written, or NULL if only the header of the
+   *                      page (or the file header) was written.  The next page
+   *                      number in the page's header may differ from the one
+   *                      on disk.
+   */
+  virtual void afterPageWrite(const PageId page_number, const Page* page) = 0;
+};
+
+}
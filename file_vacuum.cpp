@@ -0,0 +1,182 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "file_vacuum.h"
+
+#include <algorithm>
+#include <string>
+
+#include "exceptions/invalid_page_exception.h"
+#include "page_iterator.h"
+
+namespace badgerdb {
+
+FileVacuum::FileVacuum(BufMgr* buf_mgr, File* file,
+                       const std::uint32_t sparse_percent)
+    : buf_mgr_(buf_mgr),
+      file_(file),
+      sparse_percent_(sparse_percent),
+      phase_(PLAN),
+      next_to_plan_(file->readHeader().first_used_page),
+      target_(0),
+      source_(0),
+      pages_freed_(0) {
+}
+
+bool FileVacuum::step(const std::uint32_t io_budget) {
+  const BufStats& stats = buf_mgr_->getBufStats();
+  std::uint32_t io_used = 0;
+  while (phase_ != DONE && io_used < io_budget) {
+    const int buffer_io_before = stats.diskreads + stats.diskwrites;
+    switch (phase_) {
+      case PLAN:
+        io_used += planNext();
+        break;
+      case MOVE:
+        moveNext();
+        break;
+      case TRUNCATE: {
+        // Through the buffer manager, so that the file isn't shrunk under
+        // I/O its scheduler is doing.
+        std::uint32_t page_io = 0;
+        File* file = file_;
+        buf_mgr_->runFileOperation(
+            [&page_io, file]() { page_io = file->truncate(); });
+        io_used += page_io;
+        phase_ = DONE;
+        break;
+      }
+      case DONE:
+        break;
+    }
+    const int buffer_io = stats.diskreads + stats.diskwrites - buffer_io_before;
+    if (buffer_io > 0) {
+      io_used += buffer_io;
+    }
+  }
+  return phase_ == DONE;
+}
+
+void FileVacuum::run() {
+  while (!step(1)) {
+  }
+}
+
+RecordId FileVacuum::resolve(const RecordId& record_id) const {
+  std::map<RecordId, RecordId>::const_iterator iter =
+      relocations_.find(record_id);
+  return iter == relocations_.end() ? record_id : iter->second;
+}
+
+std::uint32_t FileVacuum::planNext() {
+  if (next_to_plan_ == Page::INVALID_NUMBER) {
+    std::sort(pages_.begin(), pages_.end());
+    if (pages_.empty()) {
+      phase_ = TRUNCATE;
+    } else {
+      source_ = pages_.size() - 1;
+      phase_ = MOVE;
+    }
+    return 0;
+  }
+  PageHeader header;
+  File* file = file_;
+  const PageId page_number = next_to_plan_;
+  buf_mgr_->runFileOperation([&header, file, page_number]() {
+    header = file->readPageHeader(page_number);
+  });
+  PagePlan plan;
+  plan.page_number = next_to_plan_;
+  plan.free_space = header.free_space_upper_bound -
+      header.num_slots * sizeof(PageSlot);
+  plan.keep = false;
+  pages_.push_back(plan);
+  next_to_plan_ = header.next_page_number;
+  return 1;
+}
+
+void FileVacuum::moveNext() {
+  while (source_ > target_ &&
+         (pages_[source_].keep || !isSparse(pages_[source_]))) {
+    --source_;
+  }
+  if (source_ <= target_) {
+    phase_ = TRUNCATE;
+    return;
+  }
+
+  const PageId source_number = pages_[source_].page_number;
+  Page* source_page;
+  try {
+    buf_mgr_->readPage(file_, source_number, source_page);
+  } catch (const InvalidPageException&) {
+    // Deleted since we planned; nothing left to move.
+    --source_;
+    return;
+  }
+  const SlotId slot_number =
+      PageIterator(source_page).getNextUsedSlot(Page::INVALID_SLOT);
+  if (slot_number == Page::INVALID_SLOT) {
+    buf_mgr_->unPinPage(file_, source_number, false);
+    buf_mgr_->disposePage(file_, source_number);
+    ++pages_freed_;
+    --source_;
+    return;
+  }
+  const RecordId record_id = {source_number, slot_number};
+  const std::string& record = source_page->getRecord(record_id);
+
+  // First fit among the pages before the source.  Pages known to be full are
+  // skipped for good.
+  Page* target_page = NULL;
+  std::size_t target = target_;
+  for (; target < source_; ++target) {
+    PagePlan& plan = pages_[target];
+    if (plan.free_space < record.length()) {
+      continue;
+    }
+    try {
+      buf_mgr_->readPage(file_, plan.page_number, target_page);
+    } catch (const InvalidPageException&) {
+      plan.free_space = 0;
+      continue;
+    }
+    if (target_page->hasSpaceForRecord(record)) {
+      break;
+    }
+    plan.free_space = target_page->getFreeSpace();
+    buf_mgr_->unPinPage(file_, plan.page_number, false);
+    target_page = NULL;
+  }
+  while (target_ < source_ && pages_[target_].free_space <= sizeof(PageSlot)) {
+    ++target_;
+  }
+  if (target_page == NULL) {
+    // Nothing before this page can take the record, so the source stays.
+    buf_mgr_->unPinPage(file_, source_number, false);
+    pages_[source_].keep = true;
+    return;
+  }
+
+  PagePlan& target_plan = pages_[target];
+  const RecordId new_record_id = target_page->insertRecord(record);
+  target_plan.free_space = target_page->getFreeSpace();
+  target_plan.keep = true;
+  buf_mgr_->unPinPage(file_, target_plan.page_number, true);
+
+  source_page->deleteRecord(record_id);
+  pages_[source_].free_space = source_page->getFreeSpace();
+  buf_mgr_->unPinPage(file_, source_number, true);
+  relocations_[record_id] = new_record_id;
+}
+
+bool FileVacuum::isSparse(const PagePlan& plan) const {
+  const std::size_t used_space = Page::DATA_SIZE - plan.free_space;
+  return used_space * 100 < sparse_percent_ * Page::DATA_SIZE;
+}
+
+}
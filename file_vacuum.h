@@ -0,0 +1,209 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <map>
+#include <vector>
+
+#include "buffer.h"
+#include "file.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Incremental compaction of a file through the buffer manager.
+ *
+ * A vacuum moves the records of sparsely filled pages near the end of a file
+ * into pages with free space near its start, deletes the pages it empties,
+ * and finally truncates the free pages off the end of the file.  Every record
+ * that moves gets a new RecordId; callers holding record IDs (e.g. in an
+ * index) look them up with resolve() or walk relocations().
+ *
+ * The work is split into small units so that it can be interleaved with
+ * foreground work: each call to step() does at most roughly the given number
+ * of page I/Os and then returns.  All record moves go through the buffer
+ * manager, so the file may stay in use between steps.  Pages pinned by
+ * others are still read and modified, so callers must not hold pages of the
+ * file pinned across a step.
+ *
+ * Pages are planned from their headers, so the space in holes left by deletes
+ * only counts once a page has been compacted (see BufMgr::defragment()).
+ *
+ * @warning This class is not threadsafe.
+ */
+class FileVacuum {
+ public:
+  /**
+   * Prepares a vacuum of the given file.  No work is done until step() is
+   * called.
+   *
+   * @param buf_mgr         Buffer manager used to read and modify pages.
+   * @param file            File to compact.
+   * @param sparse_percent  Pages whose records occupy less than this
+   *                        percentage of Page::DATA_SIZE are emptied.
+   */
+  FileVacuum(BufMgr* buf_mgr, File* file,
+             const std::uint32_t sparse_percent = 50);
+
+  /**
+   * Does up to <io_budget> page reads and writes worth of work.  Work that is
+   * satisfied from the buffer pool doesn't count against the budget.
+   *
+   * @param io_budget   Number of page I/Os allowed for this step.
+   * @return  True if the vacuum has finished.
+   */
+  bool step(const std::uint32_t io_budget);
+
+  /**
+   * Runs the vacuum to completion.
+   */
+  void run();
+
+  /**
+   * Returns true if the vacuum has finished.
+   */
+  bool done() const { return phase_ == DONE; }
+
+  /**
+   * Returns the current ID of a record, which differs from the given one if
+   * the vacuum moved the record.
+   *
+   * @param record_id   ID the record had before the vacuum started.
+   * @return  ID of the record now.
+   */
+  RecordId resolve(const RecordId& record_id) const;
+
+  /**
+   * Returns all record moves so far, mapping old record IDs to new ones.
+   */
+  const std::map<RecordId, RecordId>& relocations() const {
+    return relocations_;
+  }
+
+  /**
+   * Returns the number of records moved so far.
+   */
+  std::uint32_t recordsMoved() const { return relocations_.size(); }
+
+  /**
+   * Returns the number of pages emptied and deleted so far.
+   */
+  std::uint32_t pagesFreed() const { return pages_freed_; }
+
+ private:
+  /**
+   * Stages of the vacuum.
+   */
+  enum Phase {
+    PLAN,      // Reading page headers to find page fill.
+    MOVE,      // Moving records from sparse pages to fuller ones.
+    TRUNCATE,  // Dropping free pages from the end of the file.
+    DONE
+  };
+
+  /**
+   * What the vacuum knows about a used page of the file.
+   */
+  struct PagePlan {
+    /**
+     * Number of the page.
+     */
+    PageId page_number;
+
+    /**
+     * Last known free space on the page in bytes.
+     */
+    std::size_t free_space;
+
+    /**
+     * Whether the page must keep its records, either because records have
+     * been moved onto it (so no record moves twice) or because no earlier
+     * page has room for them.
+     */
+    bool keep;
+
+    bool operator<(const PagePlan& rhs) const {
+      return page_number < rhs.page_number;
+    }
+  };
+
+  /**
+   * Reads the header of the next page in the file's used list.
+   *
+   * @return  Number of page I/Os done.
+   */
+  std::uint32_t planNext();
+
+  /**
+   * Moves one record off the current source page, or deletes the source page
+   * if it has become empty.
+   */
+  void moveNext();
+
+  /**
+   * Returns true if the planned page is sparse enough to be emptied.
+   *
+   * @param plan  Page to check.
+   * @return  Whether the page should be emptied.
+   */
+  bool isSparse(const PagePlan& plan) const;
+
+  /**
+   * Buffer manager used to access pages.
+   */
+  BufMgr* buf_mgr_;
+
+  /**
+   * File being compacted.
+   */
+  File* file_;
+
+  /**
+   * Fill percentage below which pages are emptied.
+   */
+  std::uint32_t sparse_percent_;
+
+  /**
+   * Current stage.
+   */
+  Phase phase_;
+
+  /**
+   * Next page in the used list whose header has to be read.
+   */
+  PageId next_to_plan_;
+
+  /**
+   * Used pages of the file in page number order.
+   */
+  std::vector<PagePlan> pages_;
+
+  /**
+   * Index in <pages_> of the first page that may still take records.
+   */
+  std::size_t target_;
+
+  /**
+   * Index in <pages_> of the page currently being emptied.  Pages are emptied
+   * from the end of the file towards <target_>.
+   */
+  std::size_t source_;
+
+  /**
+   * Number of pages deleted.
+   */
+  std::uint32_t pages_freed_;
+
+  /**
+   * Old to new record IDs of moved records.
+   */
+  std::map<RecordId, RecordId> relocations_;
+};
+
+}
@@ -0,0 +1,216 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "flash_cache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "exceptions/file_not_found_exception.h"
+#include "file.h"
+
+namespace badgerdb {
+
+FlashCache::FlashCache(const std::string& cache_filename,
+                       const std::uint32_t capacity)
+    : cache_filename_(cache_filename),
+      fd_(::open(cache_filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644)),
+      capacity_(capacity),
+      stopping_(false),
+      in_flight_(0),
+      clock_hand_(0) {
+  if (fd_ < 0) {
+    throw FileNotFoundException(cache_filename_);
+  }
+  writer_ = std::thread(&FlashCache::writerLoop, this);
+}
+
+FlashCache::~FlashCache() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  cond_.notify_all();
+  writer_.join();
+  ::close(fd_);
+  std::remove(cache_filename_.c_str());
+}
+
+void FlashCache::insert(const File* file, const PageId page_number,
+                        const Page& page) {
+  const PageKey& key = pageKey(file, page_number);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.offered;
+    if (capacity_ == 0 || index_.count(key) > 0 || pending_.count(key) > 0) {
+      return;
+    }
+    if (ghost_set_.erase(key) == 0) {
+      // First sighting: remember it, admit it if it comes back.
+      ghosts_.push_back(key);
+      ghost_set_.insert(key);
+      if (ghosts_.size() > capacity_) {
+        ghost_set_.erase(ghosts_.front());
+        ghosts_.pop_front();
+      }
+      return;
+    }
+    ++stats_.admitted;
+    pending_[key] = page;
+    queue_.push_back(key);
+  }
+  cond_.notify_all();
+}
+
+bool FlashCache::lookup(const File* file, const PageId page_number,
+                        Page& page) {
+  const PageKey& key = pageKey(file, page_number);
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++stats_.lookups;
+  const std::map<PageKey, Page>::const_iterator pending_iter =
+      pending_.find(key);
+  if (pending_iter != pending_.end()) {
+    page = pending_iter->second;
+    ++stats_.hits;
+    return true;
+  }
+  const std::map<PageKey, CachedPage>::const_iterator iter = index_.find(key);
+  if (iter == index_.end()) {
+    return false;
+  }
+  // The read happens under the lock so the writer can't reuse the slot
+  // halfway through it.
+  std::vector<char> buffer(Page::SIZE);
+  const off_t position = static_cast<off_t>(iter->second.slot) * Page::SIZE;
+  if (::pread(fd_, &buffer[0], Page::SIZE, position) !=
+      static_cast<ssize_t>(Page::SIZE)) {
+    return false;
+  }
+  std::memcpy(&page.header_, &buffer[0], sizeof(page.header_));
+  std::memcpy(&page.data_[0], &buffer[sizeof(page.header_)], Page::DATA_SIZE);
+  page.reservation_ = iter->second.reservation;
+  slot_referenced_[iter->second.slot] = true;
+  ++stats_.hits;
+  return true;
+}
+
+void FlashCache::invalidate(const File* file, const PageId page_number) {
+  const PageKey& key = pageKey(file, page_number);
+  std::lock_guard<std::mutex> lock(mutex_);
+  // A queued copy is dropped from <pending_>; the writer skips keys it can't
+  // find there.
+  pending_.erase(key);
+  const std::map<PageKey, CachedPage>::iterator iter = index_.find(key);
+  if (iter != index_.end()) {
+    free_slots_.push_back(iter->second.slot);
+    index_.erase(iter);
+  }
+}
+
+void FlashCache::drain() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!queue_.empty() || in_flight_ > 0) {
+    cond_.wait(lock);
+  }
+}
+
+FlashCacheStats FlashCache::stats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+FlashCache::PageKey FlashCache::pageKey(const File* file,
+                                        const PageId page_number) {
+  return PageKey(file->filename(), file->incarnation(), page_number,
+                 file->pageIncarnation(page_number));
+}
+
+void FlashCache::writerLoop() {
+  std::vector<char> buffer(Page::SIZE);
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    while (!stopping_ && queue_.empty()) {
+      cond_.wait(lock);
+    }
+    if (stopping_) {
+      return;
+    }
+    const PageKey key = queue_.front();
+    queue_.pop_front();
+    std::map<PageKey, Page>::iterator pending_iter = pending_.find(key);
+    if (pending_iter == pending_.end()) {
+      // Invalidated while queued.
+      cond_.notify_all();
+      continue;
+    }
+    const Page& page = pending_iter->second;
+    std::memcpy(&buffer[0], &page.header_, sizeof(page.header_));
+    std::memcpy(&buffer[sizeof(page.header_)], &page.data_[0],
+                Page::DATA_SIZE);
+    SpaceReservation* const reservation = page.reservation_;
+    const std::uint32_t slot = chooseSlot();
+    ++in_flight_;
+
+    lock.unlock();
+    const off_t position = static_cast<off_t>(slot) * Page::SIZE;
+    const bool written = ::pwrite(fd_, &buffer[0], Page::SIZE, position) ==
+        static_cast<ssize_t>(Page::SIZE);
+    lock.lock();
+
+    --in_flight_;
+    ++stats_.writes;
+    pending_iter = pending_.find(key);
+    if (written && pending_iter != pending_.end()) {
+      CachedPage& cached = index_[key];
+      cached.slot = slot;
+      cached.reservation = reservation;
+      slot_keys_[slot] = key;
+      slot_referenced_[slot] = false;
+      pending_.erase(pending_iter);
+    } else {
+      // Invalidated during the write, or the write failed.
+      pending_.erase(key);
+      free_slots_.push_back(slot);
+    }
+    cond_.notify_all();
+  }
+}
+
+std::uint32_t FlashCache::chooseSlot() {
+  if (!free_slots_.empty()) {
+    const std::uint32_t slot = free_slots_.back();
+    free_slots_.pop_back();
+    return slot;
+  }
+  if (slot_keys_.size() < capacity_) {
+    slot_keys_.push_back(PageKey());
+    slot_referenced_.push_back(false);
+    return slot_keys_.size() - 1;
+  }
+  // Clock over the slots.  Every slot is in use (none are free and the file
+  // is at capacity), so this ends within two passes.
+  while (true) {
+    const std::uint32_t slot = clock_hand_;
+    clock_hand_ = (clock_hand_ + 1) % capacity_;
+    if (slot_referenced_[slot]) {
+      slot_referenced_[slot] = false;
+      continue;
+    }
+    // The slot's old page may have been invalidated and cached again in
+    // another slot since; that copy stays.
+    const std::map<PageKey, CachedPage>::iterator iter =
+        index_.find(slot_keys_[slot]);
+    if (iter != index_.end() && iter->second.slot == slot) {
+      index_.erase(iter);
+    }
+    return slot;
+  }
+}
+
+}
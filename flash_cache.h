@@ -0,0 +1,287 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "page.h"
+#include "types.h"
+
+namespace badgerdb {
+
+class File;
+
+/**
+ * @brief Counters kept by a FlashCache.
+ */
+struct FlashCacheStats {
+  /**
+   * Number of lookups.
+   */
+  std::uint64_t lookups;
+
+  /**
+   * Number of lookups answered from the cache.
+   */
+  std::uint64_t hits;
+
+  /**
+   * Number of evicted pages offered to the cache.
+   */
+  std::uint64_t offered;
+
+  /**
+   * Number of offered pages admitted.
+   */
+  std::uint64_t admitted;
+
+  /**
+   * Number of pages written to the cache file.
+   */
+  std::uint64_t writes;
+
+  FlashCacheStats()
+      : lookups(0),
+        hits(0),
+        offered(0),
+        admitted(0),
+        writes(0) {
+  }
+};
+
+/**
+ * @brief Second-level cache of clean pages evicted from a buffer pool, kept
+ *        in a file on fast local storage.
+ *
+ * BufMgr offers every clean page it evicts to the cache (see
+ * BufMgr::setFlashCache()) and looks pages up here before reading them from
+ * their file.  Offered pages are copied to the cache file by a background
+ * thread, so eviction never waits for the cache.
+ *
+ * To keep one-off scans from flushing the cache, a page is only admitted the
+ * second time it is offered within a window of recently offered pages; the
+ * first time only its ID is remembered.  When the cache file is full, slots
+ * are reused in clock order, skipping slots hit since the clock last passed.
+ *
+ * The cache only stays correct if its pages are written solely through the
+ * buffer manager it is attached to, which invalidates a page whenever it
+ * writes or disposes of it.  Pages are cached under the incarnations of their
+ * file and of the page itself (see File::incarnation() and
+ * File::pageIncarnation()), so copies left over from before a file was
+ * created anew or a page was deleted are never returned; they age out of the
+ * cache like any unused page.  The cache file is recreated empty on
+ * construction and deleted on destruction.
+ *
+ * All public methods are threadsafe.
+ */
+class FlashCache {
+ public:
+  /**
+   * Creates an empty cache and starts its writer thread.
+   *
+   * @param cache_filename  File to hold cached pages; overwritten if present.
+   * @param capacity        Maximum number of pages cached.
+   * @throws  FileNotFoundException   If the cache file can't be created.
+   */
+  FlashCache(const std::string& cache_filename, const std::uint32_t capacity);
+
+  /**
+   * Stops the writer thread, dropping writes that haven't happened yet, and
+   * deletes the cache file.
+   */
+  ~FlashCache();
+
+  /**
+   * Offers a clean page that is being evicted from the buffer pool.
+   *
+   * @param file          File the page belongs to.
+   * @param page_number   Number of the page.
+   * @param page          Contents of the page.
+   */
+  void insert(const File* file, const PageId page_number, const Page& page);
+
+  /**
+   * Looks a page up in the cache.
+   *
+   * @param file          File the page belongs to.
+   * @param page_number   Number of the page.
+   * @param page          Receives the page on a hit.
+   * @return  True on a hit.
+   */
+  bool lookup(const File* file, const PageId page_number, Page& page);
+
+  /**
+   * Drops any cached copy of a page, e.g. because the page was written back
+   * to its file or deleted.
+   *
+   * @param file          File the page belongs to.
+   * @param page_number   Number of the page.
+   */
+  void invalidate(const File* file, const PageId page_number);
+
+  /**
+   * Waits until every admitted page has been written to the cache file.
+   */
+  void drain();
+
+  /**
+   * Returns a snapshot of the cache's counters.
+   */
+  FlashCacheStats stats();
+
+ private:
+  /**
+   * Identifies a page: file name, incarnation of the file, page number and
+   * incarnation of the page.
+   */
+  typedef std::tuple<std::string, std::uint64_t, PageId, std::uint64_t>
+      PageKey;
+
+  /**
+   * Returns the key of a page of a file in their current incarnations.
+   *
+   * @param file          File the page belongs to.
+   * @param page_number   Number of the page.
+   * @return  Key of the page.
+   */
+  static PageKey pageKey(const File* file, const PageId page_number);
+
+  /**
+   * Where a cached page is stored, plus the in-memory state of the page that
+   * isn't written to the cache file.
+   */
+  struct CachedPage {
+    /**
+     * Slot in the cache file.
+     */
+    std::uint32_t slot;
+
+    /**
+     * Space reservation of the page's file.
+     */
+    SpaceReservation* reservation;
+  };
+
+  /**
+   * Pulls admitted pages off the queue and writes them to the cache file
+   * until the cache is destroyed.
+   */
+  void writerLoop();
+
+  /**
+   * Picks the slot for the next page to cache, dropping the page it held, if
+   * it still holds one.  Must be called with <mutex_> held.
+   *
+   * @return  Slot number.
+   */
+  std::uint32_t chooseSlot();
+
+  /**
+   * Name of the cache file.
+   */
+  std::string cache_filename_;
+
+  /**
+   * Descriptor of the cache file, used with positional reads and writes so
+   * the writer thread and lookups need no shared file position.
+   */
+  int fd_;
+
+  /**
+   * Maximum number of pages cached.
+   */
+  std::uint32_t capacity_;
+
+  /**
+   * Guards everything below.
+   */
+  std::mutex mutex_;
+
+  /**
+   * Signalled when pages are queued, when writes finish and on shutdown.
+   */
+  std::condition_variable cond_;
+
+  /**
+   * Set to stop the writer thread.
+   */
+  bool stopping_;
+
+  /**
+   * Admitted pages waiting to be written, by key.  Lookups are served from
+   * here too.
+   */
+  std::map<PageKey, Page> pending_;
+
+  /**
+   * Order in which pending pages were admitted.
+   */
+  std::deque<PageKey> queue_;
+
+  /**
+   * Number of pages the writer is writing right now (zero or one).
+   */
+  std::uint32_t in_flight_;
+
+  /**
+   * Slot of every page in the cache file.
+   */
+  std::map<PageKey, CachedPage> index_;
+
+  /**
+   * Page last written to each slot; slots past the end haven't been used
+   * yet.  A free slot keeps the key of its old page, which the index may have
+   * since placed in another slot.
+   */
+  std::vector<PageKey> slot_keys_;
+
+  /**
+   * Whether each slot has been hit since the clock last passed it.
+   */
+  std::vector<bool> slot_referenced_;
+
+  /**
+   * Slots not holding a page.
+   */
+  std::vector<std::uint32_t> free_slots_;
+
+  /**
+   * Next slot the clock looks at when the cache is full.
+   */
+  std::uint32_t clock_hand_;
+
+  /**
+   * Recently offered pages that weren't admitted, oldest first, with a set for
+   * lookups.  Holds up to <capacity_> keys.
+   */
+  std::list<PageKey> ghosts_;
+  std::set<PageKey> ghost_set_;
+
+  /**
+   * Counters.
+   */
+  FlashCacheStats stats_;
+
+  /**
+   * Thread writing admitted pages to the cache file.
+   */
+  std::thread writer_;
+};
+
+}
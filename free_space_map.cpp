@@ -0,0 +1,177 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "free_space_map.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#include "exceptions/io_error_exception.h"
+#include "file_iterator.h"
+
+namespace badgerdb {
+
+namespace {
+
+/**
+ * Page number of the root page in the map file.
+ */
+const PageId ROOT_PAGE = 1;
+
+/**
+ * Page number of the first leaf page in the map file.  Pages in the map file
+ * are never deleted, so leaf i is always page FIRST_LEAF_PAGE + i.
+ */
+const PageId FIRST_LEAF_PAGE = 2;
+
+}
+
+FreeSpaceMap::FreeSpaceMap(const std::string& data_filename,
+                           const bool create_new)
+    : map_file_(create_new ? File::create(mapFilename(data_filename))
+                           : File::open(mapFilename(data_filename))),
+      num_leaves_(0) {
+  if (create_new) {
+    root_ = map_file_.allocatePage();
+  } else {
+    root_ = map_file_.readPage(ROOT_PAGE);
+    num_leaves_ = map_file_.readHeader().num_pages - FIRST_LEAF_PAGE;
+  }
+}
+
+FreeSpaceMap::FreeSpaceMap(const std::string& map_filename)
+    : map_file_(File::create(map_filename)),
+      root_(map_file_.allocatePage()),
+      num_leaves_(0) {
+}
+
+void FreeSpaceMap::build(File& data_file) {
+  const std::string& map_filename = mapFilename(data_file.filename());
+  const std::string& temp_filename = map_filename + ".tmp";
+  // Left behind by a build that didn't finish.
+  if (File::exists(temp_filename)) {
+    File::remove(temp_filename);
+  }
+  {
+    FreeSpaceMap free_space_map(temp_filename);
+    for (FileIterator iter = data_file.begin(); iter != data_file.end();
+         ++iter) {
+      const Page& page = *iter;
+      free_space_map.update(page.page_number(), page.getFreeSpace());
+    }
+  }
+  if (std::rename(temp_filename.c_str(), map_filename.c_str()) != 0) {
+    throw IoErrorException(map_filename, 0 /* page_number */, "rename");
+  }
+}
+
+void FreeSpaceMap::update(const PageId page_number,
+                          const std::size_t free_bytes) {
+  const std::uint32_t leaf = page_number / ENTRIES_PER_LEAF;
+  if (leaf >= MAX_LEAVES) {
+    return;
+  }
+  const std::uint8_t value = category(free_bytes);
+  if (leaf >= num_leaves_ && value == 0) {
+    // Leaves that don't exist yet read as all zero, so there is nothing to do.
+    return;
+  }
+  Page& leaf_page = getLeaf(leaf);
+  const std::size_t entry = page_number % ENTRIES_PER_LEAF;
+  const std::uint8_t old_value = getEntry(leaf_page, entry);
+  if (old_value == value) {
+    return;
+  }
+  setEntry(leaf_page, entry, value);
+  map_file_.writePage(leaf_page);
+
+  // Keep the root's summary of this leaf exact so searches never visit a
+  // leaf that can't satisfy them.
+  const std::uint8_t leaf_max = root_.data_[leaf];
+  std::uint8_t new_max = leaf_max;
+  if (value > leaf_max) {
+    new_max = value;
+  } else if (old_value == leaf_max) {
+    new_max = 0;
+    for (std::size_t i = 0; i < Page::DATA_SIZE && new_max < leaf_max; ++i) {
+      const std::uint8_t byte = leaf_page.data_[i];
+      new_max = std::max<std::uint8_t>(new_max, byte & 0x0f);
+      new_max = std::max<std::uint8_t>(new_max, byte >> 4);
+    }
+  }
+  if (new_max != leaf_max) {
+    root_.data_[leaf] = new_max;
+    map_file_.writePage(root_);
+  }
+}
+
+PageId FreeSpaceMap::findPage(const std::size_t bytes, const PageId after) {
+  std::size_t needed = (bytes + CATEGORY_SIZE - 1) / CATEGORY_SIZE;
+  if (needed == 0) {
+    needed = 1;
+  } else if (needed >= NUM_CATEGORIES) {
+    needed = NUM_CATEGORIES - 1;
+  }
+  const std::size_t start = static_cast<std::size_t>(after) + 1;
+  for (std::uint32_t leaf = start / ENTRIES_PER_LEAF; leaf < num_leaves_;
+       ++leaf) {
+    if (static_cast<std::uint8_t>(root_.data_[leaf]) < needed) {
+      continue;
+    }
+    const Page& leaf_page = getLeaf(leaf);
+    const std::size_t first_entry =
+        (leaf == start / ENTRIES_PER_LEAF) ? start % ENTRIES_PER_LEAF : 0;
+    for (std::size_t entry = first_entry; entry < ENTRIES_PER_LEAF; ++entry) {
+      if (getEntry(leaf_page, entry) >= needed) {
+        return leaf * ENTRIES_PER_LEAF + entry;
+      }
+    }
+  }
+  return Page::INVALID_NUMBER;
+}
+
+std::uint8_t FreeSpaceMap::category(const std::size_t free_bytes) {
+  const std::size_t value = free_bytes / CATEGORY_SIZE;
+  return value >= NUM_CATEGORIES ? NUM_CATEGORIES - 1 : value;
+}
+
+std::uint8_t FreeSpaceMap::getEntry(const Page& leaf_page,
+                                    const std::size_t entry) {
+  const std::uint8_t byte = leaf_page.data_[entry / 2];
+  return (entry % 2 == 0) ? (byte & 0x0f) : (byte >> 4);
+}
+
+void FreeSpaceMap::setEntry(Page& leaf_page, const std::size_t entry,
+                            const std::uint8_t value) {
+  std::uint8_t byte = leaf_page.data_[entry / 2];
+  if (entry % 2 == 0) {
+    byte = (byte & 0xf0) | value;
+  } else {
+    byte = (byte & 0x0f) | (value << 4);
+  }
+  leaf_page.data_[entry / 2] = byte;
+}
+
+Page& FreeSpaceMap::getLeaf(const std::uint32_t leaf) {
+  std::map<std::uint32_t, Page>::iterator iter = leaves_.find(leaf);
+  if (iter != leaves_.end()) {
+    return iter->second;
+  }
+  // Leaves are allocated in order, so allocate any missing ones before this.
+  while (num_leaves_ <= leaf) {
+    leaves_[num_leaves_] = map_file_.allocatePage();
+    ++num_leaves_;
+  }
+  iter = leaves_.find(leaf);
+  if (iter == leaves_.end()) {
+    iter = leaves_.insert(
+        std::make_pair(leaf, map_file_.readPage(FIRST_LEAF_PAGE + leaf))).first;
+  }
+  return iter->second;
+}
+
+}
@@ -0,0 +1,183 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <string>
+
+#include "file.h"
+#include "page.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Persistent map from page number to a coarse free-space category.
+ *
+ * Each page of a data file gets a 4-bit entry recording roughly how much free
+ * space it has.  The entries are stored in the pages of a companion file
+ * (named after the data file with a ".fsm" suffix): page 1 of the companion is
+ * a root page holding, for every leaf page, the highest category in that leaf,
+ * and pages 2 onwards are leaf pages holding the entries themselves.  Finding
+ * a page with room for a record therefore reads at most the root and one leaf,
+ * no matter how large the data file is.
+ *
+ * Entries are hints.  They are updated whenever a page is written to the data
+ * file, and by BufMgr whenever a page is unpinned dirty, so they follow the
+ * newest copy of a page whether or not it has been written back yet.
+ *
+ * @warning This class is not threadsafe.
+ */
+class FreeSpaceMap {
+ public:
+  /**
+   * Number of free-space categories an entry can hold.
+   */
+  static const std::uint8_t NUM_CATEGORIES = 16;
+
+  /**
+   * Number of bytes of free space represented by one category step.  A page in
+   * category c has at least c * CATEGORY_SIZE bytes free.
+   */
+  static const std::size_t CATEGORY_SIZE =
+      (Page::DATA_SIZE + NUM_CATEGORIES - 1) / NUM_CATEGORIES;
+
+  /**
+   * Number of data pages covered by one leaf page (two entries per byte).
+   */
+  static const std::size_t ENTRIES_PER_LEAF = Page::DATA_SIZE * 2;
+
+  /**
+   * Maximum number of leaf pages (one root byte per leaf).  Data pages beyond
+   * MAX_LEAVES * ENTRIES_PER_LEAF are not tracked.
+   */
+  static const std::size_t MAX_LEAVES = Page::DATA_SIZE;
+
+  /**
+   * Returns the name of the companion file holding the map for a data file.
+   *
+   * @param data_filename   Name of the data file.
+   * @return  Name of the free-space map file.
+   */
+  static std::string mapFilename(const std::string& data_filename) {
+    return data_filename + ".fsm";
+  }
+
+  /**
+   * Opens the free-space map of a data file, creating an empty one if
+   * requested.
+   *
+   * @param data_filename   Name of the data file the map describes.
+   * @param create_new      Whether to create a new, empty map.
+   * @throws  FileExistsException     If create_new is set and the map exists.
+   * @throws  FileNotFoundException   If create_new is not set and the map
+   *                                  doesn't exist.
+   */
+  FreeSpaceMap(const std::string& data_filename, const bool create_new);
+
+  /**
+   * Builds the map of a data file from the file's current contents.  The map
+   * is written under a temporary name and renamed into place once it is
+   * complete, so a crash part way through leaves the previous map (or none)
+   * rather than a partial one.  A map already in place is replaced.
+   *
+   * @param data_file   Data file the map describes.
+   * @throws  IoErrorException  If the finished map can't be renamed into place.
+   */
+  static void build(File& data_file);
+
+  /**
+   * Records the free space of a data page.  Writes the affected map pages only
+   * if the page's category changes.
+   *
+   * @param page_number   Number of the data page.
+   * @param free_bytes    Free space on the page in bytes; zero for free
+   *                      (unallocated) pages.
+   */
+  void update(const PageId page_number, const std::size_t free_bytes);
+
+  /**
+   * Returns the lowest-numbered page after <after> whose entry says it has at
+   * least <bytes> bytes free, or Page::INVALID_NUMBER if there is none.
+   * Requests larger than the top category are answered with pages in the top
+   * category, so callers must check the page itself.
+   *
+   * @param bytes   Free space required in bytes.
+   * @param after   Page number to start searching after.
+   * @return  Candidate page number or Page::INVALID_NUMBER.
+   */
+  PageId findPage(const std::size_t bytes, const PageId after);
+
+ private:
+  /**
+   * Creates a new, empty map in the given file, for build().
+   *
+   * @param map_filename  Name of the map file to create.
+   * @throws  FileExistsException If the file exists.
+   */
+  explicit FreeSpaceMap(const std::string& map_filename);
+
+  /**
+   * Returns the category for the given amount of free space.
+   *
+   * @param free_bytes  Free space in bytes.
+   * @return  Category of the free space.
+   */
+  static std::uint8_t category(const std::size_t free_bytes);
+
+  /**
+   * Returns the entry for a page from a leaf.
+   *
+   * @param leaf_page   Leaf page.
+   * @param entry       Index of entry within the leaf.
+   * @return  Category stored in the entry.
+   */
+  static std::uint8_t getEntry(const Page& leaf_page, const std::size_t entry);
+
+  /**
+   * Stores the entry for a page into a leaf.
+   *
+   * @param leaf_page   Leaf page.
+   * @param entry       Index of entry within the leaf.
+   * @param value       Category to store.
+   */
+  static void setEntry(Page& leaf_page, const std::size_t entry,
+                       const std::uint8_t value);
+
+  /**
+   * Returns the leaf page with the given index, reading it from the map file
+   * (or allocating it and any leaves before it) the first time it is needed.
+   *
+   * @param leaf  Index of the leaf.
+   * @return  The leaf page.
+   */
+  Page& getLeaf(const std::uint32_t leaf);
+
+  /**
+   * Companion file holding the root and leaf pages.
+   */
+  File map_file_;
+
+  /**
+   * Root page, kept in memory for the life of the map.
+   */
+  Page root_;
+
+  /**
+   * Number of leaf pages allocated in the map file.
+   */
+  std::uint32_t num_leaves_;
+
+  /**
+   * Leaf pages that have been read so far.
+   */
+  std::map<std::uint32_t, Page> leaves_;
+};
+
+}
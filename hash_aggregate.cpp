@@ -0,0 +1,434 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "hash_aggregate.h"
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <thread>
+
+#include "page_iterator.h"
+
+namespace badgerdb {
+
+namespace {
+
+/**
+ * Bytes charged per hash table entry on top of its key.
+ */
+const std::size_t ENTRY_OVERHEAD = 64;
+
+/**
+ * Pages a worker takes off the input scan at a time.
+ */
+const std::size_t SCAN_BATCH_PAGES = 16;
+
+}
+
+const std::uint32_t HashAggregate::REPARTITION_FANOUT;
+const std::uint32_t HashAggregate::MAX_LEVELS;
+
+HashAggregate::Options HashAggregate::Options::defaults() {
+  Options options;
+  options.threads = std::max(1u, std::thread::hardware_concurrency());
+  options.partitions = 64;
+  options.memory_budget = 64 * 1024 * 1024;
+  options.spill_pool_frames = 256;
+  return options;
+}
+
+HashAggregate::HashAggregate(const Extractor& extractor,
+                             const Options& options)
+    : extractor_(extractor),
+      options_(options),
+      input_(NULL),
+      spill_pages_(0),
+      next_partition_(0),
+      groups_(0),
+      spilled_aggregates_(0),
+      repartitions_(0),
+      failed_(false) {}
+
+HashAggregate::Stats HashAggregate::run(File* input,
+                                        const Consumer& consumer) {
+  const std::uint32_t threads = std::max(1u, options_.threads);
+  input_ = input;
+  workers_.assign(threads, Worker());
+  for (std::size_t i = 0; i < workers_.size(); ++i) {
+    workers_[i].tables.resize(std::max(1u, options_.partitions));
+    workers_[i].bytes = 0;
+    workers_[i].records = 0;
+    workers_[i].spills = 0;
+  }
+  spill_files_.clear();
+  spill_files_.resize(std::max(1u, options_.partitions));
+  spill_pool_.reset(new BufMgr(options_.spill_pool_frames));
+  scan_position_ = input->physicalBegin();
+  scan_end_ = input->physicalEnd();
+  next_partition_ = 0;
+  groups_ = 0;
+  spilled_aggregates_ = 0;
+  repartitions_ = 0;
+  spill_pages_ = 0;
+  failed_ = false;
+
+  try {
+    runWorkers([this](const std::uint32_t i) { scan(&workers_[i]); });
+    runWorkers([this, &consumer](const std::uint32_t) { merge(consumer); });
+  } catch (...) {
+    removeSpillFiles();
+    workers_.clear();
+    throw;
+  }
+
+  Stats stats;
+  stats.records = 0;
+  stats.groups = groups_;
+  stats.spills = 0;
+  stats.spilled_aggregates = spilled_aggregates_;
+  stats.spill_pages = spill_pages_;
+  stats.repartitions = repartitions_;
+  for (std::size_t i = 0; i < workers_.size(); ++i) {
+    stats.records += workers_[i].records;
+    stats.spills += workers_[i].spills;
+  }
+  removeSpillFiles();
+  workers_.clear();
+  return stats;
+}
+
+void HashAggregate::scan(Worker* worker) {
+  const std::size_t budget = options_.memory_budget / workers_.size();
+  std::vector<Page> pages;
+  std::string key;
+  double value;
+  while (!failed_) {
+    pages.clear();
+    {
+      std::lock_guard<std::mutex> lock(scan_mutex_);
+      for (; pages.size() < SCAN_BATCH_PAGES && scan_position_ != scan_end_;
+           ++scan_position_) {
+        pages.push_back(*scan_position_);
+      }
+    }
+    if (pages.empty()) {
+      return;
+    }
+    for (std::size_t i = 0; i < pages.size(); ++i) {
+      for (PageIterator iter = pages[i].begin(); iter != pages[i].end();
+           ++iter) {
+        if (!extractor_(*iter, key, value)) {
+          continue;
+        }
+        ++worker->records;
+        const Aggregates single = {1, value, value, value};
+        std::pair<Table::iterator, bool> entry =
+            worker->tables[partitionOf(key, 0 /* level */, spill_files_.size())]
+                .insert(std::make_pair(key, single));
+        if (!entry.second) {
+          combine(entry.first->second, single);
+          continue;
+        }
+        worker->bytes += key.size() + ENTRY_OVERHEAD;
+        if (worker->bytes > budget) {
+          spill(worker);
+        }
+      }
+    }
+  }
+}
+
+void HashAggregate::spill(Worker* worker) {
+  std::lock_guard<std::mutex> lock(spill_mutex_);
+  spilled_aggregates_ += writeTables(
+      spill_files_, input_->filename() + ".agg.", worker->tables);
+  worker->bytes = 0;
+  ++worker->spills;
+}
+
+std::uint64_t HashAggregate::writeTables(std::vector<SpillFile>& spill_files,
+                                         const std::string& prefix,
+                                         std::vector<Table>& tables) {
+  std::uint64_t written = 0;
+  std::string record;
+  for (std::size_t p = 0; p < tables.size(); ++p) {
+    Table& table = tables[p];
+    if (table.empty()) {
+      continue;
+    }
+    SpillFile& spill_file = spill_files[p];
+    if (!spill_file.file) {
+      const std::string& filename = prefix + std::to_string(p);
+      if (File::exists(filename)) {
+        // Left behind by a run that didn't finish.
+        File::remove(filename);
+      }
+      spill_file.file.reset(new File(File::create(filename)));
+    }
+    File* file = spill_file.file.get();
+    PageId page_number = Page::INVALID_NUMBER;
+    Page* page = NULL;
+    if (!spill_file.pages.empty()) {
+      page_number = spill_file.pages.back();
+      spill_pool_->readPage(file, page_number, page);
+    }
+    try {
+      for (Table::const_iterator iter = table.begin(); iter != table.end();
+           ++iter) {
+        record.assign(iter->first);
+        record.append(reinterpret_cast<const char*>(&iter->second),
+                      sizeof(iter->second));
+        if (page == NULL || !page->hasSpaceForRecord(record)) {
+          if (page != NULL) {
+            spill_pool_->unPinPage(file, page_number, true);
+            page = NULL;
+          }
+          spill_pool_->allocPage(file, page_number, page);
+          spill_file.pages.push_back(page_number);
+        }
+        page->insertRecord(record);
+      }
+    } catch (...) {
+      if (page != NULL) {
+        spill_pool_->unPinPage(file, page_number, true);
+      }
+      throw;
+    }
+    spill_pool_->unPinPage(file, page_number, true);
+    written += table.size();
+    Table().swap(table);
+  }
+  return written;
+}
+
+void HashAggregate::merge(const Consumer& consumer) {
+  for (;;) {
+    std::uint32_t partition;
+    {
+      std::lock_guard<std::mutex> lock(merge_mutex_);
+      if (failed_ || next_partition_ >= spill_files_.size()) {
+        return;
+      }
+      partition = next_partition_++;
+    }
+
+    // Only this thread touches the partition's tables from here on.
+    Table merged;
+    for (std::size_t w = 0; w < workers_.size(); ++w) {
+      Table& table = workers_[w].tables[partition];
+      for (Table::const_iterator iter = table.begin(); iter != table.end();
+           ++iter) {
+        std::pair<Table::iterator, bool> entry = merged.insert(*iter);
+        if (!entry.second) {
+          combine(entry.first->second, iter->second);
+        }
+      }
+      Table().swap(table);
+    }
+    mergeSpill(merged, spill_files_[partition], 1 /* level */, consumer);
+  }
+}
+
+void HashAggregate::mergeSpill(Table& merged, SpillFile& spill_file,
+                               const std::uint32_t level,
+                               const Consumer& consumer) {
+  const std::size_t budget = options_.memory_budget / workers_.size();
+  std::vector<std::string> records;
+  // Every piece of a split takes a page at least, so splitting can't bring a
+  // partition within a budget smaller than that.
+  if (spill_file.pages.size() * Page::SIZE > budget && budget >= Page::SIZE &&
+      level < MAX_LEVELS) {
+    // Split the partition by another hash of the key, combining what fits in
+    // memory on the way, and merge the pieces one by one.
+    std::vector<Table> tables(REPARTITION_FANOUT);
+    std::size_t bytes = 0;
+    const std::string& prefix = spill_file.file->filename() + ".";
+    spill_file.children.resize(REPARTITION_FANOUT);
+    const std::function<void(const std::string&, const Aggregates&)> add =
+        [&](const std::string& key, const Aggregates& partial) {
+      std::pair<Table::iterator, bool> entry =
+          tables[partitionOf(key, level, tables.size())].insert(
+              std::make_pair(key, partial));
+      if (!entry.second) {
+        combine(entry.first->second, partial);
+        return;
+      }
+      bytes += key.size() + ENTRY_OVERHEAD;
+      if (bytes > budget) {
+        std::lock_guard<std::mutex> lock(spill_mutex_);
+        writeTables(spill_file.children, prefix, tables);
+        bytes = 0;
+      }
+    };
+    for (Table::const_iterator iter = merged.begin(); iter != merged.end();
+         ++iter) {
+      add(iter->first, iter->second);
+    }
+    Table().swap(merged);
+    for (std::size_t i = 0; i < spill_file.pages.size(); ++i) {
+      readSpillPage(spill_file, i, records);
+      for (std::size_t r = 0; r < records.size(); ++r) {
+        const std::string& record = records[r];
+        Aggregates partial;
+        std::memcpy(&partial, &record[record.size() - sizeof(partial)],
+                    sizeof(partial));
+        add(record.substr(0, record.size() - sizeof(partial)), partial);
+      }
+    }
+    {
+      std::lock_guard<std::mutex> lock(spill_mutex_);
+      writeTables(spill_file.children, prefix, tables);
+      // The pieces hold everything now, so the original can go.
+      releaseSpillFile(spill_file);
+    }
+    {
+      std::lock_guard<std::mutex> lock(merge_mutex_);
+      ++repartitions_;
+    }
+    for (std::size_t q = 0; q < spill_file.children.size() && !failed_;
+         ++q) {
+      Table table;
+      mergeSpill(table, spill_file.children[q], level + 1, consumer);
+    }
+    return;
+  }
+
+  for (std::size_t i = 0; i < spill_file.pages.size(); ++i) {
+    readSpillPage(spill_file, i, records);
+    for (std::size_t r = 0; r < records.size(); ++r) {
+      const std::string& record = records[r];
+      Aggregates partial;
+      std::memcpy(&partial, &record[record.size() - sizeof(partial)],
+                  sizeof(partial));
+      std::pair<Table::iterator, bool> entry = merged.insert(std::make_pair(
+          record.substr(0, record.size() - sizeof(partial)), partial));
+      if (!entry.second) {
+        combine(entry.first->second, partial);
+      }
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(spill_mutex_);
+    releaseSpillFile(spill_file);
+  }
+
+  std::lock_guard<std::mutex> lock(merge_mutex_);
+  for (Table::const_iterator iter = merged.begin(); iter != merged.end();
+       ++iter) {
+    consumer(iter->first, iter->second);
+  }
+  groups_ += merged.size();
+  Table().swap(merged);
+}
+
+void HashAggregate::readSpillPage(const SpillFile& spill_file,
+                                  const std::size_t index,
+                                  std::vector<std::string>& records) {
+  records.clear();
+  std::lock_guard<std::mutex> lock(spill_mutex_);
+  Page* page;
+  spill_pool_->readPage(spill_file.file.get(), spill_file.pages[index], page);
+  for (PageIterator iter = page->begin(); iter != page->end(); ++iter) {
+    records.push_back(*iter);
+  }
+  spill_pool_->unPinPage(spill_file.file.get(), spill_file.pages[index],
+                         false);
+}
+
+void HashAggregate::runWorkers(
+    const std::function<void(std::uint32_t)>& body) {
+  std::exception_ptr error;
+  std::mutex error_mutex;
+  std::vector<std::thread> threads;
+  for (std::uint32_t i = 0; i < workers_.size(); ++i) {
+    threads.push_back(std::thread([this, &body, &error, &error_mutex, i] {
+      try {
+        body(i);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        if (!error) {
+          error = std::current_exception();
+        }
+        failed_ = true;
+      }
+    }));
+  }
+  for (std::size_t i = 0; i < threads.size(); ++i) {
+    threads[i].join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+void HashAggregate::removeSpillFiles() {
+  // The spill files are scratch, so drop their pages rather than write them.
+  for (std::size_t p = 0; p < spill_files_.size(); ++p) {
+    discardSpillPages(spill_files_[p]);
+  }
+  spill_pool_.reset();
+  for (std::size_t p = 0; p < spill_files_.size(); ++p) {
+    removeSpillFile(spill_files_[p]);
+  }
+  spill_files_.clear();
+}
+
+void HashAggregate::discardSpillPages(SpillFile& spill_file) {
+  for (std::size_t i = 0; i < spill_file.pages.size(); ++i) {
+    spill_pool_->discardPage(spill_file.file.get(), spill_file.pages[i]);
+  }
+  for (std::size_t q = 0; q < spill_file.children.size(); ++q) {
+    discardSpillPages(spill_file.children[q]);
+  }
+}
+
+void HashAggregate::removeSpillFile(SpillFile& spill_file) {
+  for (std::size_t q = 0; q < spill_file.children.size(); ++q) {
+    removeSpillFile(spill_file.children[q]);
+  }
+  if (spill_file.file) {
+    const std::string filename = spill_file.file->filename();
+    spill_file.file.reset();
+    File::remove(filename);
+  }
+}
+
+void HashAggregate::releaseSpillFile(SpillFile& spill_file) {
+  for (std::size_t i = 0; i < spill_file.pages.size(); ++i) {
+    spill_pool_->discardPage(spill_file.file.get(), spill_file.pages[i]);
+  }
+  spill_pages_ += spill_file.pages.size();
+  spill_file.pages.clear();
+  if (spill_file.file) {
+    const std::string filename = spill_file.file->filename();
+    spill_file.file.reset();
+    File::remove(filename);
+  }
+}
+
+std::uint32_t HashAggregate::partitionOf(const std::string& key,
+                                         const std::uint32_t level,
+                                         const std::uint32_t count) {
+  // Mix the level into the hash so the keys of one partition spread over the
+  // partitions of the next level, and use other bits than the hash tables
+  // do, or every key of a partition would crowd into the same buckets.
+  std::uint64_t hash =
+      std::hash<std::string>()(key) + level * 0x9e3779b97f4a7c15ULL;
+  hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+  return static_cast<std::uint32_t>((hash >> 32) % count);
+}
+
+void HashAggregate::combine(Aggregates& into, const Aggregates& from) {
+  into.count += from.count;
+  into.sum += from.sum;
+  into.min = std::min(into.min, from.min);
+  into.max = std::max(into.max, from.max);
+}
+
+}
@@ -0,0 +1,348 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "buffer.h"
+#include "file.h"
+#include "physical_file_iterator.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Parallel group-by over the records of a file.
+ *
+ * Every record is mapped to a group key and a numeric value, and the
+ * operator computes the count, sum, minimum and maximum of the values of each
+ * group.  It runs in two phases:
+ *
+ *   - Worker threads take turns pulling runs of pages off a physical scan of
+ *     the input and aggregate their records into private hash tables, one per
+ *     partition of the key space, without any locking.  When a worker's
+ *     tables outgrow its share of the memory budget, it appends their partial
+ *     aggregates to per-partition spill files, written through a BufMgr, and
+ *     starts over with empty tables.
+ *   - The workers then take whole partitions, merge the partial aggregates of
+ *     each from every worker's tables and from its spill file, and hand the
+ *     finished groups to the consumer.  A partition whose spill file is
+ *     larger than a worker's share of the budget is first split into
+ *     REPARTITION_FANOUT smaller spill files by another hash of the key, and
+ *     each of those is merged the same way, up to MAX_LEVELS deep.  Splits
+ *     are skipped when the share is smaller than a page, since every piece
+ *     of a split takes a page at least.
+ *
+ * Memory is bounded by the budget during the scan, and during the merge by a
+ * worker's share of it unless a partition is still too large after
+ * MAX_LEVELS splits or the share is smaller than a page.
+ *
+ * Spill files are named after the input file with a ".agg.<partition>"
+ * suffix, with ".<sub-partition>" added per split.  Each is removed as soon
+ * as it has been merged or split, and any left over when the run ends.  Records of a spill file hold the key
+ * followed by the partial aggregate, so keys must fit in a page with
+ * SPILL_SUFFIX_SIZE bytes to spare.
+ */
+class HashAggregate {
+ public:
+  /**
+   * Aggregates of one group.
+   */
+  struct Aggregates {
+    std::uint64_t count;
+    double sum;
+    double min;
+    double max;
+  };
+
+  /**
+   * Bytes a partial aggregate adds to a key in a spill record.
+   */
+  static const std::size_t SPILL_SUFFIX_SIZE = sizeof(Aggregates);
+
+  /**
+   * Number of spill files a partition's spill file is split into when it is
+   * too large to merge in memory.
+   */
+  static const std::uint32_t REPARTITION_FANOUT = 16;
+
+  /**
+   * Most partitioning levels, counting the one during the scan.
+   */
+  static const std::uint32_t MAX_LEVELS = 4;
+
+  /**
+   * Folds partial aggregates into a group's aggregates.
+   *
+   * @param into  Aggregates of the group.
+   * @param from  Partial aggregates to add.
+   */
+  static void combine(Aggregates& into, const Aggregates& from);
+
+  /**
+   * Maps a record to its group key and value.  Called from several threads
+   * at once.  Returns false to leave the record out.
+   */
+  typedef std::function<bool(const std::string& record, std::string& key,
+                             double& value)> Extractor;
+
+  /**
+   * Receives each finished group once.  Calls are serialized, but come from
+   * the worker threads in no particular order.
+   */
+  typedef std::function<void(const std::string& key,
+                             const Aggregates& aggregates)> Consumer;
+
+  /**
+   * Settings of a run.
+   */
+  struct Options {
+    /**
+     * Worker threads.
+     */
+    std::uint32_t threads;
+
+    /**
+     * Partitions of the key space.
+     */
+    std::uint32_t partitions;
+
+    /**
+     * Most bytes the workers' hash tables may take together during the scan.
+     */
+    std::size_t memory_budget;
+
+    /**
+     * Frames of the buffer pool spill files are written through.
+     */
+    std::uint32_t spill_pool_frames;
+
+    /**
+     * Returns the defaults: one thread per core, 64 partitions, 64 MB of
+     * hash tables and a 256-frame spill pool.
+     */
+    static Options defaults();
+  };
+
+  /**
+   * What a run did.
+   */
+  struct Stats {
+    std::uint64_t records;
+    std::uint64_t groups;
+
+    /**
+     * Times a worker wrote its tables out, partial aggregates written, and
+     * pages of spill files used.
+     */
+    std::uint64_t spills;
+    std::uint64_t spilled_aggregates;
+    std::uint64_t spill_pages;
+
+    /**
+     * Spill files split because they were too large to merge in memory.
+     */
+    std::uint64_t repartitions;
+  };
+
+  /**
+   * Prepares an aggregation.
+   *
+   * @param extractor   Maps records to keys and values.
+   * @param options     Settings of the run.
+   */
+  HashAggregate(const Extractor& extractor, const Options& options);
+
+  /**
+   * Aggregates the records of a file.  Nobody may write the file meanwhile.
+   *
+   * @param input     File to aggregate.
+   * @param consumer  Receives the groups.
+   * @return  What the run did.
+   * @throws  BadgerDbException  The first error of any worker; the other
+   *                             workers stop and spill files are removed.
+   */
+  Stats run(File* input, const Consumer& consumer);
+
+ private:
+  /**
+   * Hash tables of one partition.
+   */
+  typedef std::unordered_map<std::string, Aggregates> Table;
+
+  /**
+   * A spill file, the pages written to it so far, and the spill files it was
+   * split into, if any.
+   */
+  struct SpillFile {
+    std::unique_ptr<File> file;
+    std::vector<PageId> pages;
+    std::vector<SpillFile> children;
+  };
+
+  /**
+   * What one worker holds.
+   */
+  struct Worker {
+    /**
+     * One table per partition.
+     */
+    std::vector<Table> tables;
+
+    /**
+     * Bytes charged for the entries of <tables>.
+     */
+    std::size_t bytes;
+
+    std::uint64_t records;
+    std::uint64_t spills;
+  };
+
+  /**
+   * Body of a worker in the scan phase.
+   */
+  void scan(Worker* worker);
+
+  /**
+   * Body of a worker in the merge phase.
+   */
+  void merge(const Consumer& consumer);
+
+  /**
+   * Writes a worker's tables to the spill files and empties them.
+   */
+  void spill(Worker* worker);
+
+  /**
+   * Appends each table to the spill file of the same index, creating it as
+   * <prefix><index> if needed, and empties the tables.  Called with
+   * <spill_mutex_> held.
+   *
+   * @param spill_files   Spill files, one per table.
+   * @param prefix        Name of a spill file without its index.
+   * @param tables        Tables to write.
+   * @return  Number of partial aggregates written.
+   */
+  std::uint64_t writeTables(std::vector<SpillFile>& spill_files,
+                            const std::string& prefix,
+                            std::vector<Table>& tables);
+
+  /**
+   * Merges a spill file into a table of partial aggregates of the same keys
+   * and hands the finished groups to the consumer.  If the spill file is too
+   * large, the table and the file are split into smaller spill files first,
+   * which are merged in turn.
+   *
+   * @param merged        Partial aggregates not in the spill file; emptied.
+   * @param spill_file    Spill file to merge.
+   * @param level         Partitioning level of a split.
+   * @param consumer      Receives the groups.
+   */
+  void mergeSpill(Table& merged, SpillFile& spill_file,
+                  const std::uint32_t level, const Consumer& consumer);
+
+  /**
+   * Reads the records of one page of a spill file.
+   *
+   * @param spill_file  Spill file to read.
+   * @param index       Index of the page in <spill_file.pages>.
+   * @param records     Receives the records.
+   */
+  void readSpillPage(const SpillFile& spill_file, const std::size_t index,
+                     std::vector<std::string>& records);
+
+  /**
+   * Runs a phase on all workers, stopping them all at the first error and
+   * rethrowing it.
+   */
+  void runWorkers(const std::function<void(std::uint32_t)>& body);
+
+  /**
+   * Drops the spill pool and removes the spill files.
+   */
+  void removeSpillFiles();
+
+  /**
+   * Drops the pages of a spill file and the files it was split into from the
+   * spill pool.
+   */
+  void discardSpillPages(SpillFile& spill_file);
+
+  /**
+   * Closes and removes a spill file and the files it was split into.
+   */
+  static void removeSpillFile(SpillFile& spill_file);
+
+  /**
+   * Drops the pages of a spill file whose contents have been merged or split
+   * from the spill pool, then closes and removes the file, but not the files
+   * it was split into.  Called with <spill_mutex_> held.
+   */
+  void releaseSpillFile(SpillFile& spill_file);
+
+  /**
+   * Returns the partition of a key at a partitioning level.
+   *
+   * @param key     Group key.
+   * @param level   0 for the scan, one more for each split.
+   * @param count   Number of partitions at the level.
+   */
+  static std::uint32_t partitionOf(const std::string& key,
+                                   const std::uint32_t level,
+                                   const std::uint32_t count);
+
+  const Extractor extractor_;
+  const Options options_;
+
+  /**
+   * State of the current run.
+   */
+  File* input_;
+  std::vector<Worker> workers_;
+  std::vector<SpillFile> spill_files_;
+
+  /**
+   * Protects the input scan.
+   */
+  std::mutex scan_mutex_;
+  PhysicalFileIterator scan_position_;
+  PhysicalFileIterator scan_end_;
+
+  /**
+   * Protects the spill pool and files, and the number of spill pages
+   * released so far.
+   */
+  std::mutex spill_mutex_;
+  std::unique_ptr<BufMgr> spill_pool_;
+  std::uint64_t spill_pages_;
+
+  /**
+   * Protects the merge phase's partition counter, the consumer and the
+   * counters below.
+   */
+  std::mutex merge_mutex_;
+  std::uint32_t next_partition_;
+  std::uint64_t groups_;
+  std::uint64_t spilled_aggregates_;
+  std::uint64_t repartitions_;
+
+  /**
+   * Set when a worker fails, so the others stop early.
+   */
+  std::atomic<bool> failed_;
+};
+
+}
@@ -0,0 +1,352 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "io_scheduler.h"
+
+#include <algorithm>
+
+namespace badgerdb {
+
+namespace {
+
+/**
+ * Time a class may run at full speed after being idle, in seconds.
+ */
+const double BURST_SECONDS = 0.01;
+
+}
+
+const std::uint32_t IoScheduler::MAX_OVERDUE_AHEAD;
+
+IoScheduler::IoScheduler() : overdue_ahead_(0), stopping_(false) {
+  const std::chrono::steady_clock::time_point now =
+      std::chrono::steady_clock::now();
+  for (int c = 0; c < NUM_CLASSES; ++c) {
+    limits_[c].mbps = 0;
+    limits_[c].deadline_ms = 0;
+    buckets_[c].bytes = 0;
+    buckets_[c].refilled = now;
+    stats_[c].requests = 0;
+    stats_[c].bytes = 0;
+    stats_[c].deadline_misses = 0;
+    stats_[c].superseded = 0;
+  }
+  limits_[WRITEBACK].deadline_ms = 1000;
+  limits_[CHECKPOINT].deadline_ms = 5000;
+  worker_ = std::thread(&IoScheduler::work, this);
+}
+
+IoScheduler::~IoScheduler() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  work_available_.notify_all();
+  worker_.join();
+}
+
+void IoScheduler::setLimits(const IoClass io_class,
+                            const ClassLimits& limits) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  limits_[io_class] = limits;
+  buckets_[io_class].bytes = burstBytes(io_class);
+  buckets_[io_class].refilled = std::chrono::steady_clock::now();
+}
+
+Page IoScheduler::read(File* file, const PageId page_number,
+                       const IoClass io_class) {
+  RequestPtr request(new Request);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<PageKey, RequestPtr>::const_iterator pending =
+        pending_writes_.find(PageKey(file, page_number));
+    if (pending != pending_writes_.end()) {
+      // The queued copy is newer than what the file holds.
+      return pending->second->page;
+    }
+    request->kind = Request::READ;
+    request->io_class = io_class;
+    request->file = file;
+    request->page_number = page_number;
+    enqueue(request);
+  }
+  work_available_.notify_one();
+  wait(request);
+  return request->page;
+}
+
+void IoScheduler::write(File* file, const Page& page,
+                        const IoClass io_class) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const PageKey key(file, page.page_number());
+    std::map<PageKey, RequestPtr>::iterator pending =
+        pending_writes_.find(key);
+    if (pending != pending_writes_.end()) {
+      // Keep the older request's place in line but write the newer copy.
+      pending->second->page = page;
+      ++stats_[io_class].superseded;
+      return;
+    }
+    RequestPtr request(new Request);
+    request->kind = Request::WRITE;
+    request->io_class = io_class;
+    request->file = file;
+    request->page_number = page.page_number();
+    request->page = page;
+    enqueue(request);
+    pending_writes_[key] = request;
+  }
+  work_available_.notify_one();
+}
+
+void IoScheduler::execute(const std::function<void()>& operation) {
+  RequestPtr request(new Request);
+  request->kind = Request::EXECUTE;
+  request->io_class = FOREGROUND;
+  request->file = NULL;
+  request->page_number = Page::INVALID_NUMBER;
+  request->operation = operation;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    enqueue(request);
+  }
+  work_available_.notify_one();
+  wait(request);
+}
+
+bool IoScheduler::cancel(const File* file, const PageId page_number) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::map<PageKey, RequestPtr>::iterator pending =
+      pending_writes_.find(PageKey(file, page_number));
+  if (pending == pending_writes_.end()) {
+    return false;
+  }
+  // The worker drops it when it comes up.
+  pending->second->cancelled = true;
+  ++stats_[pending->second->io_class].superseded;
+  pending_writes_.erase(pending);
+  return true;
+}
+
+void IoScheduler::drain(const File* file) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  work_done_.wait(lock, [this, file] {
+    return file == NULL ? outstanding_.empty() : outstanding_.count(file) == 0;
+  });
+  std::exception_ptr error;
+  if (file == NULL) {
+    if (!write_errors_.empty()) {
+      error = write_errors_.begin()->second;
+    }
+    write_errors_.clear();
+  } else {
+    std::map<const File*, std::exception_ptr>::iterator iter =
+        write_errors_.find(file);
+    if (iter != write_errors_.end()) {
+      error = iter->second;
+      write_errors_.erase(iter);
+    }
+  }
+  lock.unlock();
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+IoScheduler::ClassStats IoScheduler::stats(const IoClass io_class) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_[io_class];
+}
+
+void IoScheduler::enqueue(const RequestPtr& request) {
+  request->submitted = std::chrono::steady_clock::now();
+  const std::uint32_t deadline_ms = limits_[request->io_class].deadline_ms;
+  request->has_deadline = deadline_ms > 0;
+  request->deadline =
+      request->submitted + std::chrono::milliseconds(deadline_ms);
+  request->done = false;
+  request->cancelled = false;
+  queues_[request->io_class].push_back(request);
+  ++outstanding_[request->file];
+}
+
+void IoScheduler::wait(const RequestPtr& request) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  work_done_.wait(lock, [&request] { return request->done; });
+  if (request->error) {
+    std::rethrow_exception(request->error);
+  }
+}
+
+void IoScheduler::work() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    bool idle = true;
+    for (int c = 0; c < NUM_CLASSES; ++c) {
+      idle = idle && queues_[c].empty();
+    }
+    if (idle) {
+      if (stopping_) {
+        return;
+      }
+      work_available_.wait(lock);
+      continue;
+    }
+    const std::chrono::steady_clock::time_point now =
+        std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point wake_at =
+        std::chrono::steady_clock::time_point::max();
+    const RequestPtr request = pickNext(now, wake_at);
+    if (!request) {
+      work_available_.wait_until(lock, wake_at);
+      continue;
+    }
+
+    if (request->kind == Request::WRITE && !request->cancelled) {
+      // From here on a new write of the page must queue behind this one.
+      pending_writes_.erase(PageKey(request->file, request->page_number));
+    }
+    if (!request->cancelled) {
+      lock.unlock();
+      perform(*request);
+      lock.lock();
+      const std::chrono::steady_clock::time_point finished =
+          std::chrono::steady_clock::now();
+      ClassStats& stats = stats_[request->io_class];
+      ++stats.requests;
+      stats.bytes += request->kind == Request::EXECUTE ? 0 : Page::SIZE;
+      stats.latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+          finished - request->submitted).count());
+      if (request->has_deadline && finished > request->deadline) {
+        ++stats.deadline_misses;
+      }
+      if (request->kind == Request::WRITE && request->error &&
+          write_errors_.count(request->file) == 0) {
+        write_errors_[request->file] = request->error;
+      }
+    }
+    request->done = true;
+    std::map<const File*, std::uint64_t>::iterator outstanding =
+        outstanding_.find(request->file);
+    if (--outstanding->second == 0) {
+      outstanding_.erase(outstanding);
+    }
+    work_done_.notify_all();
+  }
+}
+
+IoScheduler::RequestPtr IoScheduler::pickNext(
+    const std::chrono::steady_clock::time_point now,
+    std::chrono::steady_clock::time_point& wake_at) {
+  // Overdue work goes first, oldest deadline first, limits or not, unless
+  // enough of it has already gone ahead of waiting foreground requests.
+  if (queues_[FOREGROUND].empty()) {
+    overdue_ahead_ = 0;
+  }
+  int overdue = -1;
+  for (int c = 0; c < NUM_CLASSES; ++c) {
+    if (queues_[c].empty() || !queues_[c].front()->has_deadline) {
+      continue;
+    }
+    const std::chrono::steady_clock::time_point deadline =
+        queues_[c].front()->deadline;
+    if (deadline <= now) {
+      if (c != FOREGROUND && overdue_ahead_ >= MAX_OVERDUE_AHEAD) {
+        continue;
+      }
+      if (overdue < 0 || deadline < queues_[overdue].front()->deadline) {
+        overdue = c;
+      }
+    } else {
+      wake_at = std::min(wake_at, deadline);
+    }
+  }
+
+  int chosen = overdue;
+  for (int c = 0; chosen < 0 && c < NUM_CLASSES; ++c) {
+    if (queues_[c].empty()) {
+      continue;
+    }
+    if (limits_[c].mbps <= 0) {
+      chosen = c;
+      break;
+    }
+    refill(static_cast<IoClass>(c), now);
+    const double needed = cost(*queues_[c].front());
+    if (buckets_[c].bytes >= needed) {
+      chosen = c;
+      break;
+    }
+    // Throttled; lower classes may go meanwhile.
+    const double bytes_per_second = limits_[c].mbps * 1000000;
+    wake_at = std::min(
+        wake_at,
+        now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                  std::chrono::duration<double>(
+                      (needed - buckets_[c].bytes) / bytes_per_second)));
+  }
+  if (chosen < 0) {
+    return RequestPtr();
+  }
+
+  if (chosen == FOREGROUND) {
+    overdue_ahead_ = 0;
+  } else if (chosen == overdue && !queues_[FOREGROUND].empty()) {
+    ++overdue_ahead_;
+  }
+  const RequestPtr request = queues_[chosen].front();
+  queues_[chosen].pop_front();
+  if (limits_[chosen].mbps > 0) {
+    // Overdue requests may leave the bucket in debt, which later requests
+    // of the class pay off.
+    refill(static_cast<IoClass>(chosen), now);
+    buckets_[chosen].bytes -= cost(*request);
+  }
+  return request;
+}
+
+void IoScheduler::refill(const IoClass io_class,
+                         const std::chrono::steady_clock::time_point now) {
+  TokenBucket& bucket = buckets_[io_class];
+  const double elapsed =
+      std::chrono::duration<double>(now - bucket.refilled).count();
+  bucket.bytes = std::min(burstBytes(io_class),
+                          bucket.bytes +
+                              elapsed * limits_[io_class].mbps * 1000000);
+  bucket.refilled = now;
+}
+
+void IoScheduler::perform(Request& request) {
+  try {
+    switch (request.kind) {
+      case Request::READ:
+        request.page = request.file->readPage(request.page_number);
+        break;
+      case Request::WRITE:
+        request.file->writePage(request.page);
+        break;
+      case Request::EXECUTE:
+        request.operation();
+        break;
+    }
+  } catch (...) {
+    request.error = std::current_exception();
+  }
+}
+
+double IoScheduler::cost(const Request& request) {
+  return request.kind == Request::EXECUTE || request.cancelled
+      ? 0 : Page::SIZE;
+}
+
+double IoScheduler::burstBytes(const IoClass io_class) const {
+  return std::max(limits_[io_class].mbps * 1000000 * BURST_SECONDS,
+                  2.0 * Page::SIZE);
+}
+
+}
@@ -0,0 +1,320 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "file.h"
+#include "latency_histogram.h"
+#include "page.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Queues page I/O by priority class and performs it on a worker thread.
+ *
+ * Requests are put in one queue per class.  The worker always serves the
+ * highest-priority class that has work and is within its bandwidth limit, so a
+ * foreground read waits for at most the one request already in service, no
+ * matter how many writes a checkpoint or an eviction burst has queued.  A
+ * request that has been queued longer than its class's deadline is served
+ * next regardless of priority or bandwidth limits, so low-priority work is
+ * delayed but never starved.  Foreground capacity is reserved all the same:
+ * while foreground requests wait, at most MAX_OVERDUE_AHEAD overdue
+ * requests of other classes are served before the next foreground one, so a
+ * backlog of overdue writes slows foreground reads down by a bounded factor
+ * rather than stalling them.
+ *
+ * Writes are asynchronous: write() copies the page and returns.  Until the
+ * write is done, reads of that page are answered from the copy and a newer
+ * write of the page replaces it in the queue.  Errors of asynchronous writes
+ * are reported by the next drain() covering their file.
+ *
+ * All I/O on a file served by a scheduler must go through it (or through a
+ * BufMgr using it) while it has work queued for the file; call drain() before
+ * using the file directly or closing it.  That includes the structures a
+ * write updates besides the file itself, i.e. the free-space map and the
+ * file's listeners, such as its zone map; run such calls with execute().
+ *
+ * @warning The scheduler itself is threadsafe, but File is not, which is why
+ *          it performs all I/O on a single worker thread.
+ */
+class IoScheduler {
+ public:
+  /**
+   * Most overdue requests of lower classes served in a row while foreground
+   * requests are waiting.
+   */
+  static const std::uint32_t MAX_OVERDUE_AHEAD = 4;
+
+  /**
+   * Priority classes, highest first.
+   */
+  enum IoClass {
+    FOREGROUND,  // Reads someone is waiting for, and file operations.
+    PREFETCH,    // Reads of pages expected to be needed soon.
+    WRITEBACK,   // Dirty pages written out to free buffer frames.
+    CHECKPOINT,  // Dirty pages written out by a flush.
+    NUM_CLASSES
+  };
+
+  /**
+   * Limits of a class.
+   */
+  struct ClassLimits {
+    /**
+     * Bandwidth in megabytes (10^6 bytes) per second; 0 means unlimited.
+     */
+    double mbps;
+
+    /**
+     * Time after which a queued request is served ahead of everything else,
+     * in milliseconds; 0 means none.
+     */
+    std::uint32_t deadline_ms;
+  };
+
+  /**
+   * What a class has done.
+   */
+  struct ClassStats {
+    std::uint64_t requests;
+    std::uint64_t bytes;
+
+    /**
+     * Requests finished after their deadline.
+     */
+    std::uint64_t deadline_misses;
+
+    /**
+     * Writes dropped because a newer write of the page replaced them, or
+     * because they were cancelled.
+     */
+    std::uint64_t superseded;
+
+    /**
+     * Time from submission to completion, in nanoseconds.
+     */
+    LatencyHistogram latency;
+  };
+
+  /**
+   * Starts the worker thread.  Classes start without bandwidth limits, with
+   * deadlines of one second for writeback and five seconds for checkpoint
+   * writes.
+   */
+  IoScheduler();
+
+  /**
+   * Finishes all queued work and stops the worker thread.
+   */
+  ~IoScheduler();
+
+  /**
+   * Sets the limits of a class.
+   *
+   * @param io_class  Class to set.
+   * @param limits    New limits.
+   */
+  void setLimits(const IoClass io_class, const ClassLimits& limits);
+
+  /**
+   * Reads a page, waiting until it has been read.
+   *
+   * @param file          File to read from.
+   * @param page_number   Number of the page.
+   * @param io_class      Class to queue the read in.
+   * @return  The page.
+   * @throws  InvalidPageException  If the page isn't a used page of the file.
+   */
+  Page read(File* file, const PageId page_number,
+            const IoClass io_class = FOREGROUND);
+
+  /**
+   * Queues a write of a page and returns at once.
+   *
+   * @param file      File to write to.
+   * @param page      Page to write; copied.
+   * @param io_class  Class to queue the write in.
+   */
+  void write(File* file, const Page& page, const IoClass io_class);
+
+  /**
+   * Runs an operation on the file-owning worker thread at foreground
+   * priority and waits for it, e.g. File::allocatePage().  Exceptions it
+   * throws are rethrown here.
+   *
+   * @param operation   Operation to run.
+   */
+  void execute(const std::function<void()>& operation);
+
+  /**
+   * Drops a queued write of a page, e.g. because the page is being deleted.
+   *
+   * @param file          File of the page.
+   * @param page_number   Number of the page.
+   * @return  Whether a write was dropped.
+   */
+  bool cancel(const File* file, const PageId page_number);
+
+  /**
+   * Waits until all work queued so far for a file (or for all files) is done.
+   *
+   * @param file  File to wait for, or NULL for all files.
+   * @throws  BadgerDbException  The first error of an asynchronous write of
+   *                             the file since the last drain, if any.
+   */
+  void drain(const File* file = NULL);
+
+  /**
+   * Returns what a class has done so far.
+   *
+   * @param io_class  Class to describe.
+   */
+  ClassStats stats(const IoClass io_class) const;
+
+ private:
+  /**
+   * A queued request.
+   */
+  struct Request {
+    enum Kind { READ, WRITE, EXECUTE };
+
+    Kind kind;
+    IoClass io_class;
+    File* file;
+    PageId page_number;
+
+    /**
+     * Page to write, or the page read.
+     */
+    Page page;
+
+    std::function<void()> operation;
+    std::chrono::steady_clock::time_point submitted;
+    std::chrono::steady_clock::time_point deadline;
+    bool has_deadline;
+
+    /**
+     * Set when the request is done or dropped.
+     */
+    bool done;
+    bool cancelled;
+    std::exception_ptr error;
+  };
+
+  typedef std::shared_ptr<Request> RequestPtr;
+  typedef std::pair<const File*, PageId> PageKey;
+
+  /**
+   * Bandwidth allowance of a class.
+   */
+  struct TokenBucket {
+    double bytes;
+    std::chrono::steady_clock::time_point refilled;
+  };
+
+  /**
+   * Queues a request, stamping its deadline.  Called with the lock held.
+   */
+  void enqueue(const RequestPtr& request);
+
+  /**
+   * Waits for a synchronous request and rethrows its error.
+   */
+  void wait(const RequestPtr& request);
+
+  /**
+   * Body of the worker thread.
+   */
+  void work();
+
+  /**
+   * Picks the next request to serve, or returns NULL and sets <wake_at> to
+   * when a bandwidth-limited class may go next.  Called with the lock held.
+   */
+  RequestPtr pickNext(const std::chrono::steady_clock::time_point now,
+                      std::chrono::steady_clock::time_point& wake_at);
+
+  /**
+   * Adds the allowance a class earned since it was last refilled.
+   */
+  void refill(const IoClass io_class,
+              const std::chrono::steady_clock::time_point now);
+
+  /**
+   * Performs a request.  Called without the lock.
+   */
+  static void perform(Request& request);
+
+  /**
+   * Cost of a request against its class's bandwidth, in bytes.
+   */
+  static double cost(const Request& request);
+
+  /**
+   * Most bytes a class may burst at full speed after being idle.
+   */
+  double burstBytes(const IoClass io_class) const;
+
+  mutable std::mutex mutex_;
+
+  /**
+   * Signalled when a request is queued or when the worker should stop.
+   */
+  std::condition_variable work_available_;
+
+  /**
+   * Signalled when a request is done.
+   */
+  std::condition_variable work_done_;
+
+  std::deque<RequestPtr> queues_[NUM_CLASSES];
+  ClassLimits limits_[NUM_CLASSES];
+  TokenBucket buckets_[NUM_CLASSES];
+  ClassStats stats_[NUM_CLASSES];
+
+  /**
+   * Queued writes by page, for reads of pages about to be written and for
+   * writes that replace them.
+   */
+  std::map<PageKey, RequestPtr> pending_writes_;
+
+  /**
+   * Number of requests queued or in service per file.
+   */
+  std::map<const File*, std::uint64_t> outstanding_;
+
+  /**
+   * First error of an asynchronous write per file since its last drain.
+   */
+  std::map<const File*, std::exception_ptr> write_errors_;
+
+  /**
+   * Overdue requests of lower classes served since a foreground request last
+   * went or the foreground queue was last empty.
+   */
+  std::uint32_t overdue_ahead_;
+
+  bool stopping_;
+
+  std::thread worker_;
+};
+
+}
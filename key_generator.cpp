@@ -0,0 +1,82 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "key_generator.h"
+
+#include <cmath>
+
+namespace badgerdb {
+
+namespace {
+
+/**
+ * Returns the 64-bit FNV-1a hash of a number, used to scatter popular ranks.
+ */
+std::uint64_t fnvHash(std::uint64_t value) {
+  std::uint64_t hash = 14695981039346656037ull;
+  for (int i = 0; i < 8; ++i) {
+    hash = (hash ^ (value & 0xff)) * 1099511628211ull;
+    value >>= 8;
+  }
+  return hash;
+}
+
+}
+
+const double KeyGenerator::THETA = 0.99;
+
+KeyGenerator::KeyGenerator(const Distribution distribution,
+                           const std::uint64_t num_keys,
+                           const std::uint64_t seed)
+    : distribution_(distribution),
+      rng_(seed),
+      zipf_keys_(0),
+      zeta_n_(0),
+      zeta_2_(1 + std::pow(0.5, THETA)),
+      alpha_(1 / (1 - THETA)),
+      eta_(0) {
+  if (distribution_ != UNIFORM) {
+    nextRank(num_keys);
+  }
+}
+
+std::uint64_t KeyGenerator::next(const std::uint64_t num_keys) {
+  switch (distribution_) {
+    case ZIPFIAN:
+      return fnvHash(nextRank(num_keys)) % num_keys;
+    case LATEST:
+      return num_keys - 1 - nextRank(num_keys);
+    case UNIFORM:
+    default:
+      return uniform(num_keys);
+  }
+}
+
+std::uint64_t KeyGenerator::nextRank(const std::uint64_t num_keys) {
+  if (num_keys != zipf_keys_) {
+    // Zeta only grows by the new terms, so inserts cost little here.
+    for (std::uint64_t i = zipf_keys_ + 1; i <= num_keys; ++i) {
+      zeta_n_ += 1 / std::pow(static_cast<double>(i), THETA);
+    }
+    zipf_keys_ = num_keys;
+    eta_ = (1 - std::pow(2.0 / num_keys, 1 - THETA)) /
+        (1 - zeta_2_ / zeta_n_);
+  }
+  const double u = std::uniform_real_distribution<double>(0, 1)(rng_);
+  const double uz = u * zeta_n_;
+  if (uz < 1) {
+    return 0;
+  }
+  if (uz < zeta_2_) {
+    return num_keys > 1 ? 1 : 0;
+  }
+  const std::uint64_t rank = static_cast<std::uint64_t>(
+      num_keys * std::pow(eta_ * u - eta_ + 1, alpha_));
+  return rank < num_keys ? rank : num_keys - 1;
+}
+
+}
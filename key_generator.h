@@ -0,0 +1,114 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <random>
+
+namespace badgerdb {
+
+/**
+ * @brief Chooses keys for a benchmark workload.
+ *
+ * Keys are numbered 0 to num_keys - 1, where num_keys may grow between calls
+ * as the workload inserts.  Three distributions are offered, as in YCSB:
+ *  - UNIFORM: every key equally likely.
+ *  - ZIPFIAN: a few keys are very popular (Zipf with exponent THETA); the
+ *    popular keys are spread over the key space by hashing, so they don't all
+ *    sit on the same pages.
+ *  - LATEST: Zipfian over recency, so the most recently inserted keys are the
+ *    most popular.
+ *
+ * Each thread should use its own generator.
+ */
+class KeyGenerator {
+ public:
+  /**
+   * Distributions keys can be drawn from.
+   */
+  enum Distribution {
+    UNIFORM,
+    ZIPFIAN,
+    LATEST
+  };
+
+  /**
+   * Zipf exponent used by ZIPFIAN and LATEST, YCSB's default.
+   */
+  static const double THETA;
+
+  /**
+   * Creates a generator.
+   *
+   * @param distribution  Distribution to draw keys from.
+   * @param num_keys      Initial number of keys; must be at least 1.
+   * @param seed          Seed for the random number generator.
+   */
+  KeyGenerator(const Distribution distribution, const std::uint64_t num_keys,
+               const std::uint64_t seed);
+
+  /**
+   * Returns the next key.
+   *
+   * @param num_keys  Current number of keys; must not be smaller than in any
+   *                  earlier call.
+   * @return  Key in [0, num_keys).
+   */
+  std::uint64_t next(const std::uint64_t num_keys);
+
+  /**
+   * Returns a random integer in [0, bound), for choosing operations and scan
+   * lengths from the same random stream.
+   *
+   * @param bound   Exclusive upper bound; must be at least 1.
+   * @return  Random integer.
+   */
+  std::uint64_t uniform(const std::uint64_t bound) {
+    return std::uniform_int_distribution<std::uint64_t>(0, bound - 1)(rng_);
+  }
+
+ private:
+  /**
+   * Returns a Zipf-distributed rank in [0, num_keys), 0 being most popular.
+   * Extends the precomputed constants if num_keys has grown.
+   *
+   * @param num_keys  Number of keys.
+   * @return  Rank.
+   */
+  std::uint64_t nextRank(const std::uint64_t num_keys);
+
+  /**
+   * Distribution keys are drawn from.
+   */
+  Distribution distribution_;
+
+  /**
+   * Random number generator.
+   */
+  std::mt19937_64 rng_;
+
+  /**
+   * Number of keys the Zipf constants below were computed for.
+   */
+  std::uint64_t zipf_keys_;
+
+  /**
+   * Sum of 1 / i^THETA for i in [1, zipf_keys_].
+   */
+  double zeta_n_;
+
+  /**
+   * Zeta of 2 and the constants of the Gray et al. method, derived from it
+   * and <zeta_n_>.
+   */
+  double zeta_2_;
+  double alpha_;
+  double eta_;
+};
+
+}
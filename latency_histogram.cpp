@@ -0,0 +1,88 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "latency_histogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace badgerdb {
+
+namespace {
+
+/**
+ * log2 of LatencyHistogram::SUB_BUCKETS.
+ */
+const std::uint32_t SUB_BUCKET_BITS = 5;
+
+}
+
+const std::uint32_t LatencyHistogram::SUB_BUCKETS;
+
+LatencyHistogram::LatencyHistogram()
+    : buckets_((64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS, 0),
+      count_(0),
+      sum_(0),
+      max_(0) {
+}
+
+void LatencyHistogram::record(const std::uint64_t nanoseconds) {
+  ++buckets_[bucketOf(nanoseconds)];
+  ++count_;
+  sum_ += nanoseconds;
+  max_ = std::max(max_, nanoseconds);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+  for (std::size_t i = 0; i < buckets_.size(); ++i) {
+    buckets_[i] += other.buckets_[i];
+  }
+  count_ += other.count_;
+  sum_ += other.sum_;
+  max_ = std::max(max_, other.max_);
+}
+
+std::uint64_t LatencyHistogram::percentile(const double fraction) const {
+  if (count_ == 0) {
+    return 0;
+  }
+  const std::uint64_t rank = std::max<std::uint64_t>(
+      1, static_cast<std::uint64_t>(std::ceil(fraction * count_)));
+  std::uint64_t seen = 0;
+  for (std::uint32_t bucket = 0; bucket < buckets_.size(); ++bucket) {
+    seen += buckets_[bucket];
+    if (seen >= rank) {
+      return std::min(bucketValue(bucket), max_);
+    }
+  }
+  return max_;
+}
+
+std::uint32_t LatencyHistogram::bucketOf(const std::uint64_t nanoseconds) {
+  if (nanoseconds < SUB_BUCKETS) {
+    return nanoseconds;
+  }
+  // The top SUB_BUCKET_BITS + 1 bits of the latency pick the bucket.
+  std::uint32_t shift = 0;
+  while ((nanoseconds >> shift) >= 2 * SUB_BUCKETS) {
+    ++shift;
+  }
+  return (shift + 1) * SUB_BUCKETS +
+      static_cast<std::uint32_t>(nanoseconds >> shift) - SUB_BUCKETS;
+}
+
+std::uint64_t LatencyHistogram::bucketValue(const std::uint32_t bucket) {
+  if (bucket < SUB_BUCKETS) {
+    return bucket;
+  }
+  const std::uint32_t shift = bucket / SUB_BUCKETS - 1;
+  const std::uint64_t low =
+      static_cast<std::uint64_t>(SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+  return low + ((static_cast<std::uint64_t>(1) << shift) >> 1);
+}
+
+}
@@ -0,0 +1,107 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace badgerdb {
+
+/**
+ * @brief Histogram of operation latencies for benchmarks.
+ *
+ * Latencies are counted in buckets whose width grows with the latency, so
+ * that memory stays fixed however many operations are recorded while reported
+ * percentiles stay within about 3% of the true value.  Each thread records
+ * into its own histogram; merge them afterwards.
+ */
+class LatencyHistogram {
+ public:
+  /**
+   * Creates an empty histogram.
+   */
+  LatencyHistogram();
+
+  /**
+   * Counts one operation.
+   *
+   * @param nanoseconds   Latency of the operation.
+   */
+  void record(const std::uint64_t nanoseconds);
+
+  /**
+   * Adds the operations counted by another histogram.
+   *
+   * @param other   Histogram to add.
+   */
+  void merge(const LatencyHistogram& other);
+
+  /**
+   * Returns the number of operations counted.
+   */
+  std::uint64_t count() const { return count_; }
+
+  /**
+   * Returns the mean latency in nanoseconds, or 0 if nothing was counted.
+   */
+  double mean() const {
+    return count_ == 0 ? 0 : static_cast<double>(sum_) / count_;
+  }
+
+  /**
+   * Returns the highest latency counted in nanoseconds.
+   */
+  std::uint64_t max() const { return max_; }
+
+  /**
+   * Returns the latency that the given fraction of operations did not
+   * exceed, e.g. 0.99 for p99.
+   *
+   * @param fraction  Fraction in [0, 1].
+   * @return  Latency in nanoseconds; 0 if nothing was counted.
+   */
+  std::uint64_t percentile(const double fraction) const;
+
+ private:
+  /**
+   * Number of buckets per power of two.
+   */
+  static const std::uint32_t SUB_BUCKETS = 32;
+
+  /**
+   * Returns the bucket a latency is counted in.
+   */
+  static std::uint32_t bucketOf(const std::uint64_t nanoseconds);
+
+  /**
+   * Returns the midpoint of the latencies counted in a bucket.
+   */
+  static std::uint64_t bucketValue(const std::uint32_t bucket);
+
+  /**
+   * Number of operations per bucket.
+   */
+  std::vector<std::uint64_t> buckets_;
+
+  /**
+   * Number of operations counted.
+   */
+  std::uint64_t count_;
+
+  /**
+   * Sum of the latencies counted.
+   */
+  std::uint64_t sum_;
+
+  /**
+   * Highest latency counted.
+   */
+  std::uint64_t max_;
+};
+
+}
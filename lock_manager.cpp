@@ -0,0 +1,479 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "lock_manager.h"
+
+#include <algorithm>
+#include <functional>
+#include <tuple>
+
+#include "exceptions/deadlock_exception.h"
+
+namespace badgerdb {
+
+namespace {
+
+/**
+ * Whether a lock in mode <held> on a file or page makes locks in <wanted>
+ * on the things inside it unnecessary.
+ */
+bool coversChildren(const LockManager::Mode held,
+                    const LockManager::Mode wanted) {
+  return held == LockManager::X ||
+      ((held == LockManager::S || held == LockManager::SIX) &&
+       (wanted == LockManager::S || wanted == LockManager::IS));
+}
+
+}
+
+LockName LockName::file(const std::string& filename) {
+  LockName name;
+  name.filename = filename;
+  name.page_number = Page::INVALID_NUMBER;
+  name.slot_number = Page::INVALID_SLOT;
+  return name;
+}
+
+LockName LockName::page(const std::string& filename,
+                        const PageId page_number) {
+  LockName name = file(filename);
+  name.page_number = page_number;
+  return name;
+}
+
+LockName LockName::record(const std::string& filename,
+                          const RecordId& record_id) {
+  LockName name = page(filename, record_id.page_number);
+  name.slot_number = record_id.slot_number;
+  return name;
+}
+
+LockName::Level LockName::level() const {
+  if (page_number == Page::INVALID_NUMBER) {
+    return FILE_LEVEL;
+  }
+  return slot_number == Page::INVALID_SLOT ? PAGE_LEVEL : RECORD_LEVEL;
+}
+
+std::vector<LockName> LockName::ancestors() const {
+  std::vector<LockName> names;
+  if (level() != FILE_LEVEL) {
+    names.push_back(file(filename));
+  }
+  if (level() == RECORD_LEVEL) {
+    names.push_back(page(filename, page_number));
+  }
+  return names;
+}
+
+bool LockName::operator<(const LockName& rhs) const {
+  // The invalid page and slot numbers are 0, so a file sorts before its
+  // pages and a page before its records.
+  return std::tie(filename, page_number, slot_number) <
+      std::tie(rhs.filename, rhs.page_number, rhs.slot_number);
+}
+
+std::size_t LockNameHash::operator()(const LockName& name) const {
+  return std::hash<std::string>()(name.filename) * 31 * 31 +
+      std::hash<PageId>()(name.page_number) * 31 +
+      std::hash<SlotId>()(name.slot_number);
+}
+
+LockManager::Options LockManager::Options::defaults() {
+  Options options;
+  options.partitions = 64;
+  options.escalation_threshold = 1000;
+  return options;
+}
+
+LockManager::LockManager(const Options& options)
+    : options_(options),
+      next_txn_(1),
+      requests_(0),
+      waits_(0),
+      deadlocks_(0),
+      escalations_(0) {
+  for (std::uint32_t i = 0; i < std::max(1u, options_.partitions); ++i) {
+    partitions_.push_back(std::unique_ptr<Partition>(new Partition));
+  }
+}
+
+TxnId LockManager::beginTransaction() {
+  std::lock_guard<std::mutex> lock(transactions_mutex_);
+  const TxnId txn = next_txn_++;
+  transactions_[txn];
+  return txn;
+}
+
+void LockManager::endTransaction(const TxnId txn) {
+  Transaction& state = transaction(txn);
+  // Finest first, so no page or record is ever locked without its file.
+  while (!state.held.empty()) {
+    release(state, txn, (--state.held.end())->first);
+  }
+  std::lock_guard<std::mutex> lock(transactions_mutex_);
+  transactions_.erase(txn);
+}
+
+void LockManager::lock(const TxnId txn, const LockName& name,
+                       const Mode mode) {
+  lockTree(txn, name, mode, true /* wait */);
+}
+
+bool LockManager::tryLock(const TxnId txn, const LockName& name,
+                          const Mode mode) {
+  return lockTree(txn, name, mode, false /* wait */);
+}
+
+void LockManager::unlock(const TxnId txn, const LockName& name) {
+  release(transaction(txn), txn, name);
+}
+
+bool LockManager::heldMode(const TxnId txn, const LockName& name,
+                           Mode& mode) const {
+  std::lock_guard<std::mutex> lock(transactions_mutex_);
+  const std::unordered_map<TxnId, Transaction>::const_iterator state =
+      transactions_.find(txn);
+  if (state == transactions_.end()) {
+    return false;
+  }
+  const std::map<LockName, Mode>::const_iterator held =
+      state->second.held.find(name);
+  if (held == state->second.held.end()) {
+    return false;
+  }
+  mode = held->second;
+  return true;
+}
+
+LockManager::Stats LockManager::stats() const {
+  Stats stats;
+  stats.requests = requests_;
+  stats.waits = waits_;
+  stats.deadlocks = deadlocks_;
+  stats.escalations = escalations_;
+  return stats;
+}
+
+bool LockManager::compatible(const Mode a, const Mode b) {
+  static const bool COMPATIBLE[NUM_MODES][NUM_MODES] = {
+    //           IS     IX     S      SIX    X
+    /* IS  */ {true,  true,  true,  true,  false},
+    /* IX  */ {true,  true,  false, false, false},
+    /* S   */ {true,  false, true,  false, false},
+    /* SIX */ {true,  false, false, false, false},
+    /* X   */ {false, false, false, false, false},
+  };
+  return COMPATIBLE[a][b];
+}
+
+LockManager::Mode LockManager::supremum(const Mode a, const Mode b) {
+  static const Mode SUPREMUM[NUM_MODES][NUM_MODES] = {
+    //           IS   IX   S    SIX  X
+    /* IS  */ {IS,  IX,  S,   SIX, X},
+    /* IX  */ {IX,  IX,  SIX, SIX, X},
+    /* S   */ {S,   SIX, S,   SIX, X},
+    /* SIX */ {SIX, SIX, SIX, SIX, X},
+    /* X   */ {X,   X,   X,   X,   X},
+  };
+  return SUPREMUM[a][b];
+}
+
+bool LockManager::lockTree(const TxnId txn, const LockName& name,
+                           const Mode mode, const bool wait) {
+  ++requests_;
+  Transaction& state = transaction(txn);
+  const Mode intention = (mode == IS || mode == S) ? IS : IX;
+  const std::vector<LockName> ancestors = name.ancestors();
+  for (std::size_t i = 0; i < ancestors.size(); ++i) {
+    const std::map<LockName, Mode>::const_iterator held =
+        state.held.find(ancestors[i]);
+    if (held != state.held.end() && coversChildren(held->second, mode)) {
+      return true;
+    }
+    if (!acquire(state, txn, ancestors[i], intention, wait)) {
+      return false;
+    }
+  }
+  if (!acquire(state, txn, name, mode, wait)) {
+    return false;
+  }
+  if (name.level() != LockName::FILE_LEVEL) {
+    maybeEscalate(state, txn, name.filename);
+  }
+  return true;
+}
+
+bool LockManager::acquire(Transaction& state, const TxnId txn,
+                          const LockName& name, const Mode mode,
+                          const bool wait) {
+  const std::map<LockName, Mode>::iterator held = state.held.find(name);
+  const bool upgrade = held != state.held.end();
+  const Mode target = upgrade ? supremum(held->second, mode) : mode;
+  if (upgrade && target == held->second) {
+    return true;
+  }
+
+  const std::size_t partition_index = partitionOf(name);
+  Partition& partition = *partitions_[partition_index];
+  std::unique_lock<std::mutex> lock(partition.mutex);
+  // References to elements survive rehashing, and the resource isn't
+  // erased while this request is in it.
+  Resource& resource = partition.resources[name];
+  std::list<Request>::iterator request;
+  if (upgrade) {
+    for (request = resource.requests.begin(); request->txn != txn;
+         ++request) {
+    }
+    request->wanted = target;
+  } else {
+    const Request new_request = {txn, target, target, false};
+    request = resource.requests.insert(resource.requests.end(), new_request);
+  }
+
+  bool waited = false;
+  while (blocked(resource, request, NULL)) {
+    bool abort = false;
+    if (wait) {
+      if (!waited) {
+        waited = true;
+        ++waits_;
+      }
+      updateWaits(resource, partition_index);
+      TxnId victim;
+      std::size_t victim_partition = 0;
+      {
+        std::lock_guard<std::mutex> graph_lock(graph_mutex_);
+        victim = victims_.count(txn) > 0 ? txn : findVictim(txn);
+        if (victim == txn) {
+          victims_.erase(txn);
+          waiters_.erase(txn);
+          abort = true;
+        } else if (victim != 0) {
+          victims_.insert(victim);
+          victim_partition = waiters_[victim].partition;
+        }
+      }
+      if (!abort) {
+        if (victim != 0) {
+          // Wake the victim without holding two partitions' mutexes.
+          lock.unlock();
+          {
+            Partition& other = *partitions_[victim_partition];
+            std::lock_guard<std::mutex> other_lock(other.mutex);
+            other.released.notify_all();
+          }
+          lock.lock();
+        } else {
+          partition.released.wait(lock);
+        }
+        continue;
+      }
+    }
+
+    // Give up: take the request back and let the waiters behind it go on.
+    if (upgrade) {
+      request->wanted = request->mode;
+    } else {
+      resource.requests.erase(request);
+    }
+    if (resource.requests.empty()) {
+      partition.resources.erase(name);
+    } else if (waited) {
+      updateWaits(resource, partition_index);
+      partition.released.notify_all();
+    }
+    if (abort) {
+      ++deadlocks_;
+      throw DeadlockException(txn);
+    }
+    return false;
+  }
+
+  request->mode = target;
+  request->wanted = target;
+  request->granted = true;
+  if (waited) {
+    {
+      std::lock_guard<std::mutex> graph_lock(graph_mutex_);
+      waiters_.erase(txn);
+      victims_.erase(txn);
+    }
+    updateWaits(resource, partition_index);
+  }
+  lock.unlock();
+
+  if (upgrade) {
+    held->second = target;
+  } else {
+    state.held[name] = target;
+    if (name.level() != LockName::FILE_LEVEL) {
+      ++state.fine_locks[name.filename];
+    }
+  }
+  return true;
+}
+
+void LockManager::release(Transaction& state, const TxnId txn,
+                          const LockName& name) {
+  const std::map<LockName, Mode>::iterator held = state.held.find(name);
+  if (held == state.held.end()) {
+    return;
+  }
+  {
+    const std::size_t partition_index = partitionOf(name);
+    Partition& partition = *partitions_[partition_index];
+    std::lock_guard<std::mutex> lock(partition.mutex);
+    const std::unordered_map<LockName, Resource, LockNameHash>::iterator
+        resource = partition.resources.find(name);
+    std::list<Request>& requests = resource->second.requests;
+    for (std::list<Request>::iterator request = requests.begin();
+         request != requests.end(); ++request) {
+      if (request->txn == txn) {
+        requests.erase(request);
+        break;
+      }
+    }
+    if (requests.empty()) {
+      partition.resources.erase(resource);
+    } else {
+      updateWaits(resource->second, partition_index);
+      partition.released.notify_all();
+    }
+  }
+  if (name.level() != LockName::FILE_LEVEL &&
+      --state.fine_locks[name.filename] == 0) {
+    state.fine_locks.erase(name.filename);
+  }
+  state.held.erase(held);
+}
+
+void LockManager::maybeEscalate(Transaction& state, const TxnId txn,
+                                const std::string& filename) {
+  if (options_.escalation_threshold == 0) {
+    return;
+  }
+  const std::map<std::string, std::uint32_t>::const_iterator count =
+      state.fine_locks.find(filename);
+  if (count == state.fine_locks.end() ||
+      count->second % options_.escalation_threshold != 0) {
+    return;
+  }
+
+  const LockName file = LockName::file(filename);
+  std::vector<LockName> fine_names;
+  Mode mode = S;
+  for (std::map<LockName, Mode>::const_iterator held =
+           state.held.upper_bound(file);
+       held != state.held.end() && held->first.filename == filename;
+       ++held) {
+    fine_names.push_back(held->first);
+    if (held->second != IS && held->second != S) {
+      mode = X;
+    }
+  }
+  if (!acquire(state, txn, file, mode, false /* wait */)) {
+    return;
+  }
+  ++escalations_;
+  for (std::size_t i = fine_names.size(); i > 0; --i) {
+    release(state, txn, fine_names[i - 1]);
+  }
+}
+
+bool LockManager::blocked(const Resource& resource,
+                          const std::list<Request>::const_iterator request,
+                          std::set<TxnId>* blockers) {
+  // Upgrades wait only for the holders; new requests also wait behind
+  // earlier requests they conflict with.
+  const bool upgrade = request->granted;
+  bool earlier = true;
+  bool is_blocked = false;
+  for (std::list<Request>::const_iterator other = resource.requests.begin();
+       other != resource.requests.end(); ++other) {
+    if (other == request) {
+      earlier = false;
+      continue;
+    }
+    const bool conflicts = other->granted
+        ? !compatible(other->mode, request->wanted)
+        : !upgrade && earlier && !compatible(other->wanted, request->wanted);
+    if (conflicts) {
+      if (blockers == NULL) {
+        return true;
+      }
+      blockers->insert(other->txn);
+      is_blocked = true;
+    }
+  }
+  return is_blocked;
+}
+
+void LockManager::updateWaits(const Resource& resource,
+                              const std::size_t partition) {
+  std::lock_guard<std::mutex> graph_lock(graph_mutex_);
+  for (std::list<Request>::const_iterator request = resource.requests.begin();
+       request != resource.requests.end(); ++request) {
+    if (request->granted && request->wanted == request->mode) {
+      continue;
+    }
+    std::set<TxnId> blockers;
+    if (blocked(resource, request, &blockers)) {
+      Waiter& waiter = waiters_[request->txn];
+      waiter.blockers.swap(blockers);
+      waiter.partition = partition;
+    } else {
+      // About to be granted once its thread wakes up.
+      waiters_.erase(request->txn);
+    }
+  }
+}
+
+TxnId LockManager::findVictim(const TxnId txn) const {
+  const std::map<TxnId, Waiter>::const_iterator start = waiters_.find(txn);
+  if (start == waiters_.end()) {
+    return 0;
+  }
+  // Depth-first search for a path back to <txn>; a transaction already
+  // searched from without finding one can't be on a cycle through it.
+  std::vector<TxnId> path(1, txn);
+  std::vector<std::set<TxnId>::const_iterator> positions(
+      1, start->second.blockers.begin());
+  std::set<TxnId> visited;
+  visited.insert(txn);
+  while (!path.empty()) {
+    const std::set<TxnId>& blockers = waiters_.find(path.back())->second.blockers;
+    if (positions.back() == blockers.end()) {
+      path.pop_back();
+      positions.pop_back();
+      continue;
+    }
+    const TxnId next = *positions.back()++;
+    if (next == txn) {
+      return *std::max_element(path.begin(), path.end());
+    }
+    const std::map<TxnId, Waiter>::const_iterator waiter = waiters_.find(next);
+    if (waiter == waiters_.end() || victims_.count(next) > 0 ||
+        !visited.insert(next).second) {
+      continue;
+    }
+    path.push_back(next);
+    positions.push_back(waiter->second.blockers.begin());
+  }
+  return 0;
+}
+
+LockManager::Transaction& LockManager::transaction(const TxnId txn) {
+  std::lock_guard<std::mutex> lock(transactions_mutex_);
+  return transactions_[txn];
+}
+
+std::size_t LockManager::partitionOf(const LockName& name) const {
+  return LockNameHash()(name) % partitions_.size();
+}
+
+}
@@ -0,0 +1,397 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "page.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * Identifies a transaction to the lock manager.
+ */
+typedef std::uint64_t TxnId;
+
+/**
+ * @brief Something that can be locked: a whole file, a page of a file, or a
+ *        record of a page.
+ *
+ * Names order by file, then page, then slot, so a file's name comes just
+ * before those of its pages and records.
+ */
+struct LockName {
+  /**
+   * Granularities, coarsest first.
+   */
+  enum Level { FILE_LEVEL, PAGE_LEVEL, RECORD_LEVEL };
+
+  static LockName file(const std::string& filename);
+  static LockName page(const std::string& filename, const PageId page_number);
+  static LockName record(const std::string& filename,
+                         const RecordId& record_id);
+
+  Level level() const;
+
+  /**
+   * Returns the names of the file and page this name lies in, coarsest
+   * first; empty for a file.
+   */
+  std::vector<LockName> ancestors() const;
+
+  bool operator==(const LockName& rhs) const {
+    return filename == rhs.filename && page_number == rhs.page_number &&
+        slot_number == rhs.slot_number;
+  }
+
+  bool operator<(const LockName& rhs) const;
+
+  std::string filename;
+
+  /**
+   * Page::INVALID_NUMBER for a file.
+   */
+  PageId page_number;
+
+  /**
+   * Page::INVALID_SLOT for a file or page.
+   */
+  SlotId slot_number;
+};
+
+/**
+ * @brief Hashes a LockName, for the lock table.
+ */
+struct LockNameHash {
+  std::size_t operator()(const LockName& name) const;
+};
+
+/**
+ * @brief Hierarchical two-phase lock manager for concurrent transactions.
+ *
+ * Transactions lock files, pages and records in shared or exclusive mode.
+ * Locking a page or record first takes the matching intention lock (IS or
+ * IX) on its file and page, so a transaction locking a whole file waits only
+ * for transactions using that file in a conflicting way, and a lock already
+ * held on the file (S or SIX for reads, X for anything) makes finer locks
+ * unnecessary.  Modes and what they allow others:
+ *
+ *          IS   IX   S    SIX  X
+ *     IS   yes  yes  yes  yes  no
+ *     IX   yes  yes  no   no   no
+ *     S    yes  no   yes  no   no
+ *     SIX  yes  no   no   no   no
+ *     X    no   no   no   no   no
+ *
+ * Asking for a lock already held in another mode upgrades it to a mode
+ * covering both (e.g. S and IX give SIX).  Upgrades are served ahead of new
+ * requests; new requests are served in order of arrival.
+ *
+ * Once a transaction holds Options::escalation_threshold page and record
+ * locks in one file, the manager tries to trade them for a single S or X
+ * lock on the file.  If that can't be granted right away, the transaction
+ * keeps its fine-grained locks and the manager tries again after as many
+ * more.
+ *
+ * Waiting transactions form a wait-for graph.  When a wait closes a cycle,
+ * the youngest transaction in it (the one with the highest ID) is chosen as
+ * the victim: its lock() throws DeadlockException, and it must then abort
+ * and call endTransaction() to give up its locks.
+ *
+ * The lock table is split into partitions by name, each with its own mutex,
+ * so transactions locking different things rarely contend.  The manager is
+ * threadsafe, but each transaction must be used by one thread at a time.
+ */
+class LockManager {
+ public:
+  /**
+   * Lock modes.
+   */
+  enum Mode {
+    IS,   // Intention to lock finer items shared.
+    IX,   // Intention to lock finer items exclusive.
+    S,    // Shared.
+    SIX,  // Shared, with intention to lock finer items exclusive.
+    X,    // Exclusive.
+    NUM_MODES
+  };
+
+  /**
+   * Settings of a lock manager.
+   */
+  struct Options {
+    /**
+     * Partitions of the lock table.
+     */
+    std::uint32_t partitions;
+
+    /**
+     * Page and record locks a transaction may hold in one file before the
+     * manager tries to escalate them; 0 means never.
+     */
+    std::uint32_t escalation_threshold;
+
+    /**
+     * Returns the defaults: 64 partitions, escalation at 1000 locks.
+     */
+    static Options defaults();
+  };
+
+  /**
+   * What the manager has done.
+   */
+  struct Stats {
+    std::uint64_t requests;
+
+    /**
+     * Requests that had to wait.
+     */
+    std::uint64_t waits;
+
+    std::uint64_t deadlocks;
+    std::uint64_t escalations;
+  };
+
+  /**
+   * Creates a lock manager.
+   *
+   * @param options   Settings.
+   */
+  explicit LockManager(const Options& options = Options::defaults());
+
+  /**
+   * Starts a transaction.
+   *
+   * @return  ID of the transaction; later transactions get higher IDs.
+   */
+  TxnId beginTransaction();
+
+  /**
+   * Ends a transaction, releasing all its locks.
+   *
+   * @param txn   Transaction to end.
+   */
+  void endTransaction(const TxnId txn);
+
+  /**
+   * Locks a file, page or record, and its file and page in the matching
+   * intention mode, waiting until the locks can be granted.
+   *
+   * @param txn   Transaction asking.
+   * @param name  What to lock.
+   * @param mode  Mode to lock it in.
+   * @throws  DeadlockException   If <txn> is chosen as the victim of a
+   *                              deadlock while waiting.  Locks granted
+   *                              before stay held.
+   */
+  void lock(const TxnId txn, const LockName& name, const Mode mode);
+
+  /**
+   * Like lock(), but gives up instead of waiting.
+   *
+   * @return  Whether the locks were granted.  Intention locks granted on the
+   *          way stay held if the last one isn't.
+   */
+  bool tryLock(const TxnId txn, const LockName& name, const Mode mode);
+
+  /**
+   * Releases one lock early, e.g. a shared lock under a weaker isolation
+   * level.  The transaction must not hold locks inside <name>.
+   *
+   * @param txn   Transaction holding the lock.
+   * @param name  Lock to release; does nothing if not held.
+   */
+  void unlock(const TxnId txn, const LockName& name);
+
+  /**
+   * Returns the mode a transaction holds a lock in.
+   *
+   * @param txn   Transaction.
+   * @param name  Lock.
+   * @param mode  Receives the mode if held.
+   * @return  Whether the lock is held.
+   */
+  bool heldMode(const TxnId txn, const LockName& name, Mode& mode) const;
+
+  /**
+   * Returns what the manager has done so far.
+   */
+  Stats stats() const;
+
+  /**
+   * Returns whether locks in the two modes may be held by different
+   * transactions at once.
+   */
+  static bool compatible(const Mode a, const Mode b);
+
+  /**
+   * Returns the weakest mode that allows everything both modes allow.
+   */
+  static Mode supremum(const Mode a, const Mode b);
+
+ private:
+  /**
+   * A transaction's hold on, or wait for, a lock.
+   */
+  struct Request {
+    TxnId txn;
+
+    /**
+     * Mode held, if granted.
+     */
+    Mode mode;
+
+    /**
+     * Mode asked for; differs from <mode> while an upgrade waits.
+     */
+    Mode wanted;
+
+    bool granted;
+  };
+
+  /**
+   * Requests for one lock: granted ones and waiting ones in arrival order.
+   */
+  struct Resource {
+    std::list<Request> requests;
+  };
+
+  /**
+   * An independently locked part of the lock table.
+   */
+  struct Partition {
+    std::mutex mutex;
+
+    /**
+     * Signalled when a lock is released or a waiter is chosen as a victim.
+     */
+    std::condition_variable released;
+
+    std::unordered_map<LockName, Resource, LockNameHash> resources;
+  };
+
+  /**
+   * Locks held by a transaction.  Only the transaction's thread uses it.
+   */
+  struct Transaction {
+    std::map<LockName, Mode> held;
+
+    /**
+     * Page and record locks held per file.
+     */
+    std::map<std::string, std::uint32_t> fine_locks;
+  };
+
+  /**
+   * A waiting transaction in the wait-for graph.
+   */
+  struct Waiter {
+    /**
+     * Transactions it waits for.
+     */
+    std::set<TxnId> blockers;
+
+    /**
+     * Partition it waits in.
+     */
+    std::size_t partition;
+  };
+
+  /**
+   * Locks a name and its ancestors; see lock() and tryLock().
+   */
+  bool lockTree(const TxnId txn, const LockName& name, const Mode mode,
+                const bool wait);
+
+  /**
+   * Locks one name in a mode, upgrading a lock already held.  Returns false
+   * if <wait> is false and the lock can't be granted right away.
+   */
+  bool acquire(Transaction& transaction, const TxnId txn,
+               const LockName& name, const Mode mode, const bool wait);
+
+  /**
+   * Releases one lock held by a transaction.
+   */
+  void release(Transaction& transaction, const TxnId txn,
+               const LockName& name);
+
+  /**
+   * Trades a transaction's page and record locks in a file for a file lock
+   * if it holds enough of them.
+   */
+  void maybeEscalate(Transaction& transaction, const TxnId txn,
+                     const std::string& filename);
+
+  /**
+   * Returns whether a request must wait, and if <blockers> is not NULL, adds
+   * the transactions it waits for.  Called with the partition's mutex held.
+   */
+  static bool blocked(const Resource& resource,
+                      const std::list<Request>::const_iterator request,
+                      std::set<TxnId>* blockers);
+
+  /**
+   * Recomputes the wait-for edges of the waiters of a lock.  Called with the
+   * partition's mutex held.
+   */
+  void updateWaits(const Resource& resource, const std::size_t partition);
+
+  /**
+   * Returns the victim of a deadlock <txn> is part of, or 0 if there is none.
+   * Called with <graph_mutex_> held.
+   */
+  TxnId findVictim(const TxnId txn) const;
+
+  Transaction& transaction(const TxnId txn);
+
+  std::size_t partitionOf(const LockName& name) const;
+
+  const Options options_;
+
+  std::vector<std::unique_ptr<Partition> > partitions_;
+
+  /**
+   * Protects the transaction table.
+   */
+  mutable std::mutex transactions_mutex_;
+  std::unordered_map<TxnId, Transaction> transactions_;
+  TxnId next_txn_;
+
+  /**
+   * Protects the wait-for graph and the victims.  Taken after a partition's
+   * mutex, never before.
+   */
+  std::mutex graph_mutex_;
+  std::map<TxnId, Waiter> waiters_;
+
+  /**
+   * Waiting transactions chosen as deadlock victims that haven't noticed
+   * yet.
+   */
+  std::set<TxnId> victims_;
+
+  std::atomic<std::uint64_t> requests_;
+  std::atomic<std::uint64_t> waits_;
+  std::atomic<std::uint64_t> deadlocks_;
+  std::atomic<std::uint64_t> escalations_;
+};
+
+}
@@ -1,17 +1,56 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <fstream>
+#include <iterator>
 #include <stdlib.h>
 #include <stdio.h>
+#include <thread>
 #include <cstring>
+#include <map>
 #include <memory>
+#include <set>
+#include <vector>
+#include <csignal>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
 #include "page.h"
 #include "buffer.h"
+#include "change_tracker.h"
+#include "file_analyzer.h"
 #include "file_iterator.h"
+#include "file_vacuum.h"
+#include "flash_cache.h"
+#include "free_space_map.h"
+#include "hash_aggregate.h"
+#include "io_scheduler.h"
+#include "lock_manager.h"
+#include "online_backup.h"
 #include "page_iterator.h"
+#include "physical_file_iterator.h"
+#include "query_operator.h"
+#include "record_cache.h"
+#include "replication.h"
+#include "shared_buffer.h"
+#include "shared_scan.h"
+#include "simulated_device.h"
+#include "tablespace.h"
+#include "tiered_store.h"
+#include "zone_map.h"
+#include "exceptions/file_exists_exception.h"
 #include "exceptions/file_not_found_exception.h"
+#include "exceptions/insufficient_space_exception.h"
 #include "exceptions/invalid_page_exception.h"
+#include "exceptions/invalid_record_exception.h"
+#include "exceptions/io_error_exception.h"
 #include "exceptions/page_not_pinned_exception.h"
 #include "exceptions/page_pinned_exception.h"
 #include "exceptions/buffer_exceeded_exception.h"
+#include "exceptions/deadlock_exception.h"
 
 #define PRINT_ERROR(str) \
 { \
@@ -36,6 +75,28 @@ void test3();
 void test4();
 void test5();
 void test6();
+void testLegacyPageFormat();
+void testFreeSpaceMap();
+void testFileVacuum();
+void testPhysicalScan();
+void testPageDelete();
+void testFillFactor();
+void testFileAnalyzer();
+void testTieredStore();
+void testFlashCache();
+void testSharedBuffer();
+void testTablespace();
+void testOnlineBackup();
+void testReplication();
+void testIoScheduler();
+void testHashAggregateSpill();
+void testSimulatedDevice();
+void testZoneMap();
+void testRecordCache();
+void testSharedScan();
+void testReadRecords();
+void testOperatorPipeline();
+void testLockManager();
 void testBufMgr();
 
 int main() 
@@ -74,12 +135,15 @@ int main()
     for (FileIterator iter = new_file.begin();
          iter != new_file.end();
          ++iter) {
+      // Dereferencing the iterator returns a copy of the page, so keep it alive
+      // while iterating over its records.
+      Page current_page = *iter;
       // Iterate through all records on the page.
-      for (PageIterator page_iter = (*iter).begin();
-           page_iter != (*iter).end();
+      for (PageIterator page_iter = current_page.begin();
+           page_iter != current_page.end();
            ++page_iter) {
         std::cout << "Found record: " << *page_iter
-            << " on page " << (*iter).page_number() << "\n";
+            << " on page " << current_page.page_number() << "\n";
       }
     }
 
@@ -146,6 +210,28 @@ void testBufMgr()
 	test4();
 	test5();
 	test6();
+	testLegacyPageFormat();
+	testFreeSpaceMap();
+	testFileVacuum();
+	testPhysicalScan();
+	testPageDelete();
+	testFillFactor();
+	testFileAnalyzer();
+	testTieredStore();
+	testFlashCache();
+	testSharedBuffer();
+	testTablespace();
+	testOnlineBackup();
+	testReplication();
+	testIoScheduler();
+	testHashAggregateSpill();
+	testSimulatedDevice();
+	testZoneMap();
+	testRecordCache();
+	testSharedScan();
+	testReadRecords();
+	testOperatorPipeline();
+	testLockManager();
 
 	//Close files before deleting them
 	file1.~File();
@@ -325,3 +411,1741 @@ void test6()
 
 	bufMgr->flushFile(file1ptr);
 }
+
+void testLegacyPageFormat()
+{
+	const std::string& filename = "test.legacy";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	std::vector<PageId> pages;
+	{
+		File file = File::create(filename);
+		for (int i = 0; i < 2; i++)
+		{
+			Page new_page = file.allocatePage();
+			file.writePage(new_page);
+			pages.push_back(new_page.page_number());
+		}
+	}
+
+	// rewrite both pages in the layout used before pages had a format
+	// version: 6-byte slots with a used flag, the second slot deleted
+	const std::string first("legacy first");
+	const std::string third("legacy third");
+	{
+		std::fstream stream(filename,
+				std::fstream::in | std::fstream::out | std::fstream::binary);
+		for (std::size_t i = 0; i < pages.size(); i++)
+		{
+			const std::streamoff position =
+				sizeof(FileHeader) + (pages[i] - 1) * Page::SIZE;
+			PageHeader header;
+			stream.seekg(position);
+			stream.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+			std::vector<char> data(Page::DATA_SIZE, 0);
+			const std::uint16_t legacy_slot_size = 6;
+			const std::uint16_t first_offset = Page::DATA_SIZE - first.length();
+			const std::uint16_t third_offset = first_offset - third.length();
+			std::memcpy(&data[first_offset], first.data(), first.length());
+			std::memcpy(&data[third_offset], third.data(), third.length());
+			const std::uint16_t slots[3][2] = {
+				{first_offset, static_cast<std::uint16_t>(first.length())},
+				{0, 0},
+				{third_offset, static_cast<std::uint16_t>(third.length())}};
+			for (int slot = 0; slot < 3; slot++)
+			{
+				data[slot * legacy_slot_size] = slots[slot][1] > 0;
+				std::memcpy(&data[slot * legacy_slot_size + 2], slots[slot], 4);
+			}
+			// the legacy header kept the free space lower bound here
+			header.format_version = 3 * legacy_slot_size;
+			header.free_space_upper_bound = third_offset;
+			header.num_slots = 3;
+			header.num_free_slots = 1;
+
+			stream.seekp(position);
+			stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			stream.write(&data[0], data.size());
+		}
+	}
+
+	{
+		File file = File::open(filename);
+		Page legacy_page = file.readPage(pages[0]);
+		if (legacy_page.getRecord(RecordId{pages[0], 1}) != first ||
+				legacy_page.getRecord(RecordId{pages[0], 3}) != third)
+			PRINT_ERROR("ERROR :: Legacy page read back wrong.");
+		try
+		{
+			legacy_page.getRecord(RecordId{pages[0], 2});
+			PRINT_ERROR("ERROR :: Deleted legacy slot was read. Exception should have been thrown before execution reaches this point.");
+		}
+		catch(InvalidRecordException e)
+		{
+		}
+		if (legacy_page.getFreeSpace() !=
+				Page::DATA_SIZE - first.length() - third.length() - 3 * sizeof(PageSlot))
+			PRINT_ERROR("ERROR :: Legacy slot array was not converted.");
+
+		// the converted page takes new records and is written in the new layout
+		if (legacy_page.insertRecord("new record").slot_number != 2)
+			PRINT_ERROR("ERROR :: Deleted legacy slot was not reused.");
+		file.writePage(legacy_page);
+		if (file.readPage(pages[0]).getRecord(RecordId{pages[0], 2}) != "new record")
+			PRINT_ERROR("ERROR :: Converted page was not written back.");
+
+		// a batched fetch reads both pages with one multi-page read
+		BufMgr legacyMgr(4);
+		std::vector<RecordId> rids;
+		rids.push_back(RecordId{pages[1], 3});
+		rids.push_back(RecordId{pages[0], 1});
+		rids.push_back(RecordId{pages[1], 1});
+		std::vector<std::string> records;
+		legacyMgr.readRecords(&file, rids, records);
+		if (records[0] != third || records[1] != first || records[2] != first)
+			PRINT_ERROR("ERROR :: Legacy pages read back wrong in a batch.");
+	}
+	File::remove(filename);
+
+	std::cout << "Legacy page format test passed" << "\n";
+}
+
+void testFreeSpaceMap()
+{
+	const std::string& filename = "test.fsm";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	const std::string record(100, 'r');
+	std::vector<RecordId> rids;
+	{
+		File file = File::create(filename);
+		{
+			// a map left behind by a crash is rebuilt, not trusted
+			File leftover = File::create(FreeSpaceMap::mapFilename(filename));
+			leftover.allocatePage();
+		}
+		try
+		{
+			file.enableFreeSpaceMap();
+		}
+		catch(FileExistsException e)
+		{
+			PRINT_ERROR("ERROR :: Leftover free-space map should have been rebuilt.");
+		}
+
+		// inserts fill each page before starting the next
+		for (i = 0; i < 200; i++)
+		{
+			rids.push_back(bufMgr->insertRecord(&file, record));
+			if (i > 0 && rids[i].page_number < rids[i - 1].page_number)
+				PRINT_ERROR("ERROR :: Record went back to a full page.");
+		}
+		if (rids.back().page_number != 3)
+			PRINT_ERROR("ERROR :: Records were not packed onto pages.");
+
+		// a record that fits on no page leaves no new page behind
+		for (int attempt = 0; attempt < 3; attempt++)
+		{
+			try
+			{
+				bufMgr->insertRecord(&file, std::string(Page::DATA_SIZE, 'x'));
+				PRINT_ERROR("ERROR :: Oversized record was inserted. Exception should have been thrown before execution reaches this point.");
+			}
+			catch(InsufficientSpaceException e)
+			{
+			}
+		}
+		int usedPages = 0;
+		for (FileIterator iter = file.begin(); iter != file.end(); ++iter)
+			usedPages++;
+		if (usedPages != 3)
+			PRINT_ERROR("ERROR :: Failed insert left its new page allocated.");
+
+		// space freed in the pool is found before the page is written back
+		bufMgr->readPage(&file, 1, page);
+		for (i = 0; i < 10; i++)
+			page->deleteRecord(rids[i]);
+		bufMgr->unPinPage(&file, 1, true);
+		if (bufMgr->insertRecord(&file, record).page_number == 1)
+			PRINT_ERROR("ERROR :: Record went into the holes of an uncompacted page.");
+		if (bufMgr->defragment(num, 10 * record.length()) != 1)
+			PRINT_ERROR("ERROR :: Fragmented page was not compacted.");
+		if (bufMgr->insertRecord(&file, record).page_number != 1)
+			PRINT_ERROR("ERROR :: Free space on a dirty page was not found.");
+		bufMgr->flushFile(&file);
+	}
+
+	// the map is loaded again on open
+	{
+		File file = File::open(filename);
+		if (!file.hasFreeSpaceMap() || file.findPageWithSpace(record.length()) != 1)
+			PRINT_ERROR("ERROR :: Free-space map was not loaded on open.");
+	}
+	File::remove(filename);
+
+	std::cout << "Free-space map test passed" << "\n";
+}
+
+void testFileVacuum()
+{
+	const std::string& filename = "test.vac";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		File file = File::create(filename);
+		// pages 1-5 stay 70% full; pages 6-10 keep only a few records
+		std::map<RecordId, std::string> records;
+		for (PageId p = 1; p <= 10; p++)
+		{
+			PageId pageNo;
+			bufMgr->allocPage(&file, pageNo, page);
+			for (int r = 0; r < 55; r++)
+			{
+				sprintf(tmpbuf, "test.vac Page %d Record %d", pageNo, r);
+				const std::string record = tmpbuf + std::string(70, '.');
+				const RecordId& rid = page->insertRecord(record);
+				if (pageNo <= 5 || r % 10 == 0)
+					records[rid] = record;
+				else
+					page->deleteRecord(rid);
+			}
+			bufMgr->unPinPage(&file, pageNo, true);
+		}
+		bufMgr->flushFile(&file);
+
+		FileVacuum vacuum(bufMgr, &file);
+		const BufStats& stats = bufMgr->getBufStats();
+		while (!vacuum.done())
+		{
+			const int before = stats.diskreads + stats.diskwrites;
+			vacuum.step(4);
+			// one unit of work may finish past the budget, but not by much
+			if (stats.diskreads + stats.diskwrites - before > 4 + 4)
+				PRINT_ERROR("ERROR :: Vacuum step went well over its I/O budget.");
+		}
+		if (vacuum.pagesFreed() != 5 || vacuum.recordsMoved() != 30)
+			PRINT_ERROR("ERROR :: Vacuum did not empty the sparse pages.");
+		if (file.allocationMap().size() != 6)
+			PRINT_ERROR("ERROR :: Vacuum did not truncate the file.");
+
+		// every record is found where the relocation map says it went
+		for (std::map<RecordId, std::string>::const_iterator iter = records.begin();
+		     iter != records.end(); ++iter)
+		{
+			const RecordId& rid = vacuum.resolve(iter->first);
+			if (rid.page_number > 5)
+				PRINT_ERROR("ERROR :: Record was left on a freed page.");
+			bufMgr->readPage(&file, rid.page_number, page);
+			if (page->getRecord(rid) != iter->second)
+				PRINT_ERROR("ERROR :: Relocated record does not match.");
+			bufMgr->unPinPage(&file, rid.page_number, false);
+		}
+		bufMgr->flushFile(&file);
+	}
+	File::remove(filename);
+
+	// with an I/O scheduler, the file is read and truncated on its worker,
+	// behind the writes still queued there
+	{
+		File file = File::create(filename);
+		IoScheduler scheduler;
+		BufMgr scheduledMgr(20);
+		scheduledMgr.setIoScheduler(&scheduler);
+		for (PageId p = 1; p <= 4; p++)
+		{
+			PageId pageNo;
+			scheduledMgr.allocPage(&file, pageNo, page);
+			const int kept = pageNo <= 2 ? 80 : 2;
+			for (int r = 0; r < kept; r++)
+				page->insertRecord(std::string(70, 'v'));
+			scheduledMgr.unPinPage(&file, pageNo, true);
+		}
+		scheduledMgr.startFlushFile(&file);
+		FileVacuum vacuum(&scheduledMgr, &file);
+		vacuum.run();
+		scheduledMgr.flushFile(&file);
+		if (vacuum.pagesFreed() != 2 || file.allocationMap().size() != 3)
+			PRINT_ERROR("ERROR :: Vacuum through a scheduler did not truncate the file.");
+	}
+	File::remove(filename);
+
+	std::cout << "File vacuum test passed" << "\n";
+}
+
+void testPhysicalScan()
+{
+	const std::string& filename = "test.phys";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		File file = File::create(filename);
+		for (PageId p = 1; p <= 8; p++)
+		{
+			Page new_page = file.allocatePage();
+			sprintf(tmpbuf, "test.phys Page %d", new_page.page_number());
+			new_page.insertRecord(tmpbuf);
+			file.writePage(new_page);
+		}
+		file.deletePage(3);
+		file.deletePage(6);
+
+		// the scan visits used pages in file order, skipping the free ones
+		PageId expected[] = {1, 2, 4, 5, 7, 8};
+		std::size_t n = 0;
+		for (PhysicalFileIterator iter = file.physicalBegin();
+		     iter != file.physicalEnd(); ++iter, ++n)
+		{
+			Page current_page = *iter;
+			sprintf(tmpbuf, "test.phys Page %d", expected[n]);
+			if (n >= 6 || current_page.page_number() != expected[n] ||
+			    *current_page.begin() != tmpbuf)
+				PRINT_ERROR("ERROR :: Physical scan visited the wrong page.");
+		}
+		if (n != 6)
+			PRINT_ERROR("ERROR :: Physical scan missed pages.");
+
+		// reused pages are linked back in page order
+		file.allocatePage();
+		file.allocatePage();
+		file.reorderPageLists();
+		PageId previous = Page::INVALID_NUMBER;
+		n = 0;
+		for (FileIterator iter = file.begin(); iter != file.end(); ++iter, ++n)
+		{
+			if ((*iter).page_number() <= previous)
+				PRINT_ERROR("ERROR :: Used page list is out of order.");
+			previous = (*iter).page_number();
+		}
+		if (n != 8)
+			PRINT_ERROR("ERROR :: Used page list lost pages.");
+	}
+	File::remove(filename);
+
+	std::cout << "Physical scan test passed" << "\n";
+}
+
+void testPageDelete()
+{
+	Page test_page;
+	const std::string record(1000, 'd');
+	RecordId rids[8];
+	for (int r = 0; r < 8; r++)
+		rids[r] = test_page.insertRecord(record);
+	const std::uint16_t full_free_space = test_page.getFreeSpace();
+
+	// deleting from the middle moves nothing and leaves a hole
+	test_page.deleteRecord(rids[3]);
+	if (test_page.getFreeSpace() != full_free_space ||
+			test_page.getFragmentedBytes() != record.length())
+		PRINT_ERROR("ERROR :: Deleted record did not leave a hole.");
+	for (int r = 0; r < 8; r++)
+		if (r != 3 && test_page.getRecord(rids[r]) != record)
+			PRINT_ERROR("ERROR :: Records were damaged by a delete.");
+
+	// shrinking updates are done in place
+	test_page.updateRecord(rids[0], std::string(500, 's'));
+	if (test_page.getFreeSpace() != full_free_space ||
+			test_page.getFragmentedBytes() != record.length() + 500)
+		PRINT_ERROR("ERROR :: Shrinking update was not done in place.");
+
+	// a growing update that only fits once the holes are closed compacts
+	test_page.updateRecord(rids[1], std::string(1100, 'g'));
+	if (test_page.getFragmentedBytes() != 0 ||
+			test_page.getFreeSpace() != full_free_space + record.length() + 500 - 100)
+		PRINT_ERROR("ERROR :: Growing update did not compact the page.");
+	if (test_page.getRecord(rids[0]) != std::string(500, 's') ||
+			test_page.getRecord(rids[1]) != std::string(1100, 'g'))
+		PRINT_ERROR("ERROR :: Updated records were damaged by compaction.");
+	for (int r = 2; r < 8; r++)
+		if (r != 3 && test_page.getRecord(rids[r]) != record)
+			PRINT_ERROR("ERROR :: Records were damaged by compaction.");
+
+	// the dead slot keeps its number and is the next one used
+	const RecordId& rid = test_page.insertRecord(std::string(1000, 'n'));
+	if (rid.slot_number != rids[3].slot_number)
+		PRINT_ERROR("ERROR :: Unused slot in the middle was not reused.");
+
+	// deleting the record next to the free space gives its space back, with
+	// the hole above it
+	const std::uint16_t free_space = test_page.getFreeSpace();
+	test_page.deleteRecord(rids[1]);
+	test_page.deleteRecord(rid);
+	if (test_page.getFreeSpace() != free_space + record.length() + 1100 ||
+			test_page.getFragmentedBytes() != 0)
+		PRINT_ERROR("ERROR :: Space next to the free space was not reclaimed.");
+
+	std::cout << "Page delete test passed" << "\n";
+}
+
+void testFillFactor()
+{
+	const std::string& filename = "test.fill";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	const std::string record(100, 'f');
+	PageId pageNo;
+	RecordId first;
+	{
+		File file = File::create(filename);
+		// a page already in the pool follows a fill factor set later
+		bufMgr->allocPage(&file, pageNo, page);
+		file.setFillFactor(70);
+		first = page->insertRecord(record);
+		while (page->hasSpaceForRecord(record))
+			page->insertRecord(record);
+		if (page->getFreeSpace() < Page::DATA_SIZE * 30 / 100)
+			PRINT_ERROR("ERROR :: Inserts used the reserved space.");
+
+		// updates may grow into it
+		page->updateRecord(first, std::string(1000, 'g'));
+		if (file.reservationStats().reserve_uses != 1)
+			PRINT_ERROR("ERROR :: Growing update was not counted.");
+		bufMgr->unPinPage(&file, pageNo, true);
+		bufMgr->flushFile(&file);
+	}
+
+	// the setting survives the file being closed
+	{
+		File file = File::open(filename);
+		if (file.fillFactor() != 70)
+			PRINT_ERROR("ERROR :: Fill factor was lost on close.");
+		file.setFillFactor(100);
+	}
+	{
+		File file = File::open(filename);
+		if (file.fillFactor() != 100)
+			PRINT_ERROR("ERROR :: Fill factor was not reset.");
+	}
+
+	// a record above the fill limit still goes on a page of its own
+	{
+		File file = File::open(filename);
+		file.setFillFactor(50);
+		const std::string big_record(5000, 'b');
+		const std::vector<RecordId>& loaded =
+			file.bulkLoad(std::vector<std::string>(2, big_record));
+		if (loaded[0].page_number == loaded[1].page_number ||
+				file.readPage(loaded[1].page_number).getRecord(loaded[1]) != big_record)
+			PRINT_ERROR("ERROR :: Record above the fill limit was not bulk loaded.");
+		const RecordId& rid = bufMgr->insertRecord(&file, big_record);
+		bufMgr->readPage(&file, rid.page_number, page);
+		if (page->getRecord(rid) != big_record)
+			PRINT_ERROR("ERROR :: Record above the fill limit was not inserted.");
+		bufMgr->unPinPage(&file, rid.page_number, false);
+		bufMgr->flushFile(&file);
+	}
+	File::remove(filename);
+
+	std::cout << "Fill factor test passed" << "\n";
+}
+
+void testFileAnalyzer()
+{
+	const std::string& filename = "test.analyze";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		File file = File::create(filename);
+		for (int i = 0; i < 5; i++)
+		{
+			Page new_page = file.allocatePage();
+			new_page.insertRecord("analyzed record");
+			file.writePage(new_page);
+		}
+		// nothing has been accessed, so every page moves to the slow tier
+		file.enableTiering(".");
+		if (file.migratePages(5) != 5 || file.coldPages() != 5)
+			PRINT_ERROR("ERROR :: Pages were not moved to the slow tier.");
+	}
+
+	const FileReport& report = FileAnalyzer(filename, 2).analyze();
+	if (report.used_pages != 5 || report.free_pages != 0)
+		PRINT_ERROR("ERROR :: Cold pages were not counted as used.");
+	if (report.records != 5)
+		PRINT_ERROR("ERROR :: Records on cold pages were not counted.");
+	File::remove(filename);
+
+	std::cout << "File analyzer test passed" << "\n";
+}
+
+void testTieredStore()
+{
+	const std::string& filename = "test.tiered";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	PageId first_page = Page::INVALID_NUMBER;
+	{
+		File file = File::create(filename);
+		for (int i = 0; i < 5; i++)
+		{
+			Page new_page = file.allocatePage();
+			new_page.insertRecord("tiered record");
+			file.writePage(new_page);
+			if (i == 0)
+				first_page = new_page.page_number();
+		}
+		file.enableTiering(".");
+		file.migratePages(5);
+	}
+	if (File::exists(TieredStore::mapFilename(filename) + ".tmp"))
+		PRINT_ERROR("ERROR :: Location map was left under its temporary name.");
+
+	// the saved map still finds the cold pages after the file is reopened
+	{
+		File file = File::open(filename);
+		if (file.coldPages() != 5)
+			PRINT_ERROR("ERROR :: Cold pages were lost on close.");
+		if (file.readPage(first_page).getRecord(RecordId{first_page, 1}) !=
+				"tiered record")
+			PRINT_ERROR("ERROR :: Cold page read back wrong.");
+	}
+
+	// deleting cold pages leaves the map alone until the next migration
+	// moves them back, all with one save
+	{
+		File file = File::open(filename);
+		std::ifstream saved_map(TieredStore::mapFilename(filename), std::ios::binary);
+		const std::string map_before((std::istreambuf_iterator<char>(saved_map)),
+				std::istreambuf_iterator<char>());
+		file.deletePage(first_page);
+		file.deletePage(first_page + 1);
+		std::ifstream deleted_map(TieredStore::mapFilename(filename), std::ios::binary);
+		const std::string map_after((std::istreambuf_iterator<char>(deleted_map)),
+				std::istreambuf_iterator<char>());
+		if (map_after != map_before || file.coldPages() != 5)
+			PRINT_ERROR("ERROR :: Location map was saved on a page delete.");
+		if (file.migratePages(0) != 2 || file.coldPages() != 3)
+			PRINT_ERROR("ERROR :: Deleted pages were not moved back on migration.");
+		Page reused = file.allocatePage();
+		reused.insertRecord("hot again");
+		file.writePage(reused);
+		if (file.coldPages() != 3 ||
+				file.readPage(reused.page_number()).getRecord(
+					RecordId{reused.page_number(), 1}) != "hot again")
+			PRINT_ERROR("ERROR :: Freed cold page was not reused in the fast tier.");
+	}
+
+	// a missing slow-tier file doesn't stop the data file being removed
+	std::remove("./test.tiered.cold");
+	File::remove(filename);
+	if (File::exists(TieredStore::mapFilename(filename)))
+		PRINT_ERROR("ERROR :: Location map was not removed.");
+
+	std::cout << "Tiered store test passed" << "\n";
+}
+
+void testFlashCache()
+{
+	const std::string& filename = "test.flash";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	FlashCache cache("test.flash_cache", 4);
+	Page cached;
+	PageId pageNo;
+	{
+		File file = File::create(filename);
+		Page first = file.allocatePage();
+		first.insertRecord("old contents");
+		file.writePage(first);
+		Page second = file.allocatePage();
+		file.writePage(second);
+		pageNo = first.page_number();
+
+		// pages are admitted the second time they are offered
+		cache.insert(&file, pageNo, first);
+		cache.insert(&file, pageNo, first);
+		cache.insert(&file, second.page_number(), second);
+		cache.insert(&file, second.page_number(), second);
+		cache.drain();
+		if (!cache.lookup(&file, pageNo, cached))
+			PRINT_ERROR("ERROR :: Admitted page was not cached.");
+
+		// deleting a page outside the buffer manager retires its cached copy
+		// only, even once the page is allocated again
+		const PageId secondNo = second.page_number();
+		file.deletePage(secondNo);
+		if (!cache.lookup(&file, pageNo, cached))
+			PRINT_ERROR("ERROR :: Page was dropped after a delete of another page.");
+		Page reused = file.allocatePage();
+		if (reused.page_number() != secondNo)
+			PRINT_ERROR("ERROR :: Deleted page was not reused.");
+		if (cache.lookup(&file, secondNo, cached))
+			PRINT_ERROR("ERROR :: Page was served after it was deleted.");
+		cache.insert(&file, secondNo, reused);
+		cache.insert(&file, secondNo, reused);
+		cache.drain();
+		if (!cache.lookup(&file, secondNo, cached))
+			PRINT_ERROR("ERROR :: Page was not cached again after a delete.");
+	}
+
+	// a file created anew under the same name doesn't see the old pages
+	File::remove(filename);
+	{
+		File file = File::create(filename);
+		Page first = file.allocatePage();
+		first.insertRecord("new contents");
+		file.writePage(first);
+		if (cache.lookup(&file, pageNo, cached))
+			PRINT_ERROR("ERROR :: Page of a removed file was served.");
+	}
+	File::remove(filename);
+
+	std::cout << "Flash cache test passed" << "\n";
+}
+
+void testSharedBuffer()
+{
+	const std::string& filename = "test.shared";
+	const std::string& segment = "/badgerdb_test";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	SharedBufMgr::unlink(segment);
+
+	std::vector<PageId> pages;
+	{
+		File file = File::create(filename);
+		for (int i = 0; i < 4; i++)
+			pages.push_back(file.allocatePage().page_number());
+	}
+
+	// a child pins a page for update and is killed while holding it
+	int ready[2];
+	if (pipe(ready) != 0)
+		PRINT_ERROR("ERROR :: Couldn't create a pipe.");
+	const pid_t holder = fork();
+	if (holder == 0)
+	{
+		SharedBufMgr pool(segment, 4);
+		File file = File::open(filename);
+		Page* shared_page;
+		pool.readPage(&file, pages[0], shared_page, true);
+		char byte = 1;
+		if (write(ready[1], &byte, 1) != 1)
+			_exit(1);
+		pause();
+		_exit(0);
+	}
+	char byte;
+	if (read(ready[0], &byte, 1) != 1)
+		PRINT_ERROR("ERROR :: Pinning child didn't start.");
+	kill(holder, SIGKILL);
+	waitpid(holder, NULL, 0);
+	close(ready[0]);
+	close(ready[1]);
+
+	{
+		SharedBufMgr pool(segment, 4);
+		File file = File::open(filename);
+
+		// the dead child's pin and latch are gone: every frame can be pinned,
+		// including the one it held
+		Page* shared_pages[4];
+		for (int i = 0; i < 4; i++)
+			pool.readPage(&file, pages[i], shared_pages[i], i == 0);
+		shared_pages[0]->insertRecord("shared record");
+		for (int i = 0; i < 4; i++)
+			pool.unPinPage(&file, pages[i], i == 0);
+
+		// another process sees the change in the shared frame, unflushed
+		const pid_t reader = fork();
+		if (reader == 0)
+		{
+			SharedBufMgr child_pool(segment, 4);
+			File child_file = File::open(filename);
+			Page* shared_page;
+			child_pool.readPage(&child_file, pages[0], shared_page);
+			const bool seen = shared_page->getRecord(
+					RecordId{pages[0], 1}) == "shared record";
+			child_pool.unPinPage(&child_file, pages[0], false);
+			_exit(seen ? 0 : 1);
+		}
+		int status;
+		waitpid(reader, &status, 0);
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			PRINT_ERROR("ERROR :: Change was not visible to another process.");
+
+		pool.flushFile(&file);
+		if (file.readPage(pages[0]).getRecord(RecordId{pages[0], 1}) !=
+				"shared record")
+			PRINT_ERROR("ERROR :: Shared page was not written back.");
+	}
+	SharedBufMgr::unlink(segment);
+	File::remove(filename);
+
+	std::cout << "Shared buffer test passed" << "\n";
+}
+
+void testTablespace()
+{
+	const std::string& path = "test.tbs";
+	std::remove(path.c_str());
+
+	// the third word of the superblock is the catalog's first extent
+	struct
+	{
+		std::uint32_t catalog_extent()
+		{
+			std::uint32_t words[3];
+			std::ifstream stream("test.tbs", std::ios::binary);
+			stream.read(reinterpret_cast<char*>(words), sizeof(words));
+			return words[2];
+		}
+	} superblock;
+
+	std::uint32_t num_extents;
+	std::uint32_t free_extents;
+	std::uint32_t catalog_extent;
+	PageId last_page;
+	{
+		std::shared_ptr<Tablespace> tablespace = Tablespace::create(path);
+		File file = tablespace->createFile("grow");
+		num_extents = tablespace->numExtents();
+		free_extents = tablespace->freeExtents();
+		catalog_extent = superblock.catalog_extent();
+		for (int i = 0; i < 5 * (int)Tablespace::EXTENT_PAGES; i++)
+		{
+			Page new_page = file.allocatePage();
+			new_page.insertRecord("extent record");
+			file.writePage(new_page);
+			last_page = new_page.page_number();
+		}
+		// growing the file only takes data extents; the catalog stays put
+		if (superblock.catalog_extent() != catalog_extent)
+			PRINT_ERROR("ERROR :: Growing a file rewrote the catalog.");
+		if (tablespace->numExtents() - tablespace->freeExtents() !=
+				num_extents - free_extents + 5)
+			PRINT_ERROR("ERROR :: Growing a file took extra extents.");
+		num_extents = tablespace->numExtents();
+		free_extents = tablespace->freeExtents();
+	}
+
+	// the logged extents are found again when the tablespace is reopened
+	{
+		std::shared_ptr<Tablespace> tablespace = Tablespace::open(path);
+		if (tablespace->numExtents() != num_extents ||
+				tablespace->freeExtents() != free_extents)
+			PRINT_ERROR("ERROR :: Extent counts changed on reopen.");
+		if (tablespace->fileNames().size() != 1 ||
+				tablespace->fileNames()[0] != "grow")
+			PRINT_ERROR("ERROR :: File list changed on reopen.");
+		File file = tablespace->openFile("grow");
+		for (PageId page_number = 1; page_number <= last_page; page_number++)
+		{
+			if (file.readPage(page_number).getRecord(RecordId{page_number, 1}) !=
+					"extent record")
+				PRINT_ERROR("ERROR :: Page read back wrong after reopen.");
+		}
+
+		// reading past the end fails rather than allocating an extent
+		try
+		{
+			file.readPage(last_page + 4 * Tablespace::EXTENT_PAGES);
+			PRINT_ERROR("ERROR :: Read past the end of the file succeeded.");
+		}
+		catch(InvalidPageException e)
+		{
+		}
+		if (tablespace->numExtents() != num_extents)
+			PRINT_ERROR("ERROR :: Reading past the end allocated an extent.");
+	}
+
+	std::remove(path.c_str());
+	std::cout << "Tablespace test passed" << "\n";
+}
+
+void testOnlineBackup()
+{
+	const std::string& filename = "test.backup";
+	const std::string& full_filename = "test.backup.full";
+	const std::string& incremental_filename = "test.backup.incr";
+	const std::string names[] = {filename, full_filename};
+	for (int i = 0; i < 2; i++)
+	{
+		try
+		{
+			File::remove(names[i]);
+		}
+		catch(FileNotFoundException e)
+		{
+		}
+	}
+	std::remove(incremental_filename.c_str());
+
+	{
+		File file = File::create(filename);
+		for (int i = 0; i < 6; i++)
+		{
+			Page new_page = file.allocatePage();
+			new_page.insertRecord("before");
+			file.writePage(new_page);
+		}
+		file.enableChangeTracking();
+
+		// a page overwritten part way through is copied as it was beforehand
+		{
+			OnlineBackup backup(&file, full_filename, OnlineBackup::FULL);
+			backup.step(2);
+			Page changed_page = file.readPage(5);
+			changed_page.updateRecord(RecordId{5, 1}, "after");
+			file.writePage(changed_page);
+			backup.run();
+			if (backup.pagesCopiedEarly() != 1)
+				PRINT_ERROR("ERROR :: Overwritten page was not copied early.");
+		}
+		{
+			File full = File::open(full_filename);
+			if (full.readPage(5).getRecord(RecordId{5, 1}) != "before")
+				PRINT_ERROR("ERROR :: Full backup is not the snapshot.");
+		}
+
+		// the incremental backup holds only the pages changed since
+		Page changed_page = file.readPage(3);
+		changed_page.updateRecord(RecordId{3, 1}, "after");
+		file.writePage(changed_page);
+		OnlineBackup backup(&file, incremental_filename,
+				OnlineBackup::INCREMENTAL);
+		if (backup.pagesToCopy() != 2)
+			PRINT_ERROR("ERROR :: Incremental backup copies unchanged pages.");
+		backup.run();
+	}
+
+	// restoring the full backup then the incremental gives the file back
+	OnlineBackup::applyIncremental(full_filename, incremental_filename);
+	{
+		File file = File::open(filename);
+		File restored = File::open(full_filename);
+		for (PageId page_number = 1; page_number <= 6; page_number++)
+		{
+			if (restored.readPage(page_number).getRecord(
+						RecordId{page_number, 1}) !=
+					file.readPage(page_number).getRecord(RecordId{page_number, 1}))
+				PRINT_ERROR("ERROR :: Restored page differs from the file.");
+		}
+	}
+
+	// a page write that fails part way through still leaves its change marked
+	{
+		File file = File::open(filename);
+		if (ChangeTracker(filename, false).isChanged(2))
+			PRINT_ERROR("ERROR :: Backed up page is still marked as changed.");
+		std::shared_ptr<SimulatedDevice> device(
+				new SimulatedDevice(SimulatedDevice::Profile::nvme()));
+		device->setTimeScale(0);
+		file.attachDevice(device);
+		device->injectFault(0, SimulatedDevice::SHORT_WRITE);
+		Page torn_page = file.readPage(2);
+		torn_page.updateRecord(RecordId{2, 1}, "torn");
+		try
+		{
+			file.writePage(torn_page);
+			PRINT_ERROR("ERROR :: Injected short write was not raised.");
+		}
+		catch(IoErrorException e)
+		{
+		}
+		if (!ChangeTracker(filename, false).isChanged(2))
+			PRINT_ERROR("ERROR :: Torn page is not marked as changed on disk.");
+	}
+
+	File::remove(filename);
+	File::remove(full_filename);
+	std::remove(incremental_filename.c_str());
+	std::cout << "Online backup test passed" << "\n";
+}
+
+void testReplication()
+{
+	const std::string& filename = "test.primary";
+	const std::string& replica_filename = "test.replica";
+	const std::string& name = "test_repl";
+	const std::string names[] = {filename, replica_filename};
+	for (int i = 0; i < 2; i++)
+	{
+		try
+		{
+			File::remove(names[i]);
+		}
+		catch(FileNotFoundException e)
+		{
+		}
+	}
+	std::remove((replica_filename + ".rpos").c_str());
+	std::vector<std::uint32_t> segments = ReplicationLog::listSegments(".", name);
+	for (std::size_t i = 0; i < segments.size(); i++)
+		std::remove(ReplicationLog::segmentFilename(".", name, segments[i]).c_str());
+
+	{
+		// more pages than fit in one batch, so the initial copy takes several
+		const PageId num_pages = ReplicationLog::BATCH_PAGES + 44;
+		File file = File::create(filename);
+		File::create(replica_filename);
+		for (PageId i = 0; i < num_pages; i++)
+		{
+			Page new_page = file.allocatePage();
+			new_page.insertRecord("v0");
+			file.writePage(new_page);
+		}
+
+		// the replica applies until told the last batch, measuring its lag
+		const std::uint64_t max_lag_micros = 2000000;
+		int shipped[2];
+		if (pipe(shipped) != 0)
+			PRINT_ERROR("ERROR :: Couldn't create a pipe.");
+		const pid_t replica = fork();
+		if (replica == 0)
+		{
+			BufMgr replica_buf(10);
+			File replica_file = File::open(replica_filename);
+			ReplicaApplier applier(&replica_buf, &replica_file, ".", name);
+			fcntl(shipped[0], F_SETFL, O_NONBLOCK);
+			std::uint64_t last_sequence = 0;
+			std::uint64_t max_lag = 0;
+			for (int polls = 0; last_sequence == 0 ||
+					applier.lastApplied() < last_sequence; polls++)
+			{
+				if (polls == 10000)
+					_exit(2);
+				applier.poll();
+				max_lag = std::max(max_lag, applier.lastLagMicros());
+				if (last_sequence == 0 &&
+						read(shipped[0], &last_sequence, sizeof(last_sequence)) <= 0)
+					last_sequence = 0;
+				usleep(1000);
+			}
+			if (max_lag > max_lag_micros)
+				_exit(3);
+			for (PageId page_number = 1; page_number <= num_pages; page_number++)
+			{
+				Page* replica_page;
+				replica_buf.readPage(&replica_file, page_number, replica_page);
+				const std::string& expected = page_number <= 10 ? "v1" :
+						page_number == 20 ? "v2" : "v0";
+				const bool same =
+						replica_page->getRecord(RecordId{page_number, 1}) == expected;
+				replica_buf.unPinPage(&replica_file, page_number, false);
+				if (!same)
+					_exit(1);
+			}
+			_exit(applier.pendingBytes() == 0 ? 0 : 4);
+		}
+		close(shipped[0]);
+
+		{
+			ReplicationLog log(&file, ".", name);
+			for (PageId page_number = 1; page_number <= 10; page_number++)
+			{
+				Page changed_page = file.readPage(page_number);
+				changed_page.updateRecord(RecordId{page_number, 1}, "v1");
+				file.writePage(changed_page);
+			}
+			log.ship();
+
+			// a write cut short by the file size limit leaves the log as it was
+			Page changed_page = file.readPage(20);
+			changed_page.updateRecord(RecordId{20, 1}, "v2");
+			file.writePage(changed_page);
+			const std::string& segment = ReplicationLog::segmentFilename(
+					".", name, ReplicationLog::listSegments(".", name).back());
+			struct stat info;
+			stat(segment.c_str(), &info);
+			struct rlimit old_limit;
+			getrlimit(RLIMIT_FSIZE, &old_limit);
+			struct rlimit limit = old_limit;
+			limit.rlim_cur = info.st_size + Page::SIZE / 2;
+			void (*old_handler)(int) = signal(SIGXFSZ, SIG_IGN);
+			setrlimit(RLIMIT_FSIZE, &limit);
+			const std::uint64_t sequence = log.lastShipped();
+			bool failed = false;
+			try
+			{
+				log.ship();
+			}
+			catch(IoErrorException e)
+			{
+				failed = true;
+			}
+			setrlimit(RLIMIT_FSIZE, &old_limit);
+			signal(SIGXFSZ, old_handler);
+			if (!failed)
+				PRINT_ERROR("ERROR :: Failed ship was not reported.");
+			struct stat after;
+			stat(segment.c_str(), &after);
+			if (after.st_size != info.st_size || log.pendingPages() != 1 ||
+					log.lastShipped() != sequence)
+				PRINT_ERROR("ERROR :: Failed ship left part of a batch behind.");
+
+			if (log.ship() != 1)
+				PRINT_ERROR("ERROR :: Pending page was not shipped again.");
+			const std::uint64_t last_sequence = log.lastShipped();
+			if (write(shipped[1], &last_sequence, sizeof(last_sequence)) !=
+					sizeof(last_sequence))
+				PRINT_ERROR("ERROR :: Couldn't tell the replica the last batch.");
+		}
+		int status;
+		waitpid(replica, &status, 0);
+		close(shipped[1]);
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			PRINT_ERROR("ERROR :: Replica didn't catch up in time, exit status "
+					<< WEXITSTATUS(status) << ".");
+	}
+
+	File::remove(filename);
+	File::remove(replica_filename);
+	std::remove((replica_filename + ".rpos").c_str());
+	segments = ReplicationLog::listSegments(".", name);
+	for (std::size_t i = 0; i < segments.size(); i++)
+		std::remove(ReplicationLog::segmentFilename(".", name, segments[i]).c_str());
+	std::cout << "Replication test passed" << "\n";
+}
+
+void testIoScheduler()
+{
+	const std::string& filename = "test.sched";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		File file = File::create(filename);
+		std::vector<Page> pages;
+		for (int i = 0; i < 20; i++)
+		{
+			pages.push_back(file.allocatePage());
+			file.writePage(pages.back());
+		}
+
+		IoScheduler scheduler;
+		IoScheduler::ClassLimits limits = {0 /* mbps */, 1 /* deadline_ms */};
+		scheduler.setLimits(IoScheduler::WRITEBACK, limits);
+
+		// hold the worker until a backlog of writes is overdue and a
+		// foreground request waits behind it
+		std::atomic<bool> release(false);
+		std::thread blocker([&scheduler, &release] {
+			scheduler.execute([&release] {
+				while (!release)
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			});
+		});
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		for (std::size_t i = 0; i < pages.size(); i++)
+			scheduler.write(&file, pages[i], IoScheduler::WRITEBACK);
+		std::uint64_t writes_ahead = 0;
+		std::thread foreground([&scheduler, &writes_ahead] {
+			scheduler.execute([&scheduler, &writes_ahead] {
+				writes_ahead = scheduler.stats(IoScheduler::WRITEBACK).requests;
+			});
+		});
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		release = true;
+		blocker.join();
+		foreground.join();
+		scheduler.drain();
+
+		if (writes_ahead > IoScheduler::MAX_OVERDUE_AHEAD)
+			PRINT_ERROR("ERROR :: Overdue writes held up a foreground request.");
+		if (scheduler.stats(IoScheduler::WRITEBACK).requests != pages.size())
+			PRINT_ERROR("ERROR :: Overdue writes were not all served.");
+	}
+	File::remove(filename);
+
+	// inserts keep the free-space map right while the worker writes back the
+	// pages they evict, which updates the map as well
+	{
+		File file = File::create(filename);
+		file.enableFreeSpaceMap();
+		IoScheduler scheduler;
+		BufMgr scheduledMgr(3);
+		scheduledMgr.setIoScheduler(&scheduler);
+		const std::string record(100, 'r');
+		std::vector<RecordId> rids;
+		for (int i = 0; i < 300; i++)
+		{
+			rids.push_back(scheduledMgr.insertRecord(&file, record));
+			if (i % 10 == 0)
+			{
+				// touch other pages to evict the ones being filled
+				for (int j = 0; j < 3; j++)
+				{
+					PageId pageNo;
+					Page* page;
+					scheduledMgr.allocPage(&file, pageNo, page);
+					scheduledMgr.unPinPage(&file, pageNo, false);
+				}
+			}
+		}
+		scheduledMgr.flushFile(&file);
+		scheduler.drain();
+		std::set<PageId> recordPages;
+		for (std::size_t i = 0; i < rids.size(); i++)
+		{
+			recordPages.insert(rids[i].page_number);
+			if (file.readPage(rids[i].page_number).getRecord(rids[i]) != record)
+				PRINT_ERROR("ERROR :: Record inserted through the scheduler was lost.");
+		}
+		if (recordPages.size() > 300 / (Page::DATA_SIZE / 110) + 1)
+			PRINT_ERROR("ERROR :: Inserts through the scheduler wasted pages.");
+	}
+	File::remove(filename);
+
+	std::cout << "I/O scheduler test passed" << "\n";
+}
+
+void testHashAggregateSpill()
+{
+	const std::string& filename = "test.agg";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	// every key twice, far more groups than the budget holds
+	const int num_keys = 20000;
+	{
+		File file = File::create(filename);
+		Page page = file.allocatePage();
+		for (int round = 0; round < 2; round++)
+		{
+			for (int i = 0; i < num_keys; i++)
+			{
+				const std::string& record = "key" + std::to_string(i);
+				if (!page.hasSpaceForRecord(record))
+				{
+					file.writePage(page);
+					page = file.allocatePage();
+				}
+				page.insertRecord(record);
+			}
+		}
+		file.writePage(page);
+	}
+
+	{
+		File file = File::open(filename);
+		HashAggregate::Options options = HashAggregate::Options::defaults();
+		options.threads = 2;
+		options.partitions = 2;
+		options.memory_budget = 64 * 1024;
+		options.spill_pool_frames = 16;
+		HashAggregate aggregate(
+				[](const std::string& record, std::string& key, double& value) {
+					key = record;
+					value = 1;
+					return true;
+				},
+				options);
+		std::map<std::string, HashAggregate::Aggregates> groups;
+		int filesAtLastGroup = -1;
+		const HashAggregate::Stats& stats = aggregate.run(&file,
+				[&groups, &filesAtLastGroup, &filename](const std::string& key,
+						const HashAggregate::Aggregates& aggregates) {
+					if (!groups.insert(std::make_pair(key, aggregates)).second)
+						PRINT_ERROR("ERROR :: Group handed over twice.");
+					if (groups.size() != num_keys)
+						return;
+					filesAtLastGroup = 0;
+					for (int p = 0; p < 2; p++)
+					{
+						const std::string& name = filename + ".agg." + std::to_string(p);
+						filesAtLastGroup += File::exists(name);
+						for (std::uint32_t q = 0; q < HashAggregate::REPARTITION_FANOUT; q++)
+							filesAtLastGroup += File::exists(name + "." + std::to_string(q));
+					}
+				});
+
+		// the partitions' spill files outgrew the budget and were split
+		if (stats.repartitions == 0)
+			PRINT_ERROR("ERROR :: Large spill files were not split.");
+		// and each was removed once merged, before its groups were handed over
+		if (filesAtLastGroup != 0)
+			PRINT_ERROR("ERROR :: Merged spill files were kept until the end.");
+		if (groups.size() != num_keys || stats.groups != num_keys)
+			PRINT_ERROR("ERROR :: Groups were lost or split.");
+		for (std::map<std::string, HashAggregate::Aggregates>::const_iterator
+				iter = groups.begin(); iter != groups.end(); ++iter)
+		{
+			if (iter->second.count != 2 || iter->second.sum != 2)
+				PRINT_ERROR("ERROR :: Group aggregates are wrong.");
+		}
+		if (File::exists(filename + ".agg.0") ||
+				File::exists(filename + ".agg.0.0"))
+			PRINT_ERROR("ERROR :: Spill files were left behind.");
+	}
+
+	// a worker's share of the budget is below a page, so splitting can't help
+	{
+		File file = File::open(filename);
+		HashAggregate::Options options = HashAggregate::Options::defaults();
+		options.threads = 4;
+		options.partitions = 16;
+		options.memory_budget = 16 * 1024;
+		options.spill_pool_frames = 16;
+		HashAggregate aggregate(
+				[](const std::string& record, std::string& key, double& value) {
+					key = record;
+					value = 1;
+					return true;
+				},
+				options);
+		std::uint64_t groups = 0;
+		const HashAggregate::Stats& stats = aggregate.run(&file,
+				[&groups](const std::string&,
+						const HashAggregate::Aggregates& aggregates) {
+					groups++;
+					if (aggregates.count != 2)
+						PRINT_ERROR("ERROR :: Group aggregates are wrong.");
+				});
+		if (stats.repartitions != 0)
+			PRINT_ERROR("ERROR :: Spill files were split below a page of budget.");
+		if (groups != num_keys || stats.groups != num_keys)
+			PRINT_ERROR("ERROR :: Groups were lost or split.");
+		if (File::exists(filename + ".agg.0"))
+			PRINT_ERROR("ERROR :: Spill files were left behind.");
+	}
+	File::remove(filename);
+
+	std::cout << "Hash aggregate spill test passed" << "\n";
+}
+
+void testSimulatedDevice()
+{
+	const std::string& filename = "test.device";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		File file = File::create(filename);
+		std::shared_ptr<SimulatedDevice> device(
+				new SimulatedDevice(SimulatedDevice::Profile::nvme()));
+		device->setTimeScale(0);
+		file.attachDevice(device);
+
+		Page new_page = file.allocatePage();
+		new_page.insertRecord("device record");
+		file.writePage(new_page);
+		const PageId page_number = new_page.page_number();
+		const std::uint64_t reads = device->stats().reads;
+		for (int i = 0; i < 5; i++)
+			file.readPage(page_number);
+		if (device->stats().reads != reads + 5 || device->stats().writes == 0)
+			PRINT_ERROR("ERROR :: Device didn't see the file's I/O.");
+		if (device->simulatedTime() == 0)
+			PRINT_ERROR("ERROR :: Device charged no time.");
+
+		// injected faults fail exactly one operation
+		device->injectFault(0, SimulatedDevice::IO_ERROR);
+		try
+		{
+			file.readPage(page_number);
+			PRINT_ERROR("ERROR :: Injected read error was not raised.");
+		}
+		catch(IoErrorException e)
+		{
+		}
+		if (file.readPage(page_number).getRecord(RecordId{page_number, 1}) !=
+				"device record")
+			PRINT_ERROR("ERROR :: Read after an injected error failed.");
+		device->injectFault(0, SimulatedDevice::SHORT_WRITE);
+		try
+		{
+			file.writePage(new_page);
+			PRINT_ERROR("ERROR :: Injected short write was not raised.");
+		}
+		catch(IoErrorException e)
+		{
+		}
+		if (device->stats().io_errors != 1 || device->stats().short_writes != 1)
+			PRINT_ERROR("ERROR :: Injected faults were counted wrong.");
+	}
+	File::remove(filename);
+
+	std::cout << "Simulated device test passed" << "\n";
+}
+
+void testZoneMap()
+{
+	const std::string& filename = "test.zone";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	// page i holds keys 10 * i to 10 * i + 9, loaded in key order
+	PageId pages[10];
+	{
+		File file = File::create(filename);
+		for (int i = 0; i < 10; i++)
+		{
+			Page new_page = file.allocatePage();
+			for (int k = 10 * i; k < 10 * i + 10; k++)
+			{
+				snprintf(tmpbuf, sizeof(tmpbuf), "%04d zoned record", k);
+				new_page.insertRecord(tmpbuf);
+			}
+			file.writePage(new_page);
+			pages[i] = new_page.page_number();
+		}
+		file.enableZoneMap(0 /* key_offset */, 4 /* key_length */);
+
+		std::vector<PageId> visited;
+		for (PhysicalFileIterator iter = file.physicalBegin("0035", "0042");
+				iter != file.physicalEnd(); ++iter)
+			visited.push_back((*iter).page_number());
+		if (visited.size() != 2 || visited[0] != pages[3] ||
+				visited[1] != pages[4])
+			PRINT_ERROR("ERROR :: Range scan visited the wrong pages.");
+
+		// a write widens the page's summary at once
+		Page changed_page = file.readPage(pages[0]);
+		changed_page.insertRecord("0038 moved record");
+		file.writePage(changed_page);
+	}
+
+	// the summaries are kept with the file
+	{
+		File file = File::open(filename);
+		if (!file.hasZoneMap())
+			PRINT_ERROR("ERROR :: Zone map was not loaded on open.");
+		std::vector<PageId> visited;
+		for (PhysicalFileIterator iter = file.physicalBegin("0035", "0042");
+				iter != file.physicalEnd(); ++iter)
+			visited.push_back((*iter).page_number());
+		if (visited.size() != 3 || visited[0] != pages[0])
+			PRINT_ERROR("ERROR :: Changed page was skipped by a range scan.");
+		PageId all = 0;
+		for (PhysicalFileIterator iter = file.physicalBegin("9000", "9999");
+				iter != file.physicalEnd(); ++iter)
+			all++;
+		if (all != 0)
+			PRINT_ERROR("ERROR :: Range scan past every key visited pages.");
+	}
+	File::remove(filename);
+	if (File::exists(ZoneMap::mapFilename(filename)))
+		PRINT_ERROR("ERROR :: Zone map was not removed.");
+
+	std::cout << "Zone map test passed" << "\n";
+}
+
+void testRecordCache()
+{
+	const std::string& filename = "test.rcache";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		File file = File::create(filename);
+		RecordCache cache(64 * 1024, 1 /* num_shards */);
+		BufMgr pool(4);
+		pool.setRecordCache(&cache);
+
+		PageId page_number;
+		Page* cached_page;
+		pool.allocPage(&file, page_number, cached_page);
+		const RecordId rid = cached_page->insertRecord("first version");
+		pool.unPinPage(&file, page_number, true);
+
+		// a miss fills the cache with the token its lookup returned
+		std::string record;
+		std::uint64_t fill_token;
+		if (cache.lookup(&file, rid, record, &fill_token))
+			PRINT_ERROR("ERROR :: Record cached before it was read.");
+		pool.readPage(&file, page_number, cached_page);
+		cache.insert(&file, rid, cached_page->getRecord(rid), fill_token);
+		pool.unPinPage(&file, page_number, false);
+		if (!cache.lookup(&file, rid, record) || record != "first version")
+			PRINT_ERROR("ERROR :: Filled record was not cached.");
+
+		// unpinning the page dirty drops its records
+		pool.readPage(&file, page_number, cached_page);
+		cached_page->updateRecord(rid, "second version");
+		pool.unPinPage(&file, page_number, true);
+		if (cache.lookup(&file, rid, record, &fill_token))
+			PRINT_ERROR("ERROR :: Updated record was still cached.");
+
+		// a fill racing with a change is refused
+		pool.readPage(&file, page_number, cached_page);
+		const std::string& stale = cached_page->getRecord(rid);
+		cached_page->updateRecord(rid, "third version");
+		pool.unPinPage(&file, page_number, true);
+		cache.insert(&file, rid, stale, fill_token);
+		if (cache.lookup(&file, rid, record) || cache.stats().stale_fills != 1)
+			PRINT_ERROR("ERROR :: Stale record was cached.");
+
+		// discarding the page drops its records too
+		cache.lookup(&file, rid, record, &fill_token);
+		cache.insert(&file, rid, "third version", fill_token);
+		pool.flushFile(&file);
+		pool.discardPage(&file, page_number);
+		if (cache.lookup(&file, rid, record))
+			PRINT_ERROR("ERROR :: Discarded page's record was still cached.");
+
+		// the pool's record reads consult the cache and fill it on a miss
+		if (pool.readRecord(&file, rid) != "third version" ||
+				!cache.lookup(&file, rid, record) || record != "third version")
+			PRINT_ERROR("ERROR :: Record read through the pool was not cached.");
+		pool.clearBufStats();
+		if (pool.readRecord(&file, rid) != "third version" ||
+				pool.getBufStats().accesses != 0)
+			PRINT_ERROR("ERROR :: Cached record was read from its page.");
+		PageId other_page_number;
+		Page* other_page;
+		pool.allocPage(&file, other_page_number, other_page);
+		const RecordId other_rid = other_page->insertRecord("other record");
+		pool.unPinPage(&file, other_page_number, true);
+		std::vector<RecordId> rids;
+		rids.push_back(other_rid);
+		rids.push_back(rid);
+		std::vector<std::string> records;
+		pool.clearBufStats();
+		pool.readRecords(&file, rids, records);
+		if (records.size() != 2 || records[0] != "other record" ||
+				records[1] != "third version" || pool.getBufStats().accesses != 1)
+			PRINT_ERROR("ERROR :: Batched read didn't skip the cached record.");
+		if (!cache.lookup(&file, other_rid, record) || record != "other record")
+			PRINT_ERROR("ERROR :: Batched read didn't fill the cache.");
+	}
+	File::remove(filename);
+
+	std::cout << "Record cache test passed" << "\n";
+}
+
+void testSharedScan()
+{
+	const std::string& filename = "test.sscan";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		File file = File::create(filename);
+		std::vector<PageId> pages;
+		for (int i = 0; i < 10; i++)
+			pages.push_back(file.allocatePage().page_number());
+
+		ScanCoordinator coordinator;
+		SharedScan front(&coordinator, &file, pages);
+		for (int i = 0; i < 4; i++)
+			front.next();
+
+		// a later scan starts at the page the front one is reading, then
+		// wraps around to the pages it missed
+		SharedScan follower(&coordinator, &file, pages);
+		if (follower.startPage() != pages[3] || coordinator.joinedScans() != 1)
+			PRINT_ERROR("ERROR :: Scan didn't join the one in front.");
+		std::vector<PageId> seen;
+		for (PageId page_number = follower.next();
+				page_number != Page::INVALID_NUMBER;
+				page_number = follower.next())
+		{
+			seen.push_back(page_number);
+			front.next();
+		}
+		if (seen.size() != pages.size() || seen[0] != pages[3] ||
+				seen.back() != pages[2])
+			PRINT_ERROR("ERROR :: Joined scan didn't wrap around.");
+		std::sort(seen.begin(), seen.end());
+		if (seen != pages)
+			PRINT_ERROR("ERROR :: Joined scan didn't visit every page once.");
+	}
+	File::remove(filename);
+
+	std::cout << "Shared scan test passed" << "\n";
+}
+
+void testReadRecords()
+{
+	const std::string& filename = "test.fetch";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		File file = File::create(filename);
+		std::vector<RecordId> ids;
+		for (int i = 0; i < 30; i++)
+		{
+			Page new_page = file.allocatePage();
+			for (int r = 0; r < 3; r++)
+			{
+				snprintf(tmpbuf, sizeof(tmpbuf), "page %d record %d", i, r);
+				ids.push_back(new_page.insertRecord(tmpbuf));
+			}
+			file.writePage(new_page);
+		}
+
+		// index order: scattered over the pages, with a record asked twice
+		std::vector<RecordId> wanted;
+		for (std::size_t i = 0; i < ids.size(); i++)
+			wanted.push_back(ids[(i * 37) % ids.size()]);
+		wanted.push_back(wanted[5]);
+
+		BufMgr pool(4);
+		std::vector<std::string> records;
+		pool.readRecords(&file, wanted, records);
+		if (records.size() != wanted.size())
+			PRINT_ERROR("ERROR :: Wrong number of records fetched.");
+		for (std::size_t i = 0; i < wanted.size(); i++)
+		{
+			const RecordId& rid = wanted[i];
+			snprintf(tmpbuf, sizeof(tmpbuf), "page %d record %d",
+					(int)(rid.page_number - ids[0].page_number),
+					(int)(rid.slot_number - 1));
+			if (records[i] != tmpbuf)
+				PRINT_ERROR("ERROR :: Record fetched out of order.");
+		}
+
+		// a missing record fails the fetch without leaving pages pinned
+		wanted.push_back(RecordId{ids[0].page_number, 9});
+		try
+		{
+			pool.readRecords(&file, wanted, records);
+			PRINT_ERROR("ERROR :: Fetching a missing record succeeded.");
+		}
+		catch(InvalidRecordException e)
+		{
+		}
+		pool.flushFile(&file);
+	}
+	File::remove(filename);
+
+	std::cout << "Read records test passed" << "\n";
+}
+
+void testOperatorPipeline()
+{
+	const std::string& customers_filename = "test.customers";
+	const std::string& orders_filename = "test.orders";
+	const std::string names[] = {customers_filename, orders_filename};
+	for (int i = 0; i < 2; i++)
+	{
+		try
+		{
+			File::remove(names[i]);
+		}
+		catch(FileNotFoundException e)
+		{
+		}
+	}
+
+	{
+		// 20 customers; order i belongs to customer i % 20
+		File customers = File::create(customers_filename);
+		File orders = File::create(orders_filename);
+		Page customer_page = customers.allocatePage();
+		for (int c = 0; c < 20; c++)
+		{
+			snprintf(tmpbuf, sizeof(tmpbuf), "%04d customer", c);
+			customer_page.insertRecord(tmpbuf);
+		}
+		customers.writePage(customer_page);
+		Page order_page = orders.allocatePage();
+		for (int i = 0; i < 100; i++)
+		{
+			snprintf(tmpbuf, sizeof(tmpbuf), "%04d order %03d", i % 20, i);
+			if (i % 30 == 29)
+			{
+				orders.writePage(order_page);
+				order_page = orders.allocatePage();
+			}
+			order_page.insertRecord(tmpbuf);
+		}
+		orders.writePage(order_page);
+
+		// filter, project, sort descending and page through the result
+		{
+			OperatorPtr plan(new LimitOperator(
+					OperatorPtr(new SortOperator(
+							OperatorPtr(new ProjectOperator(
+									OperatorPtr(new FilterOperator(
+											OperatorPtr(new ScanOperator(&customers)),
+											[](const RecordView& record) {
+												return (record.data[3] - '0') % 2 == 1;
+											})),
+									ProjectOperator::bytes(0, 4))),
+							[](const RecordView& a, const RecordView& b) {
+								return b.str() < a.str();
+							})),
+					3 /* limit */, 1 /* offset */));
+			RecordBatch batch(2);
+			std::vector<std::string> keys;
+			while (plan->next(batch))
+			{
+				for (std::size_t i = 0; i < batch.size(); i++)
+					keys.push_back(batch[i].str());
+			}
+			if (keys.size() != 3 || keys[0] != "0017" || keys[1] != "0015" ||
+					keys[2] != "0013")
+				PRINT_ERROR("ERROR :: Sorted projection came out wrong.");
+		}
+
+		// join the first five customers' orders with them and count per
+		// customer
+		{
+			OperatorPtr plan(new AggregateOperator(
+					OperatorPtr(new HashJoinOperator(
+							OperatorPtr(new ScanOperator(&customers)),
+							OperatorPtr(new FilterOperator(
+									OperatorPtr(new ScanOperator(&orders)),
+									[](const RecordView& record) {
+										return record.str().compare(0, 4, "0005") < 0;
+									})),
+							ProjectOperator::bytes(0, 4), ProjectOperator::bytes(0, 4))),
+					ProjectOperator::bytes(0, 4),
+					[](const RecordView& record) {
+						return record.str().find("customer") == std::string::npos
+								? 0.0 : 1.0;
+					}));
+			RecordBatch batch(3);
+			std::map<std::string, HashAggregate::Aggregates> groups;
+			while (plan->next(batch))
+			{
+				for (std::size_t i = 0; i < batch.size(); i++)
+				{
+					std::string key;
+					HashAggregate::Aggregates aggregates;
+					AggregateOperator::decode(batch[i], key, aggregates);
+					groups[key] = aggregates;
+				}
+			}
+			if (groups.size() != 5)
+				PRINT_ERROR("ERROR :: Join produced the wrong groups.");
+			for (std::map<std::string, HashAggregate::Aggregates>::const_iterator
+					iter = groups.begin(); iter != groups.end(); ++iter)
+			{
+				// every joined record carries its customer record
+				if (iter->second.count != 5 || iter->second.sum != 5)
+					PRINT_ERROR("ERROR :: Join matched the wrong records.");
+			}
+		}
+	}
+	File::remove(customers_filename);
+	File::remove(orders_filename);
+
+	std::cout << "Operator pipeline test passed" << "\n";
+}
+
+void testLockManager()
+{
+	LockManager locks;
+	const LockName& first = LockName::record("test.locks", RecordId{1, 1});
+	const LockName& second = LockName::record("test.locks", RecordId{2, 1});
+	const TxnId older = locks.beginTransaction();
+	const TxnId younger = locks.beginTransaction();
+
+	// a record lock takes intention locks on its page and file
+	locks.lock(older, first, LockManager::X);
+	LockManager::Mode mode;
+	if (!locks.heldMode(older, LockName::file("test.locks"), mode) ||
+			mode != LockManager::IX)
+		PRINT_ERROR("ERROR :: Record lock didn't take an intention lock.");
+	if (locks.tryLock(younger, LockName::file("test.locks"), LockManager::S))
+		PRINT_ERROR("ERROR :: File was locked shared under an exclusive record.");
+	locks.lock(younger, second, LockManager::X);
+
+	// each waits for the other's record; the younger one is the victim
+	std::thread waiter([&locks, older, &second] {
+		locks.lock(older, second, LockManager::X);
+	});
+	bool deadlocked = false;
+	try
+	{
+		locks.lock(younger, first, LockManager::X);
+	}
+	catch(DeadlockException e)
+	{
+		deadlocked = true;
+	}
+	if (!deadlocked)
+		PRINT_ERROR("ERROR :: Deadlock was not detected.");
+	locks.endTransaction(younger);
+	waiter.join();
+	if (!locks.heldMode(older, second, mode) || mode != LockManager::X)
+		PRINT_ERROR("ERROR :: Survivor didn't get the victim's lock.");
+	if (locks.stats().deadlocks != 1)
+		PRINT_ERROR("ERROR :: Deadlock was counted wrong.");
+	locks.endTransaction(older);
+
+	std::cout << "Lock manager test passed" << "\n";
+}
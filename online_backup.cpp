@@ -0,0 +1,221 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "online_backup.h"
+
+#include <cstdio>
+#include <unistd.h>
+
+#include "change_tracker.h"
+#include "exceptions/file_exists_exception.h"
+#include "exceptions/file_not_found_exception.h"
+#include "exceptions/file_open_exception.h"
+#include "exceptions/invalid_backup_exception.h"
+#include "exceptions/io_error_exception.h"
+
+namespace badgerdb {
+
+namespace {
+
+/**
+ * Value identifying a finished incremental backup.  Unfinished backups have
+ * zero in its place.
+ */
+const std::uint32_t INCREMENTAL_MAGIC = 0x42444942;
+
+/**
+ * Maximum number of adjacent pages step() reads at once.
+ */
+const PageId MAX_RUN_PAGES = 64;
+
+}
+
+OnlineBackup::OnlineBackup(File* file, const std::string& backup_filename,
+                           const Mode mode)
+    : file_(file),
+      backup_filename_(backup_filename),
+      mode_(mode),
+      header_(file->readHeader()),
+      next_(0),
+      states_(header_.num_pages, NOT_IN_SNAPSHOT),
+      pages_copied_(0),
+      pages_copied_early_(0),
+      done_(false) {
+  if (File::exists(backup_filename_)) {
+    throw FileExistsException(backup_filename_);
+  }
+  const ChangeTracker* change_tracker = file_->changeTracker();
+  if (mode_ == INCREMENTAL && change_tracker != NULL) {
+    pending_ = change_tracker->changedPages(header_.num_pages);
+  } else {
+    for (PageId page_number = 1; page_number < header_.num_pages;
+         ++page_number) {
+      pending_.push_back(page_number);
+    }
+  }
+  for (std::size_t i = 0; i < pending_.size(); ++i) {
+    states_[pending_[i]] = PENDING;
+  }
+
+  out_.open(backup_filename_, std::fstream::in | std::fstream::out |
+                                  std::fstream::binary | std::fstream::trunc);
+  if (mode_ == INCREMENTAL) {
+    // Reserve room for the header, which is only valid once finished.
+    const IncrementalHeader header = {0 /* magic */, header_,
+                                      0 /* num_entries */};
+    out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  }
+  file_->addListener(this);
+}
+
+OnlineBackup::~OnlineBackup() {
+  if (!done_) {
+    file_->removeListener(this);
+    out_.close();
+    std::remove(backup_filename_.c_str());
+  }
+}
+
+bool OnlineBackup::step(const std::uint32_t io_budget) {
+  std::uint32_t io_used = 0;
+  std::vector<Page> pages;
+  std::vector<char> page_bytes(Page::SIZE);
+  while (!done_ && io_used < io_budget) {
+    while (next_ < pending_.size() && states_[pending_[next_]] != PENDING) {
+      ++next_;
+    }
+    if (next_ == pending_.size()) {
+      finish();
+      break;
+    }
+    // Read the run of adjacent pending pages starting here in one go.
+    const PageId first_page_number = pending_[next_];
+    PageId run_length = 1;
+    while (run_length < MAX_RUN_PAGES && io_used + run_length < io_budget &&
+           next_ + run_length < pending_.size() &&
+           pending_[next_ + run_length] == first_page_number + run_length &&
+           states_[first_page_number + run_length] == PENDING) {
+      ++run_length;
+    }
+    file_->readPages(first_page_number, run_length, pages);
+    for (PageId i = 0; i < run_length; ++i) {
+      File::encodePage(pages[i], &page_bytes[0]);
+      writeBackupPage(first_page_number + i, &page_bytes[0]);
+    }
+    next_ += run_length;
+    io_used += run_length;
+  }
+  return done_;
+}
+
+void OnlineBackup::run() {
+  while (!step(MAX_RUN_PAGES)) {
+  }
+}
+
+void OnlineBackup::beforePageChange(const PageId page_number) {
+  if (page_number >= states_.size() || states_[page_number] != PENDING) {
+    return;
+  }
+  const Page& page = file_->readPage(page_number, true /* allow_free */);
+  std::vector<char> page_bytes(Page::SIZE);
+  File::encodePage(page, &page_bytes[0]);
+  writeBackupPage(page_number, &page_bytes[0]);
+  ++pages_copied_early_;
+}
+
+void OnlineBackup::afterPageWrite(const PageId page_number,
+                                  const Page* /* page */) {
+  if (page_number >= written_.size()) {
+    written_.resize(page_number + 1, false);
+  }
+  written_[page_number] = true;
+}
+
+void OnlineBackup::applyIncremental(const std::string& filename,
+                                    const std::string& incremental_filename) {
+  if (!File::exists(filename)) {
+    throw FileNotFoundException(filename);
+  }
+  if (!File::exists(incremental_filename)) {
+    throw FileNotFoundException(incremental_filename);
+  }
+  if (File::isOpen(filename)) {
+    throw FileOpenException(filename);
+  }
+  std::ifstream in(incremental_filename, std::ios::binary);
+  IncrementalHeader header;
+  in.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (!in || header.magic != INCREMENTAL_MAGIC) {
+    throw InvalidBackupException(incremental_filename,
+                                 "not a finished incremental backup");
+  }
+
+  std::fstream out(filename, std::fstream::in | std::fstream::out |
+                                 std::fstream::binary);
+  std::vector<char> page_bytes(Page::SIZE);
+  for (std::uint32_t entry = 0; entry < header.num_entries; ++entry) {
+    PageId page_number;
+    in.read(reinterpret_cast<char*>(&page_number), sizeof(page_number));
+    in.read(&page_bytes[0], page_bytes.size());
+    if (!in) {
+      throw InvalidBackupException(incremental_filename, "cut short");
+    }
+    out.seekp(File::pagePosition(page_number), std::ios::beg);
+    out.write(&page_bytes[0], page_bytes.size());
+  }
+  out.seekp(0 /* pos */, std::ios::beg);
+  out.write(reinterpret_cast<const char*>(&header.file_header),
+            sizeof(header.file_header));
+  out.close();
+  if (::truncate(filename.c_str(),
+                 File::pagePosition(header.file_header.num_pages)) != 0) {
+    throw IoErrorException(filename, header.file_header.num_pages, "truncate");
+  }
+}
+
+void OnlineBackup::writeBackupPage(const PageId page_number,
+                                   const char* page_bytes) {
+  if (mode_ == FULL) {
+    out_.seekp(File::pagePosition(page_number), std::ios::beg);
+  } else {
+    out_.seekp(0 /* off */, std::ios::end);
+    out_.write(reinterpret_cast<const char*>(&page_number),
+               sizeof(page_number));
+  }
+  out_.write(page_bytes, Page::SIZE);
+  states_[page_number] = COPIED;
+  ++pages_copied_;
+}
+
+void OnlineBackup::finish() {
+  out_.seekp(0 /* pos */, std::ios::beg);
+  if (mode_ == FULL) {
+    out_.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+  } else {
+    const IncrementalHeader header = {INCREMENTAL_MAGIC, header_,
+                                      pages_copied_};
+    out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  }
+  out_.close();
+
+  // Pages written since the snapshot have changed relative to this backup,
+  // so only the others are marked unchanged.
+  ChangeTracker* change_tracker = file_->changeTracker();
+  if (change_tracker != NULL) {
+    for (std::size_t i = 0; i < pending_.size(); ++i) {
+      const PageId page_number = pending_[i];
+      if (page_number >= written_.size() || !written_[page_number]) {
+        change_tracker->clearChanged(page_number);
+      }
+    }
+  }
+  file_->removeListener(this);
+  done_ = true;
+}
+
+}
@@ -0,0 +1,224 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "file.h"
+#include "file_listener.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Backup of a file taken while the file stays in use.
+ *
+ * A backup is a snapshot of the file as it was on disk when the backup was
+ * constructed.  Pages are copied a few at a time by step(), and writes to the
+ * file may continue in between: the backup listens to the file, and before a
+ * page that is still to be copied is overwritten (or dropped by truncate), its
+ * old contents are copied first.  Pages still dirty in a buffer pool are not
+ * part of the snapshot; call BufMgr::flushFile() before starting the backup to
+ * include them.
+ *
+ * A FULL backup copies every page and produces an ordinary file that
+ * File::open() accepts.  An INCREMENTAL backup copies only the pages the
+ * file's change record (see File::enableChangeTracking()) marks as changed
+ * since the previous backup, plus the file header, so it takes time in
+ * proportion to the changed data; applyIncremental() brings a restored copy
+ * up to the snapshot.  Without change tracking an incremental backup copies
+ * every page.  When a backup finishes, the change record is cleared for the
+ * pages it copied that have not been written since it started.
+ *
+ * @warning This class is not threadsafe.
+ */
+class OnlineBackup : public FileListener {
+ public:
+  /**
+   * Kinds of backup.
+   */
+  enum Mode {
+    FULL,         // Every page, as a regular file.
+    INCREMENTAL   // Changed pages only.
+  };
+
+  /**
+   * Starts a backup of the given file.  The snapshot is taken now; no pages
+   * are copied until step() is called.
+   *
+   * @param file              File to back up.  Must stay open until the
+   *                          backup is done or destroyed.
+   * @param backup_filename   Name of the backup file to create.
+   * @param mode              Kind of backup.
+   * @throws  FileExistsException   If the backup file already exists.
+   */
+  OnlineBackup(File* file, const std::string& backup_filename,
+               const Mode mode);
+
+  /**
+   * Abandons the backup if it hasn't finished, deleting the partial backup
+   * file and leaving the change record as it was.
+   */
+  ~OnlineBackup();
+
+  /**
+   * Copies up to <io_budget> pages, finishing the backup once all pages of
+   * the snapshot are copied.
+   *
+   * @param io_budget   Number of pages to copy in this step.
+   * @return  True if the backup has finished.
+   */
+  bool step(const std::uint32_t io_budget);
+
+  /**
+   * Runs the backup to completion.
+   */
+  void run();
+
+  /**
+   * Returns true if the backup has finished.
+   */
+  bool done() const { return done_; }
+
+  /**
+   * Returns the number of pages in the snapshot, not counting the file
+   * header.
+   */
+  PageId pagesToCopy() const { return pending_.size(); }
+
+  /**
+   * Returns the number of pages copied so far.
+   */
+  PageId pagesCopied() const { return pages_copied_; }
+
+  /**
+   * Returns the number of pages copied early because they were about to be
+   * overwritten.
+   */
+  PageId pagesCopiedEarly() const { return pages_copied_early_; }
+
+  /**
+   * Writes the pages of an incremental backup into a copy of the file restored
+   * from earlier backups, and sets its header and length to the snapshot's.
+   * Incremental backups must be applied in the order they were taken.
+   *
+   * @param filename              Restored copy of the file; must not be open.
+   * @param incremental_filename  Incremental backup to apply.
+   * @throws  FileNotFoundException   If either file doesn't exist.
+   * @throws  FileOpenException       If the restored copy is open.
+   * @throws  InvalidBackupException  If the backup isn't a finished
+   *                                  incremental backup.
+   * @throws  IoErrorException        If the restored copy can't be cut to the
+   *                                  snapshot's length.
+   */
+  static void applyIncremental(const std::string& filename,
+                               const std::string& incremental_filename);
+
+  virtual void beforePageChange(const PageId page_number);
+
+  virtual void afterPageWrite(const PageId page_number, const Page* page);
+
+ private:
+  /**
+   * Header of an incremental backup file.  It is followed by <num_entries>
+   * entries, each a page number and the Page::SIZE bytes of that page.
+   */
+  struct IncrementalHeader {
+    std::uint32_t magic;
+    FileHeader file_header;
+    std::uint32_t num_entries;
+  };
+
+  /**
+   * What the backup has done with a page of the snapshot.
+   */
+  enum PageState {
+    NOT_IN_SNAPSHOT,
+    PENDING,
+    COPIED
+  };
+
+  /**
+   * Writes a page to the backup file.
+   *
+   * @param page_number   Number of the page.
+   * @param page_bytes    Page::SIZE bytes of the page.
+   */
+  void writeBackupPage(const PageId page_number, const char* page_bytes);
+
+  /**
+   * Writes the snapshot's file header, closes the backup file, updates the
+   * change record and detaches from the file.
+   */
+  void finish();
+
+  /**
+   * File being backed up.
+   */
+  File* file_;
+
+  /**
+   * Name of the backup file.
+   */
+  std::string backup_filename_;
+
+  /**
+   * Kind of backup.
+   */
+  Mode mode_;
+
+  /**
+   * Stream of the backup file.
+   */
+  std::fstream out_;
+
+  /**
+   * File header at the time of the snapshot.
+   */
+  FileHeader header_;
+
+  /**
+   * Pages of the snapshot in page number order.
+   */
+  std::vector<PageId> pending_;
+
+  /**
+   * Index in <pending_> of the next page step() looks at.
+   */
+  std::size_t next_;
+
+  /**
+   * State of each page below the snapshot's number of pages.
+   */
+  std::vector<std::uint8_t> states_;
+
+  /**
+   * Pages written since the snapshot, indexed by page number.
+   */
+  std::vector<bool> written_;
+
+  /**
+   * Number of pages copied.
+   */
+  PageId pages_copied_;
+
+  /**
+   * Number of pages copied before being overwritten.
+   */
+  PageId pages_copied_early_;
+
+  /**
+   * Whether the backup has finished.
+   */
+  bool done_;
+};
+
+}
@@ -5,7 +5,10 @@
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <vector>
 
 #include "exceptions/insufficient_space_exception.h"
 #include "exceptions/invalid_record_exception.h"
@@ -16,18 +19,38 @@
 
 namespace badgerdb {
 
-Page::Page() {
+namespace {
+
+/**
+ * Slot layout used by pages written before Page::FORMAT_VERSION existed.
+ */
+struct LegacyPageSlot {
+  bool used;
+  std::uint16_t item_offset;
+  std::uint16_t item_length;
+};
+
+}
+
+const std::size_t Page::SIZE;
+const std::size_t Page::DATA_SIZE;
+const PageId Page::INVALID_NUMBER;
+const SlotId Page::INVALID_SLOT;
+const std::uint16_t Page::FORMAT_VERSION;
+
+Page::Page()
+    : reservation_(NULL) {
   initialize();
 }
 
 void Page::initialize() {
-  header_.free_space_lower_bound = 0;
+  header_.format_version = FORMAT_VERSION;
   header_.free_space_upper_bound = DATA_SIZE;
   header_.num_slots = 0;
   header_.num_free_slots = 0;
   header_.current_page_number = INVALID_NUMBER;
   header_.next_page_number = INVALID_NUMBER;
-  data_.assign(DATA_SIZE, char());
+  std::memset(data_, 0, DATA_SIZE);
 }
 
 RecordId Page::insertRecord(const std::string& record_data) {
@@ -43,23 +66,47 @@ RecordId Page::insertRecord(const std::string& record_data) {
 std::string Page::getRecord(const RecordId& record_id) const {
   validateRecordId(record_id);
   const PageSlot& slot = getSlot(record_id.slot_number);
-  return data_.substr(slot.item_offset, slot.item_length);
+  return std::string(data_ + slot.item_offset, slot.item_length);
 }
 
 void Page::updateRecord(const RecordId& record_id,
                         const std::string& record_data) {
   validateRecordId(record_id);
-  const PageSlot* slot = getSlot(record_id.slot_number);
+  PageSlot* slot = getSlot(record_id.slot_number);
+  if (record_data.length() <= slot->item_length) {
+    // Shrinking in place leaves a hole after the new data.
+    std::memcpy(data_ + slot->item_offset, record_data.data(),
+                record_data.length());
+    std::memset(data_ + slot->item_offset + record_data.length(), 0,
+                slot->item_length - record_data.length());
+    slot->item_length = record_data.length();
+    return;
+  }
+
+  if (reservation_) {
+    ++reservation_->growing_updates;
+  }
   const std::size_t free_space_after_delete =
-      getFreeSpace() + slot->item_length;
+      getFreeSpace() + getFragmentedBytes() + slot->item_length;
   if (record_data.length() > free_space_after_delete) {
+    if (reservation_) {
+      ++reservation_->reserve_overflows;
+    }
     throw InsufficientSpaceException(
         page_number(), record_data.length(), free_space_after_delete);
   }
+  if (reservation_ &&
+      free_space_after_delete - record_data.length() <
+          reservation_->reserved_bytes) {
+    ++reservation_->reserve_uses;
+  }
   // We have to disallow slot compaction here because we're going to place the
   // record data in the same slot, and compaction might delete the slot if we
   // permit it.
   deleteRecord(record_id, false /* allow_slot_compaction */);
+  if (record_data.length() > getFreeSpace()) {
+    compact();
+  }
   insertRecordInSlot(record_id.slot_number, record_data);
 }
 
@@ -71,36 +118,25 @@ void Page::deleteRecord(const RecordId& record_id,
                         const bool allow_slot_compaction) {
   validateRecordId(record_id);
   PageSlot* slot = getSlot(record_id.slot_number);
-  data_.replace(slot->item_offset, slot->item_length, slot->item_length, '\0');
-
-  // Compact the data by removing the hole left by this record (if necessary).
-  std::uint16_t move_offset = slot->item_offset; 
-  std::size_t move_bytes = 0;
-  for (SlotId i = 1; i <= header_.num_slots; ++i) {
-    PageSlot* other_slot = getSlot(i);
-    if (other_slot->used && other_slot->item_offset < slot->item_offset) {
-      if (other_slot->item_offset < move_offset) {
-        move_offset = other_slot->item_offset;
-      }
-      move_bytes += other_slot->item_length;
-      // Update the slot for the other data to reflect the soon-to-be-new
-      // location.
-      other_slot->item_offset += slot->item_length;
-    }
-  }
-  // If we have data to move, shift it to the right.
-  if (move_bytes > 0) {
-    const std::string& data_to_move = data_.substr(move_offset, move_bytes);
-    data_.replace(move_offset + slot->item_length, move_bytes, data_to_move);
-  }
-  header_.free_space_upper_bound += slot->item_length;
+  std::memset(data_ + slot->item_offset, 0, slot->item_length);
 
-  // Mark slot as unused.
-  slot->used = false;
+  // Mark slot as unused.  The other records stay where they are, so the data
+  // leaves a hole for compact() to close.
   slot->item_offset = 0;
   slot->item_length = 0;
   ++header_.num_free_slots;
 
+  // The free space reaches up to the lowest remaining record, taking in this
+  // record's data and any holes next to it if it was the lowest.
+  std::uint16_t upper_bound = DATA_SIZE;
+  for (SlotId i = 1; i <= header_.num_slots; ++i) {
+    const PageSlot* other_slot = getSlot(i);
+    if (other_slot->used() && other_slot->item_offset < upper_bound) {
+      upper_bound = other_slot->item_offset;
+    }
+  }
+  header_.free_space_upper_bound = upper_bound;
+
   if (allow_slot_compaction && record_id.slot_number == header_.num_slots) {
     // Last slot in the list, so we need to free any unused slots that are at
     // the end of the slot list.
@@ -108,7 +144,7 @@ void Page::deleteRecord(const RecordId& record_id,
     for (SlotId i = 1; i < header_.num_slots; ++i) {
       // Traverse list backwards, looking for unused slots.
       const PageSlot* other_slot = getSlot(header_.num_slots - i);
-      if (!other_slot->used) {
+      if (!other_slot->used()) {
         ++num_slots_to_delete;
       } else {
         // Stop at the first used slot we find, since we can't move used slots
@@ -118,15 +154,58 @@ void Page::deleteRecord(const RecordId& record_id,
     }
     header_.num_slots -= num_slots_to_delete;
     header_.num_free_slots -= num_slots_to_delete;
-    header_.free_space_lower_bound -= sizeof(PageSlot) * num_slots_to_delete;
   }
 }
 
+void Page::compact() {
+  // Move the records towards the end of the page highest first, so that none
+  // is overwritten before it has moved.
+  std::vector<SlotId> used_slots;
+  for (SlotId i = 1; i <= header_.num_slots; ++i) {
+    if (getSlot(i)->used()) {
+      used_slots.push_back(i);
+    }
+  }
+  std::sort(used_slots.begin(), used_slots.end(),
+            [this](const SlotId a, const SlotId b) {
+              return getSlot(a)->item_offset > getSlot(b)->item_offset;
+            });
+  std::uint16_t offset = DATA_SIZE;
+  for (std::size_t i = 0; i < used_slots.size(); ++i) {
+    PageSlot* slot = getSlot(used_slots[i]);
+    offset -= slot->item_length;
+    if (offset != slot->item_offset) {
+      std::memmove(data_ + offset, data_ + slot->item_offset,
+                   slot->item_length);
+      slot->item_offset = offset;
+    }
+  }
+  std::memset(data_ + header_.free_space_upper_bound, 0,
+              offset - header_.free_space_upper_bound);
+  header_.free_space_upper_bound = offset;
+}
+
+std::uint16_t Page::getFragmentedBytes() const {
+  std::size_t record_bytes = 0;
+  for (SlotId i = 1; i <= header_.num_slots; ++i) {
+    const PageSlot& slot = getSlot(i);
+    if (slot.used()) {
+      record_bytes += slot.item_length;
+    }
+  }
+  return DATA_SIZE - header_.free_space_upper_bound - record_bytes;
+}
+
 bool Page::hasSpaceForRecord(const std::string& record_data) const {
   std::size_t record_size = record_data.length();
   if (header_.num_free_slots == 0) {
     record_size += sizeof(PageSlot);
   }
+  // A page without records takes any record that fits, or records longer than
+  // the fill limit could never be stored.
+  if (reservation_ && header_.num_slots > header_.num_free_slots) {
+    record_size += reservation_->reserved_bytes;
+  }
   return record_size <= getFreeSpace();
 }
 
@@ -146,7 +225,7 @@ SlotId Page::getAvailableSlot() {
     // Have an allocated but unused slot that we can reuse.
     for (SlotId i = 1; i <= header_.num_slots; ++i) {
       const PageSlot* slot = getSlot(i);
-      if (!slot->used) {
+      if (!slot->used()) {
         // We don't decrement the number of free slots until someone actually
         // puts data in the slot.
         slot_number = i;
@@ -158,7 +237,11 @@ SlotId Page::getAvailableSlot() {
     slot_number = header_.num_slots + 1;
     ++header_.num_slots;
     ++header_.num_free_slots;
-    header_.free_space_lower_bound = sizeof(PageSlot) * header_.num_slots;
+    // The new slot may overlap bytes left behind by records that have since
+    // moved, so clear it before anyone checks whether it is used.
+    PageSlot* slot = getSlot(slot_number);
+    slot->item_offset = 0;
+    slot->item_length = 0;
   }
   assert(slot_number != INVALID_SLOT);
   return static_cast<SlotId>(slot_number);
@@ -171,28 +254,51 @@ void Page::insertRecordInSlot(const SlotId slot_number,
     throw InvalidSlotException(page_number(), slot_number);
   }
   PageSlot* slot = getSlot(slot_number);
-  if (slot->used) {
+  if (slot->used()) {
     throw SlotInUseException(page_number(), slot_number);
   }
   const int record_length = record_data.length();
-  slot->used = true;
   slot->item_length = record_length;
   slot->item_offset = header_.free_space_upper_bound - record_length;
   header_.free_space_upper_bound = slot->item_offset;
   --header_.num_free_slots;
-  data_.replace(slot->item_offset, slot->item_length, record_data);
+  std::memcpy(data_ + slot->item_offset, record_data.data(),
+              slot->item_length);
 }
 
 void Page::validateRecordId(const RecordId& record_id) const {
-  if (record_id.page_number != page_number()) {
+  if (record_id.page_number != page_number() ||
+      record_id.slot_number == INVALID_SLOT ||
+      record_id.slot_number > header_.num_slots) {
     throw InvalidRecordException(record_id, page_number());
   }
   const PageSlot& slot = getSlot(record_id.slot_number);
-  if (!slot.used) {
+  if (!slot.used()) {
     throw InvalidRecordException(record_id, page_number());
   }
 }
 
+void Page::upgradeFormat() {
+  if (header_.format_version == FORMAT_VERSION) {
+    return;
+  }
+  // Read the whole legacy slot array before rewriting it, since the new array
+  // overlaps the old one.
+  std::vector<PageSlot> slots(header_.num_slots);
+  for (SlotId i = 0; i < header_.num_slots; ++i) {
+    LegacyPageSlot legacy_slot;
+    std::memcpy(&legacy_slot, &data_[i * sizeof(LegacyPageSlot)],
+                sizeof(LegacyPageSlot));
+    slots[i].item_offset = legacy_slot.used ? legacy_slot.item_offset : 0;
+    slots[i].item_length = legacy_slot.used ? legacy_slot.item_length : 0;
+  }
+  std::memset(data_, 0, header_.num_slots * sizeof(LegacyPageSlot));
+  if (!slots.empty()) {
+    std::memcpy(&data_[0], &slots[0], slots.size() * sizeof(PageSlot));
+  }
+  header_.format_version = FORMAT_VERSION;
+}
+
 PageIterator Page::begin() {
   return PageIterator(this);
 }
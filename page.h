@@ -24,10 +24,13 @@ namespace badgerdb {
  */
 struct PageHeader {
   /**
-   * Lower bound of the free space.  This is the offset of the first unused byte
-   * after the slot array.
+   * Version of the page layout.  Pages written before the layout was versioned
+   * kept the free space lower bound in this field; that value is always a
+   * multiple of the legacy slot size, so it never equals
+   * Page::FORMAT_VERSION.  The lower bound itself is now derived from
+   * <num_slots>.
    */
-  std::uint16_t free_space_lower_bound;
+  std::uint16_t format_version;
 
   /**
    * Upper bound of the free space.  This is the offset of the last unused byte
@@ -73,16 +76,14 @@ struct PageHeader {
 
 /**
  * @brief Slot metadata that tracks where a record is in the data space.
+ *
+ * Slots are 4 bytes.  There is no separate used flag: a record always lives
+ * above the slot array, so its offset is never zero, and an offset of zero
+ * marks a slot whose record has been deleted.
  */
 struct PageSlot {
   /**
-   * Whether the slot currently holds data.  May be false if this slot's
-   * record has been deleted after insertion.
-   */
-  bool used;
-
-  /**
-   * Offset of the data item in the page.
+   * Offset of the data item in the page, or zero if the slot is unused.
    */
   std::uint16_t item_offset;
 
@@ -90,6 +91,53 @@ struct PageSlot {
    * Length of the data item in this slot.
    */
   std::uint16_t item_length;
+
+  /**
+   * Returns whether the slot currently holds data.  May be false if this
+   * slot's record has been deleted after insertion.
+   *
+   * @return  True if the slot holds a record.
+   */
+  bool used() const { return item_offset != 0; }
+};
+
+/**
+ * @brief Space that inserts must leave free on the pages of a file, and counts
+ *        of how that space gets used.
+ *
+ * One object is shared by all in-memory pages of a file (see
+ * File::setFillFactor()), so changing it affects pages already in a buffer
+ * pool and the counts cover every page of the file.  Pages point at it
+ * without owning it, so copying a page costs nothing extra.
+ */
+struct SpaceReservation {
+  /**
+   * Number of bytes of each page that inserts leave free for updates.
+   */
+  std::uint16_t reserved_bytes;
+
+  /**
+   * Number of updates that made a record longer.
+   */
+  std::uint64_t growing_updates;
+
+  /**
+   * Number of growing updates that left the page with less than
+   * <reserved_bytes> free, i.e. that ate into the reserved space.
+   */
+  std::uint64_t reserve_uses;
+
+  /**
+   * Number of growing updates that did not fit on the page at all.
+   */
+  std::uint64_t reserve_overflows;
+
+  SpaceReservation()
+      : reserved_bytes(0),
+        growing_updates(0),
+        reserve_uses(0),
+        reserve_overflows(0) {
+  }
 };
 
 class PageIterator;
@@ -127,6 +175,12 @@ class Page {
    */
   static const SlotId INVALID_SLOT = 0;
 
+  /**
+   * Version of the page layout written by this code.  Pages with any other
+   * value in their header are converted when they are read from disk.
+   */
+  static const std::uint16_t FORMAT_VERSION = 1;
+
   /**
    * Constructs a new, uninitialized page.
    */
@@ -153,7 +207,11 @@ class Page {
   /**
    * Updates the record with the given ID, replacing its data with a new
    * version.  This is equivalent to deleting the old record and inserting a
-   * new one, with the exception that the record ID will not change.
+   * new one, with the exception that the record ID will not change.  Data no
+   * longer than the old version is written in place.  Longer data goes into
+   * the free space; only if it doesn't fit there but would fit once the holes
+   * left by deletes are closed is the page compacted first, since the record
+   * can't move to another page without changing its ID.
    *
    * @param record_id   ID of record to update.
    * @param record_data Updated bytes that compose the record.
@@ -161,16 +219,29 @@ class Page {
   void updateRecord(const RecordId& record_id, const std::string& record_data);
 
   /**
-   * Deletes the record with the given ID.  Page is compacted upon delete to
-   * ensure that data of all records is contiguous.  Slot array is compacted if
-   * the slot deleted is at the end of the slot array.
+   * Deletes the record with the given ID.  Other records are not moved, so
+   * unless the record was next to the free space, its data leaves a hole that
+   * is only reclaimed by compact().  Slot array is compacted if the slot
+   * deleted is at the end of the slot array.  Unused slots in the middle of
+   * the array stay, since their numbers are part of the IDs of the records
+   * after them; they are reused by later inserts.
    *
    * @param record_id   ID of the record to delete.
    */
   void deleteRecord(const RecordId& record_id);
 
   /**
-   * Returns true if the page has enough free space to hold the given data.
+   * Moves the data of all records together at the end of the page, turning
+   * the holes left by deletes and shrinking updates back into free space.
+   * Record IDs do not change, but pointers into the page's data do.
+   */
+  void compact();
+
+  /**
+   * Returns true if the page has enough free space to hold the given data
+   * while still leaving the space reserved for updates by the file's fill
+   * factor.  A page without records needs no reserve, so that records longer
+   * than the fill limit can still be stored on a page of their own.
    *
    * @param record_data Bytes that compose the record.
    * @return  Whether the page can hold the data.
@@ -178,12 +249,21 @@ class Page {
   bool hasSpaceForRecord(const std::string& record_data) const;
 
   /**
-   * Returns this page's free space in bytes.
+   * Returns this page's free space in bytes.  Holes left by deletes are not
+   * included until the page is compacted.
    *
    * @return  Free space in bytes.
    */
   std::uint16_t getFreeSpace() const { return header_.free_space_upper_bound -
-                                              header_.free_space_lower_bound; }
+                                              freeSpaceLowerBound(); }
+
+  /**
+   * Returns the number of bytes in holes between records, i.e. the free space
+   * compact() would add.  Computed from the slot array.
+   *
+   * @return  Fragmented free space in bytes.
+   */
+  std::uint16_t getFragmentedBytes() const;
 
   /**
    * Returns this page's number in its file.
@@ -220,6 +300,24 @@ class Page {
    */
   void initialize();
 
+  /**
+   * Returns the lower bound of the free space.  This is the offset of the first
+   * unused byte after the slot array.
+   *
+   * @return  Offset of first byte after the slot array.
+   */
+  std::uint16_t freeSpaceLowerBound() const {
+    return header_.num_slots * sizeof(PageSlot);
+  }
+
+  /**
+   * Converts a page read from disk in the legacy layout (6-byte slots with an
+   * explicit used flag) to the current layout.  Record data stays where it is;
+   * only the slot array shrinks.  Does nothing if the page is already in the
+   * current layout.
+   */
+  void upgradeFormat();
+
   /**
    * Sets this page's number in its file.
    *
@@ -239,9 +337,8 @@ class Page {
   }
 
   /**
-   * Deletes the record with the given ID.  Page is compacted upon delete to
-   * ensure that data of all records is contiguous.  Slot array is compacted if
-   * the slot deleted is at the end of the slot array and
+   * Deletes the record with the given ID without moving other records.  Slot
+   * array is compacted if the slot deleted is at the end of the slot array and
    * <allow_slot_compaction> is set.
    *
    * @param record_id             ID of the record to delete.
@@ -327,15 +424,28 @@ class Page {
 
   /**
    * Data stored on the page.  Includes bookkeeping information about slots as
-   * well as actual content.
+   * well as actual content.  Held inline, so the header and data form one
+   * contiguous image that can be placed in shared memory (see SharedBufMgr).
    */
+  char data_[DATA_SIZE];
 
-  std::string data_;
+  /**
+   * Reserved space settings and counters of the file this page belongs to, or
+   * NULL for pages not read from a file.  Kept in memory only; owned by File,
+   * which keeps it for as long as the process runs.
+   */
+  SpaceReservation* reservation_;
 
   friend class File;
+  friend class FileAnalyzer;
+  friend class FlashCache;
+  friend class FreeSpaceMap;
   friend class PageIterator;
   friend class PageTest;
+  friend class RecordBatch;
+  friend class SharedBufMgr;
   friend class BufferTest;
+  friend class ZoneMap;
 };
 
 static_assert(Page::SIZE > sizeof(PageHeader),
@@ -112,7 +112,7 @@ class PageIterator {
     SlotId slot_number = Page::INVALID_SLOT;
     for (SlotId i = start + 1; i <= page_->header_.num_slots; ++i) {
       const PageSlot* slot = page_->getSlot(i);
-      if (slot->used) {
+      if (slot->used()) {
         slot_number = i;
         break;
       }
@@ -0,0 +1,193 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cassert>
+#include <memory>
+#include <vector>
+#include "file.h"
+#include "page.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Iterator for scanning the used pages of a file in on-disk order.
+ *
+ * Unlike FileIterator, which follows the used list one page at a time, this
+ * iterator visits used pages in page number order and reads each run of
+ * adjacent used pages (up to MAX_RUN_PAGES long) with a single read.  Which
+ * pages are used is taken from File::allocationMap() when the scan starts, so
+ * pages allocated or deleted during the scan may or may not be visited.
+ */
+class PhysicalFileIterator {
+ public:
+  /**
+   * Maximum number of pages read with one I/O.
+   */
+  static const PageId MAX_RUN_PAGES = 64;
+
+  /**
+   * Constructs an empty iterator.
+   */
+  PhysicalFileIterator()
+      : file_(NULL),
+        run_start_(Page::INVALID_NUMBER),
+        current_page_number_(Page::INVALID_NUMBER) {
+  }
+
+  /**
+   * Constructs an iterator over the used pages in a file, starting at the
+   * lowest-numbered one.
+   *
+   * @param file  File to iterate over.
+   */
+  PhysicalFileIterator(File* file)
+      : file_(file),
+        used_pages_(new std::vector<bool>(file->allocationMap())),
+        run_start_(Page::INVALID_NUMBER),
+        current_page_number_(Page::INVALID_NUMBER) {
+    assert(file_ != NULL);
+    advanceTo(1);
+  }
+
+  /**
+   * Constructs an iterator over the pages of a file marked in <pages>, which
+   * must all be used pages.
+   *
+   * @param file  File to iterate over.
+   * @param pages Pages to visit, indexed by page number.
+   */
+  PhysicalFileIterator(File* file, const std::vector<bool>& pages)
+      : file_(file),
+        used_pages_(new std::vector<bool>(pages)),
+        run_start_(Page::INVALID_NUMBER),
+        current_page_number_(Page::INVALID_NUMBER) {
+    assert(file_ != NULL);
+    advanceTo(1);
+  }
+
+  /**
+   * Constructs an iterator positioned at the given page number without
+   * reading anything.  Used for end iterators.
+   *
+   * @param file        File to iterate over.
+   * @param page_number Number of page to position iterator at.
+   */
+  PhysicalFileIterator(File* file, PageId page_number)
+      : file_(file),
+        run_start_(Page::INVALID_NUMBER),
+        current_page_number_(page_number) {
+  }
+
+  /**
+   * Advances the iterator to the next used page in the file.
+   */
+  inline PhysicalFileIterator& operator++() {
+    assert(file_ != NULL);
+    advanceTo(current_page_number_ + 1);
+    return *this;
+  }
+
+  //postfix
+  inline PhysicalFileIterator operator++(int) {
+    PhysicalFileIterator tmp = *this;   // copy ourselves
+    ++*this;
+    return tmp;
+  }
+
+  /**
+   * Returns true if this iterator is equal to the given iterator.
+   *
+   * @param rhs   Iterator to compare against.
+   * @return    True if other iterator is equal to this one.
+   */
+  inline bool operator==(const PhysicalFileIterator& rhs) const {
+    return file_->filename() == rhs.file_->filename() &&
+        current_page_number_ == rhs.current_page_number_;
+  }
+
+  inline bool operator!=(const PhysicalFileIterator& rhs) const {
+    return !(*this == rhs);
+  }
+
+  /**
+   * Dereferences the iterator, returning a copy of the current page in the
+   * file.
+   *
+   * @return  Page in file.
+   */
+  inline Page operator*() const {
+    assert(current_page_number_ >= run_start_ &&
+           current_page_number_ - run_start_ < run_->size());
+    return (*run_)[current_page_number_ - run_start_];
+  }
+
+ private:
+  /**
+   * Moves to the first used page numbered <page_number> or higher, reading the
+   * run of used pages starting there if it isn't buffered yet.
+   *
+   * @param page_number   Lowest page number to consider.
+   */
+  void advanceTo(PageId page_number) {
+    const std::vector<bool>& used_pages = *used_pages_;
+    while (page_number < used_pages.size() && !used_pages[page_number]) {
+      ++page_number;
+    }
+    if (page_number >= used_pages.size()) {
+      current_page_number_ = Page::INVALID_NUMBER;
+      run_.reset();
+      return;
+    }
+    current_page_number_ = page_number;
+    if (run_ && page_number >= run_start_ &&
+        page_number - run_start_ < run_->size()) {
+      return;
+    }
+    PageId run_length = 1;
+    while (run_length < MAX_RUN_PAGES &&
+           page_number + run_length < used_pages.size() &&
+           used_pages[page_number + run_length]) {
+      ++run_length;
+    }
+    // A new vector rather than refilling the old one, since copies of this
+    // iterator may still be looking at it.
+    std::shared_ptr<std::vector<Page> > run(new std::vector<Page>());
+    file_->readPages(page_number, run_length, *run);
+    run_ = run;
+    run_start_ = page_number;
+  }
+
+  /**
+   * File we're iterating over.
+   */
+  File* file_;
+
+  /**
+   * Which pages were in use when the scan started, indexed by page number.
+   */
+  std::shared_ptr<std::vector<bool> > used_pages_;
+
+  /**
+   * Pages of the run read most recently.
+   */
+  std::shared_ptr<std::vector<Page> > run_;
+
+  /**
+   * Page number of the first page in <run_>.
+   */
+  PageId run_start_;
+
+  /**
+   * Number of page in file iterator is currently pointing to.
+   */
+  PageId current_page_number_;
+};
+
+}
@@ -0,0 +1,258 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "query_operator.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace badgerdb {
+
+ScanOperator::ScanOperator(File* file)
+    : position_(file->physicalBegin()),
+      end_(file->physicalEnd()),
+      pages_read_(0) {}
+
+ScanOperator::ScanOperator(File* file, const std::string& low_key,
+                           const std::string& high_key)
+    : position_(file->physicalBegin(low_key, high_key)),
+      end_(file->physicalEnd()),
+      pages_read_(0) {}
+
+bool ScanOperator::next(RecordBatch& batch) {
+  batch.clear();
+  // Whole pages at a time, skipping empty ones.
+  while (!batch.full() && position_ != end_) {
+    batch.addPage(*position_);
+    ++position_;
+    ++pages_read_;
+  }
+  return !batch.empty();
+}
+
+FilterOperator::FilterOperator(OperatorPtr child, const Predicate& predicate)
+    : child_(std::move(child)), predicate_(predicate) {}
+
+bool FilterOperator::next(RecordBatch& batch) {
+  while (child_->next(batch)) {
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < batch.size(); ++i) {
+      if (predicate_(batch[i])) {
+        batch[kept++] = batch[i];
+      }
+    }
+    batch.truncate(kept);
+    if (kept > 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+ProjectOperator::ProjectOperator(OperatorPtr child, const Projector& projector)
+    : child_(std::move(child)), projector_(projector) {}
+
+bool ProjectOperator::next(RecordBatch& batch) {
+  if (!child_->next(batch)) {
+    return false;
+  }
+  for (std::size_t i = 0; i < batch.size(); ++i) {
+    batch[i] = projector_(batch[i], batch);
+  }
+  return true;
+}
+
+Projector ProjectOperator::bytes(const std::size_t offset,
+                                 const std::size_t length) {
+  return [offset, length](const RecordView& record, RecordBatch&) {
+    return record.substr(offset, length);
+  };
+}
+
+LimitOperator::LimitOperator(OperatorPtr child, const std::uint64_t limit,
+                             const std::uint64_t offset)
+    : child_(std::move(child)), remaining_(limit), to_skip_(offset) {}
+
+bool LimitOperator::next(RecordBatch& batch) {
+  while (remaining_ > 0 && child_->next(batch)) {
+    std::size_t first = 0;
+    if (to_skip_ > 0) {
+      first = static_cast<std::size_t>(
+          std::min<std::uint64_t>(to_skip_, batch.size()));
+      to_skip_ -= first;
+      for (std::size_t i = first; i < batch.size(); ++i) {
+        batch[i - first] = batch[i];
+      }
+    }
+    const std::size_t kept = static_cast<std::size_t>(
+        std::min<std::uint64_t>(remaining_, batch.size() - first));
+    batch.truncate(kept);
+    if (kept > 0) {
+      remaining_ -= kept;
+      return true;
+    }
+  }
+  batch.clear();
+  return false;
+}
+
+SortOperator::SortOperator(OperatorPtr child, const Comparator& comparator)
+    : child_(std::move(child)),
+      comparator_(comparator),
+      sorted_(false),
+      position_(0) {}
+
+bool SortOperator::next(RecordBatch& batch) {
+  if (!sorted_) {
+    // Copy everything first, since data_ moves as it grows, then point the
+    // views at the copies.
+    std::vector<std::pair<std::size_t, RecordView> > copies;
+    RecordBatch input(batch.capacity());
+    while (child_->next(input)) {
+      for (std::size_t i = 0; i < input.size(); ++i) {
+        copies.push_back(std::make_pair(data_.size(), input[i]));
+        data_.append(input[i].data, input[i].size);
+      }
+    }
+    records_.reserve(copies.size());
+    for (std::size_t i = 0; i < copies.size(); ++i) {
+      RecordView view = copies[i].second;
+      view.data = data_.data() + copies[i].first;
+      records_.push_back(view);
+    }
+    if (comparator_) {
+      std::stable_sort(records_.begin(), records_.end(), comparator_);
+    } else {
+      std::stable_sort(records_.begin(), records_.end(),
+                       [](const RecordView& a, const RecordView& b) {
+                         return a.compare(b) < 0;
+                       });
+    }
+    sorted_ = true;
+  }
+  batch.clear();
+  for (; position_ < records_.size() && !batch.full(); ++position_) {
+    batch.add(records_[position_]);
+  }
+  return !batch.empty();
+}
+
+HashJoinOperator::HashJoinOperator(OperatorPtr build, OperatorPtr probe,
+                                   const Projector& build_key,
+                                   const Projector& probe_key,
+                                   const Joiner& joiner)
+    : build_(std::move(build)),
+      probe_(std::move(probe)),
+      build_key_(build_key),
+      probe_key_(probe_key),
+      joiner_(joiner),
+      built_(false),
+      probe_position_(0),
+      matches_(NULL),
+      match_position_(0) {}
+
+bool HashJoinOperator::next(RecordBatch& batch) {
+  if (!built_) {
+    build();
+  }
+  batch.clear();
+  while (!batch.full()) {
+    if (probe_position_ >= probe_batch_.size()) {
+      // Output may point into the probe batch, so it can't be refilled
+      // until the caller is done with this batch.
+      if (!batch.empty() || !probe_->next(probe_batch_)) {
+        break;
+      }
+      probe_position_ = 0;
+      matches_ = NULL;
+      continue;
+    }
+    const RecordView& probe = probe_batch_[probe_position_];
+    if (matches_ == NULL) {
+      const auto iter = table_.find(probe_key_(probe, probe_batch_));
+      if (iter == table_.end()) {
+        ++probe_position_;
+        continue;
+      }
+      matches_ = &iter->second;
+      match_position_ = 0;
+    }
+    const RecordView& build = (*matches_)[match_position_];
+    if (joiner_) {
+      batch.add(joiner_(build, probe, batch));
+    } else {
+      char* joined = batch.allocate(probe.size + build.size);
+      std::memcpy(joined, probe.data, probe.size);
+      std::memcpy(joined + probe.size, build.data, build.size);
+      batch.add(RecordView(joined, probe.size + build.size));
+    }
+    if (++match_position_ == matches_->size()) {
+      matches_ = NULL;
+      ++probe_position_;
+    }
+  }
+  return !batch.empty();
+}
+
+void HashJoinOperator::build() {
+  RecordBatch input;
+  while (build_->next(input)) {
+    for (std::size_t i = 0; i < input.size(); ++i) {
+      RecordView record = build_storage_.store(input[i].data, input[i].size);
+      record.record_id = input[i].record_id;
+      const RecordView key = build_key_(input[i], input);
+      table_[build_storage_.store(key.data, key.size)].push_back(record);
+    }
+  }
+  built_ = true;
+}
+
+AggregateOperator::AggregateOperator(OperatorPtr child, const Projector& key,
+                                     const ValueExtractor& value)
+    : child_(std::move(child)), key_(key), value_(value), aggregated_(false) {}
+
+bool AggregateOperator::next(RecordBatch& batch) {
+  if (!aggregated_) {
+    RecordBatch input(batch.capacity());
+    std::string key;
+    while (child_->next(input)) {
+      for (std::size_t i = 0; i < input.size(); ++i) {
+        const RecordView key_view = key_(input[i], input);
+        key.assign(key_view.data, key_view.size);
+        const double value = value_(input[i]);
+        const HashAggregate::Aggregates single = {1, value, value, value};
+        std::pair<Table::iterator, bool> entry =
+            groups_.insert(std::make_pair(key, single));
+        if (!entry.second) {
+          HashAggregate::combine(entry.first->second, single);
+        }
+      }
+    }
+    position_ = groups_.begin();
+    aggregated_ = true;
+  }
+  batch.clear();
+  for (; position_ != groups_.end() && !batch.full(); ++position_) {
+    const std::string& key = position_->first;
+    const std::size_t size = key.size() + sizeof(HashAggregate::Aggregates);
+    char* record = batch.allocate(size);
+    std::memcpy(record, key.data(), key.size());
+    std::memcpy(record + key.size(), &position_->second,
+                sizeof(HashAggregate::Aggregates));
+    batch.add(RecordView(record, size));
+  }
+  return !batch.empty();
+}
+
+void AggregateOperator::decode(const RecordView& record, std::string& key,
+                               HashAggregate::Aggregates& aggregates) {
+  const std::size_t key_size = record.size - sizeof(aggregates);
+  key.assign(record.data, key_size);
+  std::memcpy(&aggregates, record.data + key_size, sizeof(aggregates));
+}
+
+}
@@ -0,0 +1,310 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "file.h"
+#include "hash_aggregate.h"
+#include "physical_file_iterator.h"
+#include "record_batch.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief A step of a query plan that produces records a batch at a time.
+ *
+ * Operators form a tree built at run time: each takes its inputs as
+ * operators and is pulled by its parent, which hands it a batch to fill.
+ * A typical pipeline:
+ *
+ *   std::unique_ptr<Operator> plan(new LimitOperator(
+ *       std::unique_ptr<Operator>(new FilterOperator(
+ *           std::unique_ptr<Operator>(new ScanOperator(&file)),
+ *           [](const RecordView& record) { return record.size > 100; })),
+ *       10));
+ *   RecordBatch batch;
+ *   while (plan->next(batch)) {
+ *     for (std::size_t i = 0; i < batch.size(); ++i) {
+ *       ... batch[i] ...
+ *     }
+ *   }
+ *
+ * Views returned by next() are valid until the next call to next() on the
+ * same operator, or until the batch is cleared or the operator destroyed.
+ */
+class Operator {
+ public:
+  virtual ~Operator() {}
+
+  /**
+   * Replaces the contents of a batch with the next records.
+   *
+   * @param batch   Batch to fill; cleared first.
+   * @return  False, with the batch empty, once there are no more records.
+   *          True means the batch holds at least one record.
+   */
+  virtual bool next(RecordBatch& batch) = 0;
+};
+
+typedef std::unique_ptr<Operator> OperatorPtr;
+
+/**
+ * Tests a record.
+ */
+typedef std::function<bool(const RecordView& record)> Predicate;
+
+/**
+ * Returns the part of a record an operator works on, e.g. a key.  May return
+ * a view of the record itself or of bytes stored in the batch.
+ */
+typedef std::function<RecordView(const RecordView& record,
+                                 RecordBatch& batch)> Projector;
+
+/**
+ * Orders records; returns whether <a> goes before <b>.
+ */
+typedef std::function<bool(const RecordView& a, const RecordView& b)>
+    Comparator;
+
+/**
+ * @brief Reads the records of a file in physical order.
+ *
+ * Pages are read straight from the file, a whole page at a time, so pages
+ * dirty in a buffer pool must be flushed first.
+ */
+class ScanOperator : public Operator {
+ public:
+  /**
+   * Scans every record of a file.
+   *
+   * @param file  File to scan; must outlive the operator.
+   */
+  explicit ScanOperator(File* file);
+
+  /**
+   * Scans the pages of a file that its zone map says may hold keys in
+   * [low_key, high_key], or every page if the file has no zone map.  Records
+   * outside the range are not filtered out.
+   *
+   * @param file      File to scan; must outlive the operator.
+   * @param low_key   Lowest key wanted.
+   * @param high_key  Highest key wanted.
+   */
+  ScanOperator(File* file, const std::string& low_key,
+               const std::string& high_key);
+
+  bool next(RecordBatch& batch);
+
+  /**
+   * Returns the number of pages read so far.
+   */
+  std::uint64_t pagesRead() const { return pages_read_; }
+
+ private:
+  PhysicalFileIterator position_;
+  PhysicalFileIterator end_;
+  std::uint64_t pages_read_;
+};
+
+/**
+ * @brief Passes on the records that satisfy a predicate.
+ */
+class FilterOperator : public Operator {
+ public:
+  FilterOperator(OperatorPtr child, const Predicate& predicate);
+
+  bool next(RecordBatch& batch);
+
+ private:
+  OperatorPtr child_;
+  const Predicate predicate_;
+};
+
+/**
+ * @brief Replaces each record by a projection of it.
+ */
+class ProjectOperator : public Operator {
+ public:
+  ProjectOperator(OperatorPtr child, const Projector& projector);
+
+  bool next(RecordBatch& batch);
+
+  /**
+   * Returns a projector that keeps <length> bytes starting at <offset>,
+   * without copying them.
+   */
+  static Projector bytes(const std::size_t offset, const std::size_t length);
+
+ private:
+  OperatorPtr child_;
+  const Projector projector_;
+};
+
+/**
+ * @brief Skips the first <offset> records and passes on at most <limit> of
+ *        the rest.
+ */
+class LimitOperator : public Operator {
+ public:
+  LimitOperator(OperatorPtr child, const std::uint64_t limit,
+                const std::uint64_t offset = 0);
+
+  bool next(RecordBatch& batch);
+
+ private:
+  OperatorPtr child_;
+  std::uint64_t remaining_;
+  std::uint64_t to_skip_;
+};
+
+/**
+ * @brief Sorts its input in memory.
+ *
+ * Copies every input record on the first call to next(), sorts them stably
+ * and then returns them in order.
+ */
+class SortOperator : public Operator {
+ public:
+  /**
+   * @param child       Input.
+   * @param comparator  Order to sort in; bytewise if empty.
+   */
+  explicit SortOperator(OperatorPtr child,
+                        const Comparator& comparator = Comparator());
+
+  bool next(RecordBatch& batch);
+
+ private:
+  OperatorPtr child_;
+  const Comparator comparator_;
+  bool sorted_;
+
+  /**
+   * Copies of the input records, and views of them in sorted order.
+   */
+  std::string data_;
+  std::vector<RecordView> records_;
+  std::size_t position_;
+};
+
+/**
+ * @brief Inner equi-join of two inputs by hashing.
+ *
+ * Reads the whole build input into a hash table on its key on the first call
+ * to next(), then streams the probe input and joins each record with every
+ * build record whose key is equal.  The build input should be the smaller.
+ */
+class HashJoinOperator : public Operator {
+ public:
+  /**
+   * Makes a joined record out of a build and a probe record.
+   */
+  typedef std::function<RecordView(const RecordView& build,
+                                   const RecordView& probe,
+                                   RecordBatch& batch)> Joiner;
+
+  /**
+   * @param build       Input kept in memory.
+   * @param probe       Input streamed.
+   * @param build_key   Key of a build record.
+   * @param probe_key   Key of a probe record.
+   * @param joiner      Makes the output records; if empty, they are the probe
+   *                    record followed by the build record.
+   */
+  HashJoinOperator(OperatorPtr build, OperatorPtr probe,
+                   const Projector& build_key, const Projector& probe_key,
+                   const Joiner& joiner = Joiner());
+
+  bool next(RecordBatch& batch);
+
+ private:
+  /**
+   * Reads the build input into the hash table.
+   */
+  void build();
+
+  OperatorPtr build_;
+  OperatorPtr probe_;
+  const Projector build_key_;
+  const Projector probe_key_;
+  const Joiner joiner_;
+  bool built_;
+
+  /**
+   * Copies of the build records and their keys, and build records by key.
+   */
+  RecordBatch build_storage_;
+  std::unordered_map<RecordView, std::vector<RecordView>, RecordViewHash>
+      table_;
+
+  /**
+   * Current probe batch, the record being joined and its next match.
+   */
+  RecordBatch probe_batch_;
+  std::size_t probe_position_;
+  const std::vector<RecordView>* matches_;
+  std::size_t match_position_;
+};
+
+/**
+ * @brief Groups its input and computes count, sum, minimum and maximum of a
+ *        value per group.
+ *
+ * Reads the whole input into a hash table on the first call to next(), then
+ * returns one record per group, in no particular order: the group key
+ * followed by the bytes of its HashAggregate::Aggregates, which decode()
+ * takes apart.  For big inputs in files, HashAggregate does the same work
+ * on several threads and within a memory budget.
+ */
+class AggregateOperator : public Operator {
+ public:
+  /**
+   * Returns the value of a record.
+   */
+  typedef std::function<double(const RecordView& record)> ValueExtractor;
+
+  /**
+   * @param child   Input.
+   * @param key     Group key of a record.
+   * @param value   Value of a record.
+   */
+  AggregateOperator(OperatorPtr child, const Projector& key,
+                    const ValueExtractor& value);
+
+  bool next(RecordBatch& batch);
+
+  /**
+   * Splits an output record into its group key and aggregates.
+   *
+   * @param record      Record returned by the operator.
+   * @param key         Receives the group key.
+   * @param aggregates  Receives the aggregates.
+   */
+  static void decode(const RecordView& record, std::string& key,
+                     HashAggregate::Aggregates& aggregates);
+
+ private:
+  typedef std::unordered_map<std::string, HashAggregate::Aggregates> Table;
+
+  OperatorPtr child_;
+  const Projector key_;
+  const ValueExtractor value_;
+  bool aggregated_;
+  Table groups_;
+  Table::const_iterator position_;
+};
+
+}
@@ -0,0 +1,87 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "record_batch.h"
+
+namespace badgerdb {
+
+std::size_t RecordViewHash::operator()(const RecordView& view) const {
+  // FNV-1a.
+  std::size_t hash = 14695981039346656037ULL;
+  for (std::size_t i = 0; i < view.size; ++i) {
+    hash = (hash ^ static_cast<unsigned char>(view.data[i])) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+RecordBatch::RecordBatch(const std::size_t capacity)
+    : capacity_(capacity > 0 ? capacity : 1),
+      pages_used_(0),
+      chunks_used_(0),
+      chunk_offset_(0) {
+  views_.reserve(capacity_);
+}
+
+void RecordBatch::addPage(const Page& page) {
+  if (pages_used_ == pages_.size()) {
+    pages_.push_back(std::unique_ptr<Page>(new Page));
+  }
+  *pages_[pages_used_] = page;
+  const Page& copy = *pages_[pages_used_++];
+  const char* data = copy.data_;
+  for (SlotId slot_number = 1; slot_number <= copy.header_.num_slots;
+       ++slot_number) {
+    const PageSlot& slot = copy.getSlot(slot_number);
+    if (!slot.used()) {
+      continue;
+    }
+    RecordView view(data + slot.item_offset, slot.item_length);
+    view.record_id = {copy.page_number(), slot_number};
+    views_.push_back(view);
+  }
+}
+
+char* RecordBatch::allocate(const std::size_t size) {
+  if (size > CHUNK_SIZE / 4) {
+    oversized_.push_back(std::unique_ptr<char[]>(new char[size]));
+    return oversized_.back().get();
+  }
+  if (chunks_used_ == 0 || chunk_offset_ + size > CHUNK_SIZE) {
+    if (chunks_used_ == chunks_.size()) {
+      chunks_.push_back(std::unique_ptr<char[]>(new char[CHUNK_SIZE]));
+    }
+    ++chunks_used_;
+    chunk_offset_ = 0;
+  }
+  char* storage = chunks_[chunks_used_ - 1].get() + chunk_offset_;
+  chunk_offset_ += size;
+  return storage;
+}
+
+RecordView RecordBatch::store(const char* data, const std::size_t size) {
+  char* storage = allocate(size);
+  if (size > 0) {
+    std::memcpy(storage, data, size);
+  }
+  return RecordView(storage, size);
+}
+
+void RecordBatch::truncate(const std::size_t size) {
+  if (size < views_.size()) {
+    views_.resize(size);
+  }
+}
+
+void RecordBatch::clear() {
+  views_.clear();
+  pages_used_ = 0;
+  chunks_used_ = 0;
+  chunk_offset_ = 0;
+  oversized_.clear();
+}
+
+}
@@ -0,0 +1,191 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "page.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Unowned bytes of a record.
+ *
+ * Points into storage owned by someone else, normally a RecordBatch or an
+ * operator, and is only valid as long as that storage is.
+ */
+struct RecordView {
+  RecordView() : data(NULL), size(0) {
+    record_id = {Page::INVALID_NUMBER, Page::INVALID_SLOT};
+  }
+
+  RecordView(const char* data, const std::size_t size) : data(data), size(size) {
+    record_id = {Page::INVALID_NUMBER, Page::INVALID_SLOT};
+  }
+
+  /**
+   * Returns a copy of the bytes.
+   */
+  std::string str() const { return std::string(data, size); }
+
+  /**
+   * Returns a view of <length> bytes starting at <offset>, clipped to the
+   * record.
+   */
+  RecordView substr(const std::size_t offset,
+                    const std::size_t length = std::string::npos) const {
+    const std::size_t start = offset < size ? offset : size;
+    return RecordView(data + start,
+                      length < size - start ? length : size - start);
+  }
+
+  /**
+   * Compares the bytes like std::string::compare().
+   */
+  int compare(const RecordView& other) const {
+    const int result =
+        std::memcmp(data, other.data, size < other.size ? size : other.size);
+    if (result != 0) {
+      return result;
+    }
+    return size < other.size ? -1 : (size > other.size ? 1 : 0);
+  }
+
+  bool operator==(const RecordView& other) const {
+    return size == other.size && std::memcmp(data, other.data, size) == 0;
+  }
+
+  const char* data;
+  std::size_t size;
+
+  /**
+   * Where the record is stored, for records read straight off a page;
+   * invalid for records made up by an operator.
+   */
+  RecordId record_id;
+};
+
+/**
+ * @brief Hashes the bytes of a RecordView, for hash tables keyed by views.
+ */
+struct RecordViewHash {
+  std::size_t operator()(const RecordView& view) const;
+};
+
+/**
+ * @brief A batch of records passed between query operators.
+ *
+ * Holds up to about <capacity> record views along with the storage they
+ * point into: copies of the pages they were read from and bytes written by
+ * operators.  Operators pass one batch down and back up a pipeline and work
+ * on all its records at once, so per-record costs are a loop iteration
+ * rather than a virtual call and a string copy.
+ *
+ * clear() keeps the storage allocated for reuse by the next batch.
+ */
+class RecordBatch {
+ public:
+  /**
+   * Records per batch unless told otherwise.
+   */
+  static const std::size_t DEFAULT_CAPACITY = 1024;
+
+  /**
+   * Creates an empty batch.
+   *
+   * @param capacity  Records the batch should hold; batches filled a page at
+   *                  a time may go over by a page's worth.
+   */
+  explicit RecordBatch(const std::size_t capacity = DEFAULT_CAPACITY);
+
+  RecordBatch(const RecordBatch&) = delete;
+  RecordBatch& operator=(const RecordBatch&) = delete;
+
+  std::size_t capacity() const { return capacity_; }
+  std::size_t size() const { return views_.size(); }
+  bool empty() const { return views_.empty(); }
+  bool full() const { return views_.size() >= capacity_; }
+
+  const RecordView& operator[](const std::size_t i) const { return views_[i]; }
+  RecordView& operator[](const std::size_t i) { return views_[i]; }
+
+  /**
+   * Appends a view.  Its bytes must live at least as long as the batch's
+   * current contents, e.g. in the batch itself.
+   */
+  void add(const RecordView& view) { views_.push_back(view); }
+
+  /**
+   * Copies a page into the batch and appends a view of each of its records.
+   *
+   * @param page  Page to add.
+   */
+  void addPage(const Page& page);
+
+  /**
+   * Returns <size> bytes of writable storage owned by the batch until it is
+   * cleared.
+   */
+  char* allocate(const std::size_t size);
+
+  /**
+   * Copies bytes into the batch's storage and returns a view of the copy.
+   * The view is not appended.
+   */
+  RecordView store(const char* data, const std::size_t size);
+
+  RecordView store(const std::string& data) {
+    return store(data.data(), data.size());
+  }
+
+  /**
+   * Keeps only the first <size> views.
+   */
+  void truncate(const std::size_t size);
+
+  /**
+   * Drops all views and the storage they point into.
+   */
+  void clear();
+
+ private:
+  /**
+   * Size of the chunks allocate() carves storage from.
+   */
+  static const std::size_t CHUNK_SIZE = 64 * 1024;
+
+  const std::size_t capacity_;
+
+  std::vector<RecordView> views_;
+
+  /**
+   * Copies of pages, of which the first <pages_used_> are in use.
+   */
+  std::vector<std::unique_ptr<Page> > pages_;
+  std::size_t pages_used_;
+
+  /**
+   * Chunks of allocate()d storage, of which the first <chunks_used_> are in
+   * use, and bytes taken from the last of those.
+   */
+  std::vector<std::unique_ptr<char[]> > chunks_;
+  std::size_t chunks_used_;
+  std::size_t chunk_offset_;
+
+  /**
+   * Allocations too big for a chunk, freed by clear().
+   */
+  std::vector<std::unique_ptr<char[]> > oversized_;
+};
+
+}
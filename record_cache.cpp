@@ -0,0 +1,177 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "record_cache.h"
+
+#include <functional>
+
+#include "page.h"
+
+namespace badgerdb {
+
+std::int64_t RecordCache::Stats::memorySaved() const {
+  return static_cast<std::int64_t>(pages * Page::SIZE) -
+      static_cast<std::int64_t>(bytes);
+}
+
+RecordCache::RecordCache(const std::size_t capacity_bytes,
+                         const std::uint32_t num_shards)
+    : shard_capacity_(capacity_bytes / (num_shards > 0 ? num_shards : 1)) {
+  for (std::uint32_t i = 0; i < (num_shards > 0 ? num_shards : 1); ++i) {
+    std::unique_ptr<Shard> shard(new Shard);
+    shard->bytes = 0;
+    shard->generation = 0;
+    shard->lookups = 0;
+    shard->hits = 0;
+    shard->inserts = 0;
+    shard->stale_fills = 0;
+    shard->evictions = 0;
+    shard->invalidations = 0;
+    shards_.push_back(std::move(shard));
+  }
+}
+
+bool RecordCache::lookup(const File* file, const RecordId& record_id,
+                         std::string& record, std::uint64_t* fill_token) {
+  Shard& shard = shardFor(file, record_id.page_number);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  ++shard.lookups;
+  std::map<Key, Entry>::iterator iter = shard.entries.find(
+      Key(file, record_id.page_number, record_id.slot_number));
+  if (iter == shard.entries.end()) {
+    if (fill_token != NULL) {
+      *fill_token = shard.generation;
+    }
+    return false;
+  }
+  ++shard.hits;
+  shard.lru.splice(shard.lru.begin(), shard.lru, iter->second.lru_position);
+  record = iter->second.record;
+  return true;
+}
+
+void RecordCache::insert(const File* file, const RecordId& record_id,
+                         const std::string& record,
+                         const std::uint64_t fill_token) {
+  const std::size_t charge = record.size() + ENTRY_OVERHEAD;
+  Shard& shard = shardFor(file, record_id.page_number);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  if (fill_token != shard.generation) {
+    ++shard.stale_fills;
+    return;
+  }
+  if (charge > shard_capacity_) {
+    return;
+  }
+  const Key key(file, record_id.page_number, record_id.slot_number);
+  std::map<Key, Entry>::iterator iter = shard.entries.find(key);
+  if (iter != shard.entries.end()) {
+    // Another thread filled it first; the page hasn't changed since, so
+    // the copies are the same.
+    return;
+  }
+  while (shard.bytes + charge > shard_capacity_) {
+    erase(shard, shard.entries.find(shard.lru.back()));
+    ++shard.evictions;
+  }
+  shard.lru.push_front(key);
+  Entry& entry = shard.entries[key];
+  entry.record = record;
+  entry.lru_position = shard.lru.begin();
+  ++shard.pages[PageKey(file, record_id.page_number)];
+  shard.bytes += charge;
+  ++shard.inserts;
+}
+
+void RecordCache::invalidate(const File* file, const RecordId& record_id) {
+  Shard& shard = shardFor(file, record_id.page_number);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  const std::map<Key, Entry>::iterator iter = shard.entries.find(
+      Key(file, record_id.page_number, record_id.slot_number));
+  std::map<Key, Entry>::iterator last = iter;
+  if (iter != shard.entries.end()) {
+    ++last;
+  }
+  invalidateRange(shard, iter, last);
+}
+
+void RecordCache::invalidatePage(const File* file, const PageId page_number) {
+  Shard& shard = shardFor(file, page_number);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  invalidateRange(shard,
+                  shard.entries.lower_bound(Key(file, page_number, 0)),
+                  shard.entries.lower_bound(Key(file, page_number + 1, 0)));
+}
+
+void RecordCache::invalidateFile(const File* file) {
+  for (std::size_t i = 0; i < shards_.size(); ++i) {
+    Shard& shard = *shards_[i];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    invalidateRange(shard, shard.entries.lower_bound(Key(file, 0, 0)),
+                    shard.entries.upper_bound(
+                        Key(file, Page::INVALID_NUMBER, SlotId(-1))));
+  }
+}
+
+RecordCache::Stats RecordCache::stats() const {
+  Stats stats;
+  stats.lookups = 0;
+  stats.hits = 0;
+  stats.inserts = 0;
+  stats.stale_fills = 0;
+  stats.evictions = 0;
+  stats.invalidations = 0;
+  stats.records = 0;
+  stats.bytes = 0;
+  stats.pages = 0;
+  for (std::size_t i = 0; i < shards_.size(); ++i) {
+    Shard& shard = *shards_[i];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    stats.lookups += shard.lookups;
+    stats.hits += shard.hits;
+    stats.inserts += shard.inserts;
+    stats.stale_fills += shard.stale_fills;
+    stats.evictions += shard.evictions;
+    stats.invalidations += shard.invalidations;
+    stats.records += shard.entries.size();
+    stats.bytes += shard.bytes;
+    stats.pages += shard.pages.size();
+  }
+  return stats;
+}
+
+RecordCache::Shard& RecordCache::shardFor(const File* file,
+                                          const PageId page_number) {
+  const std::size_t hash = std::hash<const File*>()(file) * 31 +
+      std::hash<PageId>()(page_number);
+  return *shards_[hash % shards_.size()];
+}
+
+void RecordCache::erase(Shard& shard, std::map<Key, Entry>::iterator iter) {
+  const PageKey page_key(std::get<0>(iter->first), std::get<1>(iter->first));
+  std::map<PageKey, std::uint32_t>::iterator page = shard.pages.find(page_key);
+  if (--page->second == 0) {
+    shard.pages.erase(page);
+  }
+  shard.bytes -= iter->second.record.size() + ENTRY_OVERHEAD;
+  shard.lru.erase(iter->second.lru_position);
+  shard.entries.erase(iter);
+}
+
+void RecordCache::invalidateRange(Shard& shard,
+                                  std::map<Key, Entry>::iterator first,
+                                  const std::map<Key, Entry>::iterator last) {
+  // Fills of anything read before this must not go in, even if nothing was
+  // cached yet.
+  ++shard.generation;
+  while (first != last) {
+    erase(shard, first++);
+    ++shard.invalidations;
+  }
+}
+
+}
@@ -0,0 +1,235 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "file.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Cache of individual records, kept above the buffer pool.
+ *
+ * Keeping a small hot record resident through BufMgr costs a whole page frame;
+ * this cache keeps just the record, so a hot set of small records fits in a
+ * fraction of the memory.  Records are looked up by file and RecordId before
+ * the page is pinned, and are evicted least recently used first once the
+ * cache holds more than its byte budget.  Each record is charged its length
+ * plus ENTRY_OVERHEAD for its bookkeeping.
+ *
+ * The cache is split into shards, each with its own lock, budget and LRU
+ * list, so that lookups from many threads rarely contend.  All records of a
+ * page are in the same shard, which keeps dropping a page cheap.
+ *
+ * Records must be dropped whenever they change.  A BufMgr given the cache
+ * (see BufMgr::setRecordCache()) drops the records of a page whenever the
+ * page is unpinned dirty, disposed or discarded, which covers updates and
+ * deletes made through it.  Records read from a page race with changes to it,
+ * so a record may only be added with the fill token its lookup returned; if
+ * the page's shard dropped anything in between, the record is not added.
+ */
+class RecordCache {
+ public:
+  /**
+   * Bytes charged per cached record on top of its length.
+   */
+  static const std::size_t ENTRY_OVERHEAD = 96;
+
+  /**
+   * What the cache has done and holds.
+   */
+  struct Stats {
+    std::uint64_t lookups;
+    std::uint64_t hits;
+    std::uint64_t inserts;
+
+    /**
+     * Records not added because the page changed since the lookup.
+     */
+    std::uint64_t stale_fills;
+
+    std::uint64_t evictions;
+    std::uint64_t invalidations;
+
+    /**
+     * Records cached, bytes charged for them, and the number of distinct
+     * pages they come from.
+     */
+    std::uint64_t records;
+    std::uint64_t bytes;
+    std::uint64_t pages;
+
+    /**
+     * Returns the fraction of lookups that hit.
+     */
+    double hitRatio() const {
+      return lookups == 0 ? 0 : static_cast<double>(hits) / lookups;
+    }
+
+    /**
+     * Returns the memory a buffer pool would need to keep the cached records
+     * resident, one frame per page, minus what the cache uses for them.
+     */
+    std::int64_t memorySaved() const;
+  };
+
+  /**
+   * Creates an empty cache.
+   *
+   * @param capacity_bytes  Most bytes the cache may hold, split evenly
+   *                        between the shards.
+   * @param num_shards      Number of independently locked shards.
+   */
+  explicit RecordCache(const std::size_t capacity_bytes,
+                       const std::uint32_t num_shards = 16);
+
+  /**
+   * Looks up a record.
+   *
+   * @param file          File holding the record.
+   * @param record_id     ID of the record.
+   * @param record        Receives the record on a hit.
+   * @param fill_token    If not NULL, receives the token to pass to insert()
+   *                      after reading the record from its page on a miss.
+   * @return  Whether the record was cached.
+   */
+  bool lookup(const File* file, const RecordId& record_id,
+              std::string& record, std::uint64_t* fill_token = NULL);
+
+  /**
+   * Adds a record read from its page after a lookup missed, evicting least
+   * recently used records to stay within the budget.  Does nothing if the
+   * record is bigger than a shard's budget or if records of the shard were
+   * dropped since the lookup.
+   *
+   * @param file          File holding the record.
+   * @param record_id     ID of the record.
+   * @param record        Record data.
+   * @param fill_token    Token returned by the lookup that missed.
+   */
+  void insert(const File* file, const RecordId& record_id,
+              const std::string& record, const std::uint64_t fill_token);
+
+  /**
+   * Drops a record, e.g. because it is being updated or deleted.
+   *
+   * @param file        File holding the record.
+   * @param record_id   ID of the record.
+   */
+  void invalidate(const File* file, const RecordId& record_id);
+
+  /**
+   * Drops all records of a page.
+   *
+   * @param file          File holding the page.
+   * @param page_number   Number of the page.
+   */
+  void invalidatePage(const File* file, const PageId page_number);
+
+  /**
+   * Drops all records of a file, e.g. before it is closed.
+   *
+   * @param file  File whose records to drop.
+   */
+  void invalidateFile(const File* file);
+
+  /**
+   * Returns what the cache has done so far and what it holds.
+   */
+  Stats stats() const;
+
+ private:
+  typedef std::pair<const File*, PageId> PageKey;
+  typedef std::tuple<const File*, PageId, SlotId> Key;
+
+  /**
+   * A cached record.
+   */
+  struct Entry {
+    std::string record;
+
+    /**
+     * Position in the shard's LRU list.
+     */
+    std::list<Key>::iterator lru_position;
+  };
+
+  /**
+   * An independently locked part of the cache.
+   */
+  struct Shard {
+    std::mutex mutex;
+
+    /**
+     * Records by key; all records of a page are adjacent.
+     */
+    std::map<Key, Entry> entries;
+
+    /**
+     * Keys, most recently used first.
+     */
+    std::list<Key> lru;
+
+    /**
+     * Number of cached records per page.
+     */
+    std::map<PageKey, std::uint32_t> pages;
+
+    std::size_t bytes;
+
+    /**
+     * Bumped whenever records are dropped because they changed.
+     */
+    std::uint64_t generation;
+
+    std::uint64_t lookups;
+    std::uint64_t hits;
+    std::uint64_t inserts;
+    std::uint64_t stale_fills;
+    std::uint64_t evictions;
+    std::uint64_t invalidations;
+  };
+
+  /**
+   * Returns the shard holding the records of a page.
+   */
+  Shard& shardFor(const File* file, const PageId page_number);
+
+  /**
+   * Removes an entry from a shard.  Called with the shard's lock held.
+   */
+  static void erase(Shard& shard, std::map<Key, Entry>::iterator iter);
+
+  /**
+   * Drops the entries in [first, last) of a shard because they changed.
+   * Called with the shard's lock held.
+   */
+  static void invalidateRange(Shard& shard,
+                              std::map<Key, Entry>::iterator first,
+                              std::map<Key, Entry>::iterator last);
+
+  /**
+   * Budget of each shard in bytes.
+   */
+  const std::size_t shard_capacity_;
+
+  std::vector<std::unique_ptr<Shard> > shards_;
+};
+
+}
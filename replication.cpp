@@ -0,0 +1,475 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "replication.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "exceptions/file_not_found_exception.h"
+#include "exceptions/io_error_exception.h"
+
+namespace badgerdb {
+
+namespace {
+
+/**
+ * Value identifying the start of a batch.
+ */
+const std::uint32_t BATCH_MAGIC = 0x42524c47;
+
+/**
+ * Header of a batch in a log segment.  It is followed by <num_pages> records,
+ * each a page number and the page's bytes: sizeof(FileHeader) bytes for page
+ * 0 (the file header) and Page::SIZE bytes for other pages.  Batches shipped
+ * together form a group; every batch of a group but the last has <more> set.
+ */
+struct BatchHeader {
+  std::uint64_t sequence;
+  std::uint64_t shipped_at;
+  std::uint32_t magic;
+  std::uint32_t num_pages;
+  std::uint32_t payload_bytes;
+  std::uint32_t checksum;
+  std::uint32_t more;
+  std::uint32_t unused;
+};
+
+/**
+ * Returns the wall-clock time in microseconds.
+ */
+std::uint64_t nowMicros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+/**
+ * Returns the FNV-1a hash of a byte range, used to tell complete batches from
+ * ones still being written.
+ */
+std::uint32_t checksum(const char* bytes, const std::size_t length) {
+  std::uint32_t hash = 2166136261u;
+  for (std::size_t i = 0; i < length; ++i) {
+    hash = (hash ^ static_cast<std::uint8_t>(bytes[i])) * 16777619u;
+  }
+  return hash;
+}
+
+/**
+ * Returns the size in bytes of a record's page image.
+ */
+std::size_t imageSize(const PageId page_number) {
+  return page_number == 0 ? sizeof(FileHeader) : Page::SIZE;
+}
+
+/**
+ * Returns the size of a file in bytes, or 0 if it doesn't exist.
+ */
+std::uint64_t fileSize(const std::string& filename) {
+  struct stat info;
+  return ::stat(filename.c_str(), &info) == 0 ? info.st_size : 0;
+}
+
+/**
+ * Reads the header of a complete batch at the given offset of a segment.
+ *
+ * @param fd        Descriptor of the segment.
+ * @param offset    Offset of the batch.
+ * @param header    Receives the batch header.
+ * @param payload   Receives the batch payload, if not NULL.
+ * @return  Whether a complete batch is there.
+ */
+bool readBatch(const int fd, const std::uint64_t offset, BatchHeader& header,
+               std::vector<char>* payload) {
+  if (::pread(fd, &header, sizeof(header), offset) !=
+          static_cast<ssize_t>(sizeof(header)) ||
+      header.magic != BATCH_MAGIC) {
+    return false;
+  }
+  std::vector<char> bytes(header.payload_bytes);
+  if (header.payload_bytes > 0 &&
+      ::pread(fd, &bytes[0], bytes.size(), offset + sizeof(header)) !=
+          static_cast<ssize_t>(bytes.size())) {
+    return false;
+  }
+  if (checksum(bytes.data(), bytes.size()) != header.checksum) {
+    return false;
+  }
+  if (payload != NULL) {
+    payload->swap(bytes);
+  }
+  return true;
+}
+
+}
+
+const std::size_t ReplicationLog::SEGMENT_BYTES;
+const PageId ReplicationLog::BATCH_PAGES;
+
+std::string ReplicationLog::segmentFilename(const std::string& directory,
+                                            const std::string& name,
+                                            const std::uint32_t segment) {
+  std::ostringstream filename;
+  filename << directory << "/" << name << "." << segment << ".log";
+  return filename.str();
+}
+
+std::vector<std::uint32_t> ReplicationLog::listSegments(
+    const std::string& directory, const std::string& name) {
+  std::vector<std::uint32_t> segments;
+  DIR* dir = ::opendir(directory.c_str());
+  if (dir == NULL) {
+    return segments;
+  }
+  const std::string prefix = name + ".";
+  const std::string suffix = ".log";
+  for (struct dirent* entry = ::readdir(dir); entry != NULL;
+       entry = ::readdir(dir)) {
+    const std::string entry_name(entry->d_name);
+    if (entry_name.size() <= prefix.size() + suffix.size() ||
+        entry_name.compare(0, prefix.size(), prefix) != 0 ||
+        entry_name.compare(entry_name.size() - suffix.size(), suffix.size(),
+                           suffix) != 0) {
+      continue;
+    }
+    const std::string number = entry_name.substr(
+        prefix.size(), entry_name.size() - prefix.size() - suffix.size());
+    if (number.find_first_not_of("0123456789") == std::string::npos) {
+      segments.push_back(std::strtoul(number.c_str(), NULL, 10));
+    }
+  }
+  ::closedir(dir);
+  std::sort(segments.begin(), segments.end());
+  return segments;
+}
+
+ReplicationLog::ReplicationLog(File* file, const std::string& directory,
+                               const std::string& name)
+    : file_(file),
+      directory_(directory),
+      name_(name),
+      segment_(0),
+      segment_bytes_(0),
+      fd_(-1),
+      sequence_(0) {
+  // Continue the numbering of an earlier primary's log, if there is one.
+  const std::vector<std::uint32_t>& segments = listSegments(directory_, name_);
+  if (!segments.empty()) {
+    segment_ = segments.back() + 1;
+    const int last_fd = ::open(
+        segmentFilename(directory_, name_, segments.back()).c_str(), O_RDONLY);
+    if (last_fd >= 0) {
+      BatchHeader header;
+      for (std::uint64_t offset = 0; readBatch(last_fd, offset, header, NULL);
+           offset += sizeof(header) + header.payload_bytes) {
+        sequence_ = header.sequence;
+      }
+      ::close(last_fd);
+    }
+  }
+  const std::string& filename = segmentFilename(directory_, name_, segment_);
+  fd_ = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+  if (fd_ < 0) {
+    throw FileNotFoundException(filename);
+  }
+  file_->addListener(this);
+
+  const FileHeader& header = file_->readHeader();
+  for (PageId page_number = 0; page_number < header.num_pages; ++page_number) {
+    changed_.insert(page_number);
+  }
+  try {
+    ship();
+  } catch (...) {
+    file_->removeListener(this);
+    ::close(fd_);
+    throw;
+  }
+}
+
+ReplicationLog::~ReplicationLog() {
+  file_->removeListener(this);
+  ::close(fd_);
+}
+
+PageId ReplicationLog::ship() {
+  if (changed_.empty()) {
+    return 0;
+  }
+  if (segment_bytes_ >= SEGMENT_BYTES) {
+    // The replica moves on once the next segment exists, so this one must be
+    // complete before that is created.
+    ::close(fd_);
+    ++segment_;
+    segment_bytes_ = 0;
+    const std::string& filename = segmentFilename(directory_, name_, segment_);
+    fd_ = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND,
+                 0644);
+    if (fd_ < 0) {
+      throw FileNotFoundException(filename);
+    }
+  }
+
+  const FileHeader& file_header = file_->readHeader();
+  std::vector<PageId> pages;
+  for (std::set<PageId>::const_iterator iter = changed_.begin();
+       iter != changed_.end(); ++iter) {
+    if (*iter < file_header.num_pages) {
+      pages.push_back(*iter);
+    }
+    // Otherwise truncated away since it was written.
+  }
+
+  const std::size_t start_bytes = segment_bytes_;
+  const std::uint64_t start_sequence = sequence_;
+  try {
+    std::size_t first = 0;
+    do {
+      const std::size_t last = std::min<std::size_t>(pages.size(),
+                                                     first + BATCH_PAGES);
+      appendBatch(pages, first, last, file_header);
+      first = last;
+    } while (first < pages.size());
+  } catch (...) {
+    // Leave no part of the group for the replica to wait on; the pages stay
+    // in <changed_> for the next ship().
+    if (::ftruncate(fd_, start_bytes) == 0) {
+      segment_bytes_ = start_bytes;
+      sequence_ = start_sequence;
+    }
+    throw;
+  }
+  changed_.clear();
+  return pages.size();
+}
+
+void ReplicationLog::appendBatch(const std::vector<PageId>& pages,
+                                 const std::size_t first,
+                                 const std::size_t last,
+                                 const FileHeader& file_header) {
+  BatchHeader header = {sequence_ + 1, nowMicros(), BATCH_MAGIC,
+                        0 /* num_pages */, 0 /* payload_bytes */,
+                        0 /* checksum */, last < pages.size() /* more */,
+                        0 /* unused */};
+  std::vector<char> batch(sizeof(header));
+  for (std::size_t i = first; i < last; ++i) {
+    const PageId page_number = pages[i];
+    const std::size_t record_start = batch.size();
+    batch.resize(record_start + sizeof(page_number) + imageSize(page_number));
+    std::memcpy(&batch[record_start], &page_number, sizeof(page_number));
+    char* image = &batch[record_start + sizeof(page_number)];
+    if (page_number == 0) {
+      std::memcpy(image, &file_header, sizeof(file_header));
+    } else {
+      File::encodePage(file_->readPage(page_number, true /* allow_free */),
+                       image);
+    }
+    ++header.num_pages;
+  }
+  header.payload_bytes = batch.size() - sizeof(header);
+  header.checksum = checksum(&batch[sizeof(header)], header.payload_bytes);
+  std::memcpy(&batch[0], &header, sizeof(header));
+
+  // One append per batch; a replica that sees only part of it finds the
+  // checksum wrong and waits.
+  std::size_t written = 0;
+  while (written < batch.size()) {
+    const ssize_t result =
+        ::write(fd_, &batch[written], batch.size() - written);
+    if (result <= 0) {
+      throw IoErrorException(segmentFilename(directory_, name_, segment_),
+                             0 /* page_number */, "write");
+    }
+    written += result;
+    segment_bytes_ += result;
+  }
+  sequence_ = header.sequence;
+}
+
+void ReplicationLog::afterPageWrite(const PageId page_number,
+                                    const Page* /* page */) {
+  changed_.insert(page_number);
+}
+
+ReplicaApplier::ReplicaApplier(BufMgr* buf_mgr, File* file,
+                               const std::string& directory,
+                               const std::string& name)
+    : buf_mgr_(buf_mgr),
+      file_(file),
+      directory_(directory),
+      name_(name),
+      position_filename_(file->filename() + ".rpos"),
+      segment_(0),
+      offset_(0),
+      fd_(-1),
+      last_applied_(0),
+      last_lag_micros_(0) {
+  std::ifstream position(position_filename_, std::ios::binary);
+  if (position) {
+    position.read(reinterpret_cast<char*>(&segment_), sizeof(segment_));
+    position.read(reinterpret_cast<char*>(&offset_), sizeof(offset_));
+    position.read(reinterpret_cast<char*>(&last_applied_),
+                  sizeof(last_applied_));
+  } else {
+    const std::vector<std::uint32_t>& segments =
+        ReplicationLog::listSegments(directory_, name_);
+    if (!segments.empty()) {
+      segment_ = segments.front();
+    }
+  }
+}
+
+ReplicaApplier::~ReplicaApplier() {
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+}
+
+PageId ReplicaApplier::poll() {
+  PageId pages_applied = 0;
+  while (true) {
+    if (applyBatch(pages_applied)) {
+      continue;
+    }
+    const std::string& next_filename =
+        ReplicationLog::segmentFilename(directory_, name_, segment_ + 1);
+    if (!File::exists(next_filename)) {
+      break;
+    }
+    // The primary finishes a segment before starting the next, so a batch
+    // appended just before the next appeared is complete by now.
+    if (applyBatch(pages_applied)) {
+      continue;
+    }
+    // Anything left is a batch an earlier primary never finished.
+    if (fd_ >= 0) {
+      ::close(fd_);
+      fd_ = -1;
+    }
+    std::remove(ReplicationLog::segmentFilename(directory_, name_, segment_)
+                    .c_str());
+    ++segment_;
+    offset_ = 0;
+    savePosition();
+  }
+  return pages_applied;
+}
+
+std::uint64_t ReplicaApplier::pendingBytes() const {
+  std::uint64_t bytes = 0;
+  const std::vector<std::uint32_t>& segments =
+      ReplicationLog::listSegments(directory_, name_);
+  for (std::size_t i = 0; i < segments.size(); ++i) {
+    if (segments[i] >= segment_) {
+      bytes += fileSize(
+          ReplicationLog::segmentFilename(directory_, name_, segments[i]));
+    }
+  }
+  return bytes > offset_ ? bytes - offset_ : 0;
+}
+
+bool ReplicaApplier::applyBatch(PageId& pages_applied) {
+  if (!openSegment()) {
+    return false;
+  }
+  // Find the batches of the group; a group is never split across segments.
+  BatchHeader header;
+  std::vector<std::uint64_t> offsets;
+  std::uint64_t end = offset_;
+  do {
+    if (!readBatch(fd_, end, header, NULL)) {
+      return false;
+    }
+    offsets.push_back(end);
+    end += sizeof(header) + header.payload_bytes;
+  } while (header.more);
+  const std::uint64_t last_sequence = header.sequence;
+
+  // Drop every page of the group from the pool before changing any, so a
+  // pinned page leaves the replica file untouched.  Batches are read again
+  // for each pass to keep only one in memory.
+  std::vector<char> payload;
+  for (std::size_t pass = 0; pass < 2; ++pass) {
+    for (std::size_t batch = 0; batch < offsets.size(); ++batch) {
+      if (!readBatch(fd_, offsets[batch], header, &payload)) {
+        return false;
+      }
+      if (batch == 0 && pass == 1) {
+        const std::uint64_t now = nowMicros();
+        last_lag_micros_ =
+            now > header.shipped_at ? now - header.shipped_at : 0;
+      }
+      std::size_t record_start = 0;
+      for (std::uint32_t i = 0; i < header.num_pages; ++i) {
+        PageId page_number;
+        std::memcpy(&page_number, &payload[record_start],
+                    sizeof(page_number));
+        const char* image = &payload[record_start + sizeof(page_number)];
+        if (pass == 0) {
+          if (page_number != 0) {
+            buf_mgr_->discardPage(file_, page_number);
+          }
+        } else if (page_number == 0) {
+          FileHeader file_header;
+          std::memcpy(&file_header, image, sizeof(file_header));
+          file_->writeHeader(file_header);
+        } else {
+          Page page;
+          File::decodePage(image, page);
+          file_->writePage(page_number, page);
+        }
+        record_start += sizeof(page_number) + imageSize(page_number);
+      }
+      if (pass == 1) {
+        pages_applied += header.num_pages;
+      }
+    }
+  }
+  offset_ = end;
+  last_applied_ = last_sequence;
+  savePosition();
+  return true;
+}
+
+bool ReplicaApplier::openSegment() {
+  if (fd_ < 0) {
+    fd_ = ::open(
+        ReplicationLog::segmentFilename(directory_, name_, segment_).c_str(),
+        O_RDONLY);
+  }
+  return fd_ >= 0;
+}
+
+void ReplicaApplier::savePosition() {
+  const std::string& temp_filename = position_filename_ + ".tmp";
+  {
+    std::ofstream position(temp_filename, std::ios::binary | std::ios::trunc);
+    position.write(reinterpret_cast<const char*>(&segment_), sizeof(segment_));
+    position.write(reinterpret_cast<const char*>(&offset_), sizeof(offset_));
+    position.write(reinterpret_cast<const char*>(&last_applied_),
+                   sizeof(last_applied_));
+    position.flush();
+    if (!position) {
+      throw IoErrorException(temp_filename, 0 /* page_number */, "write");
+    }
+  }
+  if (std::rename(temp_filename.c_str(), position_filename_.c_str()) != 0) {
+    throw IoErrorException(position_filename_, 0 /* page_number */, "rename");
+  }
+}
+
+}
@@ -0,0 +1,316 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "buffer.h"
+#include "file.h"
+#include "file_listener.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Primary side of page-level log shipping to a read replica.
+ *
+ * The log listens to a file and remembers which pages are written.  Each call
+ * to ship() appends the current on-disk images of those pages to a log in a
+ * directory shared with the replica process (see ReplicaApplier), as a group
+ * of batches of at most BATCH_PAGES pages each, so neither side holds more
+ * than one batch in memory.  The replica applies groups whole, so ship()
+ * should be called when the file is consistent, e.g. after
+ * BufMgr::flushFile(); pages still dirty in a buffer pool are not shipped
+ * until they are written back.  How often ship() is called, plus how often
+ * the replica polls, bounds how far the replica lags; the replica measures
+ * it with ReplicaApplier::lastLagMicros() and pendingBytes().
+ *
+ * The log is a series of segment files named "<name>.<segment>.log", each
+ * closed once it grows past SEGMENT_BYTES.  The replica deletes segments it
+ * has finished with.  A new log starts a new segment with a batch holding
+ * every page of the file, so a replica can start from an empty file and stays
+ * correct across restarts of the primary.  If appending a group fails, the
+ * segment is cut back to where the group started and its pages stay pending
+ * for the next ship().
+ *
+ * @warning This class is not threadsafe.
+ */
+class ReplicationLog : public FileListener {
+ public:
+  /**
+   * Size beyond which a segment is closed and the next one started.
+   */
+  static const std::size_t SEGMENT_BYTES = 4 * 1024 * 1024;
+
+  /**
+   * Maximum number of pages in one batch.
+   */
+  static const PageId BATCH_PAGES = 256;
+
+  /**
+   * Returns the name of a log segment file.
+   *
+   * @param directory   Directory holding the log.
+   * @param name        Name of the log.
+   * @param segment     Number of the segment.
+   * @return  Name of the segment file.
+   */
+  static std::string segmentFilename(const std::string& directory,
+                                     const std::string& name,
+                                     const std::uint32_t segment);
+
+  /**
+   * Returns the numbers of the segments of a log present in the directory, in
+   * ascending order.
+   *
+   * @param directory   Directory holding the log.
+   * @param name        Name of the log.
+   * @return  Segment numbers.
+   */
+  static std::vector<std::uint32_t> listSegments(const std::string& directory,
+                                                 const std::string& name);
+
+  /**
+   * Starts logging changes to a file and ships all its pages.
+   *
+   * @param file        File to log.  Must stay open as long as the log.
+   * @param directory   Existing directory to hold the log.
+   * @param name        Name of the log, shared with the replica.
+   * @throws  IoErrorException  If the initial copy can't be appended.
+   */
+  ReplicationLog(File* file, const std::string& directory,
+                 const std::string& name);
+
+  /**
+   * Stops logging.  Changes not yet shipped are not shipped.
+   */
+  ~ReplicationLog();
+
+  /**
+   * Appends the pages written since the last ship().  On failure nothing is
+   * left in the log and the pages stay pending.
+   *
+   * @return  Number of pages shipped, counting the file header as a page.
+   * @throws  IoErrorException  If the pages can't be appended to the log.
+   */
+  PageId ship();
+
+  /**
+   * Returns the sequence number of the last batch shipped.  Batch sequence
+   * numbers start at 1 and continue across restarts of the primary.
+   */
+  std::uint64_t lastShipped() const { return sequence_; }
+
+  /**
+   * Returns the number of pages written since the last batch.
+   */
+  PageId pendingPages() const { return changed_.size(); }
+
+  virtual void beforePageChange(const PageId /* page_number */) {}
+
+  virtual void afterPageWrite(const PageId page_number, const Page* page);
+
+ private:
+  /**
+   * Appends one batch of a group to the current segment.
+   *
+   * @param pages         Pages of the group, in page number order.
+   * @param first         Index in <pages> of the batch's first page.
+   * @param last          Index in <pages> just past the batch's last page.
+   * @param file_header   File header to ship as page 0.
+   * @throws  IoErrorException  If the batch can't be written in full.
+   */
+  void appendBatch(const std::vector<PageId>& pages, const std::size_t first,
+                   const std::size_t last, const FileHeader& file_header);
+
+  /**
+   * File being logged.
+   */
+  File* file_;
+
+  /**
+   * Directory holding the log.
+   */
+  std::string directory_;
+
+  /**
+   * Name of the log.
+   */
+  std::string name_;
+
+  /**
+   * Number of the segment being appended to.
+   */
+  std::uint32_t segment_;
+
+  /**
+   * Bytes in the segment being appended to.
+   */
+  std::size_t segment_bytes_;
+
+  /**
+   * Descriptor of the segment being appended to.
+   */
+  int fd_;
+
+  /**
+   * Sequence number of the last batch shipped.
+   */
+  std::uint64_t sequence_;
+
+  /**
+   * Pages written since the last batch; 0 is the file header.
+   */
+  std::set<PageId> changed_;
+};
+
+/**
+ * @brief Replica side of page-level log shipping.
+ *
+ * The applier reads the batches a ReplicationLog ships and writes their pages
+ * into the replica's own copy of the file, dropping the old copies from the
+ * replica's buffer pool so that reads through it see the new ones.  Readers
+ * use the replica file only through that buffer pool and must not modify it.
+ *
+ * How far the replica has got is kept in a companion of the replica file
+ * (named after it with a ".rpos" suffix), so an applier restarted on the same
+ * replica file resumes where it stopped.  Only one replica may follow a log,
+ * since the applier deletes the segments it has finished with.
+ *
+ * @warning This class is not threadsafe.
+ */
+class ReplicaApplier {
+ public:
+  /**
+   * Prepares to apply a log to a replica file.  Nothing is applied until
+   * poll() is called.
+   *
+   * @param buf_mgr     Buffer manager the replica is read through.
+   * @param file        Replica file, e.g. freshly created.
+   * @param directory   Directory holding the log.
+   * @param name        Name of the log.
+   */
+  ReplicaApplier(BufMgr* buf_mgr, File* file, const std::string& directory,
+                 const std::string& name);
+
+  /**
+   * Closes the log.
+   */
+  ~ReplicaApplier();
+
+  /**
+   * Applies every complete batch shipped so far.  A batch whose pages can't
+   * all be dropped from the buffer pool is left to the next call.
+   *
+   * @return  Number of pages applied, counting the file header as a page.
+   * @throws  PagePinnedException   If a page the next batch changes is
+   *                                pinned in the buffer pool.
+   * @throws  IoErrorException      If the new position can't be saved.
+   */
+  PageId poll();
+
+  /**
+   * Returns the sequence number of the last batch applied, or 0 if none.
+   */
+  std::uint64_t lastApplied() const { return last_applied_; }
+
+  /**
+   * Returns the number of log bytes shipped but not yet applied, which is how
+   * far the replica lags.
+   */
+  std::uint64_t pendingBytes() const;
+
+  /**
+   * Returns how long the last group applied waited between being shipped and
+   * being applied, in microseconds, or 0 if none has been applied since the
+   * applier was created.  The primary's and replica's clocks are assumed to
+   * agree.
+   */
+  std::uint64_t lastLagMicros() const { return last_lag_micros_; }
+
+ private:
+  /**
+   * Applies the group of batches at the current position if all of it is
+   * complete.
+   *
+   * @param pages_applied   Incremented by the number of pages applied.
+   * @return  Whether a group was applied.
+   */
+  bool applyBatch(PageId& pages_applied);
+
+  /**
+   * Opens the current segment if it isn't open and exists.
+   *
+   * @return  Whether the segment is open.
+   */
+  bool openSegment();
+
+  /**
+   * Records the current position in the position file.  The file is written
+   * aside and renamed into place, so a crash leaves the old position or the
+   * new one.
+   *
+   * @throws  IoErrorException  If the position can't be written.
+   */
+  void savePosition();
+
+  /**
+   * Buffer manager the replica is read through.
+   */
+  BufMgr* buf_mgr_;
+
+  /**
+   * Replica file.
+   */
+  File* file_;
+
+  /**
+   * Directory holding the log.
+   */
+  std::string directory_;
+
+  /**
+   * Name of the log.
+   */
+  std::string name_;
+
+  /**
+   * Name of the file recording the position.
+   */
+  std::string position_filename_;
+
+  /**
+   * Segment being read.
+   */
+  std::uint32_t segment_;
+
+  /**
+   * Offset in the segment of the next batch.
+   */
+  std::uint64_t offset_;
+
+  /**
+   * Descriptor of the segment being read, or -1.
+   */
+  int fd_;
+
+  /**
+   * Sequence number of the last batch applied.
+   */
+  std::uint64_t last_applied_;
+
+  /**
+   * Shipping-to-applying delay of the last group applied, in microseconds.
+   */
+  std::uint64_t last_lag_micros_;
+};
+
+}
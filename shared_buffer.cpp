@@ -0,0 +1,983 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "shared_buffer.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "exceptions/buffer_exceeded_exception.h"
+#include "exceptions/page_not_pinned_exception.h"
+#include "exceptions/page_pinned_exception.h"
+#include "exceptions/shared_memory_exception.h"
+
+namespace badgerdb {
+
+namespace {
+
+/**
+ * Marks a segment laid out by this code.
+ */
+const std::uint32_t SEGMENT_MAGIC = 0x42444253;  // "BDBS"
+
+/**
+ * Rounds <offset> up to a multiple of <alignment>.
+ */
+std::size_t alignUp(const std::size_t offset, const std::size_t alignment) {
+  return (offset + alignment - 1) / alignment * alignment;
+}
+
+/**
+ * Distance between the pages of consecutive frames.
+ */
+const std::size_t PAGE_STRIDE = alignUp(sizeof(Page), 64);
+
+/**
+ * Initializes a process-shared, robust mutex.
+ */
+void initMutex(pthread_mutex_t* mutex) {
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+  pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+  pthread_mutex_init(mutex, &attr);
+  pthread_mutexattr_destroy(&attr);
+}
+
+/**
+ * Takes a robust mutex.  If its last owner died holding it, the caller must
+ * repair what it guards and call markConsistent().
+ *
+ * @return  True if the last owner died holding the mutex.
+ * @throws  SharedMemoryException   If the mutex can't be taken.
+ */
+bool lockMutex(pthread_mutex_t* mutex, const std::string& segment) {
+  const int result = pthread_mutex_lock(mutex);
+  if (result == EOWNERDEAD) {
+    return true;
+  }
+  if (result != 0) {
+    throw SharedMemoryException(segment, std::strerror(result));
+  }
+  return false;
+}
+
+/**
+ * Marks a robust mutex whose last owner died as usable again.
+ *
+ * @throws  SharedMemoryException   If the mutex can't be recovered.
+ */
+void markConsistent(pthread_mutex_t* mutex, const std::string& segment) {
+  const int result = pthread_mutex_consistent(mutex);
+  if (result != 0) {
+    pthread_mutex_unlock(mutex);
+    throw SharedMemoryException(segment, std::strerror(result));
+  }
+}
+
+/**
+ * Returns the monotonic time <ms> milliseconds from now.
+ */
+timespec deadlineAfter(const std::uint32_t ms) {
+  timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec += ms / 1000;
+  deadline.tv_nsec += static_cast<long>(ms % 1000) * 1000000;
+  if (deadline.tv_nsec >= 1000000000) {
+    ++deadline.tv_sec;
+    deadline.tv_nsec -= 1000000000;
+  }
+  return deadline;
+}
+
+}
+
+/**
+ * Fixed header at the start of the segment.  Parts of the segment are found
+ * from the offsets here.
+ */
+struct SharedBufMgr::SegmentHeader {
+  std::uint32_t magic;
+
+  /**
+   * Set once the creator has initialized the segment.
+   */
+  std::uint32_t ready;
+
+  std::uint32_t num_frames;
+  std::uint32_t table_size;
+  std::uint32_t clock_hand;
+
+  std::uint64_t frames_offset;
+  std::uint64_t buckets_offset;
+  std::uint64_t filenames_offset;
+  std::uint64_t processes_offset;
+  std::uint64_t pins_offset;
+  std::uint64_t latches_offset;
+  std::uint64_t pages_offset;
+  std::uint64_t size;
+
+  /**
+   * Guards the tables.  Process-shared and robust.
+   */
+  pthread_mutex_t mutex;
+
+  /**
+   * Serializes page allocation and deletion.  Process-shared and robust.
+   */
+  pthread_mutex_t file_mutex;
+};
+
+/**
+ * Descriptor of one frame.
+ */
+struct SharedBufMgr::SharedFrame {
+  /**
+   * Index of the page's file in the file table.
+   */
+  std::uint32_t file_id;
+
+  PageId page_no;
+
+  /**
+   * Next frame in the same hash bucket, or -1.
+   */
+  std::int32_t next;
+
+  /**
+   * Pins held by all processes; the sum of this frame's column in the pin
+   * table.
+   */
+  std::uint32_t pin_count;
+
+  std::uint8_t valid;
+  std::uint8_t dirty;
+  std::uint8_t refbit;
+
+  /**
+   * Set once the page has been read in.  Only changed while the latch is
+   * held exclusively.
+   */
+  std::uint8_t loaded;
+
+  /**
+   * Guards the latch state below.  Process-shared and robust.
+   */
+  pthread_mutex_t latch_mutex;
+
+  /**
+   * Signalled whenever the latch is released.
+   */
+  pthread_cond_t latch_released;
+
+  /**
+   * Number of processes holding the latch shared.
+   */
+  std::uint32_t sharers;
+
+  /**
+   * Process holding the latch exclusively, or 0.
+   */
+  pid_t writer;
+};
+
+/**
+ * Entry in the table of attached processes.
+ */
+struct SharedBufMgr::ProcessSlot {
+  /**
+   * Process ID, or 0 if the slot is free.
+   */
+  pid_t pid;
+};
+
+class SharedBufMgr::PoolLock {
+ public:
+  explicit PoolLock(SharedBufMgr* buf_mgr) : buf_mgr_(buf_mgr), held_(false) {
+    buf_mgr_->lock();
+    held_ = true;
+  }
+
+  ~PoolLock() {
+    if (held_) {
+      buf_mgr_->unlock();
+    }
+  }
+
+  /**
+   * Releases the mutex, e.g. for disk I/O.
+   */
+  void release() {
+    buf_mgr_->unlock();
+    held_ = false;
+  }
+
+  /**
+   * Takes the mutex again after release().
+   */
+  void reacquire() {
+    buf_mgr_->lock();
+    held_ = true;
+  }
+
+ private:
+  SharedBufMgr* buf_mgr_;
+  bool held_;
+};
+
+class SharedBufMgr::FileLock {
+ public:
+  explicit FileLock(SharedBufMgr* buf_mgr)
+      : mutex_(&buf_mgr->header_->file_mutex) {
+    if (lockMutex(mutex_, buf_mgr->segment_)) {
+      // Its owner died part way through changing a file; nothing in the
+      // segment depends on that.
+      markConsistent(mutex_, buf_mgr->segment_);
+    }
+  }
+
+  ~FileLock() { pthread_mutex_unlock(mutex_); }
+
+ private:
+  pthread_mutex_t* mutex_;
+};
+
+const std::uint32_t SharedBufMgr::MAX_PROCESSES;
+const std::uint32_t SharedBufMgr::MAX_FILES;
+const std::size_t SharedBufMgr::MAX_FILENAME;
+const std::uint32_t SharedBufMgr::ATTACH_TIMEOUT_MS;
+const std::uint32_t SharedBufMgr::LATCH_POLL_MS;
+
+SharedBufMgr::SharedBufMgr(const std::string& segment,
+                           const std::uint32_t bufs)
+    : segment_(segment),
+      base_(NULL),
+      size_(0),
+      process_slot_(MAX_PROCESSES) {
+  // Lay out the segment for <bufs> frames; only used if we create it.
+  const std::uint32_t table_size = bufs * 6 / 5 + 1;
+  std::size_t offset = alignUp(sizeof(SegmentHeader), 64);
+  const std::size_t frames_offset = offset;
+  offset = alignUp(offset + bufs * sizeof(SharedFrame), 64);
+  const std::size_t buckets_offset = offset;
+  offset = alignUp(offset + table_size * sizeof(std::int32_t), 64);
+  const std::size_t filenames_offset = offset;
+  offset = alignUp(offset + MAX_FILES * MAX_FILENAME, 64);
+  const std::size_t processes_offset = offset;
+  offset = alignUp(offset + MAX_PROCESSES * sizeof(ProcessSlot), 64);
+  const std::size_t pins_offset = offset;
+  offset = alignUp(offset + MAX_PROCESSES * bufs * sizeof(std::uint16_t), 64);
+  const std::size_t latches_offset = offset;
+  offset = alignUp(offset + MAX_PROCESSES * bufs, Page::SIZE);
+  const std::size_t pages_offset = offset;
+  const std::size_t size =
+      offset + static_cast<std::size_t>(bufs) * PAGE_STRIDE;
+
+  bool created = true;
+  int fd = ::shm_open(segment_.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0 && errno == EEXIST) {
+    created = false;
+    fd = ::shm_open(segment_.c_str(), O_RDWR, 0600);
+  }
+  if (fd < 0) {
+    throw SharedMemoryException(segment_, std::strerror(errno));
+  }
+  if (created) {
+    if (::ftruncate(fd, size) != 0) {
+      const int error = errno;
+      ::close(fd);
+      ::shm_unlink(segment_.c_str());
+      throw SharedMemoryException(segment_, std::strerror(error));
+    }
+    size_ = size;
+  } else {
+    // The creator may not have sized the segment yet, or may have died
+    // before doing so.
+    struct stat st;
+    for (std::uint32_t waited = 0;; ++waited) {
+      if (::fstat(fd, &st) != 0) {
+        const int error = errno;
+        ::close(fd);
+        throw SharedMemoryException(segment_, std::strerror(error));
+      }
+      if (st.st_size != 0 || waited == ATTACH_TIMEOUT_MS) {
+        break;
+      }
+      ::usleep(1000);
+    }
+    if (st.st_size == 0) {
+      ::close(fd);
+      throw SharedMemoryException(segment_, "segment was never set up");
+    }
+    size_ = st.st_size;
+  }
+  void* address = ::mmap(NULL, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                         0);
+  ::close(fd);
+  if (address == MAP_FAILED) {
+    throw SharedMemoryException(segment_, std::strerror(errno));
+  }
+  base_ = static_cast<char*>(address);
+  header_ = reinterpret_cast<SegmentHeader*>(base_);
+
+  if (created) {
+    header_->magic = SEGMENT_MAGIC;
+    header_->num_frames = bufs;
+    header_->table_size = table_size;
+    header_->clock_hand = bufs - 1;
+    header_->frames_offset = frames_offset;
+    header_->buckets_offset = buckets_offset;
+    header_->filenames_offset = filenames_offset;
+    header_->processes_offset = processes_offset;
+    header_->pins_offset = pins_offset;
+    header_->latches_offset = latches_offset;
+    header_->pages_offset = pages_offset;
+    header_->size = size;
+    initMutex(&header_->mutex);
+    initMutex(&header_->file_mutex);
+  } else {
+    for (std::uint32_t waited = 0;
+         __atomic_load_n(&header_->ready, __ATOMIC_ACQUIRE) == 0; ++waited) {
+      if (waited == ATTACH_TIMEOUT_MS) {
+        ::munmap(base_, size_);
+        throw SharedMemoryException(segment_, "segment was never set up");
+      }
+      ::usleep(1000);
+    }
+    if (header_->magic != SEGMENT_MAGIC || header_->size != size_) {
+      ::munmap(base_, size_);
+      throw SharedMemoryException(segment_, "not a buffer pool segment");
+    }
+  }
+
+  frames_ = reinterpret_cast<SharedFrame*>(base_ + header_->frames_offset);
+  buckets_ = reinterpret_cast<std::int32_t*>(base_ + header_->buckets_offset);
+  filenames_ = base_ + header_->filenames_offset;
+  processes_ =
+      reinterpret_cast<ProcessSlot*>(base_ + header_->processes_offset);
+  pins_ = reinterpret_cast<std::uint16_t*>(base_ + header_->pins_offset);
+  latches_ = reinterpret_cast<std::uint8_t*>(base_ + header_->latches_offset);
+
+  if (created) {
+    // A fresh mapping is zeroed, so only non-zero initial values are set.
+    for (std::uint32_t i = 0; i < header_->table_size; ++i) {
+      buckets_[i] = -1;
+    }
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setpshared(&cond_attr, PTHREAD_PROCESS_SHARED);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    for (std::uint32_t i = 0; i < header_->num_frames; ++i) {
+      frames_[i].next = -1;
+      initMutex(&frames_[i].latch_mutex);
+      pthread_cond_init(&frames_[i].latch_released, &cond_attr);
+      new (framePage(i)) Page();
+    }
+    pthread_condattr_destroy(&cond_attr);
+    __atomic_store_n(&header_->ready, 1, __ATOMIC_RELEASE);
+  }
+
+  {
+    PoolLock lock(this);
+    reclaimLocked();
+    for (std::uint32_t i = 0; i < MAX_PROCESSES; ++i) {
+      if (processes_[i].pid == 0) {
+        processes_[i].pid = ::getpid();
+        process_slot_ = i;
+        break;
+      }
+    }
+  }
+  if (process_slot_ == MAX_PROCESSES) {
+    ::munmap(base_, size_);
+    throw SharedMemoryException(segment_, "too many processes attached");
+  }
+}
+
+SharedBufMgr::~SharedBufMgr() {
+  try {
+    PoolLock lock(this);
+    releaseProcess(process_slot_);
+    processes_[process_slot_].pid = 0;
+  } catch (const SharedMemoryException&) {
+    // Left for other processes to reclaim once this one is gone.
+  }
+  local_pins_.clear();
+  local_files_.clear();
+  ::munmap(base_, size_);
+}
+
+void SharedBufMgr::unlink(const std::string& segment) {
+  ::shm_unlink(segment.c_str());
+}
+
+void SharedBufMgr::readPage(File* file, const PageId page_no, Page*& page,
+                            const bool for_update) {
+  const LatchMode mode = for_update ? EXCLUSIVE : SHARED;
+  while (true) {
+    std::uint32_t file_id;
+    std::int32_t frame;
+    bool load = false;
+    {
+      PoolLock lock(this);
+      file_id = fileId(file);
+      const std::map<PageKey, LocalPin>::iterator iter =
+          local_pins_.find(PageKey(file_id, page_no));
+      if (iter != local_pins_.end()) {
+        LocalPin& local = iter->second;
+        if (mode == EXCLUSIVE && local.mode != EXCLUSIVE) {
+          throw PagePinnedException(file->filename(), page_no, local.frame);
+        }
+        pin(local.frame);
+        ++local.pins;
+        page = framePage(local.frame);
+        return;
+      }
+      frame = lookup(file_id, page_no);
+      if (frame < 0) {
+        const FrameId free_frame = allocFrame(lock);
+        // The mutex may have been released to write back a victim, so the
+        // file's entry and the page may have changed meanwhile.
+        file_id = fileId(file);
+        frame = lookup(file_id, page_no);
+        if (frame < 0) {
+          SharedFrame& descriptor = frames_[free_frame];
+          descriptor.file_id = file_id;
+          descriptor.page_no = page_no;
+          descriptor.dirty = 0;
+          descriptor.loaded = 0;
+          descriptor.valid = 1;
+          hashInsert(free_frame);
+          // Latched before anyone else can find it, so they wait for the
+          // read.
+          acquireFreeLatch(free_frame, EXCLUSIVE);
+          frame = free_frame;
+          load = true;
+        }
+      }
+      pin(frame);
+      frames_[frame].refbit = 1;
+    }
+
+    if (load) {
+      // Read with the pool unlocked; only this frame waits for it.
+      Page* const frame_page = framePage(frame);
+      try {
+        *frame_page = file->readPage(page_no);
+      } catch (...) {
+        PoolLock lock(this);
+        hashRemove(frame);
+        frames_[frame].valid = 0;
+        releaseLatch(frame, process_slot_);
+        unpin(frame);
+        throw;
+      }
+      frame_page->reservation_ = NULL;
+      frames_[frame].loaded = 1;
+      if (mode == SHARED) {
+        downgradeLatch(frame);
+      }
+    } else {
+      try {
+        acquireLatch(frame, mode);
+      } catch (...) {
+        PoolLock lock(this);
+        unpin(frame);
+        throw;
+      }
+      if (!frames_[frame].loaded) {
+        // Its reader failed or died; drop the frame and look again.
+        PoolLock lock(this);
+        if (frames_[frame].valid && !frames_[frame].loaded) {
+          hashRemove(frame);
+          frames_[frame].valid = 0;
+        }
+        releaseLatch(frame, process_slot_);
+        unpin(frame);
+        continue;
+      }
+    }
+
+    LocalPin& local = local_pins_[PageKey(file_id, page_no)];
+    local.frame = frame;
+    local.pins = 1;
+    local.mode = mode;
+    page = framePage(frame);
+    return;
+  }
+}
+
+void SharedBufMgr::unPinPage(File* file, const PageId page_no,
+                             const bool dirty) {
+  PoolLock lock(this);
+  const std::uint32_t file_id = fileId(file);
+  const std::map<PageKey, LocalPin>::iterator iter =
+      local_pins_.find(PageKey(file_id, page_no));
+  if (iter == local_pins_.end()) {
+    throw PageNotPinnedException(file->filename(), page_no, 0);
+  }
+  LocalPin& local = iter->second;
+  const FrameId frame = local.frame;
+  if (dirty) {
+    frames_[frame].dirty = 1;
+  }
+  unpin(frame);
+  if (--local.pins == 0) {
+    releaseLatch(frame, process_slot_);
+    local_pins_.erase(iter);
+  }
+}
+
+void SharedBufMgr::allocPage(File* file, PageId& page_no, Page*& page) {
+  Page new_page;
+  {
+    // Another process may be allocating in the same file.
+    FileLock file_lock(this);
+    new_page = file->allocatePage();
+  }
+  page_no = new_page.page_number();
+
+  PoolLock lock(this);
+  const FrameId frame = allocFrame(lock);
+  const std::uint32_t file_id = fileId(file);
+  if (lookup(file_id, page_no) >= 0) {
+    // Another process read the new page in while the mutex was released.
+    lock.release();
+    readPage(file, page_no, page, true /* for_update */);
+    return;
+  }
+  Page* const frame_page = framePage(frame);
+  *frame_page = new_page;
+  frame_page->reservation_ = NULL;
+  SharedFrame& descriptor = frames_[frame];
+  descriptor.file_id = file_id;
+  descriptor.page_no = page_no;
+  descriptor.dirty = 0;
+  descriptor.loaded = 1;
+  descriptor.valid = 1;
+  descriptor.refbit = 1;
+  hashInsert(frame);
+  acquireFreeLatch(frame, EXCLUSIVE);
+  pin(frame);
+  LocalPin& local = local_pins_[PageKey(file_id, page_no)];
+  local.frame = frame;
+  local.pins = 1;
+  local.mode = EXCLUSIVE;
+  page = frame_page;
+}
+
+void SharedBufMgr::flushFile(File* file) {
+  PoolLock lock(this);
+  const std::uint32_t file_id = fileId(file);
+  for (std::map<PageKey, LocalPin>::const_iterator iter = local_pins_.begin();
+       iter != local_pins_.end(); ++iter) {
+    if (iter->first.first == file_id) {
+      throw PagePinnedException(file->filename(), iter->first.second,
+                                iter->second.frame);
+    }
+  }
+  for (FrameId frame = 0; frame < header_->num_frames; ++frame) {
+    SharedFrame& descriptor = frames_[frame];
+    if (!descriptor.valid || descriptor.file_id != file_id) {
+      continue;
+    }
+    if (descriptor.dirty) {
+      writeBack(frame, lock);
+    }
+    // Pages other processes have pinned stay cached.
+    if (descriptor.valid && descriptor.file_id == file_id &&
+        descriptor.pin_count == 0 && !descriptor.dirty) {
+      hashRemove(frame);
+      descriptor.valid = 0;
+    }
+  }
+}
+
+void SharedBufMgr::disposePage(File* file, const PageId page_no) {
+  // Held throughout, so no process allocates the page again while a copy of
+  // it may still be cached.
+  FileLock file_lock(this);
+  {
+    PoolLock lock(this);
+    dropFrame(file, page_no);
+  }
+  file->deletePage(page_no);
+  // Another process may have read the page in while it was being deleted.
+  PoolLock lock(this);
+  dropFrame(file, page_no);
+}
+
+void SharedBufMgr::dropFrame(File* file, const PageId page_no) {
+  const std::int32_t frame = lookup(fileId(file), page_no);
+  if (frame < 0) {
+    return;
+  }
+  SharedFrame& descriptor = frames_[frame];
+  if (descriptor.pin_count > 0) {
+    throw PagePinnedException(file->filename(), page_no, frame);
+  }
+  hashRemove(frame);
+  descriptor.valid = 0;
+  descriptor.dirty = 0;
+}
+
+std::uint32_t SharedBufMgr::numFrames() const {
+  return header_->num_frames;
+}
+
+std::uint32_t SharedBufMgr::reclaimDeadProcesses() {
+  PoolLock lock(this);
+  return reclaimLocked();
+}
+
+void SharedBufMgr::lock() {
+  if (lockMutex(&header_->mutex, segment_)) {
+    // The owner died part way through changing the segment.
+    repair();
+    markConsistent(&header_->mutex, segment_);
+  }
+}
+
+void SharedBufMgr::unlock() {
+  pthread_mutex_unlock(&header_->mutex);
+}
+
+void SharedBufMgr::repair() {
+  // Pin counts are rebuilt from the per-process pin table, which is updated
+  // first whenever a pin changes.
+  for (FrameId frame = 0; frame < header_->num_frames; ++frame) {
+    std::uint32_t pin_count = 0;
+    for (std::uint32_t slot = 0; slot < MAX_PROCESSES; ++slot) {
+      pin_count += pins_[slot * header_->num_frames + frame];
+    }
+    frames_[frame].pin_count = pin_count;
+    frames_[frame].next = -1;
+  }
+  for (std::uint32_t i = 0; i < header_->table_size; ++i) {
+    buckets_[i] = -1;
+  }
+  for (FrameId frame = 0; frame < header_->num_frames; ++frame) {
+    if (frames_[frame].valid) {
+      if (lookup(frames_[frame].file_id, frames_[frame].page_no) >= 0) {
+        // Page loaded twice; keep the first copy.
+        frames_[frame].valid = 0;
+      } else {
+        hashInsert(frame);
+      }
+    }
+  }
+  header_->clock_hand %= header_->num_frames;
+  reclaimLocked();
+}
+
+std::uint32_t SharedBufMgr::reclaimLocked() {
+  std::uint32_t reclaimed = 0;
+  for (std::uint32_t slot = 0; slot < MAX_PROCESSES; ++slot) {
+    const pid_t pid = processes_[slot].pid;
+    if (pid == 0 || slot == process_slot_ ||
+        ::kill(pid, 0) == 0 || errno != ESRCH) {
+      continue;
+    }
+    releaseProcess(slot);
+    processes_[slot].pid = 0;
+    ++reclaimed;
+  }
+  return reclaimed;
+}
+
+void SharedBufMgr::releaseProcess(const std::uint32_t slot) {
+  std::uint16_t* slot_pins = pins_ + slot * header_->num_frames;
+  std::uint8_t* slot_latches = latches_ + slot * header_->num_frames;
+  for (FrameId frame = 0; frame < header_->num_frames; ++frame) {
+    frames_[frame].pin_count -= slot_pins[frame];
+    slot_pins[frame] = 0;
+    if (slot_latches[frame] != UNLATCHED) {
+      releaseLatch(frame, slot);
+    }
+  }
+}
+
+std::uint32_t SharedBufMgr::fileId(const File* file) {
+  const std::string& filename = file->filename();
+  if (filename.size() >= MAX_FILENAME) {
+    throw SharedMemoryException(segment_, "file name too long: " + filename);
+  }
+  std::uint32_t free_id = MAX_FILES;
+  for (std::uint32_t id = 0; id < MAX_FILES; ++id) {
+    const char* name = filenames_ + id * MAX_FILENAME;
+    if (filename == name) {
+      return id;
+    }
+    if (name[0] == '\0' && free_id == MAX_FILES) {
+      free_id = id;
+    }
+  }
+  if (free_id == MAX_FILES) {
+    // Reuse the entry of a file with no cached pages.
+    std::vector<bool> in_use(MAX_FILES, false);
+    for (FrameId frame = 0; frame < header_->num_frames; ++frame) {
+      if (frames_[frame].valid) {
+        in_use[frames_[frame].file_id] = true;
+      }
+    }
+    for (std::uint32_t id = 0; id < MAX_FILES && free_id == MAX_FILES; ++id) {
+      if (!in_use[id]) {
+        free_id = id;
+        local_files_.erase(id);
+      }
+    }
+    if (free_id == MAX_FILES) {
+      throw SharedMemoryException(segment_, "too many files cached");
+    }
+  }
+  std::strncpy(filenames_ + free_id * MAX_FILENAME, filename.c_str(),
+               MAX_FILENAME);
+  return free_id;
+}
+
+std::int32_t SharedBufMgr::lookup(const std::uint32_t file_id,
+                                  const PageId page_no) const {
+  const std::uint32_t bucket =
+      (file_id * 31u + page_no) % header_->table_size;
+  for (std::int32_t frame = buckets_[bucket]; frame >= 0;
+       frame = frames_[frame].next) {
+    if (frames_[frame].file_id == file_id &&
+        frames_[frame].page_no == page_no) {
+      return frame;
+    }
+  }
+  return -1;
+}
+
+void SharedBufMgr::hashInsert(const FrameId frame) {
+  const std::uint32_t bucket =
+      (frames_[frame].file_id * 31u + frames_[frame].page_no) %
+      header_->table_size;
+  frames_[frame].next = buckets_[bucket];
+  buckets_[bucket] = frame;
+}
+
+void SharedBufMgr::hashRemove(const FrameId frame) {
+  const std::uint32_t bucket =
+      (frames_[frame].file_id * 31u + frames_[frame].page_no) %
+      header_->table_size;
+  std::int32_t* link = &buckets_[bucket];
+  while (*link >= 0) {
+    if (*link == static_cast<std::int32_t>(frame)) {
+      *link = frames_[frame].next;
+      frames_[frame].next = -1;
+      return;
+    }
+    link = &frames_[*link].next;
+  }
+}
+
+FrameId SharedBufMgr::allocFrame(PoolLock& lock) {
+  for (int attempt = 0; attempt < 2; ++attempt) {
+    // Three passes: one may clear reference bits, the next write back dirty
+    // pages, the last take one of them.
+    for (std::uint32_t scanned = 0; scanned < 3 * header_->num_frames;
+         ++scanned) {
+      header_->clock_hand = (header_->clock_hand + 1) % header_->num_frames;
+      const FrameId frame = header_->clock_hand;
+      SharedFrame& descriptor = frames_[frame];
+      if (descriptor.pin_count > 0) {
+        continue;
+      }
+      if (!descriptor.valid) {
+        return frame;
+      }
+      if (descriptor.refbit) {
+        descriptor.refbit = 0;
+        continue;
+      }
+      if (descriptor.dirty) {
+        writeBack(frame, lock);
+        // Other processes may have used the frame during the write.
+        if (descriptor.pin_count > 0 || !descriptor.valid ||
+            descriptor.refbit || descriptor.dirty) {
+          continue;
+        }
+      }
+      hashRemove(frame);
+      descriptor.valid = 0;
+      return frame;
+    }
+    // Everything is pinned; maybe by processes that are gone.
+    if (reclaimLocked() == 0) {
+      break;
+    }
+  }
+  throw BufferExceededException();
+}
+
+File* SharedBufMgr::localFile(const std::uint32_t file_id) {
+  std::shared_ptr<File>& file = local_files_[file_id];
+  if (!file) {
+    file.reset(new File(File::open(filenames_ + file_id * MAX_FILENAME)));
+  }
+  return file.get();
+}
+
+void SharedBufMgr::writeBack(const FrameId frame, PoolLock& lock) {
+  SharedFrame& descriptor = frames_[frame];
+  // The pin keeps the frame from being reused and the shared latch keeps
+  // the page from changing while the mutex is released.
+  pin(frame);
+  lock.release();
+  try {
+    acquireLatch(frame, SHARED);
+  } catch (...) {
+    lock.reacquire();
+    unpin(frame);
+    throw;
+  }
+  lock.reacquire();
+  const bool dirty = descriptor.dirty;
+  const std::uint32_t file_id = descriptor.file_id;
+  descriptor.dirty = 0;
+  lock.release();
+  try {
+    if (dirty) {
+      localFile(file_id)->writePage(*framePage(frame));
+    }
+  } catch (...) {
+    lock.reacquire();
+    descriptor.dirty = 1;
+    releaseLatch(frame, process_slot_);
+    unpin(frame);
+    throw;
+  }
+  lock.reacquire();
+  releaseLatch(frame, process_slot_);
+  unpin(frame);
+}
+
+void SharedBufMgr::pin(const FrameId frame) {
+  ++pins_[process_slot_ * header_->num_frames + frame];
+  ++frames_[frame].pin_count;
+}
+
+void SharedBufMgr::unpin(const FrameId frame) {
+  --pins_[process_slot_ * header_->num_frames + frame];
+  --frames_[frame].pin_count;
+}
+
+void SharedBufMgr::lockLatch(const FrameId frame) {
+  if (lockMutex(&frames_[frame].latch_mutex, segment_)) {
+    rebuildLatch(frame);
+    markConsistent(&frames_[frame].latch_mutex, segment_);
+  }
+}
+
+void SharedBufMgr::rebuildLatch(const FrameId frame) {
+  SharedFrame& descriptor = frames_[frame];
+  descriptor.sharers = 0;
+  descriptor.writer = 0;
+  for (std::uint32_t slot = 0; slot < MAX_PROCESSES; ++slot) {
+    const std::uint8_t mode = latches_[slot * header_->num_frames + frame];
+    if (mode == SHARED) {
+      ++descriptor.sharers;
+    } else if (mode == EXCLUSIVE) {
+      descriptor.writer = processes_[slot].pid;
+    }
+  }
+}
+
+bool SharedBufMgr::grantLatch(const FrameId frame, const LatchMode mode) {
+  SharedFrame& descriptor = frames_[frame];
+  if (descriptor.writer != 0 ||
+      (mode == EXCLUSIVE && descriptor.sharers > 0)) {
+    return false;
+  }
+  // The table is updated first, so a holder's death is always repairable.
+  latches_[process_slot_ * header_->num_frames + frame] = mode;
+  if (mode == SHARED) {
+    ++descriptor.sharers;
+  } else {
+    descriptor.writer = ::getpid();
+  }
+  return true;
+}
+
+void SharedBufMgr::acquireLatch(const FrameId frame, const LatchMode mode) {
+  SharedFrame& descriptor = frames_[frame];
+  while (true) {
+    lockLatch(frame);
+    if (grantLatch(frame, mode)) {
+      pthread_mutex_unlock(&descriptor.latch_mutex);
+      return;
+    }
+    const timespec deadline = deadlineAfter(LATCH_POLL_MS);
+    const int result = pthread_cond_timedwait(
+        &descriptor.latch_released, &descriptor.latch_mutex, &deadline);
+    if (result == EOWNERDEAD) {
+      rebuildLatch(frame);
+      markConsistent(&descriptor.latch_mutex, segment_);
+    }
+    const bool granted = grantLatch(frame, mode);
+    pthread_mutex_unlock(&descriptor.latch_mutex);
+    if (granted) {
+      return;
+    }
+    if (result == ETIMEDOUT) {
+      // The holder may have died without releasing it.
+      reclaimDeadProcesses();
+    }
+  }
+}
+
+void SharedBufMgr::acquireFreeLatch(const FrameId frame,
+                                    const LatchMode mode) {
+  lockLatch(frame);
+  const bool granted = grantLatch(frame, mode);
+  pthread_mutex_unlock(&frames_[frame].latch_mutex);
+  if (!granted) {
+    throw SharedMemoryException(segment_, "latch of an unpinned frame is held");
+  }
+}
+
+void SharedBufMgr::downgradeLatch(const FrameId frame) {
+  SharedFrame& descriptor = frames_[frame];
+  lockLatch(frame);
+  latches_[process_slot_ * header_->num_frames + frame] = SHARED;
+  descriptor.writer = 0;
+  ++descriptor.sharers;
+  pthread_cond_broadcast(&descriptor.latch_released);
+  pthread_mutex_unlock(&descriptor.latch_mutex);
+}
+
+void SharedBufMgr::releaseLatch(const FrameId frame,
+                                const std::uint32_t slot) {
+  SharedFrame& descriptor = frames_[frame];
+  std::uint8_t& mode = latches_[slot * header_->num_frames + frame];
+  lockLatch(frame);
+  if (mode == SHARED) {
+    --descriptor.sharers;
+  } else if (mode == EXCLUSIVE) {
+    descriptor.writer = 0;
+  }
+  mode = UNLATCHED;
+  pthread_cond_broadcast(&descriptor.latch_released);
+  pthread_mutex_unlock(&descriptor.latch_mutex);
+}
+
+Page* SharedBufMgr::framePage(const FrameId frame) const {
+  return reinterpret_cast<Page*>(base_ + header_->pages_offset +
+                                 static_cast<std::size_t>(frame) *
+                                     PAGE_STRIDE);
+}
+
+}
@@ -0,0 +1,447 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "file.h"
+#include "page.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Buffer pool in a POSIX shared-memory segment, shared by all local
+ *        processes that attach to it by name.
+ *
+ * The segment holds the frame descriptors, a hash table from (file, page) to
+ * frame, a table of file names (File objects can't be shared between
+ * processes, so files are identified by name), a table of attached processes
+ * with the pins and latches each holds, and the pages themselves.  Everything
+ * in it refers to other parts by index, never by pointer, since each process
+ * maps it at a different address.  A process-shared, robust mutex guards the
+ * tables; it is never held during disk I/O.
+ *
+ * Pages are handed out in place: readPage() returns a pointer to the page in
+ * the shared frame, so every process sees the same image and changes need no
+ * copying.  Each frame has a process-shared latch that a pin holds, shared
+ * for reading or exclusive for updating, until the page is unpinned.  A
+ * process may pin a page several times, but can't pin for update a page it
+ * already has pinned for reading.  Pages in the pool don't carry their file's
+ * space reservation, so fill factors are not applied to them.
+ *
+ * Allocating and deleting pages are serialized across processes, since they
+ * change the file's header and page lists.
+ *
+ * If a process dies, its pins and latches are reclaimed by the next process
+ * that finds it gone (including one waiting for a latch it held), and a
+ * process that dies while holding a mutex leaves the shared state to be
+ * rebuilt from the per-process tables by the next process to take it.  Pages
+ * the dead process was updating keep whatever changes it made.
+ *
+ * @warning A SharedBufMgr object must only be used by one thread.
+ */
+class SharedBufMgr {
+ public:
+  /**
+   * Maximum number of processes attached at once.
+   */
+  static const std::uint32_t MAX_PROCESSES = 64;
+
+  /**
+   * Maximum number of distinct files cached at once.
+   */
+  static const std::uint32_t MAX_FILES = 64;
+
+  /**
+   * Maximum length of a file name, including the terminating NUL.
+   */
+  static const std::size_t MAX_FILENAME = 256;
+
+  /**
+   * Milliseconds to wait for the creator of a segment to set it up before
+   * giving up on it.
+   */
+  static const std::uint32_t ATTACH_TIMEOUT_MS = 5000;
+
+  /**
+   * Milliseconds between checks for dead holders while waiting for a latch.
+   */
+  static const std::uint32_t LATCH_POLL_MS = 50;
+
+  /**
+   * Attaches to the named pool, creating it with <bufs> frames if it doesn't
+   * exist.  An existing pool keeps the size it was created with.
+   *
+   * @param segment   Name of the shared-memory segment (e.g. "/badgerdb").
+   * @param bufs      Number of frames to create the pool with.
+   * @throws  SharedMemoryException   If the segment can't be created or
+   *                                  mapped, its creator doesn't finish
+   *                                  setting it up within ATTACH_TIMEOUT_MS,
+   *                                  or MAX_PROCESSES are attached.
+   */
+  SharedBufMgr(const std::string& segment, const std::uint32_t bufs);
+
+  /**
+   * Unpins everything this process still has pinned and detaches.  The
+   * segment stays for other processes; dirty pages are not written back.
+   */
+  ~SharedBufMgr();
+
+  /**
+   * Removes the named segment.  Processes still attached keep their mapping.
+   *
+   * @param segment   Name of the shared-memory segment.
+   */
+  static void unlink(const std::string& segment);
+
+  /**
+   * Pins a page and returns a pointer to it in the shared pool, reading it
+   * from its file if no process has it cached.  Waits until no other process
+   * holds the page's latch in a conflicting mode.
+   *
+   * @param file        File the page belongs to.
+   * @param page_no     Number of the page.
+   * @param page        Receives a pointer to the shared page.
+   * @param for_update  Whether to latch the page exclusively, so that it may
+   *                    be modified.
+   * @throws  BufferExceededException   If every frame is pinned.
+   * @throws  PagePinnedException       If <for_update> is set and this process
+   *                                    already has the page pinned for
+   *                                    reading.
+   * @throws  SharedMemoryException     If a mutex in the segment can't be
+   *                                    taken.
+   */
+  void readPage(File* file, const PageId page_no, Page*& page,
+                const bool for_update = false);
+
+  /**
+   * Unpins a page, releasing its latch when this process's last pin of it
+   * goes.
+   *
+   * @param file      File the page belongs to.
+   * @param page_no   Number of the page.
+   * @param dirty     Whether the page was modified.
+   * @throws  PageNotPinnedException  If this process hasn't pinned the page.
+   * @throws  SharedMemoryException   If a mutex in the segment can't be taken.
+   */
+  void unPinPage(File* file, const PageId page_no, const bool dirty);
+
+  /**
+   * Allocates a new page in a file and pins it for update.
+   *
+   * @param file      File to allocate the page in.
+   * @param page_no   Receives the number of the new page.
+   * @param page      Receives a pointer to the shared page.
+   * @throws  BufferExceededException   If every frame is pinned.
+   * @throws  SharedMemoryException     If a mutex in the segment can't be
+   *                                    taken.
+   */
+  void allocPage(File* file, PageId& page_no, Page*& page);
+
+  /**
+   * Writes all dirty pages of a file back to it and drops its pages that no
+   * process has pinned.  Waits for processes updating its pages to unpin
+   * them.
+   *
+   * @param file  File to flush.
+   * @throws  PagePinnedException     If this process has a page of it pinned.
+   * @throws  SharedMemoryException   If a mutex in the segment can't be taken.
+   */
+  void flushFile(File* file);
+
+  /**
+   * Deletes a page from its file and from the pool.
+   *
+   * @param file      File the page belongs to.
+   * @param page_no   Number of the page.
+   * @throws  PagePinnedException     If any process has the page pinned.
+   * @throws  SharedMemoryException   If a mutex in the segment can't be taken.
+   */
+  void disposePage(File* file, const PageId page_no);
+
+  /**
+   * Returns the number of frames in the pool.
+   */
+  std::uint32_t numFrames() const;
+
+  /**
+   * Checks the attached processes and releases the pins and latches of those
+   * that have died.
+   *
+   * @return  Number of processes reclaimed.
+   * @throws  SharedMemoryException   If a mutex in the segment can't be taken.
+   */
+  std::uint32_t reclaimDeadProcesses();
+
+ private:
+  struct SegmentHeader;
+  struct SharedFrame;
+  struct ProcessSlot;
+
+  /**
+   * Modes in which a process can hold a frame's latch, as recorded in the
+   * per-process latch table.
+   */
+  enum LatchMode {
+    UNLATCHED = 0,
+    SHARED = 1,
+    EXCLUSIVE = 2
+  };
+
+  /**
+   * A page this process has pinned.
+   */
+  struct LocalPin {
+    /**
+     * Frame holding the page.
+     */
+    FrameId frame;
+
+    /**
+     * Number of times this process has the page pinned.
+     */
+    int pins;
+
+    /**
+     * Mode in which this process holds the frame's latch.
+     */
+    LatchMode mode;
+  };
+
+  typedef std::pair<std::uint32_t, PageId> PageKey;
+
+  /**
+   * Holds the pool mutex for the lifetime of the object, except while it is
+   * released for disk I/O.
+   */
+  class PoolLock;
+
+  /**
+   * Holds the mutex serializing page allocation and deletion for the
+   * lifetime of the object.
+   */
+  class FileLock;
+
+  /**
+   * Takes the pool mutex, repairing the shared tables if its last owner died.
+   *
+   * @throws  SharedMemoryException   If the mutex can't be taken.
+   */
+  void lock();
+
+  /**
+   * Releases the pool mutex.
+   */
+  void unlock();
+
+  /**
+   * Rebuilds the hash table and pin counts from the frame descriptors and
+   * per-process pin tables after a process died holding the mutex.
+   */
+  void repair();
+
+  /**
+   * Releases the pins of dead processes.  Must be called with the mutex held.
+   *
+   * @return  Number of processes reclaimed.
+   */
+  std::uint32_t reclaimLocked();
+
+  /**
+   * Releases every pin and latch held by the process in a slot.  Must be
+   * called with the mutex held.
+   *
+   * @param slot  Slot of the process in the process table.
+   */
+  void releaseProcess(const std::uint32_t slot);
+
+  /**
+   * Returns the ID of a file in the shared file table, adding it if needed.
+   * Must be called with the mutex held.
+   *
+   * @param file  File to look up.
+   * @return  Index of the file's name in the file table.
+   */
+  std::uint32_t fileId(const File* file);
+
+  /**
+   * Returns the frame holding a page, or -1.  Must be called with the mutex
+   * held.
+   */
+  std::int32_t lookup(const std::uint32_t file_id, const PageId page_no) const;
+
+  /**
+   * Adds a frame to the hash table.  Must be called with the mutex held.
+   */
+  void hashInsert(const FrameId frame);
+
+  /**
+   * Removes a frame from the hash table.  Must be called with the mutex held.
+   */
+  void hashRemove(const FrameId frame);
+
+  /**
+   * Removes a page from the pool without writing it back.  Must be called
+   * with the mutex held.
+   *
+   * @param file      File the page belongs to.
+   * @param page_no   Number of the page.
+   * @throws  PagePinnedException   If the page is pinned.
+   */
+  void dropFrame(File* file, const PageId page_no);
+
+  /**
+   * Picks a frame to hold a new page with the clock algorithm, writing back
+   * dirty pages it passes.  Must be called with the mutex held, which is
+   * released during the writes, so callers must look the page up again
+   * afterwards.
+   *
+   * @param lock  The caller's hold on the mutex.
+   * @return  Frame number.
+   * @throws  BufferExceededException   If every frame is pinned.
+   */
+  FrameId allocFrame(PoolLock& lock);
+
+  /**
+   * Returns a File for a file in the file table, opening it if this process
+   * hasn't yet.
+   */
+  File* localFile(const std::uint32_t file_id);
+
+  /**
+   * Writes a frame's page back to its file.  Must be called with the mutex
+   * held; it is released during the write, while the frame is pinned and
+   * latched for reading.
+   *
+   * @param frame   Frame to write back.
+   * @param lock    The caller's hold on the mutex.
+   */
+  void writeBack(const FrameId frame, PoolLock& lock);
+
+  /**
+   * Adds a pin of this process to a frame.  Must be called with the mutex
+   * held.
+   */
+  void pin(const FrameId frame);
+
+  /**
+   * Removes a pin of this process from a frame.  Must be called with the
+   * mutex held.
+   */
+  void unpin(const FrameId frame);
+
+  /**
+   * Takes a frame's latch mutex, rebuilding the latch state from the latch
+   * table if its last owner died.
+   *
+   * @throws  SharedMemoryException   If the mutex can't be taken.
+   */
+  void lockLatch(const FrameId frame);
+
+  /**
+   * Recomputes a frame's latch state from the latch table after a process
+   * died holding the frame's latch mutex.  Must be called with that mutex
+   * held.
+   */
+  void rebuildLatch(const FrameId frame);
+
+  /**
+   * Grants this process a frame's latch if no other process holds it in a
+   * conflicting mode.  Must be called with the frame's latch mutex held.
+   *
+   * @return  Whether the latch was granted.
+   */
+  bool grantLatch(const FrameId frame, const LatchMode mode);
+
+  /**
+   * Takes a frame's latch, waiting for conflicting holders to release it or
+   * die.  Must be called without the pool mutex held.
+   *
+   * @throws  SharedMemoryException   If a mutex can't be taken.
+   */
+  void acquireLatch(const FrameId frame, const LatchMode mode);
+
+  /**
+   * Takes the latch of a frame no process holds.  May be called with the
+   * pool mutex held.
+   *
+   * @throws  SharedMemoryException   If the latch is held.
+   */
+  void acquireFreeLatch(const FrameId frame, const LatchMode mode);
+
+  /**
+   * Changes this process's exclusive hold on a frame's latch to a shared one.
+   */
+  void downgradeLatch(const FrameId frame);
+
+  /**
+   * Releases the latch a process holds on a frame, if any, and wakes
+   * waiters.
+   *
+   * @param frame   Frame to release.
+   * @param slot    Slot of the holding process in the process table.
+   */
+  void releaseLatch(const FrameId frame, const std::uint32_t slot);
+
+  /**
+   * Returns the page held by a frame.
+   */
+  Page* framePage(const FrameId frame) const;
+
+  /**
+   * Name of the segment.
+   */
+  std::string segment_;
+
+  /**
+   * Start of this process's mapping of the segment.
+   */
+  char* base_;
+
+  /**
+   * Size of the segment in bytes.
+   */
+  std::size_t size_;
+
+  /**
+   * Parts of the segment, located from the offsets in its header.
+   */
+  SegmentHeader* header_;
+  SharedFrame* frames_;
+  std::int32_t* buckets_;
+  char* filenames_;
+  ProcessSlot* processes_;
+  std::uint16_t* pins_;
+  std::uint8_t* latches_;
+
+  /**
+   * Index of this process's slot in the process table.
+   */
+  std::uint32_t process_slot_;
+
+  /**
+   * Pages this process has pinned.
+   */
+  std::map<PageKey, LocalPin> local_pins_;
+
+  /**
+   * Files this process has opened to write back pages, by file ID.
+   */
+  std::map<std::uint32_t, std::shared_ptr<File> > local_files_;
+};
+
+}
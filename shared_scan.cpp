@@ -0,0 +1,127 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "shared_scan.h"
+
+#include <algorithm>
+
+namespace badgerdb {
+
+ScanCoordinator::ScanCoordinator(const std::uint32_t max_lead)
+    : max_lead_(max_lead), joined_scans_(0) {}
+
+std::uint64_t ScanCoordinator::joinedScans() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return joined_scans_;
+}
+
+PageId ScanCoordinator::attach(const SharedScan* scan,
+                               const std::string& filename,
+                               std::uint64_t& position) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::map<std::string, Group>::iterator iter = groups_.find(filename);
+  if (iter == groups_.end()) {
+    Group& group = groups_[filename];
+    group.frontier = 0;
+    group.frontier_page = Page::INVALID_NUMBER;
+    group.positions[scan] = 0;
+    position = 0;
+    return Page::INVALID_NUMBER;
+  }
+  // Start with the page the scan in front is reading; it is in the pool or
+  // about to be.
+  Group& group = iter->second;
+  position = group.frontier;
+  group.positions[scan] = position;
+  ++joined_scans_;
+  return group.frontier_page;
+}
+
+void ScanCoordinator::advance(const SharedScan* scan,
+                              const std::string& filename,
+                              const std::uint64_t position,
+                              const PageId page_number) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  Group& group = groups_[filename];
+  if (max_lead_ > 0) {
+    moved_.wait(lock, [this, &group, scan, position] {
+      std::uint64_t slowest = position;
+      for (std::map<const SharedScan*, std::uint64_t>::const_iterator iter =
+               group.positions.begin();
+           iter != group.positions.end(); ++iter) {
+        if (iter->first != scan) {
+          slowest = std::min(slowest, iter->second);
+        }
+      }
+      return position <= slowest + max_lead_;
+    });
+  }
+  group.positions[scan] = position;
+  if (position >= group.frontier) {
+    group.frontier = position;
+    group.frontier_page = page_number;
+  }
+  lock.unlock();
+  moved_.notify_all();
+}
+
+void ScanCoordinator::detach(const SharedScan* scan,
+                             const std::string& filename) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<std::string, Group>::iterator iter = groups_.find(filename);
+    iter->second.positions.erase(scan);
+    if (iter->second.positions.empty()) {
+      groups_.erase(iter);
+    }
+  }
+  moved_.notify_all();
+}
+
+SharedScan::SharedScan(ScanCoordinator* coordinator, const File* file,
+                       const std::vector<PageId>& pages)
+    : coordinator_(coordinator),
+      filename_(file->filename()),
+      pages_(pages),
+      start_index_(0),
+      returned_(0),
+      position_(0),
+      attached_(true) {
+  const PageId start_page =
+      coordinator_->attach(this, filename_, position_);
+  if (start_page != Page::INVALID_NUMBER) {
+    start_index_ = std::lower_bound(pages_.begin(), pages_.end(), start_page) -
+        pages_.begin();
+    if (start_index_ == pages_.size()) {
+      start_index_ = 0;
+    }
+  }
+}
+
+SharedScan::~SharedScan() {
+  if (attached_) {
+    coordinator_->detach(this, filename_);
+  }
+}
+
+PageId SharedScan::next() {
+  if (returned_ == pages_.size()) {
+    if (attached_) {
+      coordinator_->detach(this, filename_);
+      attached_ = false;
+    }
+    return Page::INVALID_NUMBER;
+  }
+  const PageId page_number =
+      pages_[(start_index_ + returned_) % pages_.size()];
+  coordinator_->advance(this, filename_, position_, page_number);
+  ++returned_;
+  ++position_;
+  return page_number;
+}
+
+}
@@ -0,0 +1,183 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "file.h"
+#include "types.h"
+
+namespace badgerdb {
+
+class SharedScan;
+
+/**
+ * @brief Lets concurrent scans of the same file share its page reads.
+ *
+ * Scans that read a file independently through a buffer pool each read every
+ * page, so N scans of a file bigger than the pool cost N times the I/O.
+ * Scans coordinated here instead start where a scan of the same file is
+ * already reading, follow it through the file, and then wrap around to the
+ * pages they missed.  While they stay close together only the scan in front
+ * misses in the pool; the others find the pages it just loaded.
+ *
+ * To keep the group together, a scan more than <max_lead> pages ahead of the
+ * slowest scan in its group waits for it.  The pool should hold comfortably
+ * more than <max_lead> pages.  A scan must keep asking for pages or be
+ * destroyed, or the scans ahead of it wait for it forever.
+ *
+ * The coordinator is threadsafe; each SharedScan belongs to one thread.
+ */
+class ScanCoordinator {
+ public:
+  /**
+   * Creates a coordinator.
+   *
+   * @param max_lead  Most pages a scan may get ahead of the slowest scan of
+   *                  the same file; 0 means scans never wait.
+   */
+  explicit ScanCoordinator(const std::uint32_t max_lead = 0);
+
+  /**
+   * Returns the number of scans that started by joining a running scan.
+   */
+  std::uint64_t joinedScans() const;
+
+ private:
+  /**
+   * The scans of one file.  Positions are counted in pages since the group
+   * was created, so they keep growing as scans wrap around.
+   */
+  struct Group {
+    /**
+     * Position and page number of the furthest page handed out so far.
+     */
+    std::uint64_t frontier;
+    PageId frontier_page;
+
+    /**
+     * Running scans and their positions.
+     */
+    std::map<const SharedScan*, std::uint64_t> positions;
+  };
+
+  /**
+   * Adds a scan to the group of its file and returns the page it starts at.
+   */
+  PageId attach(const SharedScan* scan, const std::string& filename,
+                std::uint64_t& position);
+
+  /**
+   * Records that a scan is about to read the page at <position>, waiting
+   * first if that would take it too far ahead of its group.
+   */
+  void advance(const SharedScan* scan, const std::string& filename,
+               const std::uint64_t position, const PageId page_number);
+
+  /**
+   * Removes a scan from its group.
+   */
+  void detach(const SharedScan* scan, const std::string& filename);
+
+  const std::uint32_t max_lead_;
+
+  mutable std::mutex mutex_;
+
+  /**
+   * Signalled when a scan moves or leaves its group.
+   */
+  std::condition_variable moved_;
+
+  std::map<std::string, Group> groups_;
+
+  std::uint64_t joined_scans_;
+
+  friend class SharedScan;
+};
+
+/**
+ * @brief One scan coordinated by a ScanCoordinator.
+ *
+ * Hands out the pages of a file, each once, starting where other scans of
+ * the file are reading.  The caller reads each page (normally through a
+ * buffer pool) and asks for the next.  Typical use:
+ *
+ *   SharedScan scan(&coordinator, &file, pages);
+ *   for (PageId page_number = scan.next(); page_number != Page::INVALID_NUMBER;
+ *        page_number = scan.next()) {
+ *     bufMgr->readPage(&file, page_number, page);
+ *     ...
+ *   }
+ */
+class SharedScan {
+ public:
+  /**
+   * Starts a scan and joins the scans of the same file already running.
+   *
+   * @param coordinator   Coordinator of the scans; must outlive the scan.
+   * @param file          File being scanned.
+   * @param pages         Pages to visit in ascending order, e.g. the used
+   *                      pages of the file.
+   */
+  SharedScan(ScanCoordinator* coordinator, const File* file,
+             const std::vector<PageId>& pages);
+
+  /**
+   * Leaves the group, letting scans waiting for this one go on.
+   */
+  ~SharedScan();
+
+  /**
+   * Returns the next page to read, waiting first if this scan is too far
+   * ahead of the others.
+   *
+   * @return  Page number, or Page::INVALID_NUMBER once every page has been
+   *          returned.
+   */
+  PageId next();
+
+  /**
+   * Returns the page the scan started at.
+   */
+  PageId startPage() const {
+    return pages_.empty() ? Page::INVALID_NUMBER : pages_[start_index_];
+  }
+
+ private:
+  ScanCoordinator* coordinator_;
+  const std::string filename_;
+  const std::vector<PageId> pages_;
+
+  /**
+   * Index in <pages_> of the first page returned.
+   */
+  std::size_t start_index_;
+
+  /**
+   * Number of pages returned so far.
+   */
+  std::size_t returned_;
+
+  /**
+   * Position in the group of the next page to return.
+   */
+  std::uint64_t position_;
+
+  /**
+   * Whether the scan is still in its group.
+   */
+  bool attached_;
+};
+
+}
@@ -0,0 +1,275 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "simulated_device.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#include "exceptions/io_error_exception.h"
+
+namespace badgerdb {
+
+SimulatedDevice::Profile SimulatedDevice::Profile::hdd() {
+  Profile profile;
+  profile.name = "hdd";
+  // Sequential access only pays for the controller; random access pays for
+  // the seek and on average half a rotation at 7200 rpm.
+  const Distribution read = {Distribution::EXPONENTIAL, 50, 100, 0};
+  const Distribution write = {Distribution::EXPONENTIAL, 50, 100, 0};
+  profile.read_latency = read;
+  profile.write_latency = write;
+  profile.seek_us = 8500;
+  profile.read_mbps = 160;
+  profile.write_mbps = 150;
+  profile.queue_depth = 1;
+  return profile;
+}
+
+SimulatedDevice::Profile SimulatedDevice::Profile::sataSsd() {
+  Profile profile;
+  profile.name = "sata-ssd";
+  const Distribution read = {Distribution::LOGNORMAL, 60, 30, 0.6};
+  // Writes land in the drive's cache but garbage collection gives them a
+  // long tail.
+  const Distribution write = {Distribution::LOGNORMAL, 30, 40, 1.2};
+  profile.read_latency = read;
+  profile.write_latency = write;
+  profile.seek_us = 0;
+  profile.read_mbps = 550;
+  profile.write_mbps = 500;
+  profile.queue_depth = 32;
+  return profile;
+}
+
+SimulatedDevice::Profile SimulatedDevice::Profile::nvme() {
+  Profile profile;
+  profile.name = "nvme";
+  const Distribution read = {Distribution::LOGNORMAL, 50, 25, 0.5};
+  const Distribution write = {Distribution::LOGNORMAL, 10, 15, 1.0};
+  profile.read_latency = read;
+  profile.write_latency = write;
+  profile.seek_us = 0;
+  profile.read_mbps = 3500;
+  profile.write_mbps = 3000;
+  profile.queue_depth = 256;
+  return profile;
+}
+
+bool SimulatedDevice::Profile::byName(const std::string& name,
+                                      Profile& profile) {
+  if (name == "hdd") {
+    profile = hdd();
+  } else if (name == "sata-ssd") {
+    profile = sataSsd();
+  } else if (name == "nvme") {
+    profile = nvme();
+  } else {
+    return false;
+  }
+  return true;
+}
+
+SimulatedDevice::SimulatedDevice(const Profile& profile,
+                                 const std::uint64_t seed)
+    : profile_(profile),
+      random_(seed),
+      time_scale_(1),
+      fault_countdown_(0),
+      injected_fault_(NO_FAULT),
+      in_flight_(0),
+      transfer_free_(std::chrono::steady_clock::now()),
+      last_end_(-1),
+      simulated_ns_(0) {
+  fault_rates_.read_error = 0;
+  fault_rates_.write_error = 0;
+  fault_rates_.short_write = 0;
+  stats_.reads = 0;
+  stats_.writes = 0;
+  stats_.bytes_read = 0;
+  stats_.bytes_written = 0;
+  stats_.seeks = 0;
+  stats_.io_errors = 0;
+  stats_.short_writes = 0;
+  stats_.queued = 0;
+}
+
+void SimulatedDevice::setTimeScale(const double scale) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  time_scale_ = scale;
+}
+
+void SimulatedDevice::setFaultRates(const FaultRates& rates) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  fault_rates_ = rates;
+}
+
+void SimulatedDevice::injectFault(const std::uint64_t operations,
+                                  const Fault fault) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  fault_countdown_ = operations;
+  injected_fault_ = fault;
+}
+
+void SimulatedDevice::read(const std::string& filename,
+                           const PageId page_number,
+                           const std::streamoff offset,
+                           const std::size_t bytes) {
+  if (serve(false /* is_write */, filename, offset, bytes) != NO_FAULT) {
+    throw IoErrorException(filename, page_number, "read");
+  }
+}
+
+std::size_t SimulatedDevice::write(const std::string& filename,
+                                   const PageId page_number,
+                                   const std::streamoff offset,
+                                   const std::size_t bytes) {
+  const Fault fault = serve(true /* is_write */, filename, offset, bytes);
+  if (fault == IO_ERROR) {
+    throw IoErrorException(filename, page_number, "write");
+  }
+  if (fault == NO_FAULT) {
+    return bytes;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  const std::size_t sectors = bytes / SECTOR_SIZE;
+  return sectors <= 1 ? 0 : SECTOR_SIZE * (1 + random_() % (sectors - 1));
+}
+
+SimulatedDevice::Stats SimulatedDevice::stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+std::uint64_t SimulatedDevice::simulatedTime() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return simulated_ns_;
+}
+
+SimulatedDevice::Fault SimulatedDevice::serve(const bool is_write,
+                                              const std::string& filename,
+                                              const std::streamoff offset,
+                                              const std::size_t bytes) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  const std::chrono::steady_clock::time_point arrived =
+      std::chrono::steady_clock::now();
+
+  // Draw everything up front, in the same order every time, so that runs
+  // with the same seed see the same latencies and faults.
+  Fault fault = NO_FAULT;
+  const double draw = std::uniform_real_distribution<double>(0, 1)(random_);
+  if (is_write) {
+    if (draw < fault_rates_.write_error) {
+      fault = IO_ERROR;
+    } else if (draw < fault_rates_.write_error + fault_rates_.short_write) {
+      fault = SHORT_WRITE;
+    }
+  } else if (draw < fault_rates_.read_error) {
+    fault = IO_ERROR;
+  }
+  if (injected_fault_ != NO_FAULT) {
+    if (fault_countdown_ > 0) {
+      --fault_countdown_;
+    } else if (is_write || injected_fault_ != SHORT_WRITE) {
+      fault = injected_fault_;
+      injected_fault_ = NO_FAULT;
+    }
+  }
+
+  const bool seek = filename != last_filename_ || offset != last_end_;
+  last_filename_ = filename;
+  last_end_ = offset + static_cast<std::streamoff>(bytes);
+  double latency_ns = drawLatency(is_write ? profile_.write_latency
+                                           : profile_.read_latency);
+  if (seek) {
+    latency_ns += profile_.seek_us * 1000;
+    ++stats_.seeks;
+  }
+  const double mbps = is_write ? profile_.write_mbps : profile_.read_mbps;
+  const double transfer_ns = mbps > 0 ? bytes * 1000.0 / mbps : 0;
+
+  if (is_write) {
+    ++stats_.writes;
+    stats_.bytes_written += bytes;
+  } else {
+    ++stats_.reads;
+    stats_.bytes_read += bytes;
+  }
+  if (fault == IO_ERROR) {
+    ++stats_.io_errors;
+  } else if (fault == SHORT_WRITE) {
+    ++stats_.short_writes;
+  }
+
+  double modelled_ns = latency_ns + transfer_ns;
+  if (time_scale_ > 0) {
+    if (profile_.queue_depth > 0 && in_flight_ >= profile_.queue_depth) {
+      ++stats_.queued;
+      while (in_flight_ >= profile_.queue_depth) {
+        slot_free_.wait(lock);
+      }
+    }
+    ++in_flight_;
+    // Access latencies overlap up to the queue depth, but the data moves
+    // over one channel, so transfers are served one after another.
+    const std::chrono::steady_clock::time_point now =
+        std::chrono::steady_clock::now();
+    const std::chrono::steady_clock::time_point transfer_start =
+        std::max(now + std::chrono::duration_cast<
+                     std::chrono::steady_clock::duration>(
+                         std::chrono::duration<double, std::nano>(
+                             latency_ns * time_scale_)),
+                 transfer_free_);
+    transfer_free_ = transfer_start +
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double, std::nano>(
+                transfer_ns * time_scale_));
+    const std::chrono::steady_clock::time_point done = transfer_free_;
+    lock.unlock();
+    std::this_thread::sleep_until(done);
+    lock.lock();
+    --in_flight_;
+    slot_free_.notify_one();
+    modelled_ns = std::chrono::duration<double, std::nano>(
+        done - arrived).count() / time_scale_;
+  }
+  simulated_ns_ += static_cast<std::uint64_t>(modelled_ns);
+  stats_.latency.record(static_cast<std::uint64_t>(modelled_ns));
+  return fault;
+}
+
+double SimulatedDevice::drawLatency(const Distribution& distribution) {
+  double extra_us = 0;
+  switch (distribution.shape) {
+    case Distribution::CONSTANT:
+      extra_us = distribution.mean_us;
+      break;
+    case Distribution::UNIFORM:
+      extra_us = std::uniform_real_distribution<double>(
+          0, 2 * distribution.mean_us)(random_);
+      break;
+    case Distribution::EXPONENTIAL:
+      if (distribution.mean_us > 0) {
+        extra_us = std::exponential_distribution<double>(
+            1 / distribution.mean_us)(random_);
+      }
+      break;
+    case Distribution::LOGNORMAL:
+      if (distribution.mean_us > 0) {
+        // Pick mu so that the mean comes out at mean_us.
+        const double mu = std::log(distribution.mean_us) -
+            distribution.sigma * distribution.sigma / 2;
+        extra_us = std::lognormal_distribution<double>(
+            mu, distribution.sigma)(random_);
+      }
+      break;
+  }
+  return (distribution.min_us + extra_us) * 1000;
+}
+
+}
@@ -0,0 +1,321 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <ios>
+#include <mutex>
+#include <random>
+#include <string>
+
+#include "latency_histogram.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Storage device model that files can be attached to.
+ *
+ * A file attached to a device (see File::attachDevice()) still keeps its data
+ * in its real file, but every read and write of it first goes through the
+ * device, which charges the operation the latency the modelled hardware would
+ * have and can make it fail.  Each operation costs
+ *
+ *   - a latency drawn from the profile's distribution for its kind, plus a
+ *     seek penalty if it doesn't continue where the previous one on the same
+ *     file ended;
+ *   - its transfer time at the profile's bandwidth, with transfers of all
+ *     operations on the device taking turns;
+ *   - any time spent waiting for a free slot when the profile's queue depth
+ *     is reached.
+ *
+ * With a time scale of 1 (the default) operations really take that long.
+ * With a scale of 0 nothing sleeps and the cost is only added up in
+ * simulatedTime(), so a single-threaded run gives the same timings and faults
+ * every time for the same seed.  Several files may share one device, just as
+ * they would share a disk.
+ *
+ * Faults are injected with a given probability per operation, or once at a
+ * chosen operation with injectFault().  An I/O error fails the operation
+ * without touching the data; a short write stores only a whole number of
+ * 512-byte sectors from the start of the page before failing.
+ */
+class SimulatedDevice {
+ public:
+  /**
+   * Kinds of injected fault.
+   */
+  enum Fault {
+    NO_FAULT,
+    IO_ERROR,     // Fails the operation like EIO.
+    SHORT_WRITE   // Writes part of the page, then fails.
+  };
+
+  /**
+   * Distribution of per-operation latency.
+   */
+  struct Distribution {
+    enum Shape {
+      CONSTANT,     // Always min_us + mean_us.
+      UNIFORM,      // min_us plus uniform in [0, 2 * mean_us].
+      EXPONENTIAL,  // min_us plus exponential with mean mean_us.
+      LOGNORMAL     // min_us plus lognormal with mean mean_us; heavy tail.
+    };
+
+    Shape shape;
+
+    /**
+     * Latency no operation goes below, in microseconds.
+     */
+    double min_us;
+
+    /**
+     * Mean latency above min_us, in microseconds.
+     */
+    double mean_us;
+
+    /**
+     * Shape parameter of LOGNORMAL; larger means a longer tail.
+     */
+    double sigma;
+  };
+
+  /**
+   * Performance characteristics of a device.
+   */
+  struct Profile {
+    std::string name;
+    Distribution read_latency;
+    Distribution write_latency;
+
+    /**
+     * Extra latency of an operation that doesn't continue the previous one on
+     * the same file, in microseconds.
+     */
+    double seek_us;
+
+    /**
+     * Transfer rates in megabytes (10^6 bytes) per second; 0 means unlimited.
+     */
+    double read_mbps;
+    double write_mbps;
+
+    /**
+     * Most operations in service at once; 0 means unlimited.
+     */
+    std::uint32_t queue_depth;
+
+    /**
+     * A 7200 rpm disk: milliseconds of seek, fast sequential transfer.
+     */
+    static Profile hdd();
+
+    /**
+     * A SATA flash drive.
+     */
+    static Profile sataSsd();
+
+    /**
+     * An NVMe flash drive.
+     */
+    static Profile nvme();
+
+    /**
+     * Returns the preset with the given name ("hdd", "sata-ssd" or "nvme").
+     *
+     * @param name      Name of the preset.
+     * @param profile   Receives the preset.
+     * @return  False if there is no such preset.
+     */
+    static bool byName(const std::string& name, Profile& profile);
+  };
+
+  /**
+   * Random fault rates, each a probability per operation.
+   */
+  struct FaultRates {
+    double read_error;
+    double write_error;
+    double short_write;
+  };
+
+  /**
+   * Counters of the operations a device has served.
+   */
+  struct Stats {
+    std::uint64_t reads;
+    std::uint64_t writes;
+    std::uint64_t bytes_read;
+    std::uint64_t bytes_written;
+    std::uint64_t seeks;
+    std::uint64_t io_errors;
+    std::uint64_t short_writes;
+
+    /**
+     * Operations that had to wait for a queue slot.
+     */
+    std::uint64_t queued;
+
+    /**
+     * Modelled latency of every operation, queueing included, in
+     * nanoseconds.
+     */
+    LatencyHistogram latency;
+  };
+
+  /**
+   * Creates a device with the given profile and no faults.
+   *
+   * @param profile   Performance characteristics.
+   * @param seed      Seed for latency and fault draws.
+   */
+  explicit SimulatedDevice(const Profile& profile,
+                           const std::uint64_t seed = 1);
+
+  /**
+   * Returns the device's profile.
+   */
+  const Profile& profile() const { return profile_; }
+
+  /**
+   * Sets how much real time an operation takes per unit of modelled time;
+   * 0 makes operations return at once.
+   *
+   * @param scale   Real seconds per modelled second.
+   */
+  void setTimeScale(const double scale);
+
+  /**
+   * Sets the probabilities of random faults.
+   *
+   * @param rates   Fault rates; all zero turns random faults off.
+   */
+  void setFaultRates(const FaultRates& rates);
+
+  /**
+   * Makes one operation fail: the one after the next <operations>
+   * operations, or for a short write the first write from then on.  Replaces
+   * any fault injected before that hasn't happened.
+   *
+   * @param operations  Number of operations to let through first.
+   * @param fault       Fault to inject.
+   */
+  void injectFault(const std::uint64_t operations, const Fault fault);
+
+  /**
+   * Charges a read to the device.  Called by File before it reads.
+   *
+   * @param filename      Name of the file being read.
+   * @param page_number   Page being read, for error messages.
+   * @param offset        Byte offset of the read in its stream.
+   * @param bytes         Length of the read.
+   * @throws  IoErrorException  If a fault is injected.
+   */
+  void read(const std::string& filename, const PageId page_number,
+            const std::streamoff offset, const std::size_t bytes);
+
+  /**
+   * Charges a write to the device.  Called by File before it writes; File
+   * writes only as many bytes as this returns and then throws
+   * IoErrorException if that is fewer than it asked for.
+   *
+   * @param filename      Name of the file being written.
+   * @param page_number   Page being written, for error messages.
+   * @param offset        Byte offset of the write in its stream.
+   * @param bytes         Length of the write.
+   * @return  Number of bytes to really write.
+   * @throws  IoErrorException  If an I/O error is injected.
+   */
+  std::size_t write(const std::string& filename, const PageId page_number,
+                    const std::streamoff offset, const std::size_t bytes);
+
+  /**
+   * Returns a copy of the device's counters.
+   */
+  Stats stats() const;
+
+  /**
+   * Returns the sum of the modelled latencies of all operations so far, in
+   * nanoseconds.  With a time scale of 0 this is the time a single caller
+   * would have spent waiting for the device.
+   */
+  std::uint64_t simulatedTime() const;
+
+ private:
+  /**
+   * Size of a sector; short writes end on a sector boundary.
+   */
+  static const std::size_t SECTOR_SIZE = 512;
+
+  /**
+   * Charges one operation, waiting as the model says, and returns the fault
+   * it suffers.
+   */
+  Fault serve(const bool is_write, const std::string& filename,
+              const std::streamoff offset, const std::size_t bytes);
+
+  /**
+   * Draws a latency in nanoseconds.
+   */
+  double drawLatency(const Distribution& distribution);
+
+  /**
+   * Performance characteristics.
+   */
+  const Profile profile_;
+
+  /**
+   * Protects everything below.
+   */
+  mutable std::mutex mutex_;
+
+  /**
+   * Signalled when an operation leaves service.
+   */
+  std::condition_variable slot_free_;
+
+  /**
+   * Source of latency and fault draws.
+   */
+  std::mt19937_64 random_;
+
+  double time_scale_;
+
+  FaultRates fault_rates_;
+
+  /**
+   * Operations left before the injected fault, and the fault.
+   */
+  std::uint64_t fault_countdown_;
+  Fault injected_fault_;
+
+  /**
+   * Operations in service.
+   */
+  std::uint32_t in_flight_;
+
+  /**
+   * Real time at which the device finishes the transfers already accepted.
+   */
+  std::chrono::steady_clock::time_point transfer_free_;
+
+  /**
+   * File and offset where the previous operation ended, for seek detection.
+   */
+  std::string last_filename_;
+  std::streamoff last_end_;
+
+  Stats stats_;
+
+  std::uint64_t simulated_ns_;
+};
+
+}
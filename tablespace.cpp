@@ -0,0 +1,365 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "tablespace.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+#include "change_tracker.h"
+#include "exceptions/bad_tablespace_exception.h"
+#include "exceptions/file_exists_exception.h"
+#include "exceptions/file_not_found_exception.h"
+#include "exceptions/file_open_exception.h"
+#include "exceptions/invalid_page_exception.h"
+#include "free_space_map.h"
+#include "zone_map.h"
+
+namespace badgerdb {
+
+namespace {
+
+/**
+ * Value identifying a tablespace superblock.
+ */
+const std::uint32_t TABLESPACE_MAGIC = 0x54425350;
+
+/**
+ * Size in bytes of one extent.
+ */
+const std::size_t EXTENT_BYTES = Tablespace::EXTENT_PAGES * Page::SIZE;
+
+/**
+ * Extent number that is never allocated.
+ */
+const std::uint32_t NO_EXTENT = 0xffffffff;
+
+void appendWord(std::string& bytes, const std::uint32_t word) {
+  bytes.append(reinterpret_cast<const char*>(&word), sizeof(word));
+}
+
+std::uint32_t takeWord(const std::string& bytes, std::size_t& offset) {
+  std::uint32_t word;
+  std::memcpy(&word, bytes.data() + offset, sizeof(word));
+  offset += sizeof(word);
+  return word;
+}
+
+}
+
+const PageId Tablespace::EXTENT_PAGES;
+
+std::shared_ptr<Tablespace> Tablespace::create(const std::string& path) {
+  return std::shared_ptr<Tablespace>(
+      new Tablespace(path, true /* create_new */));
+}
+
+std::shared_ptr<Tablespace> Tablespace::open(const std::string& path) {
+  return std::shared_ptr<Tablespace>(
+      new Tablespace(path, false /* create_new */));
+}
+
+Tablespace::Tablespace(const std::string& path, const bool create_new)
+    : path_(path),
+      num_extents_(0),
+      catalog_extent_(0),
+      catalog_extents_(0),
+      catalog_bytes_(0),
+      log_extent_(NO_EXTENT),
+      log_bytes_(0) {
+  std::ios_base::openmode mode =
+      std::fstream::in | std::fstream::out | std::fstream::binary;
+  if (create_new) {
+    if (File::exists(path_)) {
+      throw FileExistsException(path_);
+    }
+    mode = mode | std::fstream::trunc;
+  } else if (!File::exists(path_)) {
+    throw FileNotFoundException(path_);
+  }
+  stream_.reset(new std::fstream(path_, mode));
+  if (create_new) {
+    saveCatalog();
+  } else {
+    loadCatalog();
+  }
+}
+
+File Tablespace::createFile(const std::string& name) {
+  if (hasFile(name)) {
+    throw FileExistsException(logicalFilename(name));
+  }
+  // Drop any companion files left behind by an earlier file of this name.
+  removeCompanions(name);
+  files_[name].push_back(allocateExtents(1, NO_EXTENT));
+  saveCatalog();
+  return File(this, name, true /* create_new */);
+}
+
+File Tablespace::openFile(const std::string& name) {
+  if (!hasFile(name)) {
+    throw FileNotFoundException(logicalFilename(name));
+  }
+  return File(this, name, false /* create_new */);
+}
+
+void Tablespace::removeFile(const std::string& name) {
+  std::map<std::string, std::vector<std::uint32_t> >::iterator iter =
+      files_.find(name);
+  const std::string& filename = logicalFilename(name);
+  if (iter == files_.end()) {
+    throw FileNotFoundException(filename);
+  }
+  if (File::open_counts_.find(filename) != File::open_counts_.end()) {
+    throw FileOpenException(filename);
+  }
+  free_extents_.insert(free_extents_.end(), iter->second.begin(),
+                       iter->second.end());
+  std::sort(free_extents_.begin(), free_extents_.end());
+  files_.erase(iter);
+  saveCatalog();
+  removeCompanions(name);
+}
+
+void Tablespace::removeCompanions(const std::string& name) const {
+  const std::string& filename = logicalFilename(name);
+  const std::string companions[] = {FreeSpaceMap::mapFilename(filename),
+                                     ChangeTracker::mapFilename(filename),
+                                     ZoneMap::mapFilename(filename),
+                                     File::fillFactorFilename(filename)};
+  for (std::size_t i = 0; i < sizeof(companions) / sizeof(companions[0]);
+       ++i) {
+    if (File::exists(companions[i])) {
+      std::remove(companions[i].c_str());
+    }
+  }
+}
+
+std::vector<std::string> Tablespace::fileNames() const {
+  std::vector<std::string> names;
+  for (std::map<std::string, std::vector<std::uint32_t> >::const_iterator
+           iter = files_.begin();
+       iter != files_.end(); ++iter) {
+    names.push_back(iter->first);
+  }
+  return names;
+}
+
+std::streampos Tablespace::pagePosition(const std::string& name,
+                                        const PageId page_number,
+                                        const bool for_write) {
+  std::vector<std::uint32_t>& extents = files_[name];
+  const std::size_t index = page_number / EXTENT_PAGES;
+  if (index >= extents.size() && !for_write) {
+    throw InvalidPageException(page_number, logicalFilename(name));
+  }
+  while (extents.size() <= index) {
+    const std::uint32_t extent = allocateExtents(1, extents.back() + 1);
+    extents.push_back(extent);
+    logExtent(name, extent);
+  }
+  return extentPosition(extents[index]) +
+      static_cast<std::streamoff>((page_number % EXTENT_PAGES) * Page::SIZE);
+}
+
+void Tablespace::truncateFile(const std::string& name,
+                              const PageId num_pages) {
+  std::vector<std::uint32_t>& extents = files_[name];
+  const std::size_t keep = (num_pages + EXTENT_PAGES - 1) / EXTENT_PAGES;
+  if (keep >= extents.size()) {
+    return;
+  }
+  free_extents_.insert(free_extents_.end(), extents.begin() + keep,
+                       extents.end());
+  std::sort(free_extents_.begin(), free_extents_.end());
+  extents.resize(keep);
+  saveCatalog();
+}
+
+std::uint32_t Tablespace::allocateExtents(const std::uint32_t count,
+                                          const std::uint32_t preferred) {
+  if (count == 1) {
+    std::vector<std::uint32_t>::iterator iter = std::lower_bound(
+        free_extents_.begin(), free_extents_.end(), preferred);
+    if (iter != free_extents_.end() && *iter == preferred) {
+      free_extents_.erase(iter);
+      return preferred;
+    }
+    if (preferred == num_extents_) {
+      return num_extents_++;
+    }
+  }
+  for (std::size_t i = 0; i + count <= free_extents_.size(); ++i) {
+    if (free_extents_[i + count - 1] == free_extents_[i] + count - 1) {
+      const std::uint32_t first = free_extents_[i];
+      free_extents_.erase(free_extents_.begin() + i,
+                          free_extents_.begin() + i + count);
+      return first;
+    }
+  }
+  const std::uint32_t first = num_extents_;
+  num_extents_ += count;
+  return first;
+}
+
+std::string Tablespace::encodeCatalog(
+    const std::vector<std::uint32_t>& free_extents) const {
+  std::string bytes;
+  appendWord(bytes, files_.size());
+  for (std::map<std::string, std::vector<std::uint32_t> >::const_iterator
+           iter = files_.begin();
+       iter != files_.end(); ++iter) {
+    appendWord(bytes, iter->first.size());
+    bytes.append(iter->first);
+    appendWord(bytes, iter->second.size());
+    for (std::size_t i = 0; i < iter->second.size(); ++i) {
+      appendWord(bytes, iter->second[i]);
+    }
+  }
+  appendWord(bytes, free_extents.size());
+  for (std::size_t i = 0; i < free_extents.size(); ++i) {
+    appendWord(bytes, free_extents[i]);
+  }
+  return bytes;
+}
+
+void Tablespace::saveCatalog() {
+  // The new catalog goes to fresh extents and lists the old catalog's and
+  // log's extents as free, since they are free as soon as the superblock
+  // stops pointing at them.  Taking extents off the free list only shrinks
+  // the catalog, so the size estimate made before allocating is an upper
+  // bound.
+  std::vector<std::uint32_t> old_extents;
+  for (std::uint32_t i = 0; i < catalog_extents_; ++i) {
+    old_extents.push_back(catalog_extent_ + i);
+  }
+  if (log_extent_ != NO_EXTENT) {
+    old_extents.push_back(log_extent_);
+  }
+  const std::size_t estimate =
+      encodeCatalog(free_extents_).size() +
+      old_extents.size() * sizeof(std::uint32_t);
+  const std::uint32_t count = (estimate + EXTENT_BYTES - 1) / EXTENT_BYTES;
+  // No preferred extent, so the catalog fills holes rather than taking the
+  // extent a growing file would want next.
+  const std::uint32_t first = allocateExtents(count, NO_EXTENT);
+  const std::uint32_t log_extent = allocateExtents(1, NO_EXTENT);
+
+  std::vector<std::uint32_t> free_extents(free_extents_);
+  free_extents.insert(free_extents.end(), old_extents.begin(),
+                      old_extents.end());
+  std::sort(free_extents.begin(), free_extents.end());
+  const std::string& bytes = encodeCatalog(free_extents);
+  assert(bytes.size() <= count * EXTENT_BYTES);
+  stream_->seekp(extentPosition(first), std::ios::beg);
+  stream_->write(bytes.data(), bytes.size());
+  stream_->flush();
+
+  free_extents_.swap(free_extents);
+  catalog_extent_ = first;
+  catalog_extents_ = count;
+  catalog_bytes_ = bytes.size();
+  log_extent_ = log_extent;
+  log_bytes_ = 0;
+  writeSuperblock();
+}
+
+void Tablespace::logExtent(const std::string& name,
+                           const std::uint32_t extent) {
+  std::string record;
+  appendWord(record, name.size());
+  record.append(name);
+  appendWord(record, extent);
+  if (log_bytes_ + record.size() > EXTENT_BYTES) {
+    // The new catalog includes the extent, and starts an empty log.
+    saveCatalog();
+    return;
+  }
+  // The record only counts once the superblock's log length covers it.
+  stream_->seekp(extentPosition(log_extent_) +
+                     static_cast<std::streamoff>(log_bytes_),
+                 std::ios::beg);
+  stream_->write(record.data(), record.size());
+  stream_->flush();
+  log_bytes_ += record.size();
+  writeSuperblock();
+}
+
+void Tablespace::writeSuperblock() {
+  const Superblock superblock = {TABLESPACE_MAGIC, num_extents_,
+                                 catalog_extent_, catalog_extents_,
+                                 catalog_bytes_, log_extent_, log_bytes_};
+  stream_->seekp(0 /* pos */, std::ios::beg);
+  stream_->write(reinterpret_cast<const char*>(&superblock),
+                 sizeof(superblock));
+  stream_->flush();
+}
+
+void Tablespace::loadCatalog() {
+  Superblock superblock;
+  stream_->seekg(0 /* pos */, std::ios::beg);
+  stream_->read(reinterpret_cast<char*>(&superblock), sizeof(superblock));
+  if (!*stream_ || superblock.magic != TABLESPACE_MAGIC) {
+    throw BadTablespaceException(path_, "no superblock");
+  }
+  num_extents_ = superblock.num_extents;
+  catalog_extent_ = superblock.catalog_extent;
+  catalog_extents_ = superblock.catalog_extents;
+  catalog_bytes_ = superblock.catalog_bytes;
+  log_extent_ = superblock.log_extent;
+  log_bytes_ = superblock.log_bytes;
+
+  std::string bytes(superblock.catalog_bytes, '\0');
+  stream_->seekg(extentPosition(catalog_extent_), std::ios::beg);
+  stream_->read(&bytes[0], bytes.size());
+  if (!*stream_) {
+    throw BadTablespaceException(path_, "catalog is cut short");
+  }
+  std::size_t offset = 0;
+  const std::uint32_t num_files = takeWord(bytes, offset);
+  for (std::uint32_t file = 0; file < num_files; ++file) {
+    const std::uint32_t name_length = takeWord(bytes, offset);
+    const std::string name(bytes, offset, name_length);
+    offset += name_length;
+    std::vector<std::uint32_t>& extents = files_[name];
+    extents.resize(takeWord(bytes, offset));
+    for (std::size_t i = 0; i < extents.size(); ++i) {
+      extents[i] = takeWord(bytes, offset);
+    }
+  }
+  free_extents_.resize(takeWord(bytes, offset));
+  for (std::size_t i = 0; i < free_extents_.size(); ++i) {
+    free_extents_[i] = takeWord(bytes, offset);
+  }
+
+  // Extents added since the catalog was written.
+  std::string log(log_bytes_, '\0');
+  if (!log.empty()) {
+    stream_->seekg(extentPosition(log_extent_), std::ios::beg);
+    stream_->read(&log[0], log.size());
+    if (!*stream_) {
+      throw BadTablespaceException(path_, "extent log is cut short");
+    }
+  }
+  offset = 0;
+  while (offset < log.size()) {
+    const std::uint32_t name_length = takeWord(log, offset);
+    const std::string name(log, offset, name_length);
+    offset += name_length;
+    const std::uint32_t extent = takeWord(log, offset);
+    files_[name].push_back(extent);
+    const std::vector<std::uint32_t>::iterator iter =
+        std::lower_bound(free_extents_.begin(), free_extents_.end(), extent);
+    if (iter != free_extents_.end() && *iter == extent) {
+      free_extents_.erase(iter);
+    }
+  }
+}
+
+}
@@ -0,0 +1,311 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "file.h"
+#include "page.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Container storing many logical files in one OS file.
+ *
+ * The OS file is divided into Page::SIZE blocks.  Block 0 holds a small
+ * superblock; the rest are handed out in extents of EXTENT_PAGES adjacent
+ * blocks.  Each logical file owns a list of extents, and page p of the file
+ * (page 0 being its FileHeader) is block p % EXTENT_PAGES of its
+ * (p / EXTENT_PAGES)th extent, so a file's pages stay in runs of adjacent
+ * blocks.  The catalog of files and their extents, along with the list of
+ * free extents, is written to freshly allocated extents when files are
+ * created, removed or truncated, and the superblock then switched over to it,
+ * so a crash leaves either the old or the new catalog.  Extents added as
+ * files grow are instead appended to an extent log (one extent written next
+ * to each catalog) and the log's new length recorded in the superblock, so
+ * growth costs one small write plus the superblock; when the log fills up, a
+ * new catalog is written.  Opening the tablespace replays the log over the
+ * catalog.  Reading a page past the extents of a file fails rather than
+ * allocating.
+ *
+ * Logical files are ordinary File objects obtained from createFile() and
+ * openFile(); they work with BufMgr and every other File user.  All of them
+ * share the tablespace's single stream.  A logical file's name, as returned by
+ * File::filename(), is the tablespace path followed by '#' and the file's
+ * name.
+ *
+ * Companion files are not stored in the tablespace: a logical file's
+ * free-space map, change record, zone map and fill factor, if it has them,
+ * are OS files of their own named after the logical file (e.g.
+ * "<path>#<name>.fsm"), written outside the catalog's crash protection.
+ * Copying or moving a tablespace must take them along.  Otherwise the files
+ * lose their fill factor, their maps and their change record until these are
+ * enabled again, and incremental backups copy every page.  Logical files
+ * can't be tiered.
+ *
+ * The Tablespace object must outlive every File obtained from it.
+ *
+ * @warning This class is not threadsafe.
+ */
+class Tablespace {
+ public:
+  /**
+   * Number of blocks per extent.
+   */
+  static const PageId EXTENT_PAGES = 8;
+
+  /**
+   * Creates a new, empty tablespace.
+   *
+   * @param path  Name of the OS file to create.
+   * @return  The tablespace.
+   * @throws  FileExistsException   If the OS file already exists.
+   */
+  static std::shared_ptr<Tablespace> create(const std::string& path);
+
+  /**
+   * Opens an existing tablespace.
+   *
+   * @param path  Name of the OS file.
+   * @return  The tablespace.
+   * @throws  FileNotFoundException   If the OS file doesn't exist.
+   * @throws  BadTablespaceException  If the OS file isn't a tablespace.
+   */
+  static std::shared_ptr<Tablespace> open(const std::string& path);
+
+  /**
+   * Creates a new logical file.
+   *
+   * @param name  Name of the file within the tablespace.
+   * @return  The new file, with only its header page.
+   * @throws  FileExistsException   If a file of that name exists.
+   */
+  File createFile(const std::string& name);
+
+  /**
+   * Opens an existing logical file.
+   *
+   * @param name  Name of the file within the tablespace.
+   * @return  The file.
+   * @throws  FileNotFoundException   If there is no file of that name.
+   */
+  File openFile(const std::string& name);
+
+  /**
+   * Deletes a logical file and frees its extents.
+   *
+   * @param name  Name of the file within the tablespace.
+   * @throws  FileNotFoundException   If there is no file of that name.
+   * @throws  FileOpenException       If the file is open.
+   */
+  void removeFile(const std::string& name);
+
+  /**
+   * Returns true if a logical file of the given name exists.
+   *
+   * @param name  Name of the file within the tablespace.
+   * @return  Whether the file exists.
+   */
+  bool hasFile(const std::string& name) const {
+    return files_.find(name) != files_.end();
+  }
+
+  /**
+   * Returns the names of all logical files, in sorted order.
+   */
+  std::vector<std::string> fileNames() const;
+
+  /**
+   * Returns the number of extents in the OS file, used or not.
+   */
+  std::uint32_t numExtents() const { return num_extents_; }
+
+  /**
+   * Returns the number of extents not in use.
+   */
+  std::uint32_t freeExtents() const { return free_extents_.size(); }
+
+  /**
+   * Returns the name of the OS file.
+   */
+  const std::string& path() const { return path_; }
+
+ private:
+  /**
+   * Superblock layout, stored at the start of block 0.
+   */
+  struct Superblock {
+    std::uint32_t magic;
+    std::uint32_t num_extents;
+    std::uint32_t catalog_extent;
+    std::uint32_t catalog_extents;
+    std::uint32_t catalog_bytes;
+    std::uint32_t log_extent;
+    std::uint32_t log_bytes;
+  };
+
+  /**
+   * Opens or creates the tablespace.  Use create() or open().
+   *
+   * @param path        Name of the OS file.
+   * @param create_new  Whether to create a new tablespace.
+   * @throws  FileExistsException     If create_new is set and the OS file
+   *                                  exists.
+   * @throws  FileNotFoundException   If create_new is not set and the OS file
+   *                                  doesn't exist.
+   * @throws  BadTablespaceException  If the OS file isn't a tablespace.
+   */
+  Tablespace(const std::string& path, const bool create_new);
+
+  /**
+   * Returns the File name of a logical file.
+   *
+   * @param name  Name of the file within the tablespace.
+   * @return  Name used by File for the logical file.
+   */
+  std::string logicalFilename(const std::string& name) const {
+    return path_ + "#" + name;
+  }
+
+  /**
+   * Deletes the companion files (free-space map, change record) of a logical
+   * file, if there are any.
+   *
+   * @param name  Name of the file within the tablespace.
+   */
+  void removeCompanions(const std::string& name) const;
+
+  /**
+   * Returns the position in the OS file of a page of a logical file,
+   * allocating extents up to the one holding the page if it is about to be
+   * written.
+   *
+   * @param name          Name of the file within the tablespace.
+   * @param page_number   Page of the file; 0 is its header.
+   * @param for_write     Whether the page is about to be written.
+   * @return  Byte offset of the page in the OS file.
+   * @throws  InvalidPageException  If the page is past the file's extents and
+   *                                <for_write> isn't set.
+   */
+  std::streampos pagePosition(const std::string& name,
+                              const PageId page_number, const bool for_write);
+
+  /**
+   * Frees the extents of a logical file beyond its first <num_pages> pages.
+   *
+   * @param name        Name of the file within the tablespace.
+   * @param num_pages   Number of pages the file keeps, including its header.
+   */
+  void truncateFile(const std::string& name, const PageId num_pages);
+
+  /**
+   * Returns a free run of <count> adjacent extents, growing the OS file if
+   * there is none.  A single extent is taken at <preferred> if that one is
+   * free or is the next one past the end of the OS file, so that files grow
+   * into adjacent blocks where possible.
+   *
+   * @param count       Number of extents needed.
+   * @param preferred   Extent to use if free and <count> is 1.
+   * @return  Number of the first extent.
+   */
+  std::uint32_t allocateExtents(const std::uint32_t count,
+                                const std::uint32_t preferred);
+
+  /**
+   * Returns the catalog serialized with the given free extent list.
+   *
+   * @param free_extents  Free extents to record.
+   * @return  Catalog bytes.
+   */
+  std::string encodeCatalog(const std::vector<std::uint32_t>& free_extents)
+      const;
+
+  /**
+   * Writes the catalog and an empty extent log to new extents and points the
+   * superblock at them.
+   */
+  void saveCatalog();
+
+  /**
+   * Records an extent added to the end of a logical file, in the extent log
+   * if it has room and by saving the catalog otherwise.
+   *
+   * @param name    Name of the file within the tablespace.
+   * @param extent  Extent added.
+   */
+  void logExtent(const std::string& name, const std::uint32_t extent);
+
+  /**
+   * Writes the superblock for the current catalog and extent log.
+   */
+  void writeSuperblock();
+
+  /**
+   * Reads the catalog the superblock points at and replays the extent log.
+   */
+  void loadCatalog();
+
+  /**
+   * Returns the byte offset of the first block of an extent.
+   */
+  static std::streampos extentPosition(const std::uint32_t extent) {
+    return static_cast<std::streamoff>(1 + extent * EXTENT_PAGES) * Page::SIZE;
+  }
+
+  /**
+   * Name of the OS file.
+   */
+  std::string path_;
+
+  /**
+   * Stream of the OS file, shared with every logical File.
+   */
+  std::shared_ptr<std::fstream> stream_;
+
+  /**
+   * Extents of each logical file, in page order.
+   */
+  std::map<std::string, std::vector<std::uint32_t> > files_;
+
+  /**
+   * Extents not in use, in ascending order.
+   */
+  std::vector<std::uint32_t> free_extents_;
+
+  /**
+   * Number of extents in the OS file.
+   */
+  std::uint32_t num_extents_;
+
+  /**
+   * Extents holding the current catalog.
+   */
+  std::uint32_t catalog_extent_;
+  std::uint32_t catalog_extents_;
+
+  /**
+   * Size in bytes of the current catalog.
+   */
+  std::uint32_t catalog_bytes_;
+
+  /**
+   * Extent holding the extent log, and the number of bytes in use in it.
+   */
+  std::uint32_t log_extent_;
+  std::uint32_t log_bytes_;
+
+  friend class File;
+};
+
+}
@@ -0,0 +1,310 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "tiered_store.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "exceptions/file_not_found_exception.h"
+#include "exceptions/io_error_exception.h"
+#include "file.h"
+
+namespace badgerdb {
+
+void TieredStore::removeFiles(const std::string& data_filename) {
+  if (!File::exists(mapFilename(data_filename))) {
+    return;
+  }
+  // Only the map's header is read, so a slow-tier file that is already gone
+  // doesn't stop the map from being removed.
+  std::ifstream map_stream(mapFilename(data_filename), std::ios::binary);
+  std::uint32_t length = 0;
+  map_stream.read(reinterpret_cast<char*>(&length), sizeof(length));
+  std::string cold_directory(map_stream ? length : 0, '\0');
+  if (!cold_directory.empty()) {
+    map_stream.read(&cold_directory[0], length);
+  }
+  map_stream.close();
+  if (!cold_directory.empty()) {
+    std::remove(coldFilename(data_filename, cold_directory).c_str());
+  }
+  std::remove(mapFilename(data_filename).c_str());
+}
+
+TieredStore::TieredStore(const std::string& data_filename,
+                         const std::string& cold_directory)
+    : data_filename_(data_filename),
+      cold_directory_(cold_directory),
+      num_slots_(0),
+      demote_cursor_(1) {
+  const std::string& cold_filename =
+      coldFilename(data_filename_, cold_directory_);
+  cold_stream_.reset(new std::fstream(
+      cold_filename, std::fstream::in | std::fstream::out |
+                         std::fstream::binary | std::fstream::trunc));
+  if (!*cold_stream_) {
+    throw FileNotFoundException(cold_filename);
+  }
+  save();
+}
+
+TieredStore::TieredStore(const std::string& data_filename)
+    : data_filename_(data_filename),
+      num_slots_(0),
+      demote_cursor_(1) {
+  std::ifstream map_stream(mapFilename(data_filename_), std::ios::binary);
+  if (!map_stream) {
+    throw FileNotFoundException(mapFilename(data_filename_));
+  }
+  std::uint32_t length = 0;
+  map_stream.read(reinterpret_cast<char*>(&length), sizeof(length));
+  cold_directory_.resize(length);
+  if (length > 0) {
+    map_stream.read(&cold_directory_[0], length);
+  }
+  std::uint32_t count = 0;
+  map_stream.read(reinterpret_cast<char*>(&num_slots_), sizeof(num_slots_));
+  map_stream.read(reinterpret_cast<char*>(&count), sizeof(count));
+  std::vector<bool> slot_used(num_slots_, false);
+  for (std::uint32_t i = 0; i < count; ++i) {
+    PageId page_number;
+    std::uint32_t slot;
+    map_stream.read(reinterpret_cast<char*>(&page_number), sizeof(page_number));
+    map_stream.read(reinterpret_cast<char*>(&slot), sizeof(slot));
+    cold_slots_[page_number] = slot;
+    slot_used[slot] = true;
+  }
+  for (std::uint32_t slot = num_slots_; slot > 0; --slot) {
+    if (!slot_used[slot - 1]) {
+      free_slots_.push_back(slot - 1);
+    }
+  }
+
+  const std::string& cold_filename =
+      coldFilename(data_filename_, cold_directory_);
+  cold_stream_.reset(new std::fstream(
+      cold_filename,
+      std::fstream::in | std::fstream::out | std::fstream::binary));
+  if (!*cold_stream_) {
+    throw FileNotFoundException(cold_filename);
+  }
+}
+
+std::streampos TieredStore::coldPosition(const PageId page_number) const {
+  const std::map<PageId, std::uint32_t>::const_iterator iter =
+      cold_slots_.find(page_number);
+  return static_cast<std::streamoff>(iter->second) * Page::SIZE;
+}
+
+void TieredStore::recordAccess(const PageId page_number) {
+  if (page_number >= access_counts_.size()) {
+    access_counts_.resize(page_number + 1, 0);
+  }
+  std::uint8_t& count = access_counts_[page_number];
+  if (count < UINT8_MAX) {
+    ++count;
+  }
+}
+
+void TieredStore::release(const PageId page_number) {
+  if (isCold(page_number)) {
+    released_.insert(page_number);
+  }
+}
+
+std::uint32_t TieredStore::migrate(File* file,
+                                   const std::uint32_t max_pages) {
+  std::fstream& hot_stream = *file->stream_;
+  const PageId num_pages = file->readHeader().num_pages;
+  std::uint32_t moved = 0;
+  bool changed = false;
+  std::vector<std::uint32_t> given_up_slots;
+
+  // Move released pages back, whatever their access counts.  Pages dropped
+  // off the end of the file since have nothing to copy.
+  std::uint32_t released = 0;
+  for (std::set<PageId>::const_iterator page_iter = released_.begin();
+       page_iter != released_.end(); ++page_iter) {
+    const std::map<PageId, std::uint32_t>::iterator iter =
+        cold_slots_.find(*page_iter);
+    if (iter == cold_slots_.end()) {
+      continue;
+    }
+    if (*page_iter < num_pages) {
+      copyPage(*cold_stream_, coldPosition(*page_iter), hot_stream,
+               File::pagePosition(*page_iter));
+    }
+    given_up_slots.push_back(iter->second);
+    cold_slots_.erase(iter);
+    ++released;
+    changed = true;
+  }
+  released_.clear();
+
+  // Promote cold pages that have become hot again.
+  for (std::map<PageId, std::uint32_t>::iterator iter = cold_slots_.begin();
+       iter != cold_slots_.end() && moved < max_pages;) {
+    const PageId page_number = iter->first;
+    if (page_number >= access_counts_.size() ||
+        access_counts_[page_number] < PROMOTE_THRESHOLD) {
+      ++iter;
+      continue;
+    }
+    copyPage(*cold_stream_, coldPosition(page_number), hot_stream,
+             File::pagePosition(page_number));
+    given_up_slots.push_back(iter->second);
+    cold_slots_.erase(iter++);
+    ++moved;
+    changed = true;
+  }
+
+  // Demote used pages that haven't been touched since the last migration,
+  // continuing the search where the previous call stopped.
+  std::vector<PageId> demoted;
+  for (PageId scanned = 1; scanned < num_pages && moved < max_pages;
+       ++scanned) {
+    if (demote_cursor_ >= num_pages) {
+      demote_cursor_ = 1;
+    }
+    const PageId page_number = demote_cursor_++;
+    if (isCold(page_number) ||
+        (page_number < access_counts_.size() &&
+         access_counts_[page_number] > 0) ||
+        file->readPageHeader(page_number).current_page_number ==
+            Page::INVALID_NUMBER) {
+      continue;
+    }
+    std::uint32_t slot;
+    if (free_slots_.empty()) {
+      slot = num_slots_++;
+    } else {
+      slot = free_slots_.back();
+      free_slots_.pop_back();
+    }
+    cold_slots_[page_number] = slot;
+    copyPage(hot_stream, File::pagePosition(page_number), *cold_stream_,
+             coldPosition(page_number));
+    demoted.push_back(page_number);
+    ++moved;
+    changed = true;
+  }
+
+  if (changed) {
+    // Copies are on disk before the map points at them, and the fast-tier
+    // space is only given back once the saved map no longer does.
+    hot_stream.flush();
+    cold_stream_->flush();
+    syncFile(data_filename_);
+    syncFile(coldFilename(data_filename_, cold_directory_));
+    save();
+    free_slots_.insert(free_slots_.end(), given_up_slots.begin(),
+                       given_up_slots.end());
+  }
+#ifdef FALLOC_FL_PUNCH_HOLE
+  if (!demoted.empty()) {
+    // Pages don't start on file system block boundaries, so adjacent pages
+    // are given back as one range to free as many whole blocks as possible.
+    // Failure just leaves the old copies taking space in the fast tier.
+    std::sort(demoted.begin(), demoted.end());
+    const int fd = ::open(data_filename_.c_str(), O_WRONLY);
+    if (fd >= 0) {
+      std::size_t run_start = 0;
+      for (std::size_t i = 1; i <= demoted.size(); ++i) {
+        if (i < demoted.size() && demoted[i] == demoted[i - 1] + 1) {
+          continue;
+        }
+        ::fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                    File::pagePosition(demoted[run_start]),
+                    (i - run_start) * Page::SIZE);
+        run_start = i;
+      }
+      ::close(fd);
+    }
+  }
+#endif
+
+  for (std::size_t i = 0; i < access_counts_.size(); ++i) {
+    access_counts_[i] /= 2;
+  }
+  return moved + released;
+}
+
+std::string TieredStore::coldFilename(const std::string& data_filename,
+                                      const std::string& cold_directory) {
+  const std::string::size_type slash = data_filename.rfind('/');
+  const std::string& base_name = slash == std::string::npos
+      ? data_filename : data_filename.substr(slash + 1);
+  return cold_directory + "/" + base_name + ".cold";
+}
+
+void TieredStore::copyPage(std::fstream& from,
+                           const std::streampos from_position,
+                           std::fstream& to,
+                           const std::streampos to_position) {
+  std::vector<char> buffer(Page::SIZE);
+  from.seekg(from_position, std::ios::beg);
+  from.read(&buffer[0], buffer.size());
+  to.seekp(to_position, std::ios::beg);
+  to.write(&buffer[0], buffer.size());
+}
+
+void TieredStore::syncFile(const std::string& filename) {
+  const int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0 || ::fsync(fd) != 0) {
+    if (fd >= 0) {
+      ::close(fd);
+    }
+    throw IoErrorException(filename, 0 /* page_number */, "fsync");
+  }
+  ::close(fd);
+}
+
+void TieredStore::save() const {
+  std::string image;
+  const std::uint32_t length = cold_directory_.size();
+  image.append(reinterpret_cast<const char*>(&length), sizeof(length));
+  image.append(cold_directory_);
+  const std::uint32_t count = cold_slots_.size();
+  image.append(reinterpret_cast<const char*>(&num_slots_), sizeof(num_slots_));
+  image.append(reinterpret_cast<const char*>(&count), sizeof(count));
+  for (std::map<PageId, std::uint32_t>::const_iterator iter =
+           cold_slots_.begin();
+       iter != cold_slots_.end(); ++iter) {
+    image.append(reinterpret_cast<const char*>(&iter->first),
+                 sizeof(iter->first));
+    image.append(reinterpret_cast<const char*>(&iter->second),
+                 sizeof(iter->second));
+  }
+
+  // Written aside, synced and renamed over the old map, so a crash leaves
+  // either the old map or the new one, never a partial one.
+  const std::string& map_filename = mapFilename(data_filename_);
+  const std::string& temp_filename = map_filename + ".tmp";
+  const int fd = ::open(temp_filename.c_str(),
+                        O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    throw IoErrorException(temp_filename, 0 /* page_number */, "open");
+  }
+  const bool written =
+      ::write(fd, image.data(), image.size()) ==
+          static_cast<ssize_t>(image.size()) &&
+      ::fsync(fd) == 0;
+  ::close(fd);
+  if (!written) {
+    std::remove(temp_filename.c_str());
+    throw IoErrorException(temp_filename, 0 /* page_number */, "write");
+  }
+  if (std::rename(temp_filename.c_str(), map_filename.c_str()) != 0) {
+    std::remove(temp_filename.c_str());
+    throw IoErrorException(map_filename, 0 /* page_number */, "rename");
+  }
+}
+
+}
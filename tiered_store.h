@@ -0,0 +1,248 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "page.h"
+#include "types.h"
+
+namespace badgerdb {
+
+class File;
+
+/**
+ * @brief Second storage tier for the pages of a data file.
+ *
+ * A tiered file keeps its hot pages in the data file as usual (the fast
+ * tier) and moves cold pages into a companion file in another directory (the
+ * slow tier), named after the data file with a ".cold" suffix.  Page numbers
+ * don't change when a page moves; File looks every page up in this store's
+ * location map before reading or writing it, so callers never see the move.
+ * A page's slot in the data file is deallocated while it is cold (where the
+ * file system supports it), so the fast tier only holds hot pages.
+ *
+ * Which pages are hot is decided from access counts that BufMgr reports
+ * through File::recordAccess().  Nothing moves until migrate() is called,
+ * which is meant to run in the background when the system is idle.
+ *
+ * The location map is saved to another companion file next to the data file
+ * (named with a ".tier" suffix) once per migration, and loaded whenever the
+ * data file is opened.  Access counts are kept in memory only.
+ *
+ * @warning This class is not threadsafe.
+ */
+class TieredStore {
+ public:
+  /**
+   * Accesses since the last migration at which a cold page is moved back to
+   * the fast tier.
+   */
+  static const std::uint8_t PROMOTE_THRESHOLD = 2;
+
+  /**
+   * Returns the name of the companion file holding the location map.
+   *
+   * @param data_filename   Name of the data file.
+   * @return  Name of the location map file.
+   */
+  static std::string mapFilename(const std::string& data_filename) {
+    return data_filename + ".tier";
+  }
+
+  /**
+   * Deletes the location map and slow-tier file of a data file, if any.  A
+   * missing slow-tier file counts as already deleted.
+   *
+   * @param data_filename   Name of the data file.
+   */
+  static void removeFiles(const std::string& data_filename);
+
+  /**
+   * Creates an empty slow tier for a data file in the given directory.
+   *
+   * @param data_filename   Name of the data file.
+   * @param cold_directory  Directory to hold the slow-tier file.
+   * @throws  FileNotFoundException   If the slow-tier file can't be created.
+   * @throws  IoErrorException        If the location map can't be saved.
+   */
+  TieredStore(const std::string& data_filename,
+              const std::string& cold_directory);
+
+  /**
+   * Loads the slow tier of a data file from its location map.
+   *
+   * @param data_filename   Name of the data file.
+   * @throws  FileNotFoundException   If the map or slow-tier file is missing.
+   */
+  explicit TieredStore(const std::string& data_filename);
+
+  /**
+   * Returns true if the given page lives in the slow tier.
+   *
+   * @param page_number   Number of the page.
+   * @return  Whether the page is cold.
+   */
+  bool isCold(const PageId page_number) const {
+    return cold_slots_.find(page_number) != cold_slots_.end();
+  }
+
+  /**
+   * Returns the position of a cold page in the slow-tier file.  The page must
+   * be cold.
+   *
+   * @param page_number   Number of the page.
+   * @return  Offset of the page in coldStream().
+   */
+  std::streampos coldPosition(const PageId page_number) const;
+
+  /**
+   * Returns the stream of the slow-tier file.
+   */
+  std::fstream& coldStream() const { return *cold_stream_; }
+
+  /**
+   * Counts an access to a page.
+   *
+   * @param page_number   Number of the page accessed.
+   */
+  void recordAccess(const PageId page_number);
+
+  /**
+   * Marks a page that is being freed as due to go back to the fast tier.  The
+   * page stays in the slow tier, where the freed page is then written, until
+   * the next migrate() moves it and saves the location map once for all pages
+   * released since, so deleting many pages doesn't rewrite the map for each.
+   * If the file is closed first, the page simply stays cold.
+   *
+   * @param page_number   Number of the page.
+   */
+  void release(const PageId page_number);
+
+  /**
+   * Moves pages between tiers: pages released since the last call go back to
+   * the fast tier, then up to <max_pages> more pages move: cold pages accessed
+   * at least PROMOTE_THRESHOLD times since the last call go back to the fast
+   * tier, then used pages not accessed since the last call go to the slow
+   * tier.  Access counts are halved afterwards so that old accesses fade.
+   *
+   * @param file        The data file.
+   * @param max_pages   Maximum number of pages to move, not counting
+   *                    released pages.
+   * @return  Number of pages moved, released pages included.
+   * @throws  IoErrorException  If the moved pages can't be synced or the
+   *                            location map can't be saved.
+   */
+  std::uint32_t migrate(File* file, const std::uint32_t max_pages);
+
+  /**
+   * Returns the number of pages in the slow tier.
+   */
+  PageId coldPages() const { return cold_slots_.size(); }
+
+  /**
+   * Returns the directory holding the slow-tier file.
+   */
+  const std::string& coldDirectory() const { return cold_directory_; }
+
+ private:
+  /**
+   * Returns the name of the slow-tier file for a data file.
+   *
+   * @param data_filename   Name of the data file.
+   * @param cold_directory  Directory holding the slow-tier file.
+   * @return  Name of the slow-tier file.
+   */
+  static std::string coldFilename(const std::string& data_filename,
+                                  const std::string& cold_directory);
+
+  /**
+   * Copies Page::SIZE bytes from one position to another.
+   *
+   * @param from            Stream to copy from.
+   * @param from_position   Position to copy from.
+   * @param to              Stream to copy to.
+   * @param to_position     Position to copy to.
+   */
+  static void copyPage(std::fstream& from, const std::streampos from_position,
+                       std::fstream& to, const std::streampos to_position);
+
+  /**
+   * Forces a file's written data to disk.
+   *
+   * @param filename  Name of the file.
+   * @throws  IoErrorException  If the file can't be synced.
+   */
+  static void syncFile(const std::string& filename);
+
+  /**
+   * Writes the location map to its companion file, replacing the old map
+   * atomically.
+   *
+   * @throws  IoErrorException  If the new map can't be written or renamed
+   *                            into place.
+   */
+  void save() const;
+
+  /**
+   * Name of the data file.
+   */
+  std::string data_filename_;
+
+  /**
+   * Directory holding the slow-tier file.
+   */
+  std::string cold_directory_;
+
+  /**
+   * Stream of the slow-tier file.
+   */
+  std::shared_ptr<std::fstream> cold_stream_;
+
+  /**
+   * Slot in the slow-tier file of every cold page.
+   */
+  std::map<PageId, std::uint32_t> cold_slots_;
+
+  /**
+   * Slots in the slow-tier file not holding a page.  A slot is only added
+   * once the saved map no longer points at it, so that a crash can't leave
+   * the map pointing at another page's data.
+   */
+  std::vector<std::uint32_t> free_slots_;
+
+  /**
+   * Cold pages freed since the last migration.
+   */
+  std::set<PageId> released_;
+
+  /**
+   * Number of slots in the slow-tier file.
+   */
+  std::uint32_t num_slots_;
+
+  /**
+   * Saturating access counts, indexed by page number.
+   */
+  std::vector<std::uint8_t> access_counts_;
+
+  /**
+   * Page number at which the next search for pages to demote starts.
+   */
+  PageId demote_cursor_;
+
+  friend class FileAnalyzer;
+};
+
+}
@@ -0,0 +1,39 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <cstdlib>
+#include <iostream>
+
+#include "file_analyzer.h"
+#include "exceptions/badgerdb_exception.h"
+
+using namespace badgerdb;
+
+/**
+ * Prints the space usage report of a data file.
+ *
+ * Usage: analyzer <file> [threads]
+ *
+ * Built from the top directory together with every source file there except
+ * main.cpp, e.g. with "-I." so the includes below resolve.
+ */
+int main(int argc, char* argv[]) {
+  if (argc < 2 || argc > 3) {
+    std::cerr << "Usage: " << argv[0] << " <file> [threads]\n";
+    return 2;
+  }
+  const std::uint32_t num_threads = argc == 3 ? std::atoi(argv[2]) : 0;
+  try {
+    const FileReport& report = FileAnalyzer(argv[1], num_threads).analyze();
+    std::cout << argv[1] << "\n";
+    report.print(std::cout);
+  } catch (const BadgerDbException& e) {
+    std::cerr << e.message() << "\n";
+    return 1;
+  }
+  return 0;
+}
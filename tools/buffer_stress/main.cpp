@@ -0,0 +1,699 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "buffer.h"
+#include "exceptions/badgerdb_exception.h"
+#include "exceptions/page_pinned_exception.h"
+#include "file.h"
+#include "io_scheduler.h"
+
+using namespace badgerdb;
+
+namespace {
+
+/**
+ * Kinds of operation the worker threads mix.
+ */
+enum Operation {
+  READ,
+  UPDATE,
+  ALLOC,
+  DISPOSE,
+  FLUSH,
+  NUM_OPERATIONS
+};
+
+const char* const OPERATION_NAMES[NUM_OPERATIONS] = {
+    "read", "update", "alloc", "dispose", "flush"};
+
+/**
+ * Stress settings from the command line.
+ */
+struct Options {
+  std::uint32_t threads;
+  double seconds;
+  std::uint32_t pool_frames;
+  std::uint32_t slots;
+  std::uint32_t files;
+  std::uint32_t checkpoint_ms;
+  bool pool_lock;
+  bool io_scheduler;
+  std::string filename;
+  std::uint64_t seed;
+};
+
+/**
+ * The buffer manager behind an optional lock.  BufMgr is not threadsafe, so
+ * the harness serializes calls into it by default; running with the lock off
+ * lets the invariant checks and ThreadSanitizer show what goes wrong.
+ */
+class Pool {
+ public:
+  Pool(const std::uint32_t frames, const bool locked, const bool scheduled)
+      : buf_mgr_(frames), locked_(locked) {
+    if (scheduled) {
+      scheduler_.reset(new IoScheduler);
+      buf_mgr_.setIoScheduler(scheduler_.get());
+    }
+  }
+
+  void readPage(File* file, const PageId page_number, Page*& page) {
+    std::unique_lock<std::mutex> lock(mutex_, std::defer_lock);
+    if (locked_) lock.lock();
+    buf_mgr_.readPage(file, page_number, page);
+  }
+
+  void allocPage(File* file, PageId& page_number, Page*& page) {
+    std::unique_lock<std::mutex> lock(mutex_, std::defer_lock);
+    if (locked_) lock.lock();
+    buf_mgr_.allocPage(file, page_number, page);
+  }
+
+  void unPinPage(File* file, const PageId page_number, const bool dirty) {
+    std::unique_lock<std::mutex> lock(mutex_, std::defer_lock);
+    if (locked_) lock.lock();
+    buf_mgr_.unPinPage(file, page_number, dirty);
+  }
+
+  void disposePage(File* file, const PageId page_number) {
+    std::unique_lock<std::mutex> lock(mutex_, std::defer_lock);
+    if (locked_) lock.lock();
+    buf_mgr_.disposePage(file, page_number);
+  }
+
+  void flushFile(const File* file) {
+    std::unique_lock<std::mutex> lock(mutex_, std::defer_lock);
+    if (locked_) lock.lock();
+    buf_mgr_.flushFile(file);
+  }
+
+  /**
+   * Only called while every worker is paused.
+   */
+  void checkConsistency(const bool expect_unpinned) {
+    buf_mgr_.checkConsistency(expect_unpinned);
+  }
+
+ private:
+  BufMgr buf_mgr_;
+  std::mutex mutex_;
+  const bool locked_;
+  std::unique_ptr<IoScheduler> scheduler_;
+};
+
+/**
+ * One logical register of the test: at most one live page holding a single
+ * record "<slot> <incarnation> <version>".  The latch plays the part of the
+ * page latch a real caller holds while it reads or changes a pinned page.
+ */
+struct Slot {
+  std::mutex latch;
+  File* file;
+  RecordId record_id;          // page_number is INVALID_NUMBER when empty.
+  std::uint64_t incarnation;   // Unique per page allocated for the slot.
+  std::uint64_t version;       // Last version written, per the model.
+};
+
+/**
+ * One completed operation on a slot, timed with the shared logical clock.
+ */
+struct Event {
+  std::uint64_t invoke;
+  std::uint64_t respond;
+  std::uint64_t incarnation;
+  std::uint64_t version;
+  bool write;
+};
+
+/**
+ * Per-thread results.
+ */
+struct ThreadResult {
+  std::uint64_t operations[NUM_OPERATIONS];
+  std::uint64_t flushes_skipped;
+  std::vector<Event> history;
+  std::string error;
+};
+
+/**
+ * State shared by the workers and the checkpointing main thread.
+ */
+class Harness {
+ public:
+  Harness(const Options& options, std::vector<File>& files)
+      : files_(files),
+        pool_(options.pool_frames, options.pool_lock, options.io_scheduler),
+        slots_(options.slots),
+        clock_(0),
+        next_incarnation_(1),
+        stop_(false),
+        pause_requested_(false),
+        paused_(0),
+        running_(0),
+        violations_(0) {
+    for (std::size_t s = 0; s < slots_.size(); ++s) {
+      slots_[s].file = &files_[s % files_.size()];
+      slots_[s].record_id.page_number = Page::INVALID_NUMBER;
+      slots_[s].record_id.slot_number = Page::INVALID_SLOT;
+      slots_[s].incarnation = 0;
+      slots_[s].version = 0;
+    }
+  }
+
+  /**
+   * Runs random operations until told to stop.
+   */
+  void work(const std::uint64_t seed, ThreadResult* result) {
+    {
+      std::lock_guard<std::mutex> lock(pause_mutex_);
+      ++running_;
+    }
+    std::mt19937_64 random(seed);
+    std::fill(result->operations, result->operations + NUM_OPERATIONS, 0);
+    result->flushes_skipped = 0;
+    try {
+      while (!stop_.load()) {
+        if (pause_requested_.load()) {
+          waitWhilePaused();
+          continue;
+        }
+        const std::uint32_t dice = random() % 100;
+        Slot& slot = slots_[random() % slots_.size()];
+        const std::size_t index = &slot - &slots_[0];
+        Operation operation;
+        if (dice < 2) {
+          operation = FLUSH;
+        } else {
+          std::lock_guard<std::mutex> latch(slot.latch);
+          if (slot.record_id.page_number == Page::INVALID_NUMBER) {
+            operation = ALLOC;
+            alloc(index, slot, result);
+          } else if (dice < 10) {
+            operation = DISPOSE;
+            pool_.disposePage(slot.file, slot.record_id.page_number);
+            slot.record_id.page_number = Page::INVALID_NUMBER;
+          } else if (dice < 40) {
+            operation = UPDATE;
+            update(index, slot, result);
+          } else {
+            operation = READ;
+            read(index, slot, result);
+          }
+        }
+        if (operation == FLUSH) {
+          try {
+            pool_.flushFile(&files_[random() % files_.size()]);
+          } catch (const PagePinnedException&) {
+            // Another thread is using a page of the file; that's expected.
+            ++result->flushes_skipped;
+          }
+        }
+        ++result->operations[operation];
+      }
+    } catch (const BadgerDbException& e) {
+      result->error = e.message();
+      stop_ = true;
+    } catch (const std::exception& e) {
+      result->error = e.what();
+      stop_ = true;
+    }
+    std::lock_guard<std::mutex> lock(pause_mutex_);
+    --running_;
+    pause_cv_.notify_all();
+  }
+
+  /**
+   * Pauses the workers between operations, checks the pool's invariants,
+   * reads every live slot through the pool, then flushes and reads every live
+   * slot straight from its file.
+   */
+  void checkpoint() {
+    std::unique_lock<std::mutex> lock(pause_mutex_);
+    pause_requested_ = true;
+    pause_cv_.wait(lock, [this] { return paused_ == running_; });
+    try {
+      pool_.checkConsistency(true);
+      verifyAll(false);
+      for (std::size_t f = 0; f < files_.size(); ++f) {
+        pool_.flushFile(&files_[f]);
+      }
+      pool_.checkConsistency(true);
+      verifyAll(true);
+    } catch (const BadgerDbException& e) {
+      violation("checkpoint: " + e.message());
+    }
+    pause_requested_ = false;
+    pause_cv_.notify_all();
+  }
+
+  void stop() {
+    stop_ = true;
+    std::lock_guard<std::mutex> lock(pause_mutex_);
+    pause_requested_ = false;
+    pause_cv_.notify_all();
+  }
+
+  /**
+   * Records a failed check, keeping the first few messages.
+   */
+  void violation(const std::string& message) {
+    std::lock_guard<std::mutex> lock(violation_mutex_);
+    if (violations_ < 10) {
+      messages_.push_back(message);
+    }
+    ++violations_;
+  }
+
+  std::uint64_t violations() const { return violations_; }
+
+  const std::vector<std::string>& messages() const { return messages_; }
+
+ private:
+  std::uint64_t tick() { return clock_.fetch_add(1) + 1; }
+
+  static std::string makeRecord(const std::size_t index,
+                                const std::uint64_t incarnation,
+                                const std::uint64_t version) {
+    char record[64];
+    std::snprintf(record, sizeof(record), "%08zu %012llu %012llu", index,
+                  static_cast<unsigned long long>(incarnation),
+                  static_cast<unsigned long long>(version));
+    return record;
+  }
+
+  /**
+   * Checks a record read back for a slot and returns its version.
+   */
+  std::uint64_t checkRecord(const std::size_t index, const Slot& slot,
+                            const std::string& record) {
+    std::size_t read_index = 0;
+    unsigned long long incarnation = 0;
+    unsigned long long version = 0;
+    if (std::sscanf(record.c_str(), "%zu %llu %llu", &read_index,
+                    &incarnation, &version) != 3 ||
+        read_index != index || incarnation != slot.incarnation) {
+      std::ostringstream message;
+      message << "slot " << index << " (page " << slot.record_id.page_number
+              << ", incarnation " << slot.incarnation << ") holds \""
+              << record << "\"";
+      violation(message.str());
+    }
+    return version;
+  }
+
+  void alloc(const std::size_t index, Slot& slot, ThreadResult* result) {
+    Event event;
+    event.invoke = tick();
+    event.write = true;
+    event.incarnation = next_incarnation_.fetch_add(1);
+    event.version = 1;
+    PageId page_number;
+    Page* page;
+    pool_.allocPage(slot.file, page_number, page);
+    slot.record_id = page->insertRecord(
+        makeRecord(index, event.incarnation, event.version));
+    pool_.unPinPage(slot.file, page_number, true);
+    slot.incarnation = event.incarnation;
+    slot.version = event.version;
+    event.respond = tick();
+    result->history.push_back(event);
+  }
+
+  void update(const std::size_t index, Slot& slot, ThreadResult* result) {
+    Event event;
+    event.invoke = tick();
+    event.write = true;
+    event.incarnation = slot.incarnation;
+    Page* page;
+    pool_.readPage(slot.file, slot.record_id.page_number, page);
+    event.version =
+        checkRecord(index, slot, page->getRecord(slot.record_id)) + 1;
+    page->updateRecord(slot.record_id,
+                       makeRecord(index, event.incarnation, event.version));
+    pool_.unPinPage(slot.file, slot.record_id.page_number, true);
+    slot.version = event.version;
+    event.respond = tick();
+    result->history.push_back(event);
+  }
+
+  void read(const std::size_t index, Slot& slot, ThreadResult* result) {
+    Event event;
+    event.invoke = tick();
+    event.write = false;
+    event.incarnation = slot.incarnation;
+    Page* page;
+    pool_.readPage(slot.file, slot.record_id.page_number, page);
+    event.version = checkRecord(index, slot, page->getRecord(slot.record_id));
+    pool_.unPinPage(slot.file, slot.record_id.page_number, false);
+    event.respond = tick();
+    result->history.push_back(event);
+  }
+
+  /**
+   * Compares every live slot with the model, through the pool or straight
+   * from the file.
+   */
+  void verifyAll(const bool from_file) {
+    for (std::size_t index = 0; index < slots_.size(); ++index) {
+      Slot& slot = slots_[index];
+      if (slot.record_id.page_number == Page::INVALID_NUMBER) {
+        continue;
+      }
+      std::string record;
+      if (from_file) {
+        record = slot.file->readPage(slot.record_id.page_number)
+                     .getRecord(slot.record_id);
+      } else {
+        Page* page;
+        pool_.readPage(slot.file, slot.record_id.page_number, page);
+        record = page->getRecord(slot.record_id);
+        pool_.unPinPage(slot.file, slot.record_id.page_number, false);
+      }
+      if (checkRecord(index, slot, record) != slot.version) {
+        std::ostringstream message;
+        message << "slot " << index << " has \"" << record << "\" "
+                << (from_file ? "on disk" : "in the pool")
+                << ", expected version " << slot.version;
+        violation(message.str());
+      }
+    }
+  }
+
+  void waitWhilePaused() {
+    std::unique_lock<std::mutex> lock(pause_mutex_);
+    ++paused_;
+    pause_cv_.notify_all();
+    pause_cv_.wait(lock, [this] { return !pause_requested_.load(); });
+    --paused_;
+  }
+
+  std::vector<File>& files_;
+  Pool pool_;
+  std::vector<Slot> slots_;
+  std::atomic<std::uint64_t> clock_;
+  std::atomic<std::uint64_t> next_incarnation_;
+  std::atomic<bool> stop_;
+  std::atomic<bool> pause_requested_;
+  std::mutex pause_mutex_;
+  std::condition_variable pause_cv_;
+  std::uint32_t paused_;
+  std::uint32_t running_;
+  std::mutex violation_mutex_;
+  std::uint64_t violations_;
+  std::vector<std::string> messages_;
+};
+
+bool byInvoke(const Event* lhs, const Event* rhs) {
+  return lhs->invoke < rhs->invoke;
+}
+
+bool byRespond(const Event* lhs, const Event* rhs) {
+  return lhs->respond < rhs->respond;
+}
+
+/**
+ * Checks the merged history against a sequential register per page
+ * incarnation.  Each write stores a new version number, so a history is
+ * linearizable iff versions are never written twice, no read returns a
+ * version older than one whose write finished before the read began, and no
+ * read returns a version whose write began after the read finished.
+ *
+ * @return  Number of events that break those rules.
+ */
+std::uint64_t checkHistory(const std::vector<ThreadResult>& results,
+                           Harness& harness) {
+  std::map<std::uint64_t, std::vector<const Event*> > by_incarnation;
+  for (std::size_t t = 0; t < results.size(); ++t) {
+    for (std::size_t e = 0; e < results[t].history.size(); ++e) {
+      const Event& event = results[t].history[e];
+      by_incarnation[event.incarnation].push_back(&event);
+    }
+  }
+  std::uint64_t failures = 0;
+  for (std::map<std::uint64_t, std::vector<const Event*> >::iterator iter =
+           by_incarnation.begin();
+       iter != by_incarnation.end(); ++iter) {
+    std::vector<const Event*> reads;
+    std::vector<const Event*> writes;
+    std::map<std::uint64_t, const Event*> write_of_version;
+    for (std::size_t e = 0; e < iter->second.size(); ++e) {
+      const Event* event = iter->second[e];
+      if (!event->write) {
+        reads.push_back(event);
+      } else if (!write_of_version.insert(
+                     std::make_pair(event->version, event)).second) {
+        std::ostringstream message;
+        message << "incarnation " << iter->first << ": version "
+                << event->version << " written twice (lost update)";
+        harness.violation(message.str());
+        ++failures;
+      } else {
+        writes.push_back(event);
+      }
+    }
+    std::sort(reads.begin(), reads.end(), byInvoke);
+    std::sort(writes.begin(), writes.end(), byRespond);
+    std::size_t next_write = 0;
+    std::uint64_t newest_finished = 0;
+    for (std::size_t r = 0; r < reads.size(); ++r) {
+      const Event* read = reads[r];
+      for (; next_write < writes.size() &&
+             writes[next_write]->respond < read->invoke;
+           ++next_write) {
+        newest_finished =
+            std::max(newest_finished, writes[next_write]->version);
+      }
+      std::map<std::uint64_t, const Event*>::const_iterator writer =
+          write_of_version.find(read->version);
+      const char* problem = NULL;
+      if (read->version < newest_finished) {
+        problem = "stale read";
+      } else if (writer == write_of_version.end()) {
+        problem = "read of a version never written";
+      } else if (writer->second->invoke > read->respond) {
+        problem = "read of a version written later";
+      }
+      if (problem != NULL) {
+        std::ostringstream message;
+        message << "incarnation " << iter->first << ": " << problem
+                << " (version " << read->version << ", newest finished "
+                << newest_finished << ")";
+        harness.violation(message.str());
+        ++failures;
+      }
+    }
+  }
+  return failures;
+}
+
+void printUsage(const char* program) {
+  std::cerr << "Usage: " << program << " [options]\n"
+            << "  --threads=N                 worker threads (8)\n"
+            << "  --seconds=N                 run time (5)\n"
+            << "  --pool=FRAMES               buffer pool frames (32)\n"
+            << "  --slots=N                   pages in play (256)\n"
+            << "  --files=N                   files the pages live in (2)\n"
+            << "  --checkpoint-ms=N           time between checkpoints (250)\n"
+            << "  --pool-lock=0|1             serialize buffer manager calls (1)\n"
+            << "  --io-scheduler=0|1          do I/O through an IoScheduler (0)\n"
+            << "  --file=PREFIX               data file prefix (stress.db)\n"
+            << "  --seed=N                    random seed (1)\n";
+}
+
+bool parseOptions(int argc, char* argv[], Options& options) {
+  options.threads = 8;
+  options.seconds = 5;
+  options.pool_frames = 32;
+  options.slots = 256;
+  options.files = 2;
+  options.checkpoint_ms = 250;
+  options.pool_lock = true;
+  options.io_scheduler = false;
+  options.filename = "stress.db";
+  options.seed = 1;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg(argv[i]);
+    const std::size_t equals = arg.find('=');
+    if (arg.compare(0, 2, "--") != 0 || equals == std::string::npos) {
+      return false;
+    }
+    const std::string name = arg.substr(2, equals - 2);
+    const std::string value = arg.substr(equals + 1);
+    const unsigned long long number = std::strtoull(value.c_str(), NULL, 10);
+    if (name == "threads") {
+      options.threads = number;
+    } else if (name == "seconds") {
+      options.seconds = std::strtod(value.c_str(), NULL);
+    } else if (name == "pool") {
+      options.pool_frames = number;
+    } else if (name == "slots") {
+      options.slots = number;
+    } else if (name == "files") {
+      options.files = number;
+    } else if (name == "checkpoint-ms") {
+      options.checkpoint_ms = number;
+    } else if (name == "pool-lock") {
+      options.pool_lock = number != 0;
+    } else if (name == "io-scheduler") {
+      options.io_scheduler = number != 0;
+    } else if (name == "file") {
+      options.filename = value;
+    } else if (name == "seed") {
+      options.seed = number;
+    } else {
+      return false;
+    }
+  }
+  // Each worker pins at most one page at a time.
+  return options.threads > 0 && options.seconds > 0 &&
+      options.pool_frames > options.threads && options.slots > 0 &&
+      options.files > 0 && options.checkpoint_ms > 0;
+}
+
+}
+
+/**
+ * Hammers one buffer manager from many threads with reads, updates,
+ * allocations, disposals and flushes of pages spread over several files.
+ * Every page holds a single record naming its slot, incarnation and version.
+ * Periodic checkpoints pause the workers to check the pool's invariants and
+ * compare every page with the model, in the pool and on disk; at the end the
+ * operation history is checked for linearizability.  Build with
+ * -fsanitize=thread to have ThreadSanitizer watch the run as well.
+ *
+ * Usage: buffer_stress [options]; see printUsage().  Exits with 1 if any
+ * check fails.
+ *
+ * Built from the top directory together with every source file there except
+ * main.cpp, e.g. with "-I." so the includes below resolve.
+ */
+int main(int argc, char* argv[]) {
+  Options options;
+  if (!parseOptions(argc, argv, options)) {
+    printUsage(argv[0]);
+    return 2;
+  }
+  std::cout << "threads " << options.threads << "  pool " << options.pool_frames
+            << "  slots " << options.slots << "  files " << options.files
+            << "  pool lock " << (options.pool_lock ? "on" : "off")
+            << "  io scheduler " << (options.io_scheduler ? "on" : "off")
+            << "\n";
+
+  std::vector<std::string> filenames;
+  for (std::uint32_t f = 0; f < options.files; ++f) {
+    std::ostringstream filename;
+    filename << options.filename << "." << f;
+    filenames.push_back(filename.str());
+    if (File::exists(filenames.back())) {
+      File::remove(filenames.back());
+    }
+  }
+
+  int status = 0;
+  try {
+    std::vector<File> files;
+    for (std::size_t f = 0; f < filenames.size(); ++f) {
+      files.push_back(File::create(filenames[f]));
+    }
+    Harness harness(options, files);
+    std::vector<ThreadResult> results(options.threads);
+    std::vector<std::thread> threads;
+    const std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    const std::chrono::steady_clock::time_point end = start +
+        std::chrono::microseconds(
+            static_cast<std::int64_t>(options.seconds * 1000000));
+    for (std::uint32_t t = 0; t < options.threads; ++t) {
+      threads.push_back(std::thread(&Harness::work, &harness,
+                                    options.seed + t, &results[t]));
+    }
+    std::uint32_t checkpoints = 0;
+    for (;;) {
+      const std::chrono::steady_clock::time_point next =
+          std::min(end, std::chrono::steady_clock::now() +
+                            std::chrono::milliseconds(options.checkpoint_ms));
+      std::this_thread::sleep_until(next);
+      if (next >= end) {
+        break;
+      }
+      harness.checkpoint();
+      ++checkpoints;
+    }
+    harness.stop();
+    for (std::size_t t = 0; t < threads.size(); ++t) {
+      threads[t].join();
+    }
+    const double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    harness.checkpoint();
+    ++checkpoints;
+
+    std::uint64_t operations[NUM_OPERATIONS] = {0};
+    std::uint64_t total = 0;
+    std::uint64_t flushes_skipped = 0;
+    for (std::size_t t = 0; t < results.size(); ++t) {
+      if (!results[t].error.empty()) {
+        harness.violation("thread error: " + results[t].error);
+      }
+      for (int operation = 0; operation < NUM_OPERATIONS; ++operation) {
+        operations[operation] += results[t].operations[operation];
+        total += results[t].operations[operation];
+      }
+      flushes_skipped += results[t].flushes_skipped;
+    }
+    const std::uint64_t history_failures = checkHistory(results, harness);
+
+    std::cout << std::fixed << std::setprecision(0) << total
+              << " operations in " << std::setprecision(2) << seconds
+              << " s (" << std::setprecision(0) << total / seconds
+              << " ops/s)\n";
+    for (int operation = 0; operation < NUM_OPERATIONS; ++operation) {
+      std::cout << "  " << std::left << std::setw(8)
+                << OPERATION_NAMES[operation] << std::right << std::setw(12)
+                << operations[operation] << std::setw(12)
+                << operations[operation] / seconds << " ops/s\n";
+    }
+    std::cout << "flushes skipped (pages pinned): " << flushes_skipped << "\n"
+              << "checkpoints: " << checkpoints << "\n"
+              << "history: " << (history_failures == 0 ? "linearizable"
+                                                       : "NOT linearizable")
+              << "\n";
+    if (harness.violations() > 0) {
+      std::cout << harness.violations() << " violations, first ones:\n";
+      for (std::size_t m = 0; m < harness.messages().size(); ++m) {
+        std::cout << "  " << harness.messages()[m] << "\n";
+      }
+      status = 1;
+    } else {
+      std::cout << "all checks passed\n";
+    }
+  } catch (const BadgerDbException& e) {
+    std::cerr << e.message() << "\n";
+    status = 1;
+  }
+  for (std::size_t f = 0; f < filenames.size(); ++f) {
+    File::remove(filenames[f]);
+  }
+  return status;
+}
@@ -0,0 +1,733 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "buffer.h"
+#include "exceptions/badgerdb_exception.h"
+#include "file.h"
+#include "file_iterator.h"
+#include "hash_aggregate.h"
+#include "page_iterator.h"
+#include "physical_file_iterator.h"
+#include "query_operator.h"
+#include "shared_scan.h"
+
+using namespace badgerdb;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * Benchmark settings from the command line.
+ */
+struct Options {
+  std::string filename;
+  std::uint64_t size_mb;
+  std::uint32_t record_size;
+  std::uint32_t fill_percent;
+  std::uint32_t pool_frames;
+  std::uint32_t threads;
+  std::uint32_t selectivity;
+  bool keep;
+};
+
+/**
+ * What one scan, or one thread's share of it, measured.
+ */
+struct ScanResult {
+  ScanResult()
+      : records(0), matches(0), bytes(0), fetch_seconds(0),
+        extract_seconds(0) {}
+
+  void add(const ScanResult& other) {
+    records += other.records;
+    matches += other.matches;
+    bytes += other.bytes;
+    fetch_seconds += other.fetch_seconds;
+    extract_seconds += other.extract_seconds;
+  }
+
+  std::uint64_t records;
+  std::uint64_t matches;
+  std::uint64_t bytes;
+
+  /**
+   * Time spent getting pages into and out of the buffer pool (including disk
+   * reads and waiting for the pool's lock).
+   */
+  double fetch_seconds;
+
+  /**
+   * Time spent reading records off pinned pages and testing them.
+   */
+  double extract_seconds;
+};
+
+double secondsSince(const Clock::time_point& start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/**
+ * Returns the key stored at the front of a record.
+ */
+std::uint64_t recordKey(const std::string& record) {
+  return std::strtoull(record.c_str(), NULL, 10);
+}
+
+/**
+ * Writes about <size_mb> MB of records, keyed in order, with the requested
+ * page fill.
+ */
+PageId generate(const Options& options) {
+  File file = File::create(options.filename);
+  file.setFillFactor(options.fill_percent);
+  const std::uint64_t total_bytes = options.size_mb * 1024 * 1024;
+  const std::size_t batch_records =
+      std::max<std::size_t>(1, (16 * 1024 * 1024) / options.record_size);
+  std::uint64_t key = 0;
+  std::vector<std::string> records;
+  char prefix[32];
+  for (std::uint64_t bytes = 0; bytes < total_bytes;) {
+    records.clear();
+    for (std::size_t i = 0; i < batch_records && bytes < total_bytes; ++i) {
+      std::snprintf(prefix, sizeof(prefix), "%016llu|",
+                    static_cast<unsigned long long>(key++));
+      std::string record(prefix);
+      record.resize(options.record_size, 'a' + key % 26);
+      records.push_back(record);
+      // Count whole pages' worth of space, so the file size is what was
+      // asked for whatever the fill.
+      bytes += (record.size() + sizeof(PageSlot)) * 100 /
+          options.fill_percent;
+    }
+    file.bulkLoad(records);
+  }
+  PageId num_pages = 0;
+  for (FileIterator iter = file.begin(); iter != file.end(); ++iter) {
+    ++num_pages;
+  }
+  return num_pages;
+}
+
+/**
+ * Drops the data file from the operating system's page cache, so the next
+ * scan reads it from the device.
+ */
+void dropOsCache(const std::string& filename) {
+  const int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd >= 0) {
+    ::fdatasync(fd);
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd);
+  }
+}
+
+/**
+ * A buffer pool shared by scanning threads.  BufMgr and File are not
+ * threadsafe, so pinning and unpinning hold one lock, while records are read
+ * off pinned pages in parallel.
+ */
+class SharedPool {
+ public:
+  SharedPool(File* file, const std::uint32_t pool_frames)
+      : file_(file), buf_mgr_(new BufMgr(pool_frames)) {}
+
+  Page* pin(const PageId page_number) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Page* page;
+    buf_mgr_->readPage(file_, page_number, page);
+    return page;
+  }
+
+  void unpin(const PageId page_number) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    buf_mgr_->unPinPage(file_, page_number, false);
+  }
+
+  void readRecords(const std::vector<RecordId>& record_ids,
+                   std::vector<std::string>& records) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    buf_mgr_->readRecords(file_, record_ids, records);
+  }
+
+  int diskReads() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return buf_mgr_->getBufStats().diskreads;
+  }
+
+  void clearStats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    buf_mgr_->clearBufStats();
+  }
+
+ private:
+  File* file_;
+  std::unique_ptr<BufMgr> buf_mgr_;
+  std::mutex mutex_;
+};
+
+/**
+ * Reads the records of one page through the pool.  Records whose key modulo
+ * 100 is below <selectivity> match.
+ */
+void scanPage(SharedPool* pool, const PageId page_number,
+              const std::uint32_t selectivity, ScanResult* result) {
+  Clock::time_point start = Clock::now();
+  Page* page = pool->pin(page_number);
+  result->fetch_seconds += secondsSince(start);
+
+  start = Clock::now();
+  for (PageIterator iter = page->begin(); iter != page->end(); ++iter) {
+    const std::string& record = *iter;
+    ++result->records;
+    result->bytes += record.size();
+    if (selectivity >= 100 || recordKey(record) % 100 < selectivity) {
+      ++result->matches;
+    }
+  }
+  result->extract_seconds += secondsSince(start);
+
+  start = Clock::now();
+  pool->unpin(page_number);
+  result->fetch_seconds += secondsSince(start);
+}
+
+/**
+ * Scans pages [1, num_pages] through the pool.  With several threads, each
+ * takes every <stride>th run of RUN_PAGES pages starting at run <first_run>,
+ * so that the threads together read the file once.
+ */
+void scanPages(SharedPool* pool, const PageId num_pages,
+               const std::uint32_t first_run, const std::uint32_t stride,
+               const std::uint32_t selectivity, ScanResult* result) {
+  static const PageId RUN_PAGES = 16;
+  for (PageId run_start = 1 + first_run * RUN_PAGES; run_start <= num_pages;
+       run_start += stride * RUN_PAGES) {
+    for (PageId page_number = run_start;
+         page_number < run_start + RUN_PAGES && page_number <= num_pages;
+         ++page_number) {
+      scanPage(pool, page_number, selectivity, result);
+    }
+  }
+}
+
+/**
+ * Waits <delay> seconds, then scans pages [1, num_pages] through the pool,
+ * sharing reads with other scans through <coordinator> if it isn't NULL.
+ */
+void scanAfter(SharedPool* pool, const File* file,
+               ScanCoordinator* coordinator, const PageId num_pages,
+               const double delay, ScanResult* result) {
+  std::this_thread::sleep_for(std::chrono::duration<double>(delay));
+  if (coordinator == NULL) {
+    scanPages(pool, num_pages, 0, 1, 100, result);
+    return;
+  }
+  std::vector<PageId> pages;
+  for (PageId page_number = 1; page_number <= num_pages; ++page_number) {
+    pages.push_back(page_number);
+  }
+  SharedScan scan(coordinator, file, pages);
+  for (PageId page_number = scan.next(); page_number != Page::INVALID_NUMBER;
+       page_number = scan.next()) {
+    scanPage(pool, page_number, 100, result);
+  }
+}
+
+void printHeading() {
+  std::cout << std::left << std::setw(28) << "scan" << std::right
+            << std::setw(12) << "records" << std::setw(10) << "matches"
+            << std::setw(9) << "seconds" << std::setw(12) << "records/s"
+            << std::setw(9) << "MB/s" << std::setw(8) << "fetch%"
+            << std::setw(10) << "extract%" << std::setw(10) << "reads"
+            << "\n";
+}
+
+void printResult(const std::string& name, const ScanResult& result,
+                 const double seconds, const int disk_reads) {
+  // Fetch and extract are summed over threads, so they are shown as shares
+  // of the total thread time rather than of the wall clock.
+  const double busy = result.fetch_seconds + result.extract_seconds;
+  std::cout << std::left << std::setw(28) << name << std::right << std::fixed
+            << std::setw(12) << result.records << std::setw(10)
+            << result.matches << std::setprecision(2) << std::setw(9)
+            << seconds << std::setprecision(0) << std::setw(12)
+            << result.records / seconds << std::setprecision(1)
+            << std::setw(9) << result.bytes / seconds / (1024 * 1024)
+            << std::setw(8) << (busy > 0 ? 100 * result.fetch_seconds / busy : 0)
+            << std::setw(10)
+            << (busy > 0 ? 100 * result.extract_seconds / busy : 0)
+            << std::setw(10) << disk_reads << "\n";
+}
+
+/**
+ * Runs one or more scans through a pool and prints the result.
+ *
+ * @param scans     Number of scans running at once, each reading the whole
+ *                  file; they share the pool.
+ * @param threads   Threads per scan, splitting the file between them.
+ */
+double runScan(const std::string& name, File* /* file */, SharedPool* pool,
+               const PageId num_pages, const std::uint32_t scans,
+               const std::uint32_t threads, const std::uint32_t selectivity) {
+  pool->clearStats();
+  std::vector<ScanResult> results(scans * threads);
+  std::vector<std::thread> workers;
+  const Clock::time_point start = Clock::now();
+  for (std::uint32_t scan = 0; scan < scans; ++scan) {
+    for (std::uint32_t thread = 0; thread < threads; ++thread) {
+      workers.push_back(std::thread(scanPages, pool, num_pages, thread,
+                                    threads, selectivity,
+                                    &results[scan * threads + thread]));
+    }
+  }
+  for (std::size_t i = 0; i < workers.size(); ++i) {
+    workers[i].join();
+  }
+  const double seconds = secondsSince(start);
+  ScanResult total;
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    total.add(results[i]);
+  }
+  printResult(name, total, seconds, pool->diskReads());
+  return seconds;
+}
+
+/**
+ * Runs full scans that start <stagger> seconds apart through a cold pool, as
+ * independent jobs would, with or without sharing reads between them.
+ */
+void runStaggeredScans(const std::string& name, File* file,
+                       const std::uint32_t pool_frames,
+                       const PageId num_pages, const std::uint32_t scans,
+                       const double stagger, const bool shared) {
+  SharedPool pool(file, pool_frames);
+  dropOsCache(file->filename());
+  // Keep the group well within the pool.
+  ScanCoordinator coordinator(pool_frames / 4);
+  std::vector<ScanResult> results(scans);
+  std::vector<std::thread> workers;
+  const Clock::time_point start = Clock::now();
+  for (std::uint32_t scan = 0; scan < scans; ++scan) {
+    workers.push_back(std::thread(scanAfter, &pool, file,
+                                  shared ? &coordinator : NULL, num_pages,
+                                  scan * stagger, &results[scan]));
+  }
+  for (std::size_t i = 0; i < workers.size(); ++i) {
+    workers[i].join();
+  }
+  const double seconds = secondsSince(start);
+  ScanResult total;
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    total.add(results[i]);
+  }
+  printResult(name, total, seconds, pool.diskReads());
+}
+
+/**
+ * Scans the file through FileIterator alone, without a buffer pool, as a
+ * baseline for the pool's overhead.
+ *
+ * @return  Number of records in the file.
+ */
+std::uint64_t runFileIteratorScan(File* file) {
+  ScanResult result;
+  const Clock::time_point start = Clock::now();
+  Clock::time_point fetch_start = Clock::now();
+  for (FileIterator iter = file->begin(); iter != file->end(); ++iter) {
+    Page page = *iter;
+    result.fetch_seconds += secondsSince(fetch_start);
+    const Clock::time_point extract_start = Clock::now();
+    for (PageIterator record = page.begin(); record != page.end(); ++record) {
+      const std::string& bytes = *record;
+      ++result.records;
+      ++result.matches;
+      result.bytes += bytes.size();
+    }
+    result.extract_seconds += secondsSince(extract_start);
+    fetch_start = Clock::now();
+  }
+  printResult("full, FileIterator, no pool", result, secondsSince(start), 0);
+  return result.records;
+}
+
+/**
+ * Counts the records whose key modulo 100 is below <selectivity>, first with
+ * a hand-written loop over FileIterator and PageIterator, then with a scan
+ * and filter operator pipeline passing batches of record views.
+ */
+void runOperatorScans(File* file, const std::uint32_t selectivity) {
+  for (int operators = 0; operators < 2; ++operators) {
+    dropOsCache(file->filename());
+    ScanResult result;
+    const Clock::time_point start = Clock::now();
+    if (operators) {
+      FilterOperator plan(
+          OperatorPtr(new ScanOperator(file)),
+          [selectivity, &result](const RecordView& record) {
+            ++result.records;
+            std::uint64_t key = 0;
+            for (std::size_t i = 0; i < record.size && record.data[i] >= '0' &&
+                 record.data[i] <= '9'; ++i) {
+              key = key * 10 + (record.data[i] - '0');
+            }
+            return key % 100 < selectivity;
+          });
+      RecordBatch batch;
+      while (plan.next(batch)) {
+        result.matches += batch.size();
+        for (std::size_t i = 0; i < batch.size(); ++i) {
+          result.bytes += batch[i].size;
+        }
+      }
+    } else {
+      for (FileIterator iter = file->begin(); iter != file->end(); ++iter) {
+        Page page = *iter;
+        for (PageIterator record = page.begin(); record != page.end();
+             ++record) {
+          const std::string& bytes = *record;
+          ++result.records;
+          if (recordKey(bytes) % 100 < selectivity) {
+            ++result.matches;
+            result.bytes += bytes.size();
+          }
+        }
+      }
+    }
+    result.extract_seconds = secondsSince(start);
+    printResult(operators ? "selective, operators" : "selective, FileIterator",
+                result, result.extract_seconds, 0);
+  }
+}
+
+/**
+ * Scans for the keys in the middle <selectivity> percent of the key range in
+ * physical order, first reading every page and then only the pages the
+ * file's zone map says may hold keys in range.  The reads column shows pages
+ * read.
+ */
+void runRangeScans(File* file, const std::uint64_t num_records,
+                   const std::uint32_t selectivity) {
+  const std::uint64_t width =
+      std::max<std::uint64_t>(1, num_records * selectivity / 100);
+  const std::uint64_t low = (num_records - std::min(width, num_records)) / 2;
+  const std::uint64_t high = low + width - 1;
+  char low_key[32];
+  char high_key[32];
+  std::snprintf(low_key, sizeof(low_key), "%016llu",
+                static_cast<unsigned long long>(low));
+  std::snprintf(high_key, sizeof(high_key), "%016llu",
+                static_cast<unsigned long long>(high));
+  // Keys are the zero-padded numbers at the front of each record.
+  file->enableZoneMap(0, 16);
+
+  for (int use_zone_map = 0; use_zone_map < 2; ++use_zone_map) {
+    dropOsCache(file->filename());
+    ScanResult result;
+    int pages_read = 0;
+    const Clock::time_point start = Clock::now();
+    Clock::time_point fetch_start = Clock::now();
+    for (PhysicalFileIterator iter = use_zone_map
+             ? file->physicalBegin(low_key, high_key)
+             : file->physicalBegin();
+         iter != file->physicalEnd(); ++iter) {
+      Page page = *iter;
+      ++pages_read;
+      result.fetch_seconds += secondsSince(fetch_start);
+      const Clock::time_point extract_start = Clock::now();
+      for (PageIterator record = page.begin(); record != page.end();
+           ++record) {
+        const std::string& bytes = *record;
+        ++result.records;
+        result.bytes += bytes.size();
+        const std::uint64_t key = recordKey(bytes);
+        if (key >= low && key <= high) {
+          ++result.matches;
+        }
+      }
+      result.extract_seconds += secondsSince(extract_start);
+      fetch_start = Clock::now();
+    }
+    printResult(use_zone_map ? "range, zone map" : "range, all pages", result,
+                secondsSince(start), pages_read);
+  }
+}
+
+/**
+ * Fetches the records whose key modulo 100 is below <selectivity>, in random
+ * order as a secondary index would return them, in batches of BATCH_RECORDS:
+ * first one record at a time, then with BufMgr::readRecords().  Both runs
+ * start with a cold pool.
+ */
+void runIndexFetches(File* file, const std::uint32_t pool_frames,
+                     const std::uint32_t selectivity) {
+  static const std::size_t BATCH_RECORDS = 4096;
+  // Bulk loading fills slots 1, 2, ... of each page.
+  std::vector<RecordId> record_ids;
+  for (PhysicalFileIterator iter = file->physicalBegin();
+       iter != file->physicalEnd(); ++iter) {
+    Page page = *iter;
+    SlotId slot_number = 1;
+    for (PageIterator record = page.begin(); record != page.end();
+         ++record, ++slot_number) {
+      if (recordKey(*record) % 100 < selectivity) {
+        const RecordId record_id = {page.page_number(), slot_number};
+        record_ids.push_back(record_id);
+      }
+    }
+  }
+  std::mt19937_64 random(1);
+  std::shuffle(record_ids.begin(), record_ids.end(), random);
+
+  for (int batched = 0; batched < 2; ++batched) {
+    SharedPool pool(file, pool_frames);
+    dropOsCache(file->filename());
+    ScanResult result;
+    const Clock::time_point start = Clock::now();
+    std::vector<std::string> records;
+    for (std::size_t first = 0; first < record_ids.size();
+         first += BATCH_RECORDS) {
+      const std::vector<RecordId> batch(
+          record_ids.begin() + first,
+          record_ids.begin() +
+              std::min(record_ids.size(), first + BATCH_RECORDS));
+      if (batched) {
+        pool.readRecords(batch, records);
+      } else {
+        records.clear();
+        for (std::size_t i = 0; i < batch.size(); ++i) {
+          Page* page = pool.pin(batch[i].page_number);
+          records.push_back(page->getRecord(batch[i]));
+          pool.unpin(batch[i].page_number);
+        }
+      }
+      for (std::size_t i = 0; i < records.size(); ++i) {
+        ++result.records;
+        ++result.matches;
+        result.bytes += records[i].size();
+      }
+    }
+    result.fetch_seconds = secondsSince(start);
+    printResult(batched ? "index fetch, batched" : "index fetch, one by one",
+                result, result.fetch_seconds, pool.diskReads());
+  }
+}
+
+/**
+ * Groups the records by key / 10 and computes count, sum, min and max of the
+ * keys of each group with HashAggregate: with one thread, with <threads>, and
+ * with <threads> and a budget small enough to make them spill.  The matches
+ * column shows groups and the reads column pages spilled.
+ */
+void runAggregations(File* file, const std::uint32_t threads,
+                     const std::uint32_t pool_frames) {
+  const HashAggregate::Extractor extractor =
+      [](const std::string& record, std::string& key, double& value) {
+        const std::uint64_t record_key = recordKey(record);
+        key = std::to_string(record_key / 10);
+        value = static_cast<double>(record_key);
+        return true;
+      };
+  for (int run = 0; run < 3; ++run) {
+    HashAggregate::Options aggregate_options =
+        HashAggregate::Options::defaults();
+    aggregate_options.threads = run == 0 ? 1 : threads;
+    aggregate_options.spill_pool_frames = pool_frames;
+    if (run == 2) {
+      aggregate_options.memory_budget = 1024 * 1024;
+    }
+    HashAggregate aggregate(extractor, aggregate_options);
+    dropOsCache(file->filename());
+    ScanResult result;
+    const Clock::time_point start = Clock::now();
+    const HashAggregate::Stats stats = aggregate.run(
+        file, [&result](const std::string& key,
+                        const HashAggregate::Aggregates& aggregates) {
+          result.records += aggregates.count;
+          result.bytes += key.size();
+        });
+    result.matches = stats.groups;
+    result.extract_seconds = secondsSince(start);
+    const std::string name = run == 0
+        ? "aggregate, 1 thread"
+        : "aggregate, " + std::to_string(threads) + " threads" +
+            (run == 2 ? ", spill" : "");
+    printResult(name, result, result.extract_seconds,
+                static_cast<int>(stats.spill_pages));
+  }
+}
+
+void printUsage(const char* program) {
+  std::cerr << "Usage: " << program << " [options]\n"
+            << "  --file=PATH           data file (scan.db)\n"
+            << "  --size-mb=N           data to generate in MB (256)\n"
+            << "  --record-size=BYTES   record size (100)\n"
+            << "  --fill=PERCENT        page fill (100)\n"
+            << "  --pool=FRAMES         buffer pool frames (1024)\n"
+            << "  --threads=N           threads for parallel scans (4)\n"
+            << "  --selectivity=PERCENT records matched by selective scans"
+            << " (10)\n"
+            << "  --keep=1              reuse and keep the data file\n";
+}
+
+bool parseOptions(int argc, char* argv[], Options& options) {
+  options.filename = "scan.db";
+  options.size_mb = 256;
+  options.record_size = 100;
+  options.fill_percent = 100;
+  options.pool_frames = 1024;
+  options.threads = 4;
+  options.selectivity = 10;
+  options.keep = false;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg(argv[i]);
+    const std::size_t equals = arg.find('=');
+    if (arg.compare(0, 2, "--") != 0 || equals == std::string::npos) {
+      return false;
+    }
+    const std::string name = arg.substr(2, equals - 2);
+    const std::string value = arg.substr(equals + 1);
+    const unsigned long long number = std::strtoull(value.c_str(), NULL, 10);
+    if (name == "file") {
+      options.filename = value;
+    } else if (name == "size-mb") {
+      options.size_mb = number;
+    } else if (name == "record-size") {
+      options.record_size = number;
+    } else if (name == "fill") {
+      options.fill_percent = number;
+    } else if (name == "pool") {
+      options.pool_frames = number;
+    } else if (name == "threads") {
+      options.threads = number;
+    } else if (name == "selectivity") {
+      options.selectivity = number;
+    } else if (name == "keep") {
+      options.keep = number != 0;
+    } else {
+      return false;
+    }
+  }
+  return options.size_mb > 0 && options.record_size >= 24 &&
+      options.record_size <= Page::DATA_SIZE / 2 &&
+      options.fill_percent > 0 && options.fill_percent <= 100 &&
+      options.pool_frames > 0 && options.threads > 0 &&
+      options.selectivity <= 100;
+}
+
+}
+
+/**
+ * Generates a data file and measures full, selective and concurrent scans of
+ * it through BufMgr, cold and warm, with one thread and several, staggered
+ * concurrent scans with and without sharing reads, selective scans with a
+ * hand-written loop and with query operators, index-driven fetches one
+ * record at a time and batched, range scans with and without skipping pages
+ * by their zone map, and a parallel group-by.  Reports
+ * records and bytes per second and how thread time splits between fetching
+ * pages and extracting records.
+ *
+ * Usage: scan_bench [options]; see printUsage().
+ *
+ * Built from the top directory together with every source file there except
+ * main.cpp, e.g. with "-I." so the includes below resolve.
+ */
+int main(int argc, char* argv[]) {
+  Options options;
+  if (!parseOptions(argc, argv, options)) {
+    printUsage(argv[0]);
+    return 2;
+  }
+  try {
+    PageId num_pages;
+    if (options.keep && File::exists(options.filename)) {
+      File file = File::open(options.filename);
+      num_pages = 0;
+      for (FileIterator iter = file.begin(); iter != file.end(); ++iter) {
+        ++num_pages;
+      }
+      std::cout << "reusing " << options.filename << ": " << num_pages
+                << " pages\n";
+    } else {
+      if (File::exists(options.filename)) {
+        File::remove(options.filename);
+      }
+      const Clock::time_point start = Clock::now();
+      num_pages = generate(options);
+      std::cout << std::fixed << std::setprecision(2) << "generated "
+                << options.filename << ": " << num_pages << " pages ("
+                << num_pages * Page::SIZE / (1024 * 1024) << " MB) in "
+                << secondsSince(start) << " s\n";
+    }
+
+    File file = File::open(options.filename);
+    std::cout << "pool " << options.pool_frames << " frames ("
+              << options.pool_frames * Page::SIZE / (1024 * 1024)
+              << " MB), record size " << options.record_size << ", fill "
+              << options.fill_percent << "%\n";
+    printHeading();
+    const std::uint32_t threads = options.threads;
+    double cold_seconds;
+    {
+      SharedPool pool(&file, options.pool_frames);
+      dropOsCache(options.filename);
+      cold_seconds =
+          runScan("full, cold, 1 thread", &file, &pool, num_pages, 1, 1, 100);
+      runScan("full, warm, 1 thread", &file, &pool, num_pages, 1, 1, 100);
+      runScan("selective, warm, 1 thread", &file, &pool, num_pages, 1, 1,
+              options.selectivity);
+    }
+    {
+      SharedPool pool(&file, options.pool_frames);
+      dropOsCache(options.filename);
+      runScan("full, cold, " + std::to_string(threads) + " threads", &file,
+              &pool, num_pages, 1, threads, 100);
+      runScan("full, warm, " + std::to_string(threads) + " threads", &file,
+              &pool, num_pages, 1, threads, 100);
+      runScan("selective, warm, " + std::to_string(threads) + " threads",
+              &file, &pool, num_pages, 1, threads, options.selectivity);
+      runScan(std::to_string(threads) + " concurrent full scans", &file,
+              &pool, num_pages, threads, 1, 100);
+    }
+    // Each scan starts a fraction of a scan's time after the one before.
+    const double stagger = cold_seconds / (2 * threads);
+    runStaggeredScans(std::to_string(threads) + " staggered scans", &file,
+                      options.pool_frames, num_pages, threads, stagger,
+                      false /* shared */);
+    runStaggeredScans(std::to_string(threads) + " staggered shared scans",
+                      &file, options.pool_frames, num_pages, threads, stagger,
+                      true /* shared */);
+    dropOsCache(options.filename);
+    const std::uint64_t num_records = runFileIteratorScan(&file);
+    runOperatorScans(&file, options.selectivity);
+    runRangeScans(&file, num_records, options.selectivity);
+    runIndexFetches(&file, options.pool_frames, options.selectivity);
+    runAggregations(&file, threads, options.pool_frames);
+  } catch (const BadgerDbException& e) {
+    std::cerr << e.message() << "\n";
+    return 1;
+  }
+  if (!options.keep) {
+    File::remove(options.filename);
+  }
+  return 0;
+}
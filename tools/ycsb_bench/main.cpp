@@ -0,0 +1,662 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "buffer.h"
+#include "exceptions/badgerdb_exception.h"
+#include "file.h"
+#include "file_iterator.h"
+#include "io_scheduler.h"
+#include "key_generator.h"
+#include "latency_histogram.h"
+#include "page_iterator.h"
+#include "record_cache.h"
+#include "simulated_device.h"
+
+using namespace badgerdb;
+
+namespace {
+
+/**
+ * Kinds of operation a workload mixes.
+ */
+enum Operation {
+  READ,
+  UPDATE,
+  INSERT,
+  SCAN,
+  READ_MODIFY_WRITE,
+  NUM_OPERATIONS
+};
+
+const char* const OPERATION_NAMES[NUM_OPERATIONS] = {
+    "READ", "UPDATE", "INSERT", "SCAN", "RMW"};
+
+/**
+ * Percentage of each operation in a workload, in Operation order.
+ */
+struct Workload {
+  char name;
+  std::uint32_t percent[NUM_OPERATIONS];
+  KeyGenerator::Distribution default_distribution;
+};
+
+/**
+ * The YCSB core workloads.
+ */
+const Workload WORKLOADS[] = {
+    {'a', {50, 50, 0, 0, 0}, KeyGenerator::ZIPFIAN},   // Update heavy.
+    {'b', {95, 5, 0, 0, 0}, KeyGenerator::ZIPFIAN},    // Read mostly.
+    {'c', {100, 0, 0, 0, 0}, KeyGenerator::ZIPFIAN},   // Read only.
+    {'d', {95, 0, 5, 0, 0}, KeyGenerator::LATEST},     // Read latest.
+    {'e', {0, 0, 5, 95, 0}, KeyGenerator::ZIPFIAN},    // Short ranges.
+    {'f', {50, 0, 0, 0, 50}, KeyGenerator::ZIPFIAN}};  // Read-modify-write.
+
+/**
+ * Benchmark settings from the command line.
+ */
+struct Options {
+  const Workload* workload;
+  KeyGenerator::Distribution distribution;
+  bool distribution_set;
+  std::uint64_t records;
+  std::uint64_t operations;
+  std::uint32_t record_size;
+  std::uint32_t pool_frames;
+  std::uint32_t threads;
+  std::uint32_t scan_length;
+  std::string filename;
+  std::uint64_t seed;
+  std::string device;
+  bool io_scheduler;
+  std::uint32_t checkpoint_ms;
+  std::uint64_t record_cache_kb;
+};
+
+/**
+ * A table of fixed-size records keyed 0 to N - 1, stored in one file and
+ * accessed through a buffer manager.  BufMgr is not threadsafe, so every
+ * operation holds one lock; with several threads the benchmark measures the
+ * storage stack as it is, contention included.
+ */
+class Table {
+ public:
+  explicit Table(const Options& options)
+      : file_(File::create(options.filename)),
+        buf_mgr_(options.pool_frames),
+        record_size_(options.record_size),
+        last_page_(Page::INVALID_NUMBER),
+        num_keys_(0) {
+    // Reads look up record IDs without the lock, so the vector must never
+    // move.
+    record_ids_.reserve(options.records + options.operations);
+    if (options.io_scheduler) {
+      scheduler_.reset(new IoScheduler);
+      buf_mgr_.setIoScheduler(scheduler_.get());
+    }
+    if (options.record_cache_kb > 0) {
+      record_cache_.reset(new RecordCache(options.record_cache_kb * 1024));
+      buf_mgr_.setRecordCache(record_cache_.get());
+    }
+  }
+
+  ~Table() {
+    if (scheduler_) {
+      scheduler_->drain();
+    }
+  }
+
+  /**
+   * Inserts the next key.  The caller holds the lock.
+   */
+  void insertLocked() {
+    const std::string& record = makeRecord(record_ids_.size(), 'a');
+    Page* page = NULL;
+    if (last_page_ != Page::INVALID_NUMBER) {
+      buf_mgr_.readPage(&file_, last_page_, page);
+      if (!page->hasSpaceForRecord(record)) {
+        buf_mgr_.unPinPage(&file_, last_page_, false);
+        page = NULL;
+      }
+    }
+    if (page == NULL) {
+      buf_mgr_.allocPage(&file_, last_page_, page);
+    }
+    record_ids_.push_back(page->insertRecord(record));
+    buf_mgr_.unPinPage(&file_, last_page_, true);
+    num_keys_ = record_ids_.size();
+  }
+
+  void insert() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    insertLocked();
+  }
+
+  /**
+   * Number of pages in the file.
+   */
+  PageId numPages() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    PageId num_pages = 0;
+    for (FileIterator iter = file_.begin(); iter != file_.end(); ++iter) {
+      ++num_pages;
+    }
+    return num_pages;
+  }
+
+  /**
+   * Returns the number of keys; safe to call without the lock.
+   */
+  std::uint64_t numKeys() const { return num_keys_; }
+
+  /**
+   * Reads a record.  Hits in the record cache don't take the lock; keys
+   * handed out are below num_keys_, so their IDs are already stored.
+   */
+  void read(const std::uint64_t key) {
+    const RecordId record_id = record_ids_[key];
+    std::string record;
+    std::uint64_t fill_token = 0;
+    if (record_cache_ &&
+        record_cache_->lookup(&file_, record_id, record, &fill_token)) {
+      checkRecord(record, key);
+      return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    Page* page;
+    buf_mgr_.readPage(&file_, record_id.page_number, page);
+    record = page->getRecord(record_id);
+    buf_mgr_.unPinPage(&file_, record_id.page_number, false);
+    if (record_cache_) {
+      record_cache_->insert(&file_, record_id, record, fill_token);
+    }
+    checkRecord(record, key);
+  }
+
+  void update(const std::uint64_t key, const char fill) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const RecordId& record_id = record_ids_[key];
+    Page* page;
+    buf_mgr_.readPage(&file_, record_id.page_number, page);
+    page->updateRecord(record_id, makeRecord(key, fill));
+    buf_mgr_.unPinPage(&file_, record_id.page_number, true);
+  }
+
+  void readModifyWrite(const std::uint64_t key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const RecordId& record_id = record_ids_[key];
+    Page* page;
+    buf_mgr_.readPage(&file_, record_id.page_number, page);
+    std::string record = page->getRecord(record_id);
+    checkRecord(record, key);
+    char& fill = record[record.size() - 1];
+    fill = fill == 'z' ? 'a' : fill + 1;
+    page->updateRecord(record_id, record);
+    buf_mgr_.unPinPage(&file_, record_id.page_number, true);
+  }
+
+  /**
+   * Reads <length> records in key order starting at <key>.  Keys are stored
+   * in insertion order, so this walks consecutive pages.
+   */
+  void scan(const std::uint64_t key, std::uint64_t length) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const RecordId& start = record_ids_[key];
+    PageId page_number = start.page_number;
+    while (length > 0 && page_number != Page::INVALID_NUMBER) {
+      Page* page;
+      buf_mgr_.readPage(&file_, page_number, page);
+      PageIterator iter = page_number == start.page_number
+          ? PageIterator(page, start) : page->begin();
+      for (; length > 0 && iter != page->end(); ++iter) {
+        if ((*iter).size() != record_size_) {
+          throw BadgerDbException("scan read a record of the wrong size");
+        }
+        --length;
+      }
+      const PageId next_page_number = page->next_page_number();
+      buf_mgr_.unPinPage(&file_, page_number, false);
+      page_number = next_page_number;
+    }
+  }
+
+  void flush() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    buf_mgr_.flushFile(&file_);
+  }
+
+  BufStats stats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return buf_mgr_.getBufStats();
+  }
+
+  void clearStats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    buf_mgr_.clearBufStats();
+  }
+
+  /**
+   * Writes out the dirty pages.  With an I/O scheduler the lock is only held
+   * while the writes are queued, so operations go on during the checkpoint.
+   */
+  void checkpoint() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      buf_mgr_.startFlushFile(&file_);
+    }
+    if (scheduler_) {
+      scheduler_->drain(&file_);
+    }
+  }
+
+  const IoScheduler* scheduler() const { return scheduler_.get(); }
+
+  const RecordCache* recordCache() const { return record_cache_.get(); }
+
+  void attachDevice(const std::shared_ptr<SimulatedDevice>& device) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    file_.attachDevice(device);
+  }
+
+ private:
+  std::string makeRecord(const std::uint64_t key, const char fill) const {
+    char prefix[32];
+    std::snprintf(prefix, sizeof(prefix), "user%012llu",
+                  static_cast<unsigned long long>(key));
+    std::string record(prefix);
+    record.resize(record_size_, fill);
+    return record;
+  }
+
+  void checkRecord(const std::string& record, const std::uint64_t key) const {
+    char prefix[32];
+    std::snprintf(prefix, sizeof(prefix), "user%012llu",
+                  static_cast<unsigned long long>(key));
+    if (record.compare(0, std::strlen(prefix), prefix) != 0) {
+      throw BadgerDbException("read returned the wrong record");
+    }
+  }
+
+  File file_;
+  BufMgr buf_mgr_;
+  std::uint32_t record_size_;
+  PageId last_page_;
+  std::vector<RecordId> record_ids_;
+  std::atomic<std::uint64_t> num_keys_;
+  std::mutex mutex_;
+  std::unique_ptr<RecordCache> record_cache_;
+  std::unique_ptr<IoScheduler> scheduler_;  // Destroyed first; drains.
+};
+
+/**
+ * What one benchmark thread measured.
+ */
+struct ThreadResult {
+  LatencyHistogram latencies[NUM_OPERATIONS];
+  std::string error;
+};
+
+/**
+ * Runs <operations> operations of the workload against the table.
+ */
+void runThread(Table* table, const Options& options,
+               const std::uint64_t operations, const std::uint64_t seed,
+               ThreadResult* result) {
+  try {
+    KeyGenerator keys(options.distribution, table->numKeys(), seed);
+    for (std::uint64_t i = 0; i < operations; ++i) {
+      std::uint64_t choice = keys.uniform(100);
+      int operation = 0;
+      while (choice >= options.workload->percent[operation]) {
+        choice -= options.workload->percent[operation];
+        ++operation;
+      }
+      const std::uint64_t key = keys.next(table->numKeys());
+      const std::chrono::steady_clock::time_point start =
+          std::chrono::steady_clock::now();
+      switch (operation) {
+        case READ:
+          table->read(key);
+          break;
+        case UPDATE:
+          table->update(key, 'a' + keys.uniform(26));
+          break;
+        case INSERT:
+          table->insert();
+          break;
+        case SCAN:
+          table->scan(key, 1 + keys.uniform(options.scan_length));
+          break;
+        case READ_MODIFY_WRITE:
+          table->readModifyWrite(key);
+          break;
+      }
+      result->latencies[operation].record(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(
+              std::chrono::steady_clock::now() - start).count());
+    }
+  } catch (const BadgerDbException& e) {
+    result->error = e.message();
+  }
+}
+
+/**
+ * Checkpoints the table every <interval_ms> until told to stop.
+ */
+void runCheckpoints(Table* table, const std::uint32_t interval_ms,
+                    const std::atomic<bool>* stop, std::uint32_t* checkpoints,
+                    std::string* error) {
+  try {
+    while (!stop->load()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(interval_ms));
+      table->checkpoint();
+      ++*checkpoints;
+    }
+  } catch (const BadgerDbException& e) {
+    *error = e.message();
+  }
+}
+
+double secondsSince(const std::chrono::steady_clock::time_point& start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start).count();
+}
+
+void printLatencies(const char* name, const LatencyHistogram& latencies) {
+  std::cout << std::left << std::setw(8) << name << std::right
+            << std::setw(10) << latencies.count() << std::fixed
+            << std::setprecision(1)
+            << std::setw(10) << latencies.mean() / 1000
+            << std::setw(10) << latencies.percentile(0.5) / 1000.0
+            << std::setw(10) << latencies.percentile(0.99) / 1000.0
+            << std::setw(10) << latencies.percentile(0.999) / 1000.0
+            << std::setw(10) << latencies.max() / 1000.0 << "\n";
+}
+
+void printUsage(const char* program) {
+  std::cerr << "Usage: " << program << " [options]\n"
+            << "  --workload=a|b|c|d|e|f      YCSB core workload (a)\n"
+            << "  --distribution=uniform|zipfian|latest\n"
+            << "                              key distribution (workload's)\n"
+            << "  --records=N                 records loaded (100000)\n"
+            << "  --operations=N              operations run (100000)\n"
+            << "  --record-size=BYTES         record size (100)\n"
+            << "  --pool=FRAMES               buffer pool frames (1000)\n"
+            << "  --threads=N                 client threads (1)\n"
+            << "  --scan-length=N             longest scan (100)\n"
+            << "  --file=PATH                 data file (ycsb.db)\n"
+            << "  --seed=N                    random seed (1)\n"
+            << "  --device=hdd|sata-ssd|nvme  simulate a device during the run\n"
+            << "  --io-scheduler=0|1          prioritize reads over writes (0)\n"
+            << "  --checkpoint-ms=N           flush this often during the run\n"
+            << "  --record-cache-kb=N         cache records above the pool\n";
+}
+
+bool parseOptions(int argc, char* argv[], Options& options) {
+  options.workload = &WORKLOADS[0];
+  options.distribution_set = false;
+  options.records = 100000;
+  options.operations = 100000;
+  options.record_size = 100;
+  options.pool_frames = 1000;
+  options.threads = 1;
+  options.scan_length = 100;
+  options.filename = "ycsb.db";
+  options.seed = 1;
+  options.io_scheduler = false;
+  options.checkpoint_ms = 0;
+  options.record_cache_kb = 0;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg(argv[i]);
+    const std::size_t equals = arg.find('=');
+    if (arg.compare(0, 2, "--") != 0 || equals == std::string::npos) {
+      return false;
+    }
+    const std::string name = arg.substr(2, equals - 2);
+    const std::string value = arg.substr(equals + 1);
+    const unsigned long long number = std::strtoull(value.c_str(), NULL, 10);
+    if (name == "workload") {
+      options.workload = NULL;
+      for (std::size_t w = 0; w < sizeof(WORKLOADS) / sizeof(WORKLOADS[0]);
+           ++w) {
+        if (value.size() == 1 && value[0] == WORKLOADS[w].name) {
+          options.workload = &WORKLOADS[w];
+        }
+      }
+      if (options.workload == NULL) {
+        return false;
+      }
+    } else if (name == "distribution") {
+      options.distribution_set = true;
+      if (value == "uniform") {
+        options.distribution = KeyGenerator::UNIFORM;
+      } else if (value == "zipfian") {
+        options.distribution = KeyGenerator::ZIPFIAN;
+      } else if (value == "latest") {
+        options.distribution = KeyGenerator::LATEST;
+      } else {
+        return false;
+      }
+    } else if (name == "records") {
+      options.records = number;
+    } else if (name == "operations") {
+      options.operations = number;
+    } else if (name == "record-size") {
+      options.record_size = number;
+    } else if (name == "pool") {
+      options.pool_frames = number;
+    } else if (name == "threads") {
+      options.threads = number;
+    } else if (name == "scan-length") {
+      options.scan_length = number;
+    } else if (name == "file") {
+      options.filename = value;
+    } else if (name == "seed") {
+      options.seed = number;
+    } else if (name == "device") {
+      SimulatedDevice::Profile profile;
+      if (!SimulatedDevice::Profile::byName(value, profile)) {
+        return false;
+      }
+      options.device = value;
+    } else if (name == "io-scheduler") {
+      options.io_scheduler = number != 0;
+    } else if (name == "checkpoint-ms") {
+      options.checkpoint_ms = number;
+    } else if (name == "record-cache-kb") {
+      options.record_cache_kb = number;
+    } else {
+      return false;
+    }
+  }
+  if (!options.distribution_set) {
+    options.distribution = options.workload->default_distribution;
+  }
+  return options.records > 0 && options.record_size >= 16 &&
+      options.record_size <= Page::DATA_SIZE / 2 &&
+      options.pool_frames > 0 && options.threads > 0 &&
+      options.scan_length > 0;
+}
+
+}
+
+/**
+ * Loads a table and runs a YCSB core workload against it through the buffer
+ * manager, reporting throughput and latency percentiles per operation.
+ *
+ * Usage: ycsb_bench [options]; see printUsage().
+ *
+ * Built from the top directory together with every source file there except
+ * main.cpp, e.g. with "-I." so the includes below resolve.
+ */
+int main(int argc, char* argv[]) {
+  Options options;
+  if (!parseOptions(argc, argv, options)) {
+    printUsage(argv[0]);
+    return 2;
+  }
+  const char* const distribution_names[] = {"uniform", "zipfian", "latest"};
+  std::cout << "workload " << options.workload->name
+            << "  distribution " << distribution_names[options.distribution]
+            << "  records " << options.records
+            << "  record size " << options.record_size
+            << "  pool " << options.pool_frames
+            << "  threads " << options.threads << "\n";
+
+  if (File::exists(options.filename)) {
+    File::remove(options.filename);
+  }
+  try {
+    Table table(options);
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    for (std::uint64_t key = 0; key < options.records; ++key) {
+      table.insert();
+    }
+    table.flush();
+    double seconds = secondsSince(start);
+    std::cout << std::fixed << std::setprecision(2) << "load: "
+              << options.records << " records, " << table.numPages()
+              << " pages in " << seconds << " s ("
+              << std::setprecision(0) << options.records / seconds
+              << " records/s)\n";
+
+    table.clearStats();
+    std::shared_ptr<SimulatedDevice> device;
+    if (!options.device.empty()) {
+      // Loading runs at full speed; only the workload sees the device.
+      SimulatedDevice::Profile profile;
+      SimulatedDevice::Profile::byName(options.device, profile);
+      device.reset(new SimulatedDevice(profile, options.seed));
+      table.attachDevice(device);
+    }
+    std::vector<ThreadResult> results(options.threads);
+    std::vector<std::thread> threads;
+    start = std::chrono::steady_clock::now();
+    for (std::uint32_t t = 0; t < options.threads; ++t) {
+      const std::uint64_t operations = options.operations / options.threads +
+          (t < options.operations % options.threads ? 1 : 0);
+      threads.push_back(std::thread(runThread, &table, std::cref(options),
+                                    operations, options.seed + t,
+                                    &results[t]));
+    }
+    std::atomic<bool> stop_checkpoints(false);
+    std::uint32_t checkpoints = 0;
+    std::string checkpoint_error;
+    std::thread checkpointer;
+    if (options.checkpoint_ms > 0) {
+      checkpointer = std::thread(runCheckpoints, &table, options.checkpoint_ms,
+                                 &stop_checkpoints, &checkpoints,
+                                 &checkpoint_error);
+    }
+    for (std::size_t t = 0; t < threads.size(); ++t) {
+      threads[t].join();
+    }
+    seconds = secondsSince(start);
+    if (checkpointer.joinable()) {
+      stop_checkpoints = true;
+      checkpointer.join();
+      if (!checkpoint_error.empty()) {
+        std::cerr << "checkpoint: " << checkpoint_error << "\n";
+        return 1;
+      }
+    }
+
+    LatencyHistogram all;
+    LatencyHistogram per_operation[NUM_OPERATIONS];
+    for (std::size_t t = 0; t < results.size(); ++t) {
+      if (!results[t].error.empty()) {
+        std::cerr << "thread " << t << ": " << results[t].error << "\n";
+        return 1;
+      }
+      for (int operation = 0; operation < NUM_OPERATIONS; ++operation) {
+        per_operation[operation].merge(results[t].latencies[operation]);
+        all.merge(results[t].latencies[operation]);
+      }
+    }
+    std::cout << std::fixed << std::setprecision(2) << "run: " << all.count()
+              << " operations in " << seconds << " s (" << std::setprecision(0)
+              << all.count() / seconds << " ops/s)\n";
+    std::cout << std::left << std::setw(8) << "op" << std::right
+              << std::setw(10) << "count" << std::setw(10) << "mean us"
+              << std::setw(10) << "p50 us" << std::setw(10) << "p99 us"
+              << std::setw(10) << "p999 us" << std::setw(10) << "max us"
+              << "\n";
+    for (int operation = 0; operation < NUM_OPERATIONS; ++operation) {
+      if (per_operation[operation].count() > 0) {
+        printLatencies(OPERATION_NAMES[operation], per_operation[operation]);
+      }
+    }
+    printLatencies("ALL", all);
+
+    const BufStats& stats = table.stats();
+    std::cout << "buffer: " << stats.accesses << " accesses, "
+              << stats.diskreads << " reads, " << stats.diskwrites
+              << " writes, hit ratio " << std::setprecision(3)
+              << (stats.accesses == 0 ? 0.0
+                  : 1 - static_cast<double>(stats.diskreads) / stats.accesses)
+              << "\n";
+    if (options.checkpoint_ms > 0) {
+      std::cout << "checkpoints: " << checkpoints << "\n";
+    }
+    if (table.recordCache() != NULL) {
+      const RecordCache::Stats& cache_stats = table.recordCache()->stats();
+      std::cout << "record cache: " << cache_stats.lookups << " lookups, hit"
+                << " ratio " << std::setprecision(3) << cache_stats.hitRatio()
+                << ", " << cache_stats.records << " records from "
+                << cache_stats.pages << " pages in "
+                << cache_stats.bytes / 1024 << " KB, "
+                << cache_stats.memorySaved() / 1024
+                << " KB less than their pages\n";
+    }
+    if (table.scheduler() != NULL) {
+      const char* const class_names[IoScheduler::NUM_CLASSES] = {
+          "foreground", "prefetch", "writeback", "checkpoint"};
+      for (int c = 0; c < IoScheduler::NUM_CLASSES; ++c) {
+        const IoScheduler::ClassStats& class_stats = table.scheduler()->stats(
+            static_cast<IoScheduler::IoClass>(c));
+        if (class_stats.requests == 0) {
+          continue;
+        }
+        std::cout << "io " << class_names[c] << ": " << class_stats.requests
+                  << " requests, latency mean " << std::setprecision(1)
+                  << class_stats.latency.mean() / 1000 << " us, p99 "
+                  << class_stats.latency.percentile(0.99) / 1000.0
+                  << " us, " << class_stats.deadline_misses
+                  << " past deadline\n";
+      }
+    }
+    if (device) {
+      const SimulatedDevice::Stats& device_stats = device->stats();
+      std::cout << "device " << options.device << ": "
+                << device_stats.reads << " reads, " << device_stats.writes
+                << " writes, " << device_stats.seeks << " seeks, "
+                << device_stats.queued << " queued, latency mean "
+                << std::setprecision(1) << device_stats.latency.mean() / 1000
+                << " us, p99 "
+                << device_stats.latency.percentile(0.99) / 1000.0 << " us\n";
+    }
+  } catch (const BadgerDbException& e) {
+    std::cerr << e.message() << "\n";
+    return 1;
+  }
+  File::remove(options.filename);
+  return 0;
+}
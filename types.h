@@ -57,6 +57,18 @@ struct RecordId {
   bool operator!=(const RecordId& rhs) const {
     return (page_number != rhs.page_number) || (slot_number != rhs.slot_number);
   }
+
+  /**
+   * Returns true if this record ID orders before the given ID, comparing page
+   * numbers first and then slot numbers.
+   *
+   * @param rhs   Record ID to compare against.
+   * @return  Whether this ID orders before the other one.
+   */
+  bool operator<(const RecordId& rhs) const {
+    return page_number < rhs.page_number ||
+        (page_number == rhs.page_number && slot_number < rhs.slot_number);
+  }
 };
 
 }
@@ -0,0 +1,162 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "zone_map.h"
+
+#include <cstring>
+
+#include "page_iterator.h"
+
+namespace badgerdb {
+
+namespace {
+
+/**
+ * Page number of the settings page in the map file.
+ */
+const PageId SETTINGS_PAGE = 1;
+
+/**
+ * Page number of the first entry page in the map file.  Pages in the map file
+ * are never deleted, so entry page i is always page FIRST_LEAF_PAGE + i.
+ */
+const PageId FIRST_LEAF_PAGE = 2;
+
+/**
+ * Values of the first byte of an entry.
+ */
+const char NO_RECORDS = 0;
+const char HAS_RECORDS = 1;
+
+}
+
+ZoneMap::ZoneMap(const std::string& data_filename,
+                 const std::uint16_t key_offset,
+                 const std::uint16_t key_length)
+    : map_file_(File::create(mapFilename(data_filename))),
+      key_offset_(key_offset),
+      key_length_(key_length),
+      num_leaves_(0) {
+  Page settings = map_file_.allocatePage();
+  std::memcpy(&settings.data_[0], &key_offset_, sizeof(key_offset_));
+  std::memcpy(&settings.data_[sizeof(key_offset_)], &key_length_,
+              sizeof(key_length_));
+  map_file_.writePage(settings);
+}
+
+ZoneMap::ZoneMap(const std::string& data_filename)
+    : map_file_(File::open(mapFilename(data_filename))),
+      key_offset_(0),
+      key_length_(0),
+      num_leaves_(0) {
+  const Page& settings = map_file_.readPage(SETTINGS_PAGE);
+  std::memcpy(&key_offset_, &settings.data_[0], sizeof(key_offset_));
+  std::memcpy(&key_length_, &settings.data_[sizeof(key_offset_)],
+              sizeof(key_length_));
+  num_leaves_ = map_file_.readHeader().num_pages - FIRST_LEAF_PAGE;
+}
+
+std::string ZoneMap::keyOf(const std::string& record) const {
+  if (record.size() <= key_offset_) {
+    return std::string();
+  }
+  return record.substr(key_offset_, key_length_);
+}
+
+void ZoneMap::summarize(const PageId page_number, const Page& page) {
+  const std::size_t entry_size = entrySize();
+  std::string entry(entry_size, '\0');
+  entry[0] = NO_RECORDS;
+  std::string min_key;
+  std::string max_key;
+  // PageIterator only reads the page, but it takes a non-const pointer.
+  Page& records = const_cast<Page&>(page);
+  for (PageIterator iter = records.begin(); iter != records.end(); ++iter) {
+    const std::string& key = keyOf(*iter);
+    if (entry[0] == NO_RECORDS || key < min_key) {
+      min_key = key;
+    }
+    if (entry[0] == NO_RECORDS || key > max_key) {
+      max_key = key;
+    }
+    entry[0] = HAS_RECORDS;
+  }
+  if (entry[0] == HAS_RECORDS) {
+    entry[1] = static_cast<char>(min_key.size());
+    entry[2] = static_cast<char>(max_key.size());
+    entry.replace(3, min_key.size(), min_key);
+    entry.replace(3 + key_length_, max_key.size(), max_key);
+  }
+
+  const std::uint32_t leaf = page_number / entriesPerLeaf();
+  if (leaf >= num_leaves_ && entry[0] == NO_RECORDS) {
+    // Entry pages that don't exist yet read as all empty.
+    return;
+  }
+  Page& leaf_page = getLeaf(leaf);
+  char* const slot =
+      &leaf_page.data_[(page_number % entriesPerLeaf()) * entry_size];
+  if (std::memcmp(slot, entry.data(), entry_size) == 0) {
+    return;
+  }
+  std::memcpy(slot, entry.data(), entry_size);
+  map_file_.writePage(leaf_page);
+}
+
+std::vector<bool> ZoneMap::candidatePages(const std::string& low_key,
+                                          const std::string& high_key) {
+  // Keys are compared as stored, so compare the bounds the same way.
+  const std::string& low = low_key.substr(0, key_length_);
+  const std::string& high = high_key.substr(0, key_length_);
+  const std::size_t entry_size = entrySize();
+  const std::size_t entries_per_leaf = entriesPerLeaf();
+  std::vector<bool> pages(num_leaves_ * entries_per_leaf, false);
+  for (std::uint32_t leaf = 0; leaf < num_leaves_; ++leaf) {
+    const Page& leaf_page = getLeaf(leaf);
+    for (std::size_t i = 0; i < entries_per_leaf; ++i) {
+      const char* const slot = &leaf_page.data_[i * entry_size];
+      if (slot[0] != HAS_RECORDS) {
+        continue;
+      }
+      const std::string min_key(slot + 3,
+                                static_cast<std::uint8_t>(slot[1]));
+      const std::string max_key(slot + 3 + key_length_,
+                                static_cast<std::uint8_t>(slot[2]));
+      if (max_key >= low && min_key <= high) {
+        pages[leaf * entries_per_leaf + i] = true;
+      }
+    }
+  }
+  return pages;
+}
+
+void ZoneMap::afterPageWrite(const PageId page_number, const Page* page) {
+  if (page != NULL) {
+    summarize(page_number, *page);
+  }
+}
+
+Page& ZoneMap::getLeaf(const std::uint32_t leaf) {
+  std::map<std::uint32_t, Page>::iterator iter = leaves_.find(leaf);
+  if (iter != leaves_.end()) {
+    return iter->second;
+  }
+  // Entry pages are allocated in order, so allocate any missing ones before
+  // this.
+  while (num_leaves_ <= leaf) {
+    leaves_[num_leaves_] = map_file_.allocatePage();
+    ++num_leaves_;
+  }
+  iter = leaves_.find(leaf);
+  if (iter == leaves_.end()) {
+    iter = leaves_.insert(
+        std::make_pair(leaf, map_file_.readPage(FIRST_LEAF_PAGE + leaf))).first;
+  }
+  return iter->second;
+}
+
+}
@@ -0,0 +1,174 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "file.h"
+#include "file_listener.h"
+#include "page.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Persistent per-page summary of the smallest and largest record key.
+ *
+ * The key of a record is the byte range [key_offset, key_offset + key_length)
+ * of the record, cut short if the record is shorter.  Keys are compared byte
+ * by byte as unsigned values, so fixed-width big-endian integers and
+ * timestamps such as "2014-03-01 12:00:00" order correctly.
+ *
+ * For every page of a data file the map keeps whether the page holds any
+ * records and, if so, its smallest and largest key.  The entries are stored in
+ * the pages of a companion file (named after the data file with a ".zm"
+ * suffix): page 1 of the companion records the key range and pages 2 onwards
+ * hold the entries.  A range scan reads the entries instead of the data pages
+ * and visits only pages whose keys overlap the range; for data loaded in key
+ * order, such as logs keyed by time, that is a small fraction of the file.
+ *
+ * Entries are recomputed from the page every time a page is written to the
+ * data file, so they are exact for pages as they are on disk.  Like the file
+ * itself they don't reflect changes still in a buffer pool until those are
+ * flushed.
+ *
+ * File owns the zone map of a file and attaches it as a listener; see
+ * File::enableZoneMap().
+ *
+ * @warning This class is not threadsafe.
+ */
+class ZoneMap : public FileListener {
+ public:
+  /**
+   * Longest key that can be summarized.
+   */
+  static const std::uint16_t MAX_KEY_LENGTH = 64;
+
+  /**
+   * Returns the name of the companion file holding the map for a data file.
+   *
+   * @param data_filename   Name of the data file.
+   * @return  Name of the zone map file.
+   */
+  static std::string mapFilename(const std::string& data_filename) {
+    return data_filename + ".zm";
+  }
+
+  /**
+   * Creates an empty zone map for a data file.
+   *
+   * @param data_filename   Name of the data file the map describes.
+   * @param key_offset      Offset of the key within each record.
+   * @param key_length      Length of the key; 1 to MAX_KEY_LENGTH bytes.
+   * @throws  FileExistsException   If the map exists.
+   */
+  ZoneMap(const std::string& data_filename, const std::uint16_t key_offset,
+          const std::uint16_t key_length);
+
+  /**
+   * Opens the existing zone map of a data file.
+   *
+   * @param data_filename   Name of the data file the map describes.
+   * @throws  FileNotFoundException   If the map doesn't exist.
+   */
+  explicit ZoneMap(const std::string& data_filename);
+
+  /**
+   * Returns the offset of the key within each record.
+   */
+  std::uint16_t keyOffset() const { return key_offset_; }
+
+  /**
+   * Returns the length of the key.
+   */
+  std::uint16_t keyLength() const { return key_length_; }
+
+  /**
+   * Returns the key of a record.
+   *
+   * @param record  Record data.
+   * @return  The key bytes of the record, possibly shorter than keyLength().
+   */
+  std::string keyOf(const std::string& record) const;
+
+  /**
+   * Recomputes the entry of a page from its records.
+   *
+   * @param page_number   Number of the data page.
+   * @param page          Contents of the page.
+   */
+  void summarize(const PageId page_number, const Page& page);
+
+  /**
+   * Returns, for every page number, whether the page holds a record whose key
+   * is in [low_key, high_key].  A true entry means the page may hold one; a
+   * false entry means it certainly doesn't.
+   *
+   * @param low_key   Smallest key wanted.
+   * @param high_key  Largest key wanted.
+   * @return  Candidate pages, indexed by page number.
+   */
+  std::vector<bool> candidatePages(const std::string& low_key,
+                                   const std::string& high_key);
+
+  virtual void beforePageChange(const PageId /* page_number */) {}
+
+  virtual void afterPageWrite(const PageId page_number, const Page* page);
+
+ private:
+  /**
+   * Size of an entry: a record-count flag, the lengths of the smallest and
+   * largest key, then both keys padded to key_length_ bytes.
+   */
+  std::size_t entrySize() const { return 3 + 2 * key_length_; }
+
+  /**
+   * Number of data pages covered by one entry page.
+   */
+  std::size_t entriesPerLeaf() const { return Page::DATA_SIZE / entrySize(); }
+
+  /**
+   * Returns the entry page with the given index, reading it from the map file
+   * (or allocating it and any before it) the first time it is needed.
+   *
+   * @param leaf  Index of the entry page.
+   * @return  The entry page.
+   */
+  Page& getLeaf(const std::uint32_t leaf);
+
+  /**
+   * Companion file holding the settings page and the entry pages.
+   */
+  File map_file_;
+
+  /**
+   * Offset of the key within each record.
+   */
+  std::uint16_t key_offset_;
+
+  /**
+   * Length of the key.
+   */
+  std::uint16_t key_length_;
+
+  /**
+   * Number of entry pages allocated in the map file.
+   */
+  std::uint32_t num_leaves_;
+
+  /**
+   * Entry pages that have been read so far.
+   */
+  std::map<std::uint32_t, Page> leaves_;
+};
+
+}